@@ -5,12 +5,23 @@
  */
 
 #include <stdio.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <strings.h>
+#include <ctype.h>
+#include <math.h>
+#include <stdatomic.h>
 #include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <pthread.h>
+#include "../../../src/perf/eghact-perf.h"
 
 #ifdef __EMSCRIPTEN__
     #include <emscripten.h>
@@ -21,7 +32,22 @@
 #define PAGE_SIZE 4096
 #define MAX_KEY_SIZE 256
 #define MAX_VALUE_SIZE 65536
-#define CACHE_SIZE 1000
+#define CACHE_BYTES (64 * 1024 * 1024)  // Default read cache capacity
+#define CACHE_SHARDS 64                   // Power of two
+#define CACHE_ADMIT_BITS 4096             // Per shard, power of two
+#define READER_STRIPES 64
+#define INDEX_TERM_MAX 64                 // Encoded field value at the front of an index key
+#define BTREE_KEY_MAX (INDEX_TERM_MAX + MAX_KEY_SIZE)
+#define SQL_CACHE_PLANS 256               // Parsed statements kept, least recently used first out
+#define SQL_CACHE_BUCKETS 512             // Power of two
+#define SQL_MAX_TOKENS 1024
+
+EGHACT_PERF_COUNTER(perf_db_inserts, "db.insert");
+EGHACT_PERF_COUNTER(perf_db_bulk_keys, "db.bulk.keys");
+EGHACT_PERF_COUNTER(perf_db_gets, "db.get");
+EGHACT_PERF_COUNTER(perf_db_commits, "db.commit");
+EGHACT_PERF_COUNTER(perf_db_index_finds, "db.find.index");
+EGHACT_PERF_COUNTER(perf_db_scan_finds, "db.find.scan");
 
 // Data types
 typedef enum {
@@ -48,26 +74,195 @@ typedef struct {
     size_t size;
 } Value;
 
-// B-tree node for indexing
+// B+tree node: one PAGE_SIZE slotted page (see "B+tree storage" below)
+typedef struct {
+    uint32_t head;    // First 4 suffix bytes, big-endian and zero padded
+    uint16_t offset;  // Suffix bytes, from the start of the node
+    uint16_t length;
+    union {
+        Value* value;              // Leaf
+        struct BTreeNode* child;   // Inner: subtree holding keys >= this key
+    } ptr;
+} BTreeSlot;
+
 typedef struct BTreeNode {
     bool is_leaf;
-    int num_keys;
-    char** keys;
-    Value** values;
-    struct BTreeNode** children;
-    struct BTreeNode* parent;
+    bool dirty;            // Changed since the last checkpoint; so is every ancestor
+    uint16_t num_keys;
+    uint16_t prefix_len;   // Prefix shared by every key, stored at the end of the page
+    uint16_t heap_start;   // Suffix bytes live in [heap_start, PAGE_SIZE - prefix_len)
+    uint16_t garbage;      // Suffix bytes orphaned by removals
+    bool fresh;            // Not published yet, so the writer may change it in place
+    uint32_t page_no;      // Home in the page file; 0 = never written
+    uint32_t run_page;     // Leaf: pages holding its encoded values
+    uint32_t run_pages;
+    struct BTreeNode* first_child;  // Inner: subtree left of the first key
+    BTreeSlot slots[];
 } BTreeNode;
 
+// Secondary indexes on one collection; replaced whole when one is added
+typedef struct {
+    size_t count;
+    struct Collection* items[];
+} IndexList;
+
 // Collection (table) structure
 typedef struct Collection {
     char* name;
     BTreeNode* root;
     size_t count;
-    pthread_rwlock_t lock;
+    struct EghactDB* db;
+    uint32_t id;  // Index in db->collections; names the collection in the log
+    _Atomic uint64_t writes;  // Publishes that changed the tree; cache fills check it
+    IndexList* indexes;       // NULL until the first index is declared
+    struct Collection* base;  // Set if this is an index: the collection it covers
+    const char* field;        // Index: dotted JSON path, inside name
 } Collection;
 
-// Database structure
+// Read cache entry; the value is borrowed from the collection's tree
+typedef struct {
+    const Collection* collection;  // NULL = free slot
+    char* key;
+    uint16_t key_len;
+    _Atomic bool referenced;       // CLOCK bit, set by readers
+    uint32_t hash;
+    int32_t next;                  // Bucket chain, or free list
+    Value* value;
+    size_t charge;                 // Bytes counted against the shard's capacity
+} CacheEntry;
+
+// One shard of the read cache, on its own cache lines
+typedef struct {
+    _Alignas(64) pthread_rwlock_t lock;
+    _Atomic uint64_t hits;
+    _Atomic uint64_t misses;
+    uint64_t evictions;
+    CacheEntry* entries;
+    uint32_t entry_capacity;
+    uint32_t entry_count;
+    int32_t free_list;
+    uint32_t hand;                 // CLOCK hand
+    int32_t* buckets;
+    uint32_t bucket_count;         // Power of two
+    size_t bytes;
+    size_t capacity;
+    _Atomic uint64_t admit[CACHE_ADMIT_BITS / 64];  // Keys missed once recently
+    _Atomic uint32_t admit_count;
+} CacheShard;
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t entries;
+    size_t bytes;
+    size_t capacity;
+} EghactCacheStats;
+
+typedef struct {
+    uint64_t commits;        // Frames appended: transactions and single writes
+    uint64_t syncs;          // fdatasync calls; fewer than commits when grouped
+    uint64_t log_bytes;      // Durable log size since the last checkpoint
+    uint64_t pending_bytes;  // Appended but not yet durable
+} EghactWalStats;
+
+// Write-ahead log buffer (see "Write-ahead log" below)
+typedef struct {
+    uint8_t* data;
+    size_t length;
+    size_t capacity;
+} WalBuffer;
+
+typedef struct {
+    int fd;
+    pthread_mutex_t lock;
+    pthread_cond_t flushed;  // Committers waiting for a sync
+    pthread_cond_t wake;     // Background writer
+    WalBuffer pending;       // Appended, not yet written
+    WalBuffer writing;       // Owned by the committer leading a sync
+    uint64_t appended_lsn;   // Log offsets since open
+    uint64_t durable_lsn;
+    uint64_t file_size;
+    uint64_t commits;
+    uint64_t syncs;
+    bool flushing;
+    bool failed;             // A write or sync failed; further writes are refused
+    bool stopping;
+    bool has_thread;
+    pthread_t thread;
+} Wal;
+
+// Run of free pages in the page file
+typedef struct {
+    uint32_t start;
+    uint32_t pages;
+} PageExtent;
+
+// Page file (see "Page file" below)
+typedef struct {
+    int fd;
+    uint8_t* map;            // Private view of the file as it was at open
+    size_t map_length;
+    uint64_t epoch;          // Bumped by each checkpoint; the log names the one it follows
+    uint32_t page_count;
+    uint32_t catalog_page;   // Run holding collection roots and free extents
+    uint32_t catalog_pages;
+    PageExtent* free;        // Reusable by the next checkpoint
+    size_t free_count;
+    size_t free_capacity;
+    PageExtent* released;    // Dropped since the last checkpoint, still in its durable state
+    size_t released_count;
+    size_t released_capacity;
+    pthread_mutex_t lock;    // Guards released; writers of any collection add to it
+} PageFile;
+
+// Nodes gathered by a checkpoint or a writer
+typedef struct {
+    BTreeNode** nodes;
+    size_t count;
+    size_t capacity;
+} NodeList;
+
+// Trees as of one publish (see "Versions" below)
+typedef struct {
+    size_t root_count;
+    BTreeNode* roots[];  // By collection id; ids past root_count are still empty
+} DbVersion;
+
+// Unlinked from the trees and freed once no reader can still hold it
+typedef struct {
+    void* object;
+    uint8_t kind;    // RETIRED_*
+    uint64_t epoch;  // Current when the publish that unlinked it was stored
+} Retired;
+
+// Pinned readers of one stripe of threads, on its own cache line
+typedef struct {
+    _Alignas(64) _Atomic uint64_t active[2];  // In even and odd epochs
+} ReaderStripe;
+
+// Writer's side of the versions; guarded by the log lock, which every writer holds
+typedef struct {
+    NodeList fresh;          // Created since the last publish
+    NodeList discarded;      // Fresh nodes dropped again before anyone saw them
+    Retired* retired;
+    size_t retired_count;
+    size_t retired_capacity;
+    size_t retired_stamped;  // Entries before this one carry their epoch
+    size_t since_reclaim;    // Entries stamped since the last reclaim
+} VersionWriter;
+
+// Parsed statements by normalized text (see "SQL" below)
 typedef struct {
+    pthread_mutex_t lock;
+    struct SqlPlan* buckets[SQL_CACHE_BUCKETS];
+    struct SqlPlan* newest;  // LRU list
+    struct SqlPlan* oldest;
+    size_t count;
+} SqlCache;
+
+// Database structure
+typedef struct EghactDB {
     char* path;
     Collection** collections;
     size_t collection_count;
@@ -75,33 +270,54 @@ typedef struct {
     pthread_mutex_t mutex;
     bool is_open;
     
-    // Cache
-    struct {
-        char** keys;
-        Value** values;
-        size_t* timestamps;
-        size_t size;
-        size_t capacity;
-        pthread_mutex_t lock;
-    } cache;
+    // Read cache, sharded by key hash
+    CacheShard* cache;
+    
+    // Durability: writers hold checkpoint_lock shared, checkpoints hold it exclusive
+    PageFile file;
+    Wal wal;
+    pthread_rwlock_t checkpoint_lock;
+    bool replaying;
+    
+    // Versions: readers pin an epoch and load version; writers publish a new one
+    DbVersion* version;
+    ReaderStripe* readers;
+    _Atomic uint64_t reader_epoch;
+    VersionWriter writer;
+    
+    SqlCache plans;
 } EghactDB;
 
+// Write buffered by a transaction until commit
+typedef struct {
+    uint8_t op;
+    Collection* collection;
+    char* key;
+    size_t key_len;
+    Value* value;
+} TxOp;
+
 // Transaction structure
 typedef struct {
     EghactDB* db;
     bool active;
-    Collection** modified_collections;
-    size_t modified_count;
+    DbVersion* snapshot;         // What the transaction's reads see
+    _Atomic uint64_t* pin;       // Keeps the snapshot from being reclaimed
+    TxOp* ops;
+    size_t op_count;
+    size_t op_capacity;
     pthread_mutex_t lock;
 } Transaction;
 
 // Query structure
-typedef struct {
+typedef struct Query {
     char* collection;
     char* field;
     char* op;  // =, !=, <, >, <=, >=, LIKE, IN
     Value* value;
-    struct Query* next;  // For compound queries
+    Value** values;  // IN: the list to match against
+    size_t value_count;
+    struct Query* next;  // For compound queries; every predicate must hold
 } Query;
 
 // Forward declarations
@@ -117,6 +333,45 @@ Value* eghactdb_get(Collection* collection, const char* key);
 bool eghactdb_update(Collection* collection, const char* key, Value* value);
 bool eghactdb_delete(Collection* collection, const char* key);
 
+// Transactions; writes are buffered and applied atomically and durably at commit.
+// Reads see the database as it was at begin, without the transaction's own writes.
+Transaction* eghactdb_begin_transaction(EghactDB* db);
+Value* eghactdb_tx_get(Transaction* tx, Collection* collection, const char* key);
+bool eghactdb_tx_insert(Transaction* tx, Collection* collection, const char* key, Value* value);
+bool eghactdb_tx_update(Transaction* tx, Collection* collection, const char* key, Value* value);
+bool eghactdb_tx_delete(Transaction* tx, Collection* collection, const char* key);
+bool eghactdb_commit_transaction(Transaction* tx);
+bool eghactdb_rollback_transaction(Transaction* tx);
+
+// Durability
+bool eghactdb_checkpoint(EghactDB* db);
+void eghactdb_get_wal_stats(EghactDB* db, EghactWalStats* stats);
+
+// Read cache
+void eghactdb_set_cache_capacity(EghactDB* db, size_t bytes);
+void eghactdb_get_cache_stats(EghactDB* db, EghactCacheStats* stats);
+
+// Range scans; return false from the callback to stop early
+typedef bool (*EghactScanFn)(const char* key, size_t key_len, Value* value, void* user_data);
+size_t eghactdb_scan(Collection* collection, const char* start, const char* end,
+                     EghactScanFn fn, void* user_data);
+size_t eghactdb_tx_scan(Transaction* tx, Collection* collection, const char* start, const char* end,
+                        EghactScanFn fn, void* user_data);
+
+// Secondary indexes on a JSON field of string documents, and filtered queries
+bool eghactdb_create_index(Collection* collection, const char* field);
+size_t eghactdb_find(Collection* collection, const Query* query, EghactScanFn fn, void* user_data);
+size_t eghactdb_tx_find(Transaction* tx, Collection* collection, const Query* query,
+                        EghactScanFn fn, void* user_data);
+
+// Bulk loading; replaces per-key logging with one checkpoint at the end
+bool eghactdb_bulk_insert(Collection* collection, const char** keys, Value** values, size_t n);
+typedef struct EghactBulkLoader EghactBulkLoader;
+EghactBulkLoader* eghactdb_bulk_begin(Collection* collection);
+bool eghactdb_bulk_add(EghactBulkLoader* loader, const char* key, Value* value);
+bool eghactdb_bulk_finish(EghactBulkLoader* loader);
+void eghactdb_bulk_abort(EghactBulkLoader* loader);
+
 // SQL-like interface
 typedef struct {
     Value** results;
@@ -127,6 +382,24 @@ typedef struct {
 ResultSet* eghactdb_query(EghactDB* db, const char* sql);
 void eghactdb_free_results(ResultSet* results);
 
+// Prepared statements. Parameters are the ?s in order from 1, borrowed until the
+// statement is reset or bound again. Rows are borrowed until the next step.
+typedef struct EghactStmt EghactStmt;
+typedef enum {
+    EGHACTDB_ROW,
+    EGHACTDB_DONE,
+    EGHACTDB_ERROR
+} EghactStepResult;
+EghactStmt* eghactdb_prepare(EghactDB* db, const char* sql);
+bool eghactdb_bind(EghactStmt* stmt, size_t index, const Value* value);
+bool eghactdb_bind_int(EghactStmt* stmt, size_t index, int64_t value);
+bool eghactdb_bind_text(EghactStmt* stmt, size_t index, const char* text);
+EghactStepResult eghactdb_step(EghactStmt* stmt);
+const char* eghactdb_row_key(const EghactStmt* stmt, size_t* len);
+Value* eghactdb_row_value(const EghactStmt* stmt);
+void eghactdb_reset(EghactStmt* stmt);
+void eghactdb_finalize(EghactStmt* stmt);
+
 // Value creation helpers
 Value* value_null();
 Value* value_bool(bool val);
@@ -138,6 +411,32 @@ Value* value_object();
 Value* value_array();
 void value_free(Value* val);
 
+static inline BTreeNode* node_load(const PageFile* file, BTreeNode** ref);
+static void btree_free(PageFile* file, BTreeNode* node);
+static Value* slot_value(const PageFile* file, BTreeSlot* slot);
+static void page_release(PageFile* file, uint32_t start, uint32_t pages);
+static BTreeNode* node_new(EghactDB* db, bool is_leaf);
+static BTreeNode* node_writable(EghactDB* db, BTreeNode** ref);
+static void node_drop(EghactDB* db, BTreeNode* node);
+static void value_retire(EghactDB* db, Value* value);
+static Value* value_clone(const Value* value);
+static bool versions_init(EghactDB* db);
+static void versions_publish(EghactDB* db);
+static void versions_destroy(EghactDB* db);
+static CacheShard* cache_create(size_t capacity);
+static void cache_destroy(CacheShard* shards);
+static void storage_open(EghactDB* db);
+static bool wal_log_create(EghactDB* db, const char* name, size_t len, uint32_t id);
+static void storage_close(EghactDB* db);
+static bool index_attach(EghactDB* db, Collection* index);
+static void index_build(EghactDB* db, Collection* index);
+static void indexes_apply(Collection* collection, const char* key, size_t len,
+                          const Value* before, const Value* after);
+static void sql_cache_destroy(SqlCache* cache);
+
+// Value of every index entry; the key says everything
+static Value g_index_entry = { .type = TYPE_NULL };
+
 // Implementation
 
 // Open database
@@ -150,22 +449,26 @@ EghactDB* eghactdb_open(const char* path) {
     db->is_open = true;
     
     pthread_mutex_init(&db->mutex, NULL);
+    pthread_mutex_init(&db->plans.lock, NULL);
     
     // Initialize cache
-    db->cache.capacity = CACHE_SIZE;
-    db->cache.size = 0;
-    db->cache.keys = (char**)calloc(CACHE_SIZE, sizeof(char*));
-    db->cache.values = (Value**)calloc(CACHE_SIZE, sizeof(Value*));
-    db->cache.timestamps = (size_t*)calloc(CACHE_SIZE, sizeof(size_t));
-    pthread_mutex_init(&db->cache.lock, NULL);
-    
-    // Load existing database if file exists
-    FILE* file = fopen(path, "rb");
-    if (file) {
-        // TODO: Load database from file
-        fclose(file);
+    db->cache = cache_create(CACHE_BYTES);
+    
+    if (!versions_init(db)) {
+        cache_destroy(db->cache);
+        pthread_mutex_destroy(&db->plans.lock);
+        pthread_mutex_destroy(&db->mutex);
+        free(db->path);
+        free(db);
+        return NULL;
     }
     
+    // Map the page file and replay the log written since its last checkpoint
+    storage_open(db);
+    
+    // Readers start from whatever open recovered
+    versions_publish(db);
+    
     return db;
 }
 
@@ -173,32 +476,29 @@ EghactDB* eghactdb_open(const char* path) {
 void eghactdb_close(EghactDB* db) {
     if (!db || !db->is_open) return;
     
-    // Save to disk
-    FILE* file = fopen(db->path, "wb");
-    if (file) {
-        // TODO: Save database to file
-        fclose(file);
-    }
+    // Checkpoint and stop the background writer
+    storage_close(db);
+    
+    // The cache borrows values from the trees, so it goes first
+    cache_destroy(db->cache);
     
-    // Free collections
+    // No reader is left, so everything retired goes at once
+    versions_destroy(db);
+    
+    // Free collections; pages still in the mapping go with it. Readers loaded the root
+    // through the version, so it may hold decoded values while col->root is on disk.
     for (size_t i = 0; i < db->collection_count; i++) {
         Collection* col = db->collections[i];
         free(col->name);
-        // TODO: Free B-tree
-        pthread_rwlock_destroy(&col->lock);
+        free(col->indexes);
+        btree_free(&db->file, node_load(&db->file, &col->root));
         free(col);
     }
     free(db->collections);
+    if (db->file.map) munmap(db->file.map, db->file.map_length);
     
-    // Free cache
-    for (size_t i = 0; i < db->cache.size; i++) {
-        free(db->cache.keys[i]);
-        value_free(db->cache.values[i]);
-    }
-    free(db->cache.keys);
-    free(db->cache.values);
-    free(db->cache.timestamps);
-    pthread_mutex_destroy(&db->cache.lock);
+    // Statements must be finalized by now
+    sql_cache_destroy(&db->plans);
     
     free(db->path);
     pthread_mutex_destroy(&db->mutex);
@@ -206,44 +506,68 @@ void eghactdb_close(EghactDB* db) {
     free(db);
 }
 
-// Create collection
-Collection* eghactdb_create_collection(EghactDB* db, const char* name) {
-    if (!db || !name) return NULL;
+// Index collections are named INDEX_NAME_MARK, the covered collection's id, ':' and
+// the field. Users can't create or open names starting with the mark.
+#define INDEX_NAME_MARK '\x01'
+
+// Creates a collection unless one of that name exists. An index is attached to the
+// collection it covers and, with build set, filled from it before any other write.
+static Collection* collection_create(EghactDB* db, const char* name, bool build) {
+    size_t name_len = strlen(name);
+    if (name_len > MAX_KEY_SIZE) return NULL;
     
+    pthread_rwlock_rdlock(&db->checkpoint_lock);
     pthread_mutex_lock(&db->mutex);
     
     // Check if collection already exists
     for (size_t i = 0; i < db->collection_count; i++) {
         if (strcmp(db->collections[i]->name, name) == 0) {
             pthread_mutex_unlock(&db->mutex);
+            pthread_rwlock_unlock(&db->checkpoint_lock);
             return db->collections[i];
         }
     }
     
-    // Grow collections array if needed
-    if (db->collection_count >= db->collection_capacity) {
-        size_t new_capacity = db->collection_capacity == 0 ? 4 : db->collection_capacity * 2;
-        db->collections = (Collection**)realloc(db->collections, new_capacity * sizeof(Collection*));
-        db->collection_capacity = new_capacity;
+    // Writers publish from the array, and they all hold the log lock. Collection ids
+    // are positions in the log's creation order.
+    pthread_mutex_lock(&db->wal.lock);
+    Collection* col = NULL;
+    if (db->replaying || wal_log_create(db, name, name_len, (uint32_t)db->collection_count)) {
+        col = (Collection*)calloc(1, sizeof(Collection));
+        col->name = strdup(name);
+        col->root = NULL;
+        col->count = 0;
+        col->db = db;
+        col->id = (uint32_t)db->collection_count;
+        
+        if (db->collection_count >= db->collection_capacity) {
+            size_t new_capacity = db->collection_capacity == 0 ? 4 : db->collection_capacity * 2;
+            db->collections = (Collection**)realloc(db->collections, new_capacity * sizeof(Collection*));
+            db->collection_capacity = new_capacity;
+        }
+        db->collections[db->collection_count++] = col;
     }
-    
-    // Create new collection
-    Collection* col = (Collection*)calloc(1, sizeof(Collection));
-    col->name = strdup(name);
-    col->root = NULL;
-    col->count = 0;
-    pthread_rwlock_init(&col->lock, NULL);
-    
-    db->collections[db->collection_count++] = col;
+    if (col && name[0] == INDEX_NAME_MARK && index_attach(db, col) && build) {
+        index_build(db, col);
+        if (!db->replaying) versions_publish(db);
+    }
+    pthread_mutex_unlock(&db->wal.lock);
     
     pthread_mutex_unlock(&db->mutex);
+    pthread_rwlock_unlock(&db->checkpoint_lock);
     
     return col;
 }
 
+// Create collection
+Collection* eghactdb_create_collection(EghactDB* db, const char* name) {
+    if (!db || !name || name[0] == INDEX_NAME_MARK) return NULL;
+    return collection_create(db, name, false);
+}
+
 // Get collection
 Collection* eghactdb_get_collection(EghactDB* db, const char* name) {
-    if (!db || !name) return NULL;
+    if (!db || !name || name[0] == INDEX_NAME_MARK) return NULL;
     
     pthread_mutex_lock(&db->mutex);
     
@@ -258,199 +582,4872 @@ Collection* eghactdb_get_collection(EghactDB* db, const char* name) {
     return NULL;
 }
 
-// Insert into collection
-bool eghactdb_insert(Collection* collection, const char* key, Value* value) {
-    if (!collection || !key || !value) return false;
-    
-    pthread_rwlock_wrlock(&collection->lock);
-    
-    // TODO: Insert into B-tree
-    // For now, just increment count
-    collection->count++;
-    
-    pthread_rwlock_unlock(&collection->lock);
-    
-    return true;
+// B+tree storage
+//
+// Every node is one PAGE_SIZE slotted page. The slot array grows up from the header.
+// Key bytes grow down from the end of the page. The prefix shared by all keys in a
+// node is stored once, at the very end, and slots only hold the rest of each key.
+// Each slot also caches the first four bytes of its suffix as an integer, so most
+// comparisons in a binary search never leave the slot array. Range scans walk a path
+// stack from leaf to leaf, so no node points at its siblings. Writers copy a node before
+// changing it once readers can see it (see "Versions" below).
+//
+// Nodes loaded from the page file live in its private mapping and fault in when first
+// touched. References in their slots start out as page numbers or value offsets tagged
+// with the low bit, and are swapped for pointers the first time they are followed.
+
+#define BTREE_MAX_DEPTH 32
+#define BTREE_HEADER_SIZE (offsetof(BTreeNode, slots))
+#define BTREE_MAX_SLOTS ((PAGE_SIZE - BTREE_HEADER_SIZE) / sizeof(BTreeSlot))
+
+// Key being moved during a rebuild: node prefix bytes followed by the slot's suffix
+typedef struct {
+    const uint8_t* a;
+    size_t a_len;
+    const uint8_t* b;
+    size_t b_len;
+    void* ptr;
+} BTreeEntry;
+
+// Node visited on the way down, and the child taken (-1 = first_child)
+typedef struct {
+    BTreeNode* node;
+    int index;
+} BTreePathStep;
+
+typedef struct {
+    BTreePathStep steps[BTREE_MAX_DEPTH];
+    int depth;  // steps[depth].node is the leaf
+} BTreePath;
+
+static inline uint8_t* node_bytes(const BTreeNode* node) {
+    return (uint8_t*)node;
 }
 
-// Get from collection
-Value* eghactdb_get(Collection* collection, const char* key) {
-    if (!collection || !key) return NULL;
-    
-    pthread_rwlock_rdlock(&collection->lock);
-    
-    // TODO: Search B-tree
-    Value* result = NULL;
-    
-    pthread_rwlock_unlock(&collection->lock);
-    
-    return result;
+static inline const uint8_t* node_prefix(const BTreeNode* node) {
+    return node_bytes(node) + PAGE_SIZE - node->prefix_len;
 }
 
-// Value creation
-Value* value_null() {
-    Value* val = (Value*)calloc(1, sizeof(Value));
-    val->type = TYPE_NULL;
-    return val;
+static inline size_t node_free_space(const BTreeNode* node) {
+    return node->heap_start - BTREE_HEADER_SIZE - node->num_keys * sizeof(BTreeSlot);
 }
 
-Value* value_bool(bool b) {
-    Value* val = (Value*)calloc(1, sizeof(Value));
-    val->type = TYPE_BOOL;
-    val->data.bool_val = b;
-    return val;
+static inline uint32_t key_head(const uint8_t* key, size_t len) {
+    uint32_t head = 0;
+    for (size_t i = 0; i < 4; i++) {
+        head = (head << 8) | (i < len ? key[i] : 0);
+    }
+    return head;
 }
 
-Value* value_int(int64_t i) {
-    Value* val = (Value*)calloc(1, sizeof(Value));
-    val->type = TYPE_INT;
-    val->data.int_val = i;
-    return val;
+static void node_init(BTreeNode* node, bool is_leaf) {
+    memset(node, 0, BTREE_HEADER_SIZE);
+    node->is_leaf = is_leaf;
+    node->heap_start = PAGE_SIZE;
 }
 
-Value* value_float(double f) {
-    Value* val = (Value*)calloc(1, sizeof(Value));
-    val->type = TYPE_FLOAT;
-    val->data.float_val = f;
-    return val;
+static BTreeNode* node_alloc(bool is_leaf) {
+    void* memory = NULL;
+    if (posix_memalign(&memory, PAGE_SIZE, PAGE_SIZE) != 0) return NULL;
+    node_init((BTreeNode*)memory, is_leaf);
+    ((BTreeNode*)memory)->dirty = true;
+    return (BTreeNode*)memory;
 }
 
-Value* value_string(const char* s) {
-    Value* val = (Value*)calloc(1, sizeof(Value));
-    val->type = TYPE_STRING;
-    val->data.string_val = strdup(s);
-    val->size = strlen(s);
-    return val;
+// Carries a node's place in the page file across a rebuild
+static inline void node_copy_storage(BTreeNode* to, const BTreeNode* from) {
+    to->dirty = from->dirty;
+    to->fresh = from->fresh;
+    to->page_no = from->page_no;
+    to->run_page = from->run_page;
+    to->run_pages = from->run_pages;
 }
 
-Value* value_blob(const void* data, size_t size) {
-    Value* val = (Value*)calloc(1, sizeof(Value));
-    val->type = TYPE_BLOB;
-    val->data.blob_val = malloc(size);
-    memcpy(val->data.blob_val, data, size);
-    val->size = size;
-    return val;
+// References stored in pages: a pointer once loaded, otherwise (location << 1) | 1,
+// where location is a page number for a child and a file offset for a value
+static inline bool ref_on_disk(const void* ref) {
+    return ((uintptr_t)ref & 1) != 0;
 }
 
-void value_free(Value* val) {
-    if (!val) return;
-    
-    switch (val->type) {
-        case TYPE_STRING:
-            free(val->data.string_val);
-            break;
-        case TYPE_BLOB:
-            free(val->data.blob_val);
-            break;
-        default:
-            break;
+static inline void* disk_ref(uint64_t location) {
+    return (void*)(uintptr_t)((location << 1) | 1);
+}
+
+static inline uint64_t ref_location(const void* ref) {
+    return (uintptr_t)ref >> 1;
+}
+
+static inline bool page_mapped(const PageFile* file, const void* p) {
+    return file->map && (const uint8_t*)p >= file->map && (const uint8_t*)p < file->map + file->map_length;
+}
+
+// Follows a child reference, swapping a page number for its address in the mapping.
+// Readers can race to do it, but they all store the same pointer.
+static inline BTreeNode* node_load(const PageFile* file, BTreeNode** ref) {
+    BTreeNode* node = __atomic_load_n(ref, __ATOMIC_ACQUIRE);
+    if (ref_on_disk(node)) {
+        node = (BTreeNode*)(file->map + ref_location(node) * PAGE_SIZE);
+        __atomic_store_n(ref, node, __ATOMIC_RELEASE);
     }
-    
-    free(val);
+    return node;
 }
 
-// SQL parser (simplified)
-ResultSet* eghactdb_query(EghactDB* db, const char* sql) {
-    if (!db || !sql) return NULL;
-    
-    ResultSet* results = (ResultSet*)calloc(1, sizeof(ResultSet));
-    results->results = NULL;
-    results->count = 0;
-    results->capacity = 0;
-    
-    // TODO: Parse SQL and execute query
-    // Support basic SELECT, INSERT, UPDATE, DELETE
-    
-    return results;
+// Drops a node from its tree; its pages return once a checkpoint forgets them
+static void node_release(EghactDB* db, BTreeNode* node) {
+    if (node->page_no) page_release(&db->file, node->page_no, 1);
+    if (node->run_pages) page_release(&db->file, node->run_page, node->run_pages);
+    node_drop(db, node);
 }
 
-void eghactdb_free_results(ResultSet* results) {
-    if (!results) return;
-    
-    for (size_t i = 0; i < results->count; i++) {
-        value_free(results->results[i]);
+static inline void value_release(Value* value) {
+    if (!ref_on_disk(value) && value != &g_index_entry) value_free(value);
+}
+
+// Compares a slot's suffix with a key suffix whose head is already computed
+static inline int slot_compare(const BTreeNode* node, const BTreeSlot* slot,
+                               const uint8_t* key, size_t len, uint32_t head) {
+    if (slot->head != head) return slot->head < head ? -1 : 1;
+
+    // Keys hold no NUL bytes, so equal heads mean the first min(len, 4) bytes match
+    size_t n = slot->length < len ? slot->length : len;
+    if (n > 4) {
+        int cmp = memcmp(node_bytes(node) + slot->offset + 4, key + 4, n - 4);
+        if (cmp != 0) return cmp;
     }
-    free(results->results);
-    free(results);
+    return slot->length < len ? -1 : (slot->length > len ? 1 : 0);
 }
 
-// Transaction support
-Transaction* eghactdb_begin_transaction(EghactDB* db) {
-    Transaction* tx = (Transaction*)calloc(1, sizeof(Transaction));
-    tx->db = db;
-    tx->active = true;
-    tx->modified_collections = NULL;
-    tx->modified_count = 0;
-    pthread_mutex_init(&tx->lock, NULL);
-    return tx;
+// Index of the first slot whose key is >= key
+static uint16_t node_lower_bound(const BTreeNode* node, const uint8_t* key, size_t len, bool* found) {
+    *found = false;
+
+    size_t prefix_len = node->prefix_len;
+    if (prefix_len > 0) {
+        int cmp = memcmp(key, node_prefix(node), len < prefix_len ? len : prefix_len);
+        if (cmp < 0 || (cmp == 0 && len < prefix_len)) return 0;
+        if (cmp > 0) return node->num_keys;
+        key += prefix_len;
+        len -= prefix_len;
+    }
+
+    uint32_t head = key_head(key, len);
+    uint16_t lo = 0, hi = node->num_keys;
+    while (lo < hi) {
+        uint16_t mid = (uint16_t)((lo + hi) / 2);
+        if (slot_compare(node, &node->slots[mid], key, len, head) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    *found = lo < node->num_keys && slot_compare(node, &node->slots[lo], key, len, head) == 0;
+    return lo;
 }
 
-bool eghactdb_commit_transaction(Transaction* tx) {
-    if (!tx || !tx->active) return false;
-    
-    pthread_mutex_lock(&tx->lock);
-    
-    // TODO: Commit changes
-    tx->active = false;
-    
-    pthread_mutex_unlock(&tx->lock);
-    pthread_mutex_destroy(&tx->lock);
-    free(tx->modified_collections);
-    free(tx);
-    
+// Child to descend into, as an index into slots (-1 = first_child)
+static inline int node_child_index(const BTreeNode* node, const uint8_t* key, size_t len) {
+    bool found;
+    uint16_t pos = node_lower_bound(node, key, len, &found);
+    return found ? pos : (int)pos - 1;
+}
+
+static inline BTreeNode* node_child(const PageFile* file, BTreeNode* node, int index) {
+    return node_load(file, index < 0 ? &node->first_child : &node->slots[index].ptr.child);
+}
+
+// Copies the full key of a slot into buf (at least BTREE_KEY_MAX bytes)
+static size_t node_key(const BTreeNode* node, uint16_t index, uint8_t* buf) {
+    const BTreeSlot* slot = &node->slots[index];
+    memcpy(buf, node_prefix(node), node->prefix_len);
+    memcpy(buf + node->prefix_len, node_bytes(node) + slot->offset, slot->length);
+    return node->prefix_len + slot->length;
+}
+
+static BTreeNode* btree_find_leaf(const PageFile* file, BTreeNode* root, const uint8_t* key, size_t len,
+                                  BTreePath* path) {
+    BTreeNode* node = root;
+    int depth = 0;
+    while (!node->is_leaf) {
+        int index = node_child_index(node, key, len);
+        if (path) {
+            path->steps[depth].node = node;
+            path->steps[depth].index = index;
+        }
+        node = node_child(file, node, index);
+        
+        // The binary search below jumps across the page; requesting every line now
+        // overlaps those misses instead of taking them one after another
+        for (size_t offset = 0; offset < PAGE_SIZE; offset += 64) {
+            __builtin_prefetch(node_bytes(node) + offset);
+        }
+        depth++;
+    }
+    if (path) {
+        path->steps[depth].node = node;
+        path->steps[depth].index = 0;
+        path->depth = depth;
+    }
+    return node;
+}
+
+// Swaps every node on path for one the writer may change (see "Versions" below)
+static bool path_writable(EghactDB* db, BTreeNode** root, BTreePath* path) {
+    BTreeNode** ref = root;
+    for (int i = 0; i <= path->depth; i++) {
+        BTreeNode* node = node_writable(db, ref);
+        if (!node) return false;
+        path->steps[i].node = node;
+        if (i < path->depth) {
+            int index = path->steps[i].index;
+            ref = index < 0 ? &node->first_child : &node->slots[index].ptr.child;
+        }
+    }
     return true;
 }
 
-bool eghactdb_rollback_transaction(Transaction* tx) {
-    if (!tx || !tx->active) return false;
-    
-    pthread_mutex_lock(&tx->lock);
-    
-    // TODO: Rollback changes
-    tx->active = false;
-    
-    pthread_mutex_unlock(&tx->lock);
-    pthread_mutex_destroy(&tx->lock);
-    free(tx->modified_collections);
-    free(tx);
-    
+static Value* btree_lookup(const PageFile* file, BTreeNode* root, const uint8_t* key, size_t len) {
+    if (!root) return NULL;
+    BTreeNode* leaf = btree_find_leaf(file, root, key, len, NULL);
+    bool found;
+    uint16_t pos = node_lower_bound(leaf, key, len, &found);
+    return found ? slot_value(file, &leaf->slots[pos]) : NULL;
+}
+
+// Moves path to the next leaf in key order; NULL after the last one
+static BTreeNode* btree_next_leaf(const PageFile* file, BTreePath* path) {
+    int level = path->depth;
+    while (level-- > 0) {
+        BTreePathStep* step = &path->steps[level];
+        if (step->index + 1 >= step->node->num_keys) continue;
+
+        // Every leaf is at the same depth, so the leftmost descent ends at one
+        step->index++;
+        BTreeNode* node = node_child(file, step->node, step->index);
+        while (++level < path->depth) {
+            path->steps[level].node = node;
+            path->steps[level].index = -1;
+            node = node_child(file, node, -1);
+        }
+        path->steps[level].node = node;
+        path->steps[level].index = 0;
+        return node;
+    }
+    return NULL;
+}
+
+// Inserts without reorganizing the node; fails if the key breaks the node's prefix
+// or there is no contiguous room left
+static bool node_insert_fast(BTreeNode* node, uint16_t pos, const uint8_t* key, size_t len, void* ptr) {
+    size_t prefix_len = node->prefix_len;
+    if (prefix_len > 0 && (len < prefix_len || memcmp(key, node_prefix(node), prefix_len) != 0)) {
+        return false;
+    }
+
+    const uint8_t* suffix = key + prefix_len;
+    size_t suffix_len = len - prefix_len;
+    if (node_free_space(node) < sizeof(BTreeSlot) + suffix_len) return false;
+
+    node->heap_start -= (uint16_t)suffix_len;
+    memcpy(node_bytes(node) + node->heap_start, suffix, suffix_len);
+
+    memmove(&node->slots[pos + 1], &node->slots[pos], (node->num_keys - pos) * sizeof(BTreeSlot));
+    BTreeSlot* slot = &node->slots[pos];
+    slot->head = key_head(suffix, suffix_len);
+    slot->offset = node->heap_start;
+    slot->length = (uint16_t)suffix_len;
+    slot->ptr.child = (BTreeNode*)ptr;
+    node->num_keys++;
     return true;
 }
 
-// WebAssembly exports
-#ifdef __EMSCRIPTEN__
-EMSCRIPTEN_KEEPALIVE
-void* eghactdb_wasm_open(const char* path) {
-    return eghactdb_open(path);
+static void node_remove_slot(BTreeNode* node, uint16_t pos) {
+    node->garbage += node->slots[pos].length;
+    memmove(&node->slots[pos], &node->slots[pos + 1], (node->num_keys - pos - 1) * sizeof(BTreeSlot));
+    node->num_keys--;
 }
 
-EMSCRIPTEN_KEEPALIVE
-void eghactdb_wasm_close(void* db) {
-    eghactdb_close((EghactDB*)db);
+static inline size_t entry_len(const BTreeEntry* entry) {
+    return entry->a_len + entry->b_len;
 }
 
-EMSCRIPTEN_KEEPALIVE
-void* eghactdb_wasm_create_collection(void* db, const char* name) {
-    return eghactdb_create_collection((EghactDB*)db, name);
+static inline uint8_t entry_byte(const BTreeEntry* entry, size_t i) {
+    return i < entry->a_len ? entry->a[i] : entry->b[i - entry->a_len];
 }
 
-EMSCRIPTEN_KEEPALIVE
-bool eghactdb_wasm_insert(void* collection, const char* key, const char* json_value) {
-    // Parse JSON and create value
-    Value* val = value_string(json_value);  // Simplified
-    return eghactdb_insert((Collection*)collection, key, val);
+static size_t entry_common_prefix(const BTreeEntry* x, const BTreeEntry* y) {
+    size_t limit = entry_len(x) < entry_len(y) ? entry_len(x) : entry_len(y);
+    size_t i = 0;
+    while (i < limit && entry_byte(x, i) == entry_byte(y, i)) i++;
+    return i;
 }
 
-EMSCRIPTEN_KEEPALIVE
-const char* eghactdb_wasm_get(void* collection, const char* key) {
-    Value* val = eghactdb_get((Collection*)collection, key);
-    if (!val) return NULL;
-    
-    // Convert to JSON
-    if (val->type == TYPE_STRING) {
-        return val->data.string_val;
+static void entry_copy(const BTreeEntry* entry, size_t from, size_t to, uint8_t* out) {
+    for (size_t i = from; i < to; i++) {
+        *out++ = entry_byte(entry, i);
+    }
+}
+
+// All slots of a node in order, with a new entry spliced in at pos
+static size_t node_gather(const BTreeNode* node, uint16_t pos, const uint8_t* key, size_t len,
+                          void* ptr, BTreeEntry* entries) {
+    size_t count = 0;
+    for (uint16_t i = 0; i <= node->num_keys; i++) {
+        if (i == pos) {
+            entries[count++] = (BTreeEntry){ NULL, 0, key, len, ptr };
+        }
+        if (i < node->num_keys) {
+            const BTreeSlot* slot = &node->slots[i];
+            entries[count++] = (BTreeEntry){
+                node_prefix(node), node->prefix_len,
+                node_bytes(node) + slot->offset, slot->length,
+                slot->ptr.child
+            };
+        }
+    }
+    return count;
+}
+
+static inline size_t range_prefix(const BTreeEntry* entries, size_t from, size_t to) {
+    return to - from > 1 ? entry_common_prefix(&entries[from], &entries[to - 1]) : 0;
+}
+
+// Bytes a node holding entries [from, to) needs; key_bytes holds running key lengths
+static size_t range_size(const BTreeEntry* entries, const size_t* key_bytes, size_t from, size_t to) {
+    size_t count = to - from;
+    size_t prefix_len = range_prefix(entries, from, to);
+    return BTREE_HEADER_SIZE + count * sizeof(BTreeSlot) + prefix_len +
+           (key_bytes[to] - key_bytes[from]) - count * prefix_len;
+}
+
+// Writes entries [from, to) into a blank page; links are left to the caller
+static void node_build(BTreeNode* node, bool is_leaf, const BTreeEntry* entries, size_t from, size_t to) {
+    node_init(node, is_leaf);
+
+    size_t prefix_len = range_prefix(entries, from, to);
+    node->prefix_len = (uint16_t)prefix_len;
+    if (prefix_len > 0) {
+        entry_copy(&entries[from], 0, prefix_len, node_bytes(node) + PAGE_SIZE - prefix_len);
+    }
+
+    uint16_t heap = (uint16_t)(PAGE_SIZE - prefix_len);
+    for (size_t i = from; i < to; i++) {
+        const BTreeEntry* entry = &entries[i];
+        size_t suffix_len = entry_len(entry) - prefix_len;
+        heap -= (uint16_t)suffix_len;
+        entry_copy(entry, prefix_len, entry_len(entry), node_bytes(node) + heap);
+
+        BTreeSlot* slot = &node->slots[node->num_keys++];
+        slot->head = key_head(node_bytes(node) + heap, suffix_len);
+        slot->offset = heap;
+        slot->length = (uint16_t)suffix_len;
+        slot->ptr.child = (BTreeNode*)entry->ptr;
+    }
+    node->heap_start = heap;
+}
+
+// Inserts an entry by rebuilding the node. Returns 0 if it fit in place, 1 if the node
+// was split with right as its new sibling and sep/sep_len as the key for the parent,
+// or -1 if no split fits.
+static int node_insert_rebuild(BTreeNode* node, uint16_t pos, const uint8_t* key, size_t len, void* ptr,
+                               bool rightmost, BTreeNode* right, uint8_t* sep, size_t* sep_len) {
+    BTreeEntry entries[BTREE_MAX_SLOTS + 1];
+    size_t key_bytes[BTREE_MAX_SLOTS + 2];
+    _Alignas(16) uint8_t scratch[PAGE_SIZE];
+    BTreeNode* rebuilt = (BTreeNode*)scratch;
+
+    size_t count = node_gather(node, pos, key, len, ptr, entries);
+    key_bytes[0] = 0;
+    for (size_t i = 0; i < count; i++) {
+        key_bytes[i + 1] = key_bytes[i] + entry_len(&entries[i]);
+    }
+
+    bool is_leaf = node->is_leaf;
+    BTreeNode* first_child = node->first_child;
+
+    // Compacting away garbage or a shorter prefix may be enough
+    if (range_size(entries, key_bytes, 0, count) <= PAGE_SIZE) {
+        node_build(rebuilt, is_leaf, entries, 0, count);
+        rebuilt->first_child = first_child;
+        node_copy_storage(rebuilt, node);
+        memcpy(node, rebuilt, PAGE_SIZE);
+        return 0;
+    }
+
+    // Leaves split into [0, split) and [split, count). Inner nodes push entries[split]
+    // up and keep [0, split) and [split + 1, count). Appending to the rightmost leaf
+    // leaves it full, so sequential loads don't leave half-empty pages behind.
+    size_t split = 0;
+    size_t skip = is_leaf ? 0 : 1;
+    if (is_leaf && rightmost && pos == count - 1 &&
+        range_size(entries, key_bytes, 0, count - 1) <= PAGE_SIZE) {
+        split = count - 1;
+    } else {
+        size_t best = SIZE_MAX;
+        for (size_t k = 1; k + skip < count; k++) {
+            size_t left = range_size(entries, key_bytes, 0, k);
+            size_t right = range_size(entries, key_bytes, k + skip, count);
+            if (left > PAGE_SIZE || right > PAGE_SIZE) continue;
+            size_t imbalance = left > right ? left - right : right - left;
+            if (imbalance < best) {
+                best = imbalance;
+                split = k;
+            }
+        }
+    }
+    if (split == 0) return -1;
+
+    // Separators only need to tell the two halves apart, so leaves get the shortest one
+    const BTreeEntry* first = &entries[split];
+    if (is_leaf) {
+        *sep_len = entry_common_prefix(&entries[split - 1], first) + 1;
+    } else {
+        *sep_len = entry_len(first);
+    }
+    entry_copy(first, 0, *sep_len, sep);
+
+    // Entries point into node, so build the right half before overwriting it
+    node_build(right, is_leaf, entries, split + skip, count);
+    node_build(rebuilt, is_leaf, entries, 0, split);
+    if (!is_leaf) {
+        right->first_child = (BTreeNode*)first->ptr;
+        rebuilt->first_child = first_child;
+    }
+    node_copy_storage(rebuilt, node);
+    memcpy(node, rebuilt, PAGE_SIZE);
+    return 1;
+}
+
+// Inserts key/ptr at pos in the leaf at the end of path, splitting up the tree as needed.
+// Every node on path must be writable.
+static bool btree_insert_at(EghactDB* db, BTreeNode** root, BTreePath* path, uint16_t pos,
+                            const uint8_t* key, size_t len, void* ptr) {
+    int level = path->depth;
+    bool rightmost = true;
+    for (int i = 0; i < level; i++) {
+        if (path->steps[i].index != path->steps[i].node->num_keys - 1) rightmost = false;
+    }
+    if (node_insert_fast(path->steps[level].node, pos, key, len, ptr)) return true;
+
+    // A split can climb to the root, so reserve a node per level plus a new root up
+    // front. Running out of memory halfway up would leave the tree inconsistent.
+    BTreeNode* spares[BTREE_MAX_DEPTH + 1];
+    int spare_count = 0;
+    while (spare_count < level + 2) {
+        BTreeNode* spare = node_new(db, true);
+        if (!spare) break;
+        spares[spare_count++] = spare;
+    }
+
+    bool inserted = spare_count == level + 2;
+    uint8_t sep_buffers[2][BTREE_KEY_MAX];
+    for (int round = 0; inserted; round++) {
+        BTreeNode* node = path->steps[level].node;
+        if (round > 0 && node_insert_fast(node, pos, key, len, ptr)) break;
+
+        uint8_t* sep = sep_buffers[round & 1];  // key may point at the other buffer
+        size_t sep_len;
+        BTreeNode* right = spares[spare_count - 1];
+        int result = node_insert_rebuild(node, pos, key, len, ptr, rightmost && round == 0, right, sep, &sep_len);
+        if (result <= 0) {
+            inserted = result == 0;
+            break;
+        }
+        spare_count--;
+        right->dirty = right->fresh = true;
+
+        if (level == 0) {
+            BTreeNode* new_root = spares[--spare_count];
+            node_init(new_root, false);
+            new_root->dirty = new_root->fresh = true;
+            new_root->first_child = node;
+            node_insert_fast(new_root, 0, sep, sep_len, right);
+            *root = new_root;
+            break;
+        }
+
+        level--;
+        pos = (uint16_t)(path->steps[level].index + 1);
+        key = sep;
+        len = sep_len;
+        ptr = right;
+    }
+
+    while (spare_count > 0) node_drop(db, spares[--spare_count]);
+    return inserted;
+}
+
+// Removes key and returns its value
+static Value* btree_remove(EghactDB* db, BTreeNode** root, const uint8_t* key, size_t len) {
+    PageFile* file = &db->file;
+    BTreeNode* node = node_load(file, root);
+    if (!node) return NULL;
+
+    BTreePath path;
+    BTreeNode* leaf = btree_find_leaf(file, node, key, len, &path);
+    bool found;
+    uint16_t pos = node_lower_bound(leaf, key, len, &found);
+    if (!found || !path_writable(db, root, &path)) return NULL;
+
+    leaf = path.steps[path.depth].node;
+    Value* value = leaf->slots[pos].ptr.value;
+    node_remove_slot(leaf, pos);
+
+    if (leaf->num_keys == 0 && path.depth > 0) {
+        // Drop the emptied child from its parent, and the parent too if it was the last
+        int level = path.depth;
+        node_release(db, path.steps[level].node);
+        while (level-- > 0) {
+            BTreeNode* parent = path.steps[level].node;
+            int index = path.steps[level].index;
+            if (index >= 0) {
+                node_remove_slot(parent, (uint16_t)index);
+                break;
+            }
+            if (parent->num_keys > 0) {
+                parent->first_child = parent->slots[0].ptr.child;
+                node_remove_slot(parent, 0);
+                break;
+            }
+            node_release(db, parent);
+        }
+
+        // An inner root with one child is an extra level for every lookup
+        while (!(*root)->is_leaf && (*root)->num_keys == 0) {
+            BTreeNode* old_root = *root;
+            *root = node_load(file, &old_root->first_child);
+            node_release(db, old_root);
+        }
+    }
+
+    return value;
+}
+
+// Frees what was loaded or created in memory; anything still on disk is left alone
+static void btree_free(PageFile* file, BTreeNode* node) {
+    if (!node || ref_on_disk(node)) return;
+    if (node->is_leaf) {
+        for (uint16_t i = 0; i < node->num_keys; i++) {
+            value_release(node->slots[i].ptr.value);
+        }
+    } else {
+        btree_free(file, node->first_child);
+        for (uint16_t i = 0; i < node->num_keys; i++) {
+            btree_free(file, node->slots[i].ptr.child);
+        }
+    }
+    if (!page_mapped(file, node)) free(node);
+}
+
+// Versions
+//
+// Readers take no locks. A reader pins the current epoch, loads db->version once and
+// walks the trees it names, so it sees every write published before that load and none
+// after. Writers never change a node a reader might be looking at. The first time a
+// write reaches a published node it changes a copy instead, and the copy takes the
+// original's place in a copied parent, all the way up to a new root. Nodes created since
+// the last publish are still private to the writer and change in place, so a
+// transaction copies each node at most once however many of its writes land there.
+//
+// Publishing stores a new DbVersion, then stamps what the new trees no longer hold with
+// the current epoch: the copied nodes, the replaced and deleted values and the old
+// DbVersion. The epoch moves on only when no reader is left in the one before it, so two
+// moves past an object's stamp mean nobody can still reach it, and it is freed. Writers
+// never wait for readers; a reader that stays pinned only holds memory back.
+//
+// Nodes in the page file's mapping are never freed. A checkpoint may rewrite their page
+// in place, which a private mapping shows through, so a retired one is written to first
+// to give it a private copy. Reclaiming it drops that copy again.
+
+#define RECLAIM_BATCH 64  // Stamped retirements before the writer tries to reclaim
+
+enum {
+    RETIRED_NODE,
+    RETIRED_VALUE,
+    RETIRED_VERSION,
+    RETIRED_INDEXES
+};
+
+static _Thread_local uint32_t t_reader_stripe;  // 1-based; 0 until first picked
+static _Atomic uint32_t g_reader_stripes;
+
+static bool node_list_push(NodeList* list, BTreeNode* node) {
+    if (list->count >= list->capacity) {
+        size_t new_capacity = list->capacity == 0 ? 256 : list->capacity * 2;
+        BTreeNode** nodes = (BTreeNode**)realloc(list->nodes, new_capacity * sizeof(BTreeNode*));
+        if (!nodes) return false;
+        list->nodes = nodes;
+        list->capacity = new_capacity;
+    }
+    list->nodes[list->count++] = node;
+    return true;
+}
+
+// Pins the current epoch; pass the result to read_end
+static _Atomic uint64_t* read_begin(EghactDB* db) {
+    if (t_reader_stripe == 0) {
+        t_reader_stripe = atomic_fetch_add_explicit(&g_reader_stripes, 1, memory_order_relaxed) % READER_STRIPES + 1;
+    }
+    ReaderStripe* stripe = &db->readers[t_reader_stripe - 1];
+    for (;;) {
+        uint64_t epoch = atomic_load(&db->reader_epoch);
+        _Atomic uint64_t* active = &stripe->active[epoch & 1];
+        atomic_fetch_add(active, 1);
+
+        // If the epoch moved on meanwhile, a reclaimer may have checked before the pin landed
+        if (atomic_load(&db->reader_epoch) == epoch) return active;
+        atomic_fetch_sub(active, 1);
+    }
+}
+
+static inline void read_end(_Atomic uint64_t* active) {
+    atomic_fetch_sub_explicit(active, 1, memory_order_release);
+}
+
+static inline DbVersion* version_current(EghactDB* db) {
+    return __atomic_load_n(&db->version, __ATOMIC_SEQ_CST);
+}
+
+static inline BTreeNode* version_root(const PageFile* file, DbVersion* version, const Collection* collection) {
+    if (!version || collection->id >= version->root_count) return NULL;
+    return node_load(file, &version->roots[collection->id]);
+}
+
+static void retired_free(EghactDB* db, void* object, uint8_t kind) {
+    switch (kind) {
+        case RETIRED_NODE:
+            if (page_mapped(&db->file, object)) {
+                madvise(object, PAGE_SIZE, MADV_DONTNEED);
+            } else {
+                free(object);
+            }
+            break;
+        case RETIRED_VALUE:
+            value_free((Value*)object);
+            break;
+        default:
+            free(object);
+            break;
+    }
+}
+
+// Queues object to be freed once readers are done with it. Before the first publish
+// there are no readers. If the list can't grow the object is never freed.
+static void retire(EghactDB* db, void* object, uint8_t kind) {
+    VersionWriter* writer = &db->writer;
+    if (!db->version) {
+        retired_free(db, object, kind);
+        return;
+    }
+    if (writer->retired_count >= writer->retired_capacity) {
+        size_t new_capacity = writer->retired_capacity == 0 ? 256 : writer->retired_capacity * 2;
+        Retired* retired = (Retired*)realloc(writer->retired, new_capacity * sizeof(Retired));
+        if (!retired) return;
+        writer->retired = retired;
+        writer->retired_capacity = new_capacity;
+    }
+    writer->retired[writer->retired_count++] = (Retired){ object, kind, 0 };
+}
+
+static void node_retire(EghactDB* db, BTreeNode* node) {
+    if (page_mapped(&db->file, node)) {
+        __atomic_store_n(&node->dirty, node->dirty, __ATOMIC_RELAXED);  // See above
+    }
+    retire(db, node, RETIRED_NODE);
+}
+
+static void value_retire(EghactDB* db, Value* value) {
+    if (value && !ref_on_disk(value) && value != &g_index_entry) retire(db, value, RETIRED_VALUE);
+}
+
+// New node, private to the writer until the next publish
+static BTreeNode* node_new(EghactDB* db, bool is_leaf) {
+    BTreeNode* node = node_alloc(is_leaf);
+    if (node && !node_list_push(&db->writer.fresh, node)) {
+        free(node);
+        return NULL;
+    }
+    if (node) node->fresh = true;
+    return node;
+}
+
+// Node dropped from the writer's tree. One nobody has seen goes at the next publish;
+// until then its fresh flag is still cleared through the list. If the discard list
+// can't grow it is never freed.
+static void node_drop(EghactDB* db, BTreeNode* node) {
+    if (node->fresh) {
+        node_list_push(&db->writer.discarded, node);
+    } else {
+        node_retire(db, node);
+    }
+}
+
+// Copies a published node; readers may be swapping references in it, so those are
+// read atomically and the rest is copied around them
+static void node_clone(const BTreeNode* node, BTreeNode* copy) {
+    memcpy(copy, node, offsetof(BTreeNode, first_child));
+    memcpy(node_bytes(copy) + node->heap_start, node_bytes(node) + node->heap_start, PAGE_SIZE - node->heap_start);
+    copy->first_child = __atomic_load_n(&node->first_child, __ATOMIC_ACQUIRE);
+    for (uint16_t i = 0; i < node->num_keys; i++) {
+        const BTreeSlot* slot = &node->slots[i];
+        copy->slots[i].head = slot->head;
+        copy->slots[i].offset = slot->offset;
+        copy->slots[i].length = slot->length;
+        copy->slots[i].ptr.child = __atomic_load_n(&slot->ptr.child, __ATOMIC_ACQUIRE);
+    }
+}
+
+// The node at *ref, replaced there by a copy first unless it is still fresh. ref lies
+// in a writable parent or is the collection's own root.
+static BTreeNode* node_writable(EghactDB* db, BTreeNode** ref) {
+    PageFile* file = &db->file;
+    BTreeNode* node = node_load(file, ref);
+    if (node->fresh) return node;
+
+    // Only leaves in the mapping hold values still on disk. Decoding them into the
+    // original first leaves both versions sharing every value, so retiring the original
+    // frees none of them.
+    if (node->is_leaf && page_mapped(file, node)) {
+        for (uint16_t i = 0; i < node->num_keys; i++) {
+            slot_value(file, &node->slots[i]);
+        }
+    }
+
+    BTreeNode* copy = node_new(db, node->is_leaf);
+    if (!copy) return NULL;
+    node_clone(node, copy);
+    copy->dirty = copy->fresh = true;
+    *ref = copy;
+    node_retire(db, node);
+    return copy;
+}
+
+static bool versions_init(EghactDB* db) {
+    void* memory = NULL;
+    if (posix_memalign(&memory, 64, READER_STRIPES * sizeof(ReaderStripe)) != 0) return false;
+    memset(memory, 0, READER_STRIPES * sizeof(ReaderStripe));
+    db->readers = (ReaderStripe*)memory;
+    return true;
+}
+
+// Moves the epoch on while no reader is left in the previous one, then frees what
+// was stamped two epochs back. Caller holds the log lock.
+static void versions_reclaim(EghactDB* db) {
+    VersionWriter* writer = &db->writer;
+    uint64_t epoch = atomic_load(&db->reader_epoch);
+    for (int step = 0; step < 2; step++) {
+        uint64_t lingering = 0;
+        for (size_t i = 0; i < READER_STRIPES; i++) {
+            lingering += atomic_load(&db->readers[i].active[(epoch + 1) & 1]);
+        }
+        if (lingering > 0) break;
+        atomic_store(&db->reader_epoch, ++epoch);
+    }
+
+    size_t freed = 0;
+    while (freed < writer->retired_stamped && writer->retired[freed].epoch + 2 <= epoch) {
+        retired_free(db, writer->retired[freed].object, writer->retired[freed].kind);
+        freed++;
+    }
+    memmove(writer->retired, writer->retired + freed, (writer->retired_count - freed) * sizeof(Retired));
+    writer->retired_count -= freed;
+    writer->retired_stamped -= freed;
+    writer->since_reclaim = 0;
+}
+
+// Makes the writer's trees visible to readers. Caller holds the log lock, or is opening
+// the database. If the new version can't be allocated readers keep the old one and the
+// writes stay pending for the next publish.
+static void versions_publish(EghactDB* db) {
+    VersionWriter* writer = &db->writer;
+    DbVersion* old = db->version;
+    if (old && writer->fresh.count == 0 && writer->retired_stamped == writer->retired_count) return;
+
+    DbVersion* version = (DbVersion*)malloc(offsetof(DbVersion, roots) + db->collection_count * sizeof(BTreeNode*));
+    if (!version) return;
+    version->root_count = db->collection_count;
+    for (size_t i = 0; i < db->collection_count; i++) {
+        version->roots[i] = db->collections[i]->root;
+    }
+
+    // The new trees are shared from here on
+    for (size_t i = 0; i < writer->fresh.count; i++) {
+        writer->fresh.nodes[i]->fresh = false;
+    }
+    writer->fresh.count = 0;
+    for (size_t i = 0; i < writer->discarded.count; i++) {
+        free(writer->discarded.nodes[i]);
+    }
+    writer->discarded.count = 0;
+
+    __atomic_store_n(&db->version, version, __ATOMIC_SEQ_CST);
+    for (size_t i = 0; old && i < version->root_count; i++) {
+        BTreeNode* before = i < old->root_count ? __atomic_load_n(&old->roots[i], __ATOMIC_RELAXED) : NULL;
+        if (version->roots[i] != before) atomic_fetch_add(&db->collections[i]->writes, 1);
+    }
+    if (old) retire(db, old, RETIRED_VERSION);
+
+    // Reclaim before stamping: the caller drops cached copies of what this publish
+    // replaced only after it returns, and until then a reader can still find them
+    if (writer->since_reclaim >= RECLAIM_BATCH) versions_reclaim(db);
+
+    // A reader still on the old version loaded it before the store above, so it pinned
+    // an epoch no later than this one
+    uint64_t epoch = atomic_load(&db->reader_epoch);
+    for (size_t i = writer->retired_stamped; i < writer->retired_count; i++) {
+        writer->retired[i].epoch = epoch;
+    }
+    writer->since_reclaim += writer->retired_count - writer->retired_stamped;
+    writer->retired_stamped = writer->retired_count;
+}
+
+// Frees everything retired at once; nobody is reading any more
+static void versions_destroy(EghactDB* db) {
+    VersionWriter* writer = &db->writer;
+    for (size_t i = 0; i < writer->retired_count; i++) {
+        retired_free(db, writer->retired[i].object, writer->retired[i].kind);
+    }
+    for (size_t i = 0; i < writer->discarded.count; i++) {
+        free(writer->discarded.nodes[i]);
+    }
+    free(writer->retired);
+    free(writer->discarded.nodes);
+    free(writer->fresh.nodes);
+    free(db->version);
+    free(db->readers);
+}
+
+// Read cache
+//
+// Point reads are cached by (collection, key) in CACHE_SHARDS independent shards.
+// Each shard has its own rwlock, so readers only meet when their keys hash to the
+// same shard. A hit runs under the shard's read lock and only sets the entry's CLOCK
+// bit. Fills and invalidations take the write lock. Eviction sweeps the CLOCK hand
+// until the shard is back under its share of the byte capacity. Entries are filled on
+// a miss and dropped by update/delete right after the write is published. A fill checks
+// under the shard lock that no publish changed the collection since the reader looked,
+// so the cache never keeps a value the tree has already retired.
+//
+// A key is only admitted on its second miss within a window, tracked in a small
+// per-shard bitmap. Uniform or scanning workloads would otherwise pay for a fill and an
+// eviction on nearly every read while getting almost no hits.
+
+#define CACHE_INITIAL_ENTRIES 64
+#define CACHE_ADMIT_WINDOW (CACHE_ADMIT_BITS / 2)  // Misses before the bitmap is cleared
+
+static uint32_t cache_hash(const Collection* collection, const char* key, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)key[i];
+        hash *= 16777619u;
+    }
+
+    // Equal keys in different collections land apart; the finalizer spreads the
+    // low bits used for the shard
+    hash ^= (uint32_t)((uintptr_t)collection >> 4) * 2654435761u;
+    hash ^= hash >> 15;
+    hash *= 2246822519u;
+    hash ^= hash >> 13;
+    return hash;
+}
+
+static inline CacheShard* cache_shard(CacheShard* shards, uint32_t hash) {
+    return &shards[hash & (CACHE_SHARDS - 1)];
+}
+
+static inline uint32_t cache_bucket(const CacheShard* shard, uint32_t hash) {
+    return (hash / CACHE_SHARDS) & (shard->bucket_count - 1);
+}
+
+static size_t value_charge(const Value* value) {
+    size_t charge = sizeof(Value);
+    if (value->type == TYPE_STRING || value->type == TYPE_BLOB) {
+        charge += value->size;
+    }
+    return charge;
+}
+
+static CacheShard* cache_create(size_t capacity) {
+    void* memory = NULL;
+    if (posix_memalign(&memory, 64, CACHE_SHARDS * sizeof(CacheShard)) != 0) return NULL;
+
+    CacheShard* shards = (CacheShard*)memory;
+    memset(shards, 0, CACHE_SHARDS * sizeof(CacheShard));
+    for (size_t i = 0; i < CACHE_SHARDS; i++) {
+        pthread_rwlock_init(&shards[i].lock, NULL);
+        shards[i].free_list = -1;
+        shards[i].capacity = capacity / CACHE_SHARDS;
+    }
+    return shards;
+}
+
+static void cache_destroy(CacheShard* shards) {
+    if (!shards) return;
+    for (size_t i = 0; i < CACHE_SHARDS; i++) {
+        CacheShard* shard = &shards[i];
+        for (uint32_t j = 0; j < shard->entry_capacity; j++) {
+            free(shard->entries[j].key);
+        }
+        free(shard->entries);
+        free(shard->buckets);
+        pthread_rwlock_destroy(&shard->lock);
+    }
+    free(shards);
+}
+
+static int32_t cache_find(const CacheShard* shard, const Collection* collection,
+                          const char* key, size_t len, uint32_t hash) {
+    if (shard->bucket_count == 0) return -1;
+
+    int32_t index = shard->buckets[cache_bucket(shard, hash)];
+    while (index >= 0) {
+        const CacheEntry* entry = &shard->entries[index];
+        if (entry->hash == hash && entry->collection == collection &&
+            entry->key_len == len && memcmp(entry->key, key, len) == 0) {
+            return index;
+        }
+        index = entry->next;
+    }
+    return -1;
+}
+
+static void cache_unlink(CacheShard* shard, int32_t index) {
+    CacheEntry* entry = &shard->entries[index];
+
+    int32_t* link = &shard->buckets[cache_bucket(shard, entry->hash)];
+    while (*link != index) link = &shard->entries[*link].next;
+    *link = entry->next;
+
+    shard->bytes -= entry->charge;
+    shard->entry_count--;
+    free(entry->key);
+    entry->key = NULL;
+    entry->collection = NULL;
+    entry->value = NULL;
+    entry->next = shard->free_list;
+    shard->free_list = index;
+}
+
+// Sweeps the CLOCK hand until needed more bytes fit
+static void cache_evict(CacheShard* shard, size_t needed) {
+    while (shard->entry_count > 0 && shard->bytes + needed > shard->capacity) {
+        CacheEntry* entry = &shard->entries[shard->hand];
+        if (entry->collection) {
+            if (atomic_load_explicit(&entry->referenced, memory_order_relaxed)) {
+                atomic_store_explicit(&entry->referenced, false, memory_order_relaxed);
+            } else {
+                cache_unlink(shard, (int32_t)shard->hand);
+                shard->evictions++;
+            }
+        }
+        shard->hand = (shard->hand + 1) % shard->entry_capacity;
+    }
+}
+
+static bool cache_grow_buckets(CacheShard* shard) {
+    uint32_t count = shard->bucket_count == 0 ? CACHE_INITIAL_ENTRIES : shard->bucket_count * 2;
+    int32_t* buckets = (int32_t*)malloc(count * sizeof(int32_t));
+    if (!buckets) return false;
+
+    free(shard->buckets);
+    shard->buckets = buckets;
+    shard->bucket_count = count;
+    for (uint32_t i = 0; i < count; i++) {
+        buckets[i] = -1;
+    }
+    for (uint32_t i = 0; i < shard->entry_capacity; i++) {
+        CacheEntry* entry = &shard->entries[i];
+        if (!entry->collection) continue;
+        uint32_t bucket = cache_bucket(shard, entry->hash);
+        entry->next = buckets[bucket];
+        buckets[bucket] = (int32_t)i;
+    }
+    return true;
+}
+
+static int32_t cache_alloc_entry(CacheShard* shard) {
+    if (shard->free_list < 0) {
+        uint32_t capacity = shard->entry_capacity == 0 ? CACHE_INITIAL_ENTRIES : shard->entry_capacity * 2;
+        CacheEntry* entries = (CacheEntry*)realloc(shard->entries, capacity * sizeof(CacheEntry));
+        if (!entries) return -1;
+
+        memset(&entries[shard->entry_capacity], 0, (capacity - shard->entry_capacity) * sizeof(CacheEntry));
+        for (uint32_t i = capacity; i-- > shard->entry_capacity; ) {
+            entries[i].next = shard->free_list;
+            shard->free_list = (int32_t)i;
+        }
+        shard->entries = entries;
+        shard->entry_capacity = capacity;
+    }
+
+    int32_t index = shard->free_list;
+    shard->free_list = shard->entries[index].next;
+    return index;
+}
+
+static Value* cache_lookup(CacheShard* shards, const Collection* collection,
+                           const char* key, size_t len, uint32_t hash) {
+    if (!shards) return NULL;
+    CacheShard* shard = cache_shard(shards, hash);
+
+    pthread_rwlock_rdlock(&shard->lock);
+
+    Value* value = NULL;
+    int32_t index = cache_find(shard, collection, key, len, hash);
+    if (index >= 0) {
+        CacheEntry* entry = &shard->entries[index];
+        // Skip the store when already set so hot entries stay shared across cores
+        if (!atomic_load_explicit(&entry->referenced, memory_order_relaxed)) {
+            atomic_store_explicit(&entry->referenced, true, memory_order_relaxed);
+        }
+        value = entry->value;
+        atomic_fetch_add_explicit(&shard->hits, 1, memory_order_relaxed);
+    } else {
+        atomic_fetch_add_explicit(&shard->misses, 1, memory_order_relaxed);
+    }
+
+    pthread_rwlock_unlock(&shard->lock);
+    return value;
+}
+
+// True if the key already missed once in the current window
+static bool cache_admit(CacheShard* shard, uint32_t hash) {
+    uint32_t bit = (hash * 2654435769u) >> 20 & (CACHE_ADMIT_BITS - 1);
+    uint64_t mask = 1ULL << (bit & 63);
+    uint64_t seen = atomic_fetch_or_explicit(&shard->admit[bit / 64], mask, memory_order_relaxed);
+    if (seen & mask) return true;
+
+    if (atomic_fetch_add_explicit(&shard->admit_count, 1, memory_order_relaxed) + 1 >= CACHE_ADMIT_WINDOW) {
+        atomic_store_explicit(&shard->admit_count, 0, memory_order_relaxed);
+        for (size_t i = 0; i < CACHE_ADMIT_BITS / 64; i++) {
+            atomic_store_explicit(&shard->admit[i], 0, memory_order_relaxed);
+        }
+    }
+    return false;
+}
+
+// Caller is pinned, so value can't be freed underneath the fill. writes is what the
+// collection's counter read before the lookup that found value.
+static void cache_fill(CacheShard* shards, Collection* collection,
+                       const char* key, size_t len, uint32_t hash, Value* value, uint64_t writes) {
+    if (!shards) return;
+    CacheShard* shard = cache_shard(shards, hash);
+    if (!cache_admit(shard, hash)) return;
+    size_t charge = sizeof(CacheEntry) + len + 1 + value_charge(value);
+
+    pthread_rwlock_wrlock(&shard->lock);
+
+    // A writer that replaced value invalidates after bumping the counter, so either its
+    // invalidation comes after this fill or the fill sees the new count
+    if (charge > shard->capacity || atomic_load(&collection->writes) != writes) {
+        pthread_rwlock_unlock(&shard->lock);
+        return;
+    }
+
+    // Another reader may have filled it first
+    int32_t index = cache_find(shard, collection, key, len, hash);
+    if (index >= 0) {
+        pthread_rwlock_unlock(&shard->lock);
+        return;
+    }
+
+    cache_evict(shard, charge);
+
+    char* key_copy = (char*)malloc(len + 1);
+    index = key_copy ? cache_alloc_entry(shard) : -1;
+    if (index >= 0 && shard->entry_count >= shard->bucket_count && !cache_grow_buckets(shard)) {
+        shard->entries[index].next = shard->free_list;
+        shard->free_list = index;
+        index = -1;
+    }
+    if (index < 0) {
+        free(key_copy);
+        pthread_rwlock_unlock(&shard->lock);
+        return;
+    }
+
+    memcpy(key_copy, key, len);
+    key_copy[len] = '\0';
+
+    CacheEntry* entry = &shard->entries[index];
+    entry->collection = collection;
+    entry->key = key_copy;
+    entry->key_len = (uint16_t)len;
+    atomic_store_explicit(&entry->referenced, false, memory_order_relaxed);
+    entry->hash = hash;
+    entry->value = value;
+    entry->charge = charge;
+
+    uint32_t bucket = cache_bucket(shard, hash);
+    entry->next = shard->buckets[bucket];
+    shard->buckets[bucket] = index;
+    shard->bytes += charge;
+    shard->entry_count++;
+
+    pthread_rwlock_unlock(&shard->lock);
+}
+
+// Caller holds the log lock and has published the write
+static void cache_invalidate(CacheShard* shards, const Collection* collection, const char* key, size_t len) {
+    if (!shards) return;
+    uint32_t hash = cache_hash(collection, key, len);
+    CacheShard* shard = cache_shard(shards, hash);
+
+    pthread_rwlock_wrlock(&shard->lock);
+    int32_t index = cache_find(shard, collection, key, len, hash);
+    if (index >= 0) {
+        cache_unlink(shard, index);
+    }
+    pthread_rwlock_unlock(&shard->lock);
+}
+
+// Total capacity in bytes, split evenly across shards; 0 disables caching
+void eghactdb_set_cache_capacity(EghactDB* db, size_t bytes) {
+    if (!db || !db->cache) return;
+    for (size_t i = 0; i < CACHE_SHARDS; i++) {
+        CacheShard* shard = &db->cache[i];
+        pthread_rwlock_wrlock(&shard->lock);
+        shard->capacity = bytes / CACHE_SHARDS;
+        cache_evict(shard, 0);
+        pthread_rwlock_unlock(&shard->lock);
+    }
+}
+
+void eghactdb_get_cache_stats(EghactDB* db, EghactCacheStats* stats) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(*stats));
+    if (!db || !db->cache) return;
+
+    for (size_t i = 0; i < CACHE_SHARDS; i++) {
+        CacheShard* shard = &db->cache[i];
+        pthread_rwlock_rdlock(&shard->lock);
+        stats->hits += atomic_load_explicit(&shard->hits, memory_order_relaxed);
+        stats->misses += atomic_load_explicit(&shard->misses, memory_order_relaxed);
+        stats->evictions += shard->evictions;
+        stats->entries += shard->entry_count;
+        stats->bytes += shard->bytes;
+        stats->capacity += shard->capacity;
+        pthread_rwlock_unlock(&shard->lock);
+    }
+}
+
+// Tree writes. Callers hold the log lock, which every writer takes, have validated
+// the key and publish afterwards; until then readers still see the old trees.
+
+// On success the collection owns value
+static bool collection_insert(Collection* collection, const char* key, size_t len, Value* value) {
+    EghactDB* db = collection->db;
+    BTreeNode* root = node_load(&db->file, &collection->root);
+    if (!root) {
+        root = collection->root = node_new(db, true);
+        if (!root) return false;
+    }
+    
+    BTreePath path;
+    BTreeNode* leaf = btree_find_leaf(&db->file, root, (const uint8_t*)key, len, &path);
+    bool found;
+    uint16_t pos = node_lower_bound(leaf, (const uint8_t*)key, len, &found);
+    if (found || !path_writable(db, &collection->root, &path) ||
+        !btree_insert_at(db, &collection->root, &path, pos, (const uint8_t*)key, len, value)) {
+        return false;
+    }
+    collection->count++;
+    return true;
+}
+
+static bool collection_update(Collection* collection, const char* key, size_t len, Value* value) {
+    EghactDB* db = collection->db;
+    BTreeNode* root = node_load(&db->file, &collection->root);
+    if (!root) return false;
+    
+    BTreePath path;
+    BTreeNode* leaf = btree_find_leaf(&db->file, root, (const uint8_t*)key, len, &path);
+    bool found;
+    uint16_t pos = node_lower_bound(leaf, (const uint8_t*)key, len, &found);
+    if (!found || !path_writable(db, &collection->root, &path)) return false;
+    
+    leaf = path.steps[path.depth].node;
+    value_retire(db, leaf->slots[pos].ptr.value);
+    leaf->slots[pos].ptr.value = value;
+    return true;
+}
+
+static bool collection_delete(Collection* collection, const char* key, size_t len) {
+    EghactDB* db = collection->db;
+    Value* removed = btree_remove(db, &collection->root, (const uint8_t*)key, len);
+    if (!removed) return false;
+    
+    collection->count--;
+    value_retire(db, removed);
+    return true;
+}
+
+// Write-ahead log
+//
+// Every change is appended to <path>-wal as a frame: a length, a CRC32 and a run of
+// compact redo ops. A transaction is exactly one frame, so recovery applies all of its
+// ops or none. Ops are applied to the trees while the log lock is held, which makes log
+// order the same as apply order.
+//
+// Commits are grouped. The first committer that finds its records unsynced becomes the
+// leader: it takes everything appended so far and writes and fdatasyncs it with the
+// lock released. Committers that arrive meanwhile append and wait, and the next leader
+// syncs all of them with one call. Single writes outside a transaction don't wait; the
+// background writer syncs them within WAL_FLUSH_INTERVAL_MS. It also checkpoints once
+// the log grows past WAL_CHECKPOINT_BYTES.
+//
+// A checkpoint writes the pages changed since the last one back to <path> (see "Page
+// file" below) and starts a new log. The log's header names the checkpoint it follows.
+// Open replays it onto that checkpoint only, stopping at the first torn or corrupt
+// frame.
+
+#define WAL_FLUSH_INTERVAL_MS 10
+#define WAL_CHECKPOINT_BYTES (64 * 1024 * 1024)
+#define WAL_MAGIC "EGDBWAL1"
+#define WAL_HEADER_SIZE 16                // Magic, u64 checkpoint epoch
+#define WAL_FRAME_HEADER 8                // u32 payload length, u32 CRC32
+
+enum {
+    WAL_OP_CREATE = 1,  // Key is the collection name
+    WAL_OP_INSERT,
+    WAL_OP_UPDATE,
+    WAL_OP_DELETE,
+    WAL_OP_PAGE         // Checkpoint page image: u32 page number, PAGE_SIZE bytes
+};
+
+static uint32_t g_crc_table[256];
+static pthread_once_t g_crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+        }
+        g_crc_table[i] = crc;
+    }
+}
+
+static uint32_t crc32(const uint8_t* data, size_t length) {
+    pthread_once(&g_crc_once, crc_init);
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; i++) {
+        crc = g_crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// Encoding; everything is little-endian
+static bool wal_reserve(WalBuffer* buffer, size_t extra) {
+    if (buffer->length + extra <= buffer->capacity) return true;
+    size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+    while (capacity < buffer->length + extra) capacity *= 2;
+    uint8_t* data = (uint8_t*)realloc(buffer->data, capacity);
+    if (!data) return false;
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return true;
+}
+
+static inline void put_u8(WalBuffer* buffer, uint8_t v) {
+    buffer->data[buffer->length++] = v;
+}
+
+static inline void put_u16(WalBuffer* buffer, uint16_t v) {
+    put_u8(buffer, (uint8_t)v);
+    put_u8(buffer, (uint8_t)(v >> 8));
+}
+
+static inline void put_u32(WalBuffer* buffer, uint32_t v) {
+    for (int i = 0; i < 4; i++) put_u8(buffer, (uint8_t)(v >> (8 * i)));
+}
+
+static inline void put_u64(WalBuffer* buffer, uint64_t v) {
+    for (int i = 0; i < 8; i++) put_u8(buffer, (uint8_t)(v >> (8 * i)));
+}
+
+static inline void put_bytes(WalBuffer* buffer, const void* data, size_t length) {
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+}
+
+static inline void patch_u32(uint8_t* at, uint32_t v) {
+    for (int i = 0; i < 4; i++) at[i] = (uint8_t)(v >> (8 * i));
+}
+
+static size_t wal_value_size(const Value* value) {
+    if (!value) return 0;
+    switch (value->type) {
+        case TYPE_BOOL: return 2;
+        case TYPE_INT:
+        case TYPE_FLOAT: return 9;
+        case TYPE_STRING:
+        case TYPE_BLOB: return 5 + value->size;
+        default: return 1;
+    }
+}
+
+static void wal_put_value(WalBuffer* buffer, const Value* value) {
+    if (!value) return;
+    switch (value->type) {
+        case TYPE_BOOL:
+            put_u8(buffer, TYPE_BOOL);
+            put_u8(buffer, value->data.bool_val ? 1 : 0);
+            break;
+        case TYPE_INT:
+            put_u8(buffer, TYPE_INT);
+            put_u64(buffer, (uint64_t)value->data.int_val);
+            break;
+        case TYPE_FLOAT: {
+            uint64_t bits;
+            memcpy(&bits, &value->data.float_val, sizeof(bits));
+            put_u8(buffer, TYPE_FLOAT);
+            put_u64(buffer, bits);
+            break;
+        }
+        case TYPE_STRING:
+        case TYPE_BLOB:
+            put_u8(buffer, (uint8_t)value->type);
+            put_u32(buffer, (uint32_t)value->size);
+            put_bytes(buffer, value->type == TYPE_STRING ? (const void*)value->data.string_val
+                                                         : value->data.blob_val, value->size);
+            break;
+        default:
+            put_u8(buffer, TYPE_NULL);  // Objects and arrays have no storage format yet
+            break;
+    }
+}
+
+static inline size_t wal_op_size(size_t key_len, const Value* value) {
+    return 1 + 4 + 2 + key_len + wal_value_size(value);
+}
+
+// Caller reserved wal_op_size bytes
+static void wal_put_op(WalBuffer* buffer, uint8_t op, uint32_t collection_id,
+                       const char* key, size_t key_len, const Value* value) {
+    put_u8(buffer, op);
+    put_u32(buffer, collection_id);
+    put_u16(buffer, (uint16_t)key_len);
+    put_bytes(buffer, key, key_len);
+    if (op == WAL_OP_INSERT || op == WAL_OP_UPDATE) {
+        wal_put_value(buffer, value);
+    }
+}
+
+static inline size_t wal_begin_frame(WalBuffer* buffer) {
+    size_t start = buffer->length;
+    buffer->length += WAL_FRAME_HEADER;
+    return start;
+}
+
+// Returns the frame's size, or 0 if it held no ops and was dropped
+static size_t wal_end_frame(WalBuffer* buffer, size_t start) {
+    size_t payload = buffer->length - start - WAL_FRAME_HEADER;
+    if (payload == 0) {
+        buffer->length = start;
+        return 0;
+    }
+    uint8_t* header = buffer->data + start;
+    patch_u32(header, (uint32_t)payload);
+    patch_u32(header + 4, crc32(header + WAL_FRAME_HEADER, payload));
+    return buffer->length - start;
+}
+
+// Decoding
+typedef struct {
+    const uint8_t* p;
+    const uint8_t* end;
+} WalReader;
+
+static bool get_bytes(WalReader* reader, void* out, size_t length) {
+    if ((size_t)(reader->end - reader->p) < length) return false;
+    memcpy(out, reader->p, length);
+    reader->p += length;
+    return true;
+}
+
+static bool get_uint(WalReader* reader, size_t width, uint64_t* out) {
+    uint8_t bytes[8];
+    if (!get_bytes(reader, bytes, width)) return false;
+    *out = 0;
+    for (size_t i = 0; i < width; i++) *out |= (uint64_t)bytes[i] << (8 * i);
+    return true;
+}
+
+static Value* wal_get_value(WalReader* reader) {
+    uint64_t type, v;
+    if (!get_uint(reader, 1, &type)) return NULL;
+    switch (type) {
+        case TYPE_NULL:
+            return value_null();
+        case TYPE_BOOL:
+            return get_uint(reader, 1, &v) ? value_bool(v != 0) : NULL;
+        case TYPE_INT:
+            return get_uint(reader, 8, &v) ? value_int((int64_t)v) : NULL;
+        case TYPE_FLOAT: {
+            if (!get_uint(reader, 8, &v)) return NULL;
+            double f;
+            memcpy(&f, &v, sizeof(f));
+            return value_float(f);
+        }
+        case TYPE_STRING:
+        case TYPE_BLOB: {
+            if (!get_uint(reader, 4, &v) || (uint64_t)(reader->end - reader->p) < v) return NULL;
+            Value* value;
+            if (type == TYPE_BLOB) {
+                value = value_blob(reader->p, (size_t)v);
+            } else {
+                value = (Value*)calloc(1, sizeof(Value));
+                if (value) {
+                    value->type = TYPE_STRING;
+                    value->size = (size_t)v;
+                    value->data.string_val = (char*)malloc((size_t)v + 1);
+                    memcpy(value->data.string_val, reader->p, (size_t)v);
+                    value->data.string_val[v] = '\0';
+                }
+            }
+            reader->p += v;
+            return value;
+        }
+        default:
+            return NULL;
+    }
+}
+
+static bool write_all(int fd, const uint8_t* data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+    return true;
+}
+
+static int sync_data(int fd) {
+#ifdef __APPLE__
+    return fsync(fd);
+#else
+    return fdatasync(fd);
+#endif
+}
+
+// Waits until the log is durable up to target; caller holds wal->lock
+static bool wal_sync_locked(Wal* wal, uint64_t target) {
+    while (wal->durable_lsn < target && !wal->failed) {
+        if (wal->flushing) {
+            pthread_cond_wait(&wal->flushed, &wal->lock);
+            continue;
+        }
+
+        // Lead this group: take everything appended so far
+        WalBuffer batch = wal->pending;
+        wal->pending = wal->writing;
+        wal->pending.length = 0;
+        wal->writing = batch;
+        uint64_t end = wal->appended_lsn;
+        wal->flushing = true;
+        pthread_mutex_unlock(&wal->lock);
+
+        bool ok = write_all(wal->fd, wal->writing.data, wal->writing.length) && sync_data(wal->fd) == 0;
+
+        pthread_mutex_lock(&wal->lock);
+        wal->flushing = false;
+        wal->syncs++;
+        if (ok) {
+            wal->durable_lsn = end;
+            wal->file_size += wal->writing.length;
+        } else {
+            wal->failed = true;  // The log's tail is unknown now; refuse further writes
+        }
+        wal->writing.length = 0;
+        pthread_cond_broadcast(&wal->flushed);
+    }
+    return wal->durable_lsn >= target;
+}
+
+static bool collection_write(Collection* collection, uint8_t op, const char* key, size_t len, Value* value) {
+    switch (op) {
+        case WAL_OP_INSERT:
+            return collection_insert(collection, key, len, value);
+        case WAL_OP_UPDATE:
+            return collection_update(collection, key, len, value);
+        case WAL_OP_DELETE:
+            return collection_delete(collection, key, len);
+        default:
+            return false;
+    }
+}
+
+// Applies one op to a collection's tree and its indexes. On failure the caller still
+// owns value. Indexes are derived from the documents, so the log never mentions them.
+static bool collection_apply(Collection* collection, uint8_t op, const char* key, size_t len, Value* value) {
+    if (!collection->indexes || (op != WAL_OP_INSERT && op != WAL_OP_UPDATE && op != WAL_OP_DELETE)) {
+        return collection_write(collection, op, key, len, value);
+    }
+    if (op == WAL_OP_INSERT) {
+        if (!collection_insert(collection, key, len, value)) return false;
+        indexes_apply(collection, key, len, NULL, value);
+        return true;
+    }
+    
+    // The write may free the old document, so its entries are replaced first
+    const PageFile* file = &collection->db->file;
+    Value* before = btree_lookup(file, node_load(file, &collection->root), (const uint8_t*)key, len);
+    if (!before) return false;
+    indexes_apply(collection, key, len, before, value);
+    if (collection_write(collection, op, key, len, value)) return true;
+    indexes_apply(collection, key, len, value, before);
+    return false;
+}
+
+// Logs and applies a single write outside a transaction; it syncs with the next group
+static bool wal_write(Collection* collection, uint8_t op, const char* key, size_t len, Value* value) {
+    EghactDB* db = collection->db;
+    Wal* wal = &db->wal;
+
+    pthread_rwlock_rdlock(&db->checkpoint_lock);
+    pthread_mutex_lock(&wal->lock);
+
+    bool applied = false;
+    if (!wal->failed && wal_reserve(&wal->pending, WAL_FRAME_HEADER + wal_op_size(len, value)) &&
+        collection_apply(collection, op, key, len, value)) {
+        size_t start = wal_begin_frame(&wal->pending);
+        wal_put_op(&wal->pending, op, collection->id, key, len, value);
+        wal->appended_lsn += wal_end_frame(&wal->pending, start);
+        wal->commits++;
+        applied = true;
+    }
+
+    // Cached values are dropped only once readers can no longer find them in the tree
+    versions_publish(db);
+    if (applied && op != WAL_OP_INSERT) {
+        cache_invalidate(db->cache, collection, key, len);
+    }
+
+    pthread_mutex_unlock(&wal->lock);
+    pthread_rwlock_unlock(&db->checkpoint_lock);
+    return applied;
+}
+
+// Caller holds db->mutex and the log lock, so ids are handed out in log order
+static bool wal_log_create(EghactDB* db, const char* name, size_t len, uint32_t id) {
+    Wal* wal = &db->wal;
+    bool logged = !wal->failed && wal_reserve(&wal->pending, WAL_FRAME_HEADER + wal_op_size(len, NULL));
+    if (logged) {
+        size_t start = wal_begin_frame(&wal->pending);
+        wal_put_op(&wal->pending, WAL_OP_CREATE, id, name, len, NULL);
+        wal->appended_lsn += wal_end_frame(&wal->pending, start);
+        wal->commits++;
+    }
+    return logged;
+}
+
+// Background writer: syncs unsynced single writes and checkpoints a long log
+static void* wal_writer_main(void* arg) {
+    EghactDB* db = (EghactDB*)arg;
+    Wal* wal = &db->wal;
+
+    pthread_mutex_lock(&wal->lock);
+    while (!wal->stopping) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += WAL_FLUSH_INTERVAL_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&wal->wake, &wal->lock, &deadline);
+
+        if (wal->durable_lsn < wal->appended_lsn) {
+            wal_sync_locked(wal, wal->appended_lsn);
+        }
+        // Frees what readers have moved past even while no writes come in
+        if (db->writer.retired_count > 0) {
+            versions_reclaim(db);
+        }
+        if (!wal->stopping && !wal->failed && wal->file_size >= WAL_CHECKPOINT_BYTES) {
+            pthread_mutex_unlock(&wal->lock);
+            eghactdb_checkpoint(db);
+            pthread_mutex_lock(&wal->lock);
+        }
+    }
+    pthread_mutex_unlock(&wal->lock);
+    return NULL;
+}
+
+// Starts a new, empty log for the checkpoint with the given epoch
+static bool wal_reset(Wal* wal, uint64_t epoch) {
+    uint8_t header[WAL_HEADER_SIZE];
+    memcpy(header, WAL_MAGIC, 8);
+    for (int i = 0; i < 8; i++) header[8 + i] = (uint8_t)(epoch >> (8 * i));
+
+    bool ok = ftruncate(wal->fd, 0) == 0 && write_all(wal->fd, header, sizeof(header)) &&
+              sync_data(wal->fd) == 0;
+    if (ok) wal->file_size = 0;
+    return ok;
+}
+
+// Length of the valid frame at data, or 0 if it is torn or corrupt
+static size_t wal_frame_at(const uint8_t* data, size_t size, WalReader* payload) {
+    if (size < WAL_FRAME_HEADER) return 0;
+
+    WalReader header = { data, data + WAL_FRAME_HEADER };
+    uint64_t length, crc;
+    get_uint(&header, 4, &length);
+    get_uint(&header, 4, &crc);
+    if (length == 0 || length > size - WAL_FRAME_HEADER ||
+        crc32(data + WAL_FRAME_HEADER, (size_t)length) != crc) return 0;
+
+    payload->p = data + WAL_FRAME_HEADER;
+    payload->end = payload->p + length;
+    return WAL_FRAME_HEADER + (size_t)length;
+}
+
+static bool get_page(WalReader* frame, uint64_t* page_no, const uint8_t** image) {
+    uint64_t op;
+    if (!get_uint(frame, 1, &op) || op != WAL_OP_PAGE || !get_uint(frame, 4, page_no) ||
+        (size_t)(frame->end - frame->p) < PAGE_SIZE) return false;
+    *image = frame->p;
+    frame->p += PAGE_SIZE;
+    return true;
+}
+
+// Replays logged writes onto the trees. Stops at the first page image, torn or corrupt
+// frame, and returns the bytes consumed.
+static size_t wal_replay(EghactDB* db, const uint8_t* data, size_t size) {
+    size_t valid = 0;
+    size_t frame_len;
+    WalReader frame;
+    while ((frame_len = wal_frame_at(data + valid, size - valid, &frame)) > 0) {
+        if (*frame.p == WAL_OP_PAGE) break;  // A checkpoint that never finished
+
+        while (frame.p < frame.end) {
+            uint64_t op, id, key_len;
+            char key[MAX_KEY_SIZE + 1];
+            if (!get_uint(&frame, 1, &op) || !get_uint(&frame, 4, &id) || !get_uint(&frame, 2, &key_len) ||
+                key_len > MAX_KEY_SIZE || !get_bytes(&frame, key, (size_t)key_len)) break;
+            key[key_len] = '\0';
+
+            if (op == WAL_OP_CREATE) {
+                Collection* collection = collection_create(db, key, true);
+                if (!collection || collection->id != id) break;
+                continue;
+            }
+            if (id >= db->collection_count) break;
+
+            Value* value = NULL;
+            if (op == WAL_OP_INSERT || op == WAL_OP_UPDATE) {
+                value = wal_get_value(&frame);
+                if (!value) break;
+            }
+            if (!collection_apply(db->collections[id], (uint8_t)op, key, (size_t)key_len, value)) {
+                value_free(value);
+            }
+        }
+        valid += frame_len;
+    }
+    return valid;
+}
+
+// Page file
+//
+// <path> is an array of PAGE_SIZE pages, stored in native byte order. Page 0 is the
+// header. Every other page is a B+tree node written exactly as it sits in memory,
+// except that child pointers are page numbers and leaf values are offsets into the
+// leaf's value run: a few contiguous pages holding its values in the log's encoding.
+// A catalog run lists each collection's root and the free extents.
+//
+// Open reads the header and the catalog and maps the file privately. Nothing else is
+// read until a lookup first follows a reference into it, so open costs the same for
+// any size of database. Writes never touch the mapping's file; they modify nodes in
+// memory, mark them and their ancestors dirty and go to the log.
+//
+// A checkpoint walks only the dirty nodes:
+//   1. New nodes get pages. Dirty leaves rewrite their value run into free space, and
+//      a new catalog is written. No page the last checkpoint uses is touched.
+//   2. The dirty nodes and the new header are appended to the log and synced. This is
+//      the checkpoint's commit point.
+//   3. The same pages are written in place, synced, and the log starts over.
+// A crash during 3 is repaired on open by copying the images from the log again. Pages
+// freed since the last checkpoint are still part of its state, so they are only reused
+// by the checkpoint after the one that freed them.
+
+#define PAGE_FILE_MAGIC "EGDBPAGE"
+#define PAGE_FILE_VERSION 1
+#define CHECKPOINT_FRAME_PAGES 64
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t page_size;
+    uint64_t epoch;
+    uint32_t page_count;
+    uint32_t catalog_page;
+    uint32_t catalog_pages;
+    uint32_t catalog_crc;
+    uint64_t catalog_bytes;
+    uint32_t crc;  // Of everything above
+} PageFileHeader;
+
+static bool pwrite_all(int fd, const uint8_t* data, size_t length, uint64_t offset) {
+    while (length > 0) {
+        ssize_t written = pwrite(fd, data, length, (off_t)offset);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        length -= (size_t)written;
+        offset += (uint64_t)written;
+    }
+    return true;
+}
+
+static bool extent_push(PageExtent** list, size_t* count, size_t* capacity, uint32_t start, uint32_t pages) {
+    if (*count >= *capacity) {
+        size_t new_capacity = *capacity == 0 ? 16 : *capacity * 2;
+        PageExtent* extents = (PageExtent*)realloc(*list, new_capacity * sizeof(PageExtent));
+        if (!extents) return false;
+        *list = extents;
+        *capacity = new_capacity;
+    }
+    (*list)[(*count)++] = (PageExtent){ start, pages };
+    return true;
+}
+
+static int extent_compare(const void* a, const void* b) {
+    uint32_t x = ((const PageExtent*)a)->start, y = ((const PageExtent*)b)->start;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+// Pages dropped from the trees; if the list can't grow they are simply never reused
+static void page_release(PageFile* file, uint32_t start, uint32_t pages) {
+    pthread_mutex_lock(&file->lock);
+    extent_push(&file->released, &file->released_count, &file->released_capacity, start, pages);
+    pthread_mutex_unlock(&file->lock);
+}
+
+// First fit from the free extents, otherwise grows the file
+static uint32_t page_alloc(PageFile* file, uint32_t pages) {
+    for (size_t i = 0; i < file->free_count; i++) {
+        PageExtent* extent = &file->free[i];
+        if (extent->pages < pages) continue;
+        uint32_t start = extent->start;
+        extent->start += pages;
+        extent->pages -= pages;
+        if (extent->pages == 0) {
+            memmove(extent, extent + 1, (file->free_count - i - 1) * sizeof(PageExtent));
+            file->free_count--;
+        }
+        return start;
+    }
+    uint32_t start = file->page_count;
+    file->page_count += pages;
+    return start;
+}
+
+// Makes released pages reusable and coalesces neighbouring extents
+static void page_merge_released(PageFile* file) {
+    for (size_t i = 0; i < file->released_count; i++) {
+        PageExtent extent = file->released[i];
+        if (!extent_push(&file->free, &file->free_count, &file->free_capacity, extent.start, extent.pages)) break;
+    }
+    file->released_count = 0;
+    if (file->free_count == 0) return;
+
+    qsort(file->free, file->free_count, sizeof(PageExtent), extent_compare);
+    size_t merged = 0;
+    for (size_t i = 1; i < file->free_count; i++) {
+        PageExtent* last = &file->free[merged];
+        if (last->start + last->pages == file->free[i].start) {
+            last->pages += file->free[i].pages;
+        } else {
+            file->free[++merged] = file->free[i];
+        }
+    }
+    file->free_count = merged + 1;
+}
+
+static inline uint32_t ref_page(const BTreeNode* ref) {
+    return ref_on_disk(ref) ? (uint32_t)ref_location(ref) : ref->page_no;
+}
+
+// Value in a leaf slot, decoded from the mapping on first use. Readers can race to
+// decode the same value; the loser frees its copy.
+static Value* slot_value(const PageFile* file, BTreeSlot* slot) {
+    Value* value = __atomic_load_n(&slot->ptr.value, __ATOMIC_ACQUIRE);
+    if (!ref_on_disk(value)) return value;
+
+    uint64_t offset = ref_location(value);
+    WalReader reader = { file->map + offset, file->map + file->map_length };
+    Value* decoded = offset < file->map_length ? wal_get_value(&reader) : NULL;
+    if (!decoded) {
+        fprintf(stderr, "eghactdb: corrupt value at offset %llu\n", (unsigned long long)offset);
+        decoded = value_null();
+    }
+    if (__atomic_compare_exchange_n(&slot->ptr.value, &value, decoded, false,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return decoded;
+    }
+    value_free(decoded);
+    return value;
+}
+
+// Page image of a node. Readers may be swapping references in the live node, so those
+// are read atomically and the rest is copied around them.
+static void node_image(const BTreeNode* node, uint8_t* out) {
+    size_t slots_end = BTREE_HEADER_SIZE + node->num_keys * sizeof(BTreeSlot);
+    memcpy(out, node, offsetof(BTreeNode, first_child));
+    memset(out + slots_end, 0, node->heap_start - slots_end);
+    memcpy(out + node->heap_start, node_bytes(node) + node->heap_start, PAGE_SIZE - node->heap_start);
+
+    BTreeNode* image = (BTreeNode*)out;
+    image->dirty = false;
+    image->first_child = NULL;
+    if (!node->is_leaf) {
+        image->first_child = (BTreeNode*)disk_ref(ref_page(__atomic_load_n(&node->first_child, __ATOMIC_ACQUIRE)));
+    }
+
+    uint64_t offset = (uint64_t)node->run_page * PAGE_SIZE;
+    for (uint16_t i = 0; i < node->num_keys; i++) {
+        const BTreeSlot* slot = &node->slots[i];
+        BTreeSlot* copy = &image->slots[i];
+        copy->head = slot->head;
+        copy->offset = slot->offset;
+        copy->length = slot->length;
+        if (node->is_leaf) {
+            copy->ptr.value = (Value*)disk_ref(offset);
+            offset += wal_value_size(__atomic_load_n(&slot->ptr.value, __ATOMIC_ACQUIRE));
+        } else {
+            copy->ptr.child = (BTreeNode*)disk_ref(ref_page(__atomic_load_n(&slot->ptr.child, __ATOMIC_ACQUIRE)));
+        }
+    }
+}
+
+// Dirty nodes below and including node, children first
+static bool checkpoint_collect(NodeList* list, BTreeNode* node) {
+    if (!node->is_leaf) {
+        for (int i = -1; i < node->num_keys; i++) {
+            BTreeNode* child = __atomic_load_n(i < 0 ? &node->first_child : &node->slots[i].ptr.child,
+                                               __ATOMIC_ACQUIRE);
+            if (!ref_on_disk(child) && child->dirty && !checkpoint_collect(list, child)) return false;
+        }
+    }
+    return node_list_push(list, node);
+}
+
+// Moves a dirty leaf's values to a new run. Values still on disk are decoded first,
+// because the old run is reused once this checkpoint is followed by another.
+static bool leaf_write_values(PageFile* file, BTreeNode* leaf, WalBuffer* buffer) {
+    size_t bytes = 0;
+    for (uint16_t i = 0; i < leaf->num_keys; i++) {
+        bytes += wal_value_size(slot_value(file, &leaf->slots[i]));
+    }
+
+    if (leaf->run_pages) page_release(file, leaf->run_page, leaf->run_pages);
+    uint32_t pages = (uint32_t)((bytes + PAGE_SIZE - 1) / PAGE_SIZE);
+    leaf->run_page = pages ? page_alloc(file, pages) : 0;
+    leaf->run_pages = pages;
+    if (pages == 0) return true;
+
+    buffer->length = 0;
+    if (!wal_reserve(buffer, (size_t)pages * PAGE_SIZE)) return false;
+    for (uint16_t i = 0; i < leaf->num_keys; i++) {
+        wal_put_value(buffer, leaf->slots[i].ptr.value);
+    }
+    memset(buffer->data + buffer->length, 0, (size_t)pages * PAGE_SIZE - buffer->length);
+    return pwrite_all(file->fd, buffer->data, (size_t)pages * PAGE_SIZE, (uint64_t)leaf->run_page * PAGE_SIZE);
+}
+
+// Writes collection roots and free extents to a new run recorded in header
+static bool catalog_write(EghactDB* db, WalBuffer* buffer, PageFileHeader* header) {
+    PageFile* file = &db->file;
+    if (file->catalog_pages) page_release(file, file->catalog_page, file->catalog_pages);
+
+    size_t bytes = 8 + (file->free_count + file->released_count) * 8;
+    for (size_t i = 0; i < db->collection_count; i++) {
+        bytes += 2 + strlen(db->collections[i]->name) + 4 + 8;
+    }
+    uint32_t pages = (uint32_t)((bytes + PAGE_SIZE - 1) / PAGE_SIZE);
+    file->catalog_page = page_alloc(file, pages);
+    file->catalog_pages = pages;
+
+    buffer->length = 0;
+    if (!wal_reserve(buffer, (size_t)pages * PAGE_SIZE)) return false;
+    put_u32(buffer, (uint32_t)db->collection_count);
+    for (size_t i = 0; i < db->collection_count; i++) {
+        Collection* collection = db->collections[i];
+        BTreeNode* root = __atomic_load_n(&collection->root, __ATOMIC_ACQUIRE);
+        size_t name_len = strlen(collection->name);
+        put_u16(buffer, (uint16_t)name_len);
+        put_bytes(buffer, collection->name, name_len);
+        put_u32(buffer, root ? ref_page(root) : 0);
+        put_u64(buffer, collection->count);
+    }
+
+    // Everything released so far is free in the state this catalog describes
+    put_u32(buffer, (uint32_t)(file->free_count + file->released_count));
+    for (size_t i = 0; i < file->free_count; i++) {
+        put_u32(buffer, file->free[i].start);
+        put_u32(buffer, file->free[i].pages);
+    }
+    for (size_t i = 0; i < file->released_count; i++) {
+        put_u32(buffer, file->released[i].start);
+        put_u32(buffer, file->released[i].pages);
+    }
+
+    header->catalog_page = file->catalog_page;
+    header->catalog_pages = pages;
+    header->catalog_bytes = buffer->length;
+    header->catalog_crc = crc32(buffer->data, buffer->length);
+    memset(buffer->data + buffer->length, 0, (size_t)pages * PAGE_SIZE - buffer->length);
+    return pwrite_all(file->fd, buffer->data, (size_t)pages * PAGE_SIZE, (uint64_t)file->catalog_page * PAGE_SIZE);
+}
+
+static void header_image(const PageFileHeader* header, uint8_t* out) {
+    memset(out, 0, PAGE_SIZE);
+    memcpy(out, header, sizeof(*header));
+    PageFileHeader* copy = (PageFileHeader*)out;
+    copy->crc = crc32(out, offsetof(PageFileHeader, crc));
+}
+
+// Appends a page image op; caller reserved room for it
+static void wal_put_page(WalBuffer* buffer, uint32_t page_no, const uint8_t* image) {
+    put_u8(buffer, WAL_OP_PAGE);
+    put_u32(buffer, page_no);
+    put_bytes(buffer, image, PAGE_SIZE);
+}
+
+// Logs the images of every dirty node, then the header, and syncs; the header frame
+// commits the checkpoint. Caller holds the log lock.
+static bool checkpoint_log_pages(Wal* wal, const NodeList* dirty, const uint8_t* header,
+                                 WalBuffer* buffer, uint8_t* image) {
+    size_t op_size = 1 + 4 + PAGE_SIZE;
+    bool ok = true;
+    for (size_t i = 0; ok && i < dirty->count; i += CHECKPOINT_FRAME_PAGES) {
+        size_t end = i + CHECKPOINT_FRAME_PAGES < dirty->count ? i + CHECKPOINT_FRAME_PAGES : dirty->count;
+        buffer->length = 0;
+        ok = wal_reserve(buffer, WAL_FRAME_HEADER + (end - i) * op_size);
+        if (!ok) break;
+        size_t start = wal_begin_frame(buffer);
+        for (size_t j = i; j < end; j++) {
+            node_image(dirty->nodes[j], image);
+            wal_put_page(buffer, dirty->nodes[j]->page_no, image);
+        }
+        wal_end_frame(buffer, start);
+        ok = write_all(wal->fd, buffer->data, buffer->length);
+    }
+
+    buffer->length = 0;
+    ok = ok && wal_reserve(buffer, WAL_FRAME_HEADER + op_size);
+    if (ok) {
+        size_t start = wal_begin_frame(buffer);
+        wal_put_page(buffer, 0, header);
+        wal_end_frame(buffer, start);
+        ok = write_all(wal->fd, buffer->data, buffer->length);
+    }
+    return ok && sync_data(wal->fd) == 0;
+}
+
+// Writes the pages changed since the last checkpoint to the page file and starts a
+// new log. Caller holds checkpoint_lock exclusively.
+static bool checkpoint_locked(EghactDB* db) {
+    PageFile* file = &db->file;
+    Wal* wal = &db->wal;
+
+    pthread_mutex_lock(&wal->lock);
+    bool ok = wal_sync_locked(wal, wal->appended_lsn);
+    uint64_t log_size = wal->file_size;
+    pthread_mutex_unlock(&wal->lock);
+
+    // Collections can't be created meanwhile; that takes checkpoint_lock too
+    NodeList dirty = { NULL, 0, 0 };
+    for (size_t i = 0; ok && i < db->collection_count; i++) {
+        BTreeNode* root = __atomic_load_n(&db->collections[i]->root, __ATOMIC_ACQUIRE);
+        if (root && !ref_on_disk(root) && root->dirty) {
+            ok = checkpoint_collect(&dirty, root);
+        }
+    }
+
+    // Every change is logged, so an empty log means there is nothing to write
+    if (ok && dirty.count == 0 && log_size == 0) return true;
+
+    // 1: new space
+    WalBuffer buffer = { NULL, 0, 0 };
+    for (size_t i = 0; ok && i < dirty.count; i++) {
+        if (!dirty.nodes[i]->page_no) dirty.nodes[i]->page_no = page_alloc(file, 1);
+    }
+    for (size_t i = 0; ok && i < dirty.count; i++) {
+        if (dirty.nodes[i]->is_leaf) ok = leaf_write_values(file, dirty.nodes[i], &buffer);
+    }
+    PageFileHeader header;
+    memset(&header, 0, sizeof(header));
+    ok = ok && catalog_write(db, &buffer, &header);
+    ok = ok && sync_data(file->fd) == 0;
+
+    memcpy(header.magic, PAGE_FILE_MAGIC, 8);
+    header.version = PAGE_FILE_VERSION;
+    header.page_size = PAGE_SIZE;
+    header.epoch = file->epoch + 1;
+    header.page_count = file->page_count;
+    _Alignas(16) uint8_t header_page[PAGE_SIZE];
+    _Alignas(16) uint8_t image[PAGE_SIZE];
+    header_image(&header, header_page);
+
+    // 2: commit through the log
+    bool committed = false;
+    if (ok) {
+        pthread_mutex_lock(&wal->lock);
+        committed = checkpoint_log_pages(wal, &dirty, header_page, &buffer, image);
+        if (!committed && ftruncate(wal->fd, (off_t)(WAL_HEADER_SIZE + log_size)) != 0) {
+            wal->failed = true;  // Later frames would follow a half-written checkpoint
+        }
+        pthread_mutex_unlock(&wal->lock);
+        ok = committed;
+    }
+
+    // 3: in place
+    for (size_t i = 0; ok && i < dirty.count; i++) {
+        node_image(dirty.nodes[i], image);
+        ok = pwrite_all(file->fd, image, PAGE_SIZE, (uint64_t)dirty.nodes[i]->page_no * PAGE_SIZE);
+    }
+    ok = ok && pwrite_all(file->fd, header_page, PAGE_SIZE, 0) && sync_data(file->fd) == 0;
+
+    if (committed) {
+        pthread_mutex_lock(&wal->lock);
+        ok = ok && wal_reset(wal, header.epoch);
+        if (!ok) {
+            wal->failed = true;  // The log must end with this checkpoint for recovery
+        }
+        pthread_mutex_unlock(&wal->lock);
+    }
+
+    if (ok) {
+        for (size_t i = 0; i < dirty.count; i++) {
+            dirty.nodes[i]->dirty = false;
+        }
+        file->epoch = header.epoch;
+        page_merge_released(file);
+    }
+
+    free(dirty.nodes);
+    free(buffer.data);
+    return ok;
+}
+
+// Writers wait for a checkpoint; readers keep going
+bool eghactdb_checkpoint(EghactDB* db) {
+    if (!db) return false;
+    pthread_rwlock_wrlock(&db->checkpoint_lock);
+    bool ok = checkpoint_locked(db);
+    pthread_rwlock_unlock(&db->checkpoint_lock);
+    return ok;
+}
+
+// Copies the page images of a checkpoint whose header image reached the log into the
+// page file. Returns 1 if it did, 0 if there was none, -1 on a write error.
+static int wal_restore_pages(PageFile* file, const uint8_t* data, size_t size) {
+    size_t valid = 0, first = SIZE_MAX, commit = 0;
+    size_t frame_len;
+    WalReader frame;
+    while ((frame_len = wal_frame_at(data + valid, size - valid, &frame)) > 0) {
+        if (*frame.p == WAL_OP_PAGE) {
+            if (first == SIZE_MAX) first = valid;
+            uint64_t page_no;
+            const uint8_t* image;
+            while (get_page(&frame, &page_no, &image)) {
+                if (page_no == 0) commit = valid + frame_len;
+            }
+        }
+        valid += frame_len;
+    }
+    if (commit == 0) return 0;
+
+    for (valid = first; valid < commit; valid += frame_len) {
+        frame_len = wal_frame_at(data + valid, size - valid, &frame);
+        uint64_t page_no;
+        const uint8_t* image;
+        while (get_page(&frame, &page_no, &image)) {
+            if (!pwrite_all(file->fd, image, PAGE_SIZE, page_no * PAGE_SIZE)) return -1;
+        }
+    }
+    return sync_data(file->fd) == 0 ? 1 : -1;
+}
+
+// Reads and checks the header; an empty file becomes a new database
+static bool pagefile_read_header(PageFile* file, PageFileHeader* header) {
+    struct stat st;
+    if (fstat(file->fd, &st) != 0) return false;
+
+    if (st.st_size == 0) {
+        _Alignas(16) uint8_t page[PAGE_SIZE];
+        memset(header, 0, sizeof(*header));
+        memcpy(header->magic, PAGE_FILE_MAGIC, 8);
+        header->version = PAGE_FILE_VERSION;
+        header->page_size = PAGE_SIZE;
+        header->page_count = 1;
+        header_image(header, page);
+        return pwrite_all(file->fd, page, PAGE_SIZE, 0) && sync_data(file->fd) == 0;
+    }
+
+    return pread(file->fd, header, sizeof(*header), 0) == (ssize_t)sizeof(*header) &&
+           memcmp(header->magic, PAGE_FILE_MAGIC, 8) == 0 &&
+           header->version == PAGE_FILE_VERSION && header->page_size == PAGE_SIZE &&
+           header->crc == crc32((const uint8_t*)header, offsetof(PageFileHeader, crc));
+}
+
+// Creates the collections listed in the catalog with their roots still on disk
+static bool catalog_load(EghactDB* db, const PageFileHeader* header) {
+    PageFile* file = &db->file;
+    file->catalog_page = header->catalog_page;
+    file->catalog_pages = header->catalog_pages;
+    if (header->catalog_pages == 0) return true;
+
+    uint64_t start = (uint64_t)header->catalog_page * PAGE_SIZE;
+    if (start + header->catalog_bytes > file->map_length) return false;
+    const uint8_t* data = file->map + start;
+    if (crc32(data, (size_t)header->catalog_bytes) != header->catalog_crc) return false;
+
+    WalReader reader = { data, data + header->catalog_bytes };
+    uint64_t count;
+    if (!get_uint(&reader, 4, &count)) return false;
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t name_len, root, keys;
+        char name[MAX_KEY_SIZE + 1];
+        if (!get_uint(&reader, 2, &name_len) || name_len > MAX_KEY_SIZE ||
+            !get_bytes(&reader, name, (size_t)name_len) ||
+            !get_uint(&reader, 4, &root) || !get_uint(&reader, 8, &keys)) return false;
+        name[name_len] = '\0';
+
+        Collection* collection = collection_create(db, name, false);
+        if (!collection || collection->id != i) return false;
+        collection->root = root ? (BTreeNode*)disk_ref(root) : NULL;
+        collection->count = (size_t)keys;
+    }
+
+    if (!get_uint(&reader, 4, &count)) return false;
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t first, pages;
+        if (!get_uint(&reader, 4, &first) || !get_uint(&reader, 4, &pages)) return false;
+        page_release(file, (uint32_t)first, (uint32_t)pages);
+    }
+    page_merge_released(file);
+    return true;
+}
+
+static uint8_t* read_file(const char* path, size_t* size) {
+    *size = 0;
+    FILE* file = fopen(path, "rb");
+    if (!file) return NULL;
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t* data = length > 0 ? (uint8_t*)malloc((size_t)length) : NULL;
+    if (data && fread(data, 1, (size_t)length, file) == (size_t)length) {
+        *size = (size_t)length;
+    } else {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    return data;
+}
+
+// Finishes an interrupted checkpoint, maps the page file and replays the log onto it.
+// On any failure the database stays empty and refuses writes.
+static void storage_open(EghactDB* db) {
+    PageFile* file = &db->file;
+    Wal* wal = &db->wal;
+    pthread_mutex_init(&file->lock, NULL);
+    pthread_mutex_init(&wal->lock, NULL);
+    pthread_cond_init(&wal->flushed, NULL);
+    pthread_cond_init(&wal->wake, NULL);
+    pthread_rwlock_init(&db->checkpoint_lock, NULL);
+    file->fd = -1;
+    wal->fd = -1;
+    wal->failed = true;
+
+    size_t path_len = strlen(db->path);
+    char* wal_path = (char*)malloc(path_len + 5);
+    if (!wal_path) return;
+    memcpy(wal_path, db->path, path_len);
+    memcpy(wal_path + path_len, "-wal", 5);
+
+    size_t log_size;
+    uint8_t* log = read_file(wal_path, &log_size);
+    bool log_valid = log_size >= WAL_HEADER_SIZE && memcmp(log, WAL_MAGIC, 8) == 0;
+    uint64_t log_epoch = 0;
+    if (log_valid) {
+        WalReader reader = { log + 8, log + WAL_HEADER_SIZE };
+        get_uint(&reader, 8, &log_epoch);
+    }
+    const uint8_t* frames = log_valid ? log + WAL_HEADER_SIZE : NULL;
+    size_t frames_size = log_valid ? log_size - WAL_HEADER_SIZE : 0;
+
+    PageFileHeader header;
+    file->fd = open(db->path, O_RDWR | O_CREAT, 0644);
+    int restored = file->fd >= 0 && log_valid ? wal_restore_pages(file, frames, frames_size) : 0;
+    bool ok = file->fd >= 0 && restored >= 0 && pagefile_read_header(file, &header);
+
+    // Pages past the header's count belong to a checkpoint that never committed
+    uint64_t length = ok ? (uint64_t)header.page_count * PAGE_SIZE : 0;
+    struct stat st;
+    ok = ok && fstat(file->fd, &st) == 0 && ((uint64_t)st.st_size == length || ftruncate(file->fd, (off_t)length) == 0);
+    if (ok) {
+        file->map = (uint8_t*)mmap(NULL, (size_t)length, PROT_READ | PROT_WRITE, MAP_PRIVATE, file->fd, 0);
+        ok = file->map != MAP_FAILED;
+        if (!ok) file->map = NULL;
+        file->map_length = ok ? (size_t)length : 0;
+        
+        // Lookups jump between pages; readahead would mostly fetch ones nobody asked for
+        if (ok) madvise(file->map, file->map_length, MADV_RANDOM);
+    }
+    if (ok) {
+        file->epoch = header.epoch;
+        file->page_count = header.page_count;
+        db->replaying = true;
+        ok = catalog_load(db, &header);
+    }
+
+    // The log only applies on top of the checkpoint it started from
+    size_t replayed = 0;
+    bool keep_log = ok && restored == 0 && log_valid && log_epoch == header.epoch;
+    if (keep_log) replayed = wal_replay(db, frames, frames_size);
+    db->replaying = false;
+    free(log);
+
+    if (ok) {
+        wal->fd = open(wal_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        ok = wal->fd >= 0;
+    }
+    if (ok && keep_log) {
+        // Drop a torn tail so new frames follow the last good one
+        ok = ftruncate(wal->fd, (off_t)(WAL_HEADER_SIZE + replayed)) == 0;
+        wal->file_size = replayed;
+    } else if (ok) {
+        ok = wal_reset(wal, header.epoch);
+    }
+    free(wal_path);
+
+    if (!ok) {
+        fprintf(stderr, "eghactdb: cannot open %s\n", db->path);
+        return;
+    }
+    wal->failed = false;
+    wal->has_thread = pthread_create(&wal->thread, NULL, wal_writer_main, db) == 0;
+}
+
+static void storage_close(EghactDB* db) {
+    PageFile* file = &db->file;
+    Wal* wal = &db->wal;
+    if (wal->has_thread) {
+        pthread_mutex_lock(&wal->lock);
+        wal->stopping = true;
+        pthread_cond_signal(&wal->wake);
+        pthread_mutex_unlock(&wal->lock);
+        pthread_join(wal->thread, NULL);
+    }
+
+    if (!wal->failed) {
+        eghactdb_checkpoint(db);
+    }
+    if (wal->fd >= 0) close(wal->fd);
+    if (file->fd >= 0) close(file->fd);
+
+    free(wal->pending.data);
+    free(wal->writing.data);
+    free(file->free);
+    free(file->released);
+    pthread_cond_destroy(&wal->wake);
+    pthread_cond_destroy(&wal->flushed);
+    pthread_mutex_destroy(&wal->lock);
+    pthread_mutex_destroy(&file->lock);
+    pthread_rwlock_destroy(&db->checkpoint_lock);
+}
+
+void eghactdb_get_wal_stats(EghactDB* db, EghactWalStats* stats) {
+    if (!db || !stats) return;
+    pthread_mutex_lock(&db->wal.lock);
+    stats->commits = db->wal.commits;
+    stats->syncs = db->wal.syncs;
+    stats->log_bytes = db->wal.file_size;
+    stats->pending_bytes = db->wal.appended_lsn - db->wal.durable_lsn;
+    pthread_mutex_unlock(&db->wal.lock);
+}
+
+// Insert into collection; on success the collection owns value
+bool eghactdb_insert(Collection* collection, const char* key, Value* value) {
+    if (!collection || !key || !value) return false;
+    size_t len = strlen(key);
+    if (len > MAX_KEY_SIZE) return false;
+    EGHACT_PERF_ADD(perf_db_inserts, 1);
+    
+    return wal_write(collection, WAL_OP_INSERT, key, len, value);
+}
+
+// Get from collection; returns a copy the caller frees with value_free. A concurrent
+// write may retire the stored value as soon as the read ends, so it is copied while
+// pinned. To read without copying, use eghactdb_tx_get.
+Value* eghactdb_get(Collection* collection, const char* key) {
+    if (!collection || !key) return NULL;
+    EGHACT_PERF_ADD(perf_db_gets, 1);
+    
+    size_t len = strlen(key);
+    EghactDB* db = collection->db;
+    CacheShard* cache = db->cache;
+    uint32_t hash = cache_hash(collection, key, len);
+    _Atomic uint64_t* pin = read_begin(db);
+    
+    Value* result = cache_lookup(cache, collection, key, len, hash);
+    if (!result) {
+        uint64_t writes = atomic_load(&collection->writes);
+        const PageFile* file = &db->file;
+        result = btree_lookup(file, version_root(file, version_current(db), collection), (const uint8_t*)key, len);
+        if (result) {
+            cache_fill(cache, collection, key, len, hash, result, writes);
+        }
+    }
+    Value* copy = result ? value_clone(result) : NULL;
+    
+    read_end(pin);
+    
+    return copy;
+}
+
+// Replace the value of an existing key; the old value is freed
+bool eghactdb_update(Collection* collection, const char* key, Value* value) {
+    if (!collection || !key || !value) return false;
+    size_t len = strlen(key);
+    if (len > MAX_KEY_SIZE) return false;
+    
+    return wal_write(collection, WAL_OP_UPDATE, key, len, value);
+}
+
+bool eghactdb_delete(Collection* collection, const char* key) {
+    if (!collection || !key) return false;
+    size_t len = strlen(key);
+    if (len > MAX_KEY_SIZE) return false;
+    
+    return wal_write(collection, WAL_OP_DELETE, key, len, NULL);
+}
+
+// Without values, fn gets NULL instead and nothing is decoded from the page file
+static size_t btree_scan(const PageFile* file, BTreeNode* root, const char* start, const char* end,
+                         bool values, EghactScanFn fn, void* user_data) {
+    BTreePath path;
+    BTreeNode* leaf = root;
+    uint16_t pos = 0;
+    if (leaf) {
+        size_t start_len = start ? strlen(start) : 0;
+        leaf = btree_find_leaf(file, leaf, (const uint8_t*)(start ? start : ""), start_len, &path);
+        bool found;
+        pos = node_lower_bound(leaf, (const uint8_t*)(start ? start : ""), start_len, &found);
+    }
+    
+    size_t visited = 0;
+    size_t end_len = end ? strlen(end) : 0;
+    uint8_t key[BTREE_KEY_MAX + 1];
+    bool more = true;
+    for (; leaf && more; leaf = btree_next_leaf(file, &path), pos = 0) {
+        for (; pos < leaf->num_keys && more; pos++) {
+            size_t len = node_key(leaf, pos, key);
+            if (end) {
+                int cmp = memcmp(key, end, len < end_len ? len : end_len);
+                if (cmp > 0 || (cmp == 0 && len >= end_len)) break;
+            }
+            key[len] = '\0';
+            visited++;
+            more = fn((const char*)key, len, values ? slot_value(file, &leaf->slots[pos]) : NULL, user_data);
+        }
+        if (pos < leaf->num_keys) break;
+    }
+    return visited;
+}
+
+// Visit keys in [start, end) in order; NULL bounds are open. The scan sees the
+// collection as it was when it started, and fn may write to it meanwhile.
+size_t eghactdb_scan(Collection* collection, const char* start, const char* end,
+                     EghactScanFn fn, void* user_data) {
+    if (!collection || !fn) return 0;
+    
+    EghactDB* db = collection->db;
+    _Atomic uint64_t* pin = read_begin(db);
+    size_t visited = btree_scan(&db->file, version_root(&db->file, version_current(db), collection),
+                                start, end, true, fn, user_data);
+    read_end(pin);
+    return visited;
+}
+
+// Secondary indexes
+//
+// Documents are string values holding a JSON object. An index on a field is a hidden
+// collection whose keys are the field's value, encoded so that bytewise order is value
+// order, followed by the document's key. It sits in db->collections like any other
+// tree, so it is copied on write, published, checkpointed and reclaimed along with the
+// collection it covers, and a reader of one version always sees the two agree. Entries
+// change in collection_apply under the log lock. Replay rebuilds them from the logged
+// documents, and the log entry that creates an index fills it from the collection as it
+// was at that point, so index entries are never logged themselves.
+//
+// Encoded terms start with a kind tag and never hold a NUL byte. Numbers are the bits
+// of the double, flipped to sort as unsigned and spread 7 to a byte. String bytes up to
+// 2 are escaped, and a 1 ends the string: it sorts below every byte left, so a string
+// sorts before its extensions. Strings are cut at INDEX_TERM_MAX, which keeps order but
+// not equality, so every candidate an index returns is checked against the document.
+
+enum {
+    TERM_NULL = 0x10,
+    TERM_FALSE = 0x20,
+    TERM_TRUE,
+    TERM_NUMBER = 0x30,
+    TERM_STRING = 0x40
+};
+
+#define TERM_NUMBER_SIZE 11
+
+// Scalar in a document; kind is 0 for objects and arrays
+typedef struct {
+    uint8_t kind;      // TERM_*
+    bool escaped;      // String holds backslash escapes
+    double number;
+    const char* text;  // String: contents between the quotes, as written
+    size_t length;
+} JsonTerm;
+
+static inline const char* json_ws(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+    return p;
+}
+
+// Closing quote of the string whose contents start at p, or NULL. memchr jumps to
+// each quote; one after an odd run of backslashes is part of the string.
+static const char* json_string_end(const char* p, const char* end, bool* escaped) {
+    const char* start = p;
+    for (;;) {
+        const char* quote = (const char*)memchr(p, '"', (size_t)(end - p));
+        if (!quote) return NULL;
+        const char* run = quote;
+        while (run > start && run[-1] == '\\') run--;
+        if (((quote - run) & 1) == 0) {
+            if (!*escaped && memchr(start, '\\', (size_t)(quote - start))) *escaped = true;
+            return quote;
+        }
+        p = quote + 1;
+    }
+}
+
+// End of the value starting at p, or NULL if it is malformed
+static const char* json_skip(const char* p, const char* end) {
+    bool escaped = false;
+    if (p >= end) return NULL;
+    if (*p == '"') {
+        p = json_string_end(p + 1, end, &escaped);
+        return p ? p + 1 : NULL;
+    }
+    if (*p == '{' || *p == '[') {
+        int depth = 0;
+        for (; p < end; p++) {
+            if (*p == '"') {
+                p = json_string_end(p + 1, end, &escaped);
+                if (!p) return NULL;
+            } else if (*p == '{' || *p == '[') {
+                depth++;
+            } else if ((*p == '}' || *p == ']') && --depth == 0) {
+                return p + 1;
+            }
+        }
+        return NULL;
+    }
+    while (p < end && *p != ',' && *p != '}' && *p != ']' && *p != ' ' &&
+           *p != '\t' && *p != '\n' && *p != '\r') p++;
+    return p;
+}
+
+// Up to 15 digits and a power of ten up to 22 are both exact doubles, so one multiply
+// or divide rounds correctly. Anything longer goes to strtod.
+static bool json_number(const char* p, const char* end, double* out) {
+    static const double powers[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const char* q = p;
+    bool negative = q < end && *q == '-';
+    if (negative) q++;
+
+    uint64_t mantissa = 0;
+    int digits = 0, scale = 0;
+    for (; q < end && *q >= '0' && *q <= '9'; q++, digits++) mantissa = mantissa * 10 + (uint64_t)(*q - '0');
+    if (q < end && *q == '.') {
+        for (q++; q < end && *q >= '0' && *q <= '9'; q++, digits++, scale--) {
+            mantissa = mantissa * 10 + (uint64_t)(*q - '0');
+        }
+    }
+    if (digits > 0 && digits <= 15 && (q >= end || (*q != 'e' && *q != 'E')) && scale >= -22) {
+        double x = scale < 0 ? (double)mantissa / powers[-scale] : (double)mantissa;
+        *out = negative ? -x : x;
+        return true;
+    }
+
+    // Document strings are NUL terminated, so strtod stops in time
+    char* stop;
+    *out = strtod(p, &stop);
+    return stop > p && stop <= end;
+}
+
+static bool json_scalar(const char* p, const char* end, JsonTerm* term) {
+    term->kind = 0;
+    term->escaped = false;
+    if (p >= end) return false;
+    switch (*p) {
+        case '"': {
+            const char* close = json_string_end(p + 1, end, &term->escaped);
+            if (!close) return false;
+            term->kind = TERM_STRING;
+            term->text = p + 1;
+            term->length = (size_t)(close - term->text);
+            return true;
+        }
+        case 't':
+            term->kind = TERM_TRUE;
+            return end - p >= 4 && memcmp(p, "true", 4) == 0;
+        case 'f':
+            term->kind = TERM_FALSE;
+            return end - p >= 5 && memcmp(p, "false", 5) == 0;
+        case 'n':
+            term->kind = TERM_NULL;
+            return end - p >= 4 && memcmp(p, "null", 4) == 0;
+        case '{':
+        case '[':
+            return true;
+        default:
+            if (*p != '-' && (*p < '0' || *p > '9')) return false;
+            term->kind = TERM_NUMBER;
+            return json_number(p, end, &term->number);
+    }
+}
+
+// Value at a dotted path of object fields. Names are compared as written, escapes
+// and all.
+static bool json_field(const char* p, const char* end, const char* path, size_t path_len, JsonTerm* term) {
+    for (;;) {
+        const char* dot = (const char*)memchr(path, '.', path_len);
+        size_t name_len = dot ? (size_t)(dot - path) : path_len;
+        p = json_ws(p, end);
+        if (p >= end || *p != '{') return false;
+        p = json_ws(p + 1, end);
+        for (;;) {
+            if (p >= end || *p != '"') return false;
+            bool escaped = false;
+            const char* name = p + 1;
+            const char* name_end = json_string_end(name, end, &escaped);
+            if (!name_end) return false;
+            p = json_ws(name_end + 1, end);
+            if (p >= end || *p != ':') return false;
+            p = json_ws(p + 1, end);
+            if ((size_t)(name_end - name) == name_len && memcmp(name, path, name_len) == 0) break;
+
+            p = json_skip(p, end);
+            if (!p) return false;
+            p = json_ws(p, end);
+            if (p >= end || *p != ',') return false;
+            p = json_ws(p + 1, end);
+        }
+        if (!dot) return json_scalar(p, end, term);
+        path_len -= name_len + 1;
+        path = dot + 1;
+    }
+}
+
+static bool json_hex4(const char* p, uint32_t* out) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9') v |= (uint32_t)(c - '0');
+        else if (c >= 'a' && c <= 'f') v |= (uint32_t)(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') v |= (uint32_t)(c - 'A' + 10);
+        else return false;
+    }
+    *out = v;
+    return true;
+}
+
+// Decodes up to limit bytes of an escaped string as UTF-8; never longer than length
+static size_t json_unescape(const char* p, size_t length, char* out, size_t limit) {
+    const char* end = p + length;
+    size_t n = 0;
+    while (p < end && n < limit) {
+        if (*p != '\\') {
+            out[n++] = *p++;
+            continue;
+        }
+        if (++p >= end) break;
+        uint32_t cp;
+        switch (*p++) {
+            case 'b': cp = '\b'; break;
+            case 'f': cp = '\f'; break;
+            case 'n': cp = '\n'; break;
+            case 'r': cp = '\r'; break;
+            case 't': cp = '\t'; break;
+            case 'u': {
+                if (end - p < 4 || !json_hex4(p, &cp)) return n;
+                p += 4;
+                uint32_t low;
+                if (cp >= 0xD800 && cp < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u' &&
+                    json_hex4(p + 2, &low) && low >= 0xDC00 && low < 0xE000) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    p += 6;
+                }
+                break;
+            }
+            default:
+                cp = (uint8_t)p[-1];
+                break;
+        }
+
+        char utf8[4];
+        size_t bytes;
+        if (cp < 0x80) {
+            utf8[0] = (char)cp;
+            bytes = 1;
+        } else if (cp < 0x800) {
+            utf8[0] = (char)(0xC0 | (cp >> 6));
+            utf8[1] = (char)(0x80 | (cp & 0x3F));
+            bytes = 2;
+        } else if (cp < 0x10000) {
+            utf8[0] = (char)(0xE0 | (cp >> 12));
+            utf8[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+            utf8[2] = (char)(0x80 | (cp & 0x3F));
+            bytes = 3;
+        } else {
+            utf8[0] = (char)(0xF0 | (cp >> 18));
+            utf8[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+            utf8[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+            utf8[3] = (char)(0x80 | (cp & 0x3F));
+            bytes = 4;
+        }
+        for (size_t i = 0; i < bytes && n < limit; i++) {
+            out[n++] = utf8[i];
+        }
+    }
+    return n;
+}
+
+// Decoded contents of a string term. If *heap is set the caller frees it.
+static const char* term_text(const JsonTerm* term, char* buf, size_t buf_size, size_t* len, char** heap) {
+    *heap = NULL;
+    *len = term->length;
+    if (!term->escaped) return term->text;
+
+    char* out = buf;
+    if (term->length > buf_size) {
+        out = *heap = (char*)malloc(term->length);
+        if (!out) {
+            *len = 0;
+            return buf;
+        }
+    }
+    *len = json_unescape(term->text, term->length, out, term->length);
+    return out;
+}
+
+static size_t term_put_number(double x, uint8_t* out) {
+    if (x == 0) x = 0;  // -0 sorts with 0
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    bits = (bits >> 63) ? ~bits : bits | (1ull << 63);
+
+    out[0] = TERM_NUMBER;
+    for (int i = 0; i < TERM_NUMBER_SIZE - 1; i++) {
+        out[1 + i] = (uint8_t)(0x80 | ((bits >> (63 - 7 * i)) & 0x7F));
+    }
+    return TERM_NUMBER_SIZE;
+}
+
+static size_t term_put_string(const char* s, size_t n, uint8_t* out) {
+    size_t len = 0;
+    out[len++] = TERM_STRING;
+    for (size_t i = 0; i < n; i++) {
+        uint8_t c = (uint8_t)s[i];
+        if (len + (c <= 2 ? 2 : 1) > INDEX_TERM_MAX - 1) break;
+        if (c <= 2) {
+            out[len++] = 2;
+            out[len++] = (uint8_t)(c + 2);
+        } else {
+            out[len++] = c;
+        }
+    }
+    out[len++] = 1;
+    return len;
+}
+
+// Term of a query operand; 0 if no document term has its kind
+static size_t value_term(const Value* value, uint8_t* out) {
+    switch (value->type) {
+        case TYPE_NULL:
+            out[0] = TERM_NULL;
+            return 1;
+        case TYPE_BOOL:
+            out[0] = value->data.bool_val ? TERM_TRUE : TERM_FALSE;
+            return 1;
+        case TYPE_INT:
+            return term_put_number((double)value->data.int_val, out);
+        case TYPE_FLOAT:
+            return term_put_number(value->data.float_val, out);
+        case TYPE_STRING:
+            return term_put_string(value->data.string_val, value->size, out);
+        default:
+            return 0;
+    }
+}
+
+// Term of the index's field in doc; 0 if doc has no scalar there
+static size_t doc_term(const Collection* index, const Value* doc, uint8_t* out) {
+    if (!doc || doc->type != TYPE_STRING) return 0;
+    JsonTerm term;
+    const char* text = doc->data.string_val;
+    if (!json_field(text, text + doc->size, index->field, strlen(index->field), &term)) return 0;
+
+    switch (term.kind) {
+        case 0:
+            return 0;
+        case TERM_NUMBER:
+            return term_put_number(term.number, out);
+        case TERM_STRING: {
+            char buf[INDEX_TERM_MAX];
+            if (!term.escaped) {
+                return term_put_string(term.text, term.length < INDEX_TERM_MAX ? term.length : INDEX_TERM_MAX, out);
+            }
+            return term_put_string(buf, json_unescape(term.text, term.length, buf, sizeof(buf)), out);
+        }
+        default:
+            out[0] = term.kind;
+            return 1;
+    }
+}
+
+// Bytes of the term at the front of an index key; the document's key follows
+static size_t entry_term_len(const uint8_t* key, size_t len) {
+    if (len == 0) return 0;
+    switch (key[0]) {
+        case TERM_NUMBER:
+            return len < TERM_NUMBER_SIZE ? len : TERM_NUMBER_SIZE;
+        case TERM_STRING: {
+            const uint8_t* close = (const uint8_t*)memchr(key + 1, 1, len - 1);
+            return close ? (size_t)(close - key) + 1 : len;
+        }
+        default:
+            return 1;
+    }
+}
+
+// Moves one document's entries from before to after in every index of collection.
+// Either may be NULL. Caller holds the log lock.
+static void indexes_apply(Collection* collection, const char* key, size_t len,
+                          const Value* before, const Value* after) {
+    IndexList* indexes = collection->indexes;
+    for (size_t i = 0; i < indexes->count; i++) {
+        Collection* index = indexes->items[i];
+        uint8_t old_key[BTREE_KEY_MAX], new_key[BTREE_KEY_MAX];
+        size_t old_len = doc_term(index, before, old_key);
+        size_t new_len = doc_term(index, after, new_key);
+        if (old_len == new_len && memcmp(old_key, new_key, old_len) == 0) continue;
+
+        if (old_len > 0) {
+            memcpy(old_key + old_len, key, len);
+            collection_delete(index, (const char*)old_key, old_len + len);
+        }
+        if (new_len > 0) {
+            memcpy(new_key + new_len, key, len);
+            collection_insert(index, (const char*)new_key, new_len + len, &g_index_entry);
+        }
+    }
+}
+
+// Links an index to the collection its name points at. Readers load the list without
+// a lock, so it is replaced rather than grown. Caller holds the log lock.
+static bool index_attach(EghactDB* db, Collection* index) {
+    char* end;
+    unsigned long id = strtoul(index->name + 1, &end, 10);
+    if (end == index->name + 1 || *end != ':' || end[1] == '\0' || id >= index->id) return false;
+    Collection* base = db->collections[id];
+    if (base->base) return false;
+
+    IndexList* old = base->indexes;
+    size_t count = old ? old->count : 0;
+    IndexList* list = (IndexList*)malloc(offsetof(IndexList, items) + (count + 1) * sizeof(Collection*));
+    if (!list) return false;
+    if (old) memcpy(list->items, old->items, count * sizeof(Collection*));
+    list->items[count] = index;
+    list->count = count + 1;
+
+    index->base = base;
+    index->field = end + 1;
+    __atomic_store_n(&base->indexes, list, __ATOMIC_RELEASE);
+    if (old) retire(db, old, RETIRED_INDEXES);
+    return true;
+}
+
+static bool index_build_visit(const char* key, size_t len, Value* value, void* user_data) {
+    Collection* index = (Collection*)user_data;
+    uint8_t entry[BTREE_KEY_MAX];
+    size_t term_len = doc_term(index, value, entry);
+    if (term_len > 0) {
+        memcpy(entry + term_len, key, len);
+        collection_insert(index, (const char*)entry, term_len + len, &g_index_entry);
+    }
+    return true;
+}
+
+// Fills a new index from the writer's tree. Caller holds the log lock.
+static void index_build(EghactDB* db, Collection* index) {
+    btree_scan(&db->file, node_load(&db->file, &index->base->root), NULL, NULL, true, index_build_visit, index);
+}
+
+// Declares an index on a dotted JSON path, filled from the documents already there.
+// Writers wait while it is filled; readers keep going and use it once it is.
+bool eghactdb_create_index(Collection* collection, const char* field) {
+    if (!collection || collection->base || !field || !*field) return false;
+
+    char name[MAX_KEY_SIZE + 1];
+    int len = snprintf(name, sizeof(name), "%c%u:%s", INDEX_NAME_MARK, collection->id, field);
+    if (len < 0 || len > MAX_KEY_SIZE) return false;
+
+    Collection* index = collection_create(collection->db, name, true);
+    return index && index->base == collection;
+}
+
+// Queries
+//
+// A query is a chain of predicates that must all hold. The planner picks the predicate
+// an index visible in the reader's version answers best: =, then IN, then a range, with
+// every range bound on that field folded into one. It walks the index entries in range,
+// looks each document up in the same version and checks the whole chain against it.
+// Matches come in index order.
+//
+// Without an index the documents are scanned in key order, SCAN_BATCH at a time from
+// one leaf. Each numeric field the chain compares is extracted once per document into a
+// column, and its predicates run over the whole column with vector compares, a bit per
+// document. Documents that fail a column are not parsed for the next one, and only
+// those left are checked against the other predicates.
+
+#define SCAN_BATCH 64  // Documents per batch; one bit each in a uint64_t
+#define SCAN_LANES 4   // Doubles per vector compare: one AVX register, two SSE2 or NEON
+
+typedef double ScanLanes __attribute__((vector_size(SCAN_LANES * sizeof(double))));
+typedef int64_t ScanMask __attribute__((vector_size(SCAN_LANES * sizeof(int64_t))));
+
+enum {
+    QUERY_EQ,
+    QUERY_NE,
+    QUERY_LT,
+    QUERY_LE,
+    QUERY_GT,
+    QUERY_GE,
+    QUERY_LIKE,
+    QUERY_IN
+};
+
+typedef struct {
+    const char* field;
+    size_t field_len;
+    uint8_t op;               // QUERY_*
+    Value* const* operands;   // One, or the IN list
+    size_t operand_count;
+    int column;               // Batch column holding the field; -1 = checked per document
+} Predicate;
+
+typedef struct {
+    Predicate* predicates;
+    size_t count;
+    int column_count;
+} QueryPlan;
+
+// Key range of an index: [start, end), NUL terminated; no end means to the last key
+typedef struct {
+    uint8_t start[INDEX_TERM_MAX + 1];
+    uint8_t end[INDEX_TERM_MAX + 1];
+    bool has_end;
+} TermRange;
+
+static int query_op(const char* op) {
+    if (!op) return -1;
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) return QUERY_EQ;
+    if (strcmp(op, "!=") == 0 || strcmp(op, "<>") == 0) return QUERY_NE;
+    if (strcmp(op, "<") == 0) return QUERY_LT;
+    if (strcmp(op, "<=") == 0) return QUERY_LE;
+    if (strcmp(op, ">") == 0) return QUERY_GT;
+    if (strcmp(op, ">=") == 0) return QUERY_GE;
+    if (strcasecmp(op, "LIKE") == 0) return QUERY_LIKE;
+    if (strcasecmp(op, "IN") == 0) return QUERY_IN;
+    return -1;
+}
+
+static inline bool value_is_number(const Value* value) {
+    return value->type == TYPE_INT || value->type == TYPE_FLOAT;
+}
+
+static inline double value_number(const Value* value) {
+    return value->type == TYPE_INT ? (double)value->data.int_val : value->data.float_val;
+}
+
+static size_t query_length(const Query* query) {
+    size_t count = 0;
+    for (const Query* q = query; q; q = q->next) count++;
+    return count;
+}
+
+// Checks query and plans it into predicates, one per link
+static bool plan_prepare(const Query* query, QueryPlan* plan, Predicate* predicates) {
+    plan->predicates = predicates;
+    plan->count = query_length(query);
+    plan->column_count = 0;
+
+    size_t i = 0;
+    for (const Query* q = query; q; q = q->next, i++) {
+        Predicate* p = &plan->predicates[i];
+        int op = query_op(q->op);
+        if (op < 0 || !q->field || !*q->field) return false;
+        p->field = q->field;
+        p->field_len = strlen(q->field);
+        p->op = (uint8_t)op;
+        p->operands = op == QUERY_IN ? q->values : &q->value;
+        p->operand_count = op == QUERY_IN ? q->value_count : 1;
+        p->column = -1;
+
+        bool numeric = p->operand_count > 0 && op != QUERY_LIKE;
+        for (size_t j = 0; j < p->operand_count; j++) {
+            if (!p->operands[j]) return false;
+            if (!value_is_number(p->operands[j])) numeric = false;
+        }
+        if (op == QUERY_LIKE && p->operands[0]->type != TYPE_STRING) return false;
+        if (!numeric) continue;
+
+        // Predicates on one field share its column
+        for (size_t j = 0; j < i && p->column < 0; j++) {
+            const Predicate* other = &plan->predicates[j];
+            if (other->column >= 0 && other->field_len == p->field_len &&
+                memcmp(other->field, p->field, p->field_len) == 0) {
+                p->column = other->column;
+            }
+        }
+        if (p->column < 0) p->column = plan->column_count++;
+    }
+    return true;
+}
+
+static inline int bytes_compare(const char* a, size_t a_len, const char* b, size_t b_len) {
+    int cmp = memcmp(a, b, a_len < b_len ? a_len : b_len);
+    if (cmp != 0) return cmp;
+    return a_len < b_len ? -1 : (a_len > b_len ? 1 : 0);
+}
+
+// Orders a document's term against an operand; false if their kinds don't compare
+static bool term_compare(const JsonTerm* term, const Value* value, int* cmp) {
+    switch (term->kind) {
+        case TERM_NUMBER: {
+            if (!value_is_number(value)) return false;
+            double x = value_number(value);
+            *cmp = term->number < x ? -1 : (term->number > x ? 1 : 0);
+            return true;
+        }
+        case TERM_STRING: {
+            if (value->type != TYPE_STRING) return false;
+            char buf[256];
+            char* heap;
+            size_t len;
+            const char* text = term_text(term, buf, sizeof(buf), &len, &heap);
+            *cmp = bytes_compare(text, len, value->data.string_val, value->size);
+            free(heap);
+            return true;
+        }
+        case TERM_FALSE:
+        case TERM_TRUE:
+            if (value->type != TYPE_BOOL) return false;
+            *cmp = (term->kind == TERM_TRUE) - (int)value->data.bool_val;
+            return true;
+        case TERM_NULL:
+            *cmp = 0;
+            return value->type == TYPE_NULL;
+        default:
+            return false;
+    }
+}
+
+// SQL LIKE: % matches any run of bytes, _ any one byte
+static bool like_match(const char* s, size_t n, const char* pattern, size_t m) {
+    size_t i = 0, j = 0, star = SIZE_MAX, resume = 0;
+    while (i < n) {
+        if (j < m && pattern[j] == '%') {
+            star = j++;
+            resume = i;
+        } else if (j < m && (pattern[j] == '_' || pattern[j] == s[i])) {
+            i++;
+            j++;
+        } else if (star != SIZE_MAX) {
+            j = star + 1;
+            i = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (j < m && pattern[j] == '%') j++;
+    return j == m;
+}
+
+static bool term_match(const Predicate* p, const JsonTerm* term) {
+    int cmp;
+    if (p->op == QUERY_IN) {
+        for (size_t i = 0; i < p->operand_count; i++) {
+            if (term_compare(term, p->operands[i], &cmp) && cmp == 0) return true;
+        }
+        return false;
+    }
+    if (p->op == QUERY_LIKE) {
+        if (term->kind != TERM_STRING) return false;
+        char buf[256];
+        char* heap;
+        size_t len;
+        const char* text = term_text(term, buf, sizeof(buf), &len, &heap);
+        const Value* pattern = p->operands[0];
+        bool match = like_match(text, len, pattern->data.string_val, pattern->size);
+        free(heap);
+        return match;
+    }
+
+    if (!term_compare(term, p->operands[0], &cmp)) return false;
+    switch (p->op) {
+        case QUERY_EQ: return cmp == 0;
+        case QUERY_NE: return cmp != 0;
+        case QUERY_LT: return cmp < 0;
+        case QUERY_LE: return cmp <= 0;
+        case QUERY_GT: return cmp > 0;
+        case QUERY_GE: return cmp >= 0;
+        default: return false;
+    }
+}
+
+// Checks the chain against one document, leaving out column predicates if asked
+static bool plan_match(const QueryPlan* plan, const Value* doc, bool skip_columns) {
+    if (doc->type != TYPE_STRING) return false;
+    const char* text = doc->data.string_val;
+    for (size_t i = 0; i < plan->count; i++) {
+        const Predicate* p = &plan->predicates[i];
+        if (skip_columns && p->column >= 0) continue;
+        JsonTerm term;
+        if (!json_field(text, text + doc->size, p->field, p->field_len, &term) || !term_match(p, &term)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#define COLUMN_COMPARE(expr)                                              \
+    for (size_t i = 0; i < SCAN_BATCH; i += SCAN_LANES) {                 \
+        ScanLanes v;                                                      \
+        memcpy(&v, column + i, sizeof(v));                                \
+        ScanMask mask = (expr);                                           \
+        for (int lane = 0; lane < SCAN_LANES; lane++) {                   \
+            bits |= (uint64_t)(mask[lane] & 1) << (i + lane);             \
+        }                                                                 \
+    }
+
+// Bit i set where column[i] compares true with x. Missing fields are NaN, which
+// compares false, so != also asks v == v.
+static uint64_t column_compare(const double* column, uint8_t op, double x) {
+    ScanLanes b;
+    for (int lane = 0; lane < SCAN_LANES; lane++) b[lane] = x;
+
+    uint64_t bits = 0;
+    switch (op) {
+        case QUERY_EQ: COLUMN_COMPARE(v == b); break;
+        case QUERY_NE: COLUMN_COMPARE((v != b) & (v == v)); break;
+        case QUERY_LT: COLUMN_COMPARE(v < b); break;
+        case QUERY_LE: COLUMN_COMPARE(v <= b); break;
+        case QUERY_GT: COLUMN_COMPARE(v > b); break;
+        case QUERY_GE: COLUMN_COMPARE(v >= b); break;
+        default: break;
+    }
+    return bits;
+}
+
+static uint64_t predicate_columns(const Predicate* p, const double* column) {
+    if (p->op != QUERY_IN) return column_compare(column, p->op, value_number(p->operands[0]));
+
+    uint64_t bits = 0;
+    for (size_t i = 0; i < p->operand_count; i++) {
+        bits |= column_compare(column, QUERY_EQ, value_number(p->operands[i]));
+    }
+    return bits;
+}
+
+// Pulls p's field out of the live documents; the rest of the column is NaN
+static void column_extract(const Predicate* p, Value* const* docs, uint64_t live, double* column) {
+    for (size_t i = 0; i < SCAN_BATCH; i++) {
+        column[i] = NAN;
+    }
+    for (; live; live &= live - 1) {
+        int i = __builtin_ctzll(live);
+        uint64_t next = live & (live - 1);
+        if (next) __builtin_prefetch(docs[__builtin_ctzll(next)]->data.string_val);
+        const char* text = docs[i]->data.string_val;
+        JsonTerm term;
+        if (json_field(text, text + docs[i]->size, p->field, p->field_len, &term) && term.kind == TERM_NUMBER) {
+            column[i] = term.number;
+        }
+    }
+}
+
+static size_t plan_scan(const PageFile* file, BTreeNode* root, const QueryPlan* plan,
+                        EghactScanFn fn, void* user_data) {
+    if (!root) return 0;
+
+    BTreePath path;
+    BTreeNode* leaf = btree_find_leaf(file, root, (const uint8_t*)"", 0, &path);
+    _Alignas(32) double column[SCAN_BATCH];
+    Value* docs[SCAN_BATCH];
+    uint8_t key[BTREE_KEY_MAX + 1];
+    size_t matched = 0;
+    bool more = true;
+    for (; leaf && more; leaf = btree_next_leaf(file, &path)) {
+        for (uint16_t first = 0; first < leaf->num_keys && more; first += SCAN_BATCH) {
+            size_t count = leaf->num_keys - first < SCAN_BATCH ? leaf->num_keys - first : SCAN_BATCH;
+            uint64_t live = 0;
+            for (size_t i = 0; i < count; i++) {
+                docs[i] = slot_value(file, &leaf->slots[first + i]);
+                if (docs[i]->type == TYPE_STRING) live |= 1ull << i;
+            }
+
+            for (int c = 0; c < plan->column_count && live; c++) {
+                bool extracted = false;
+                for (size_t j = 0; j < plan->count && live; j++) {
+                    const Predicate* p = &plan->predicates[j];
+                    if (p->column != c) continue;
+                    if (!extracted) {
+                        column_extract(p, docs, live, column);
+                        extracted = true;
+                    }
+                    live &= predicate_columns(p, column);
+                }
+            }
+
+            for (; live && more; live &= live - 1) {
+                int i = __builtin_ctzll(live);
+                if (!plan_match(plan, docs[i], true)) continue;
+                size_t len = node_key(leaf, (uint16_t)(first + i), key);
+                key[len] = '\0';
+                matched++;
+                more = fn((const char*)key, len, docs[i], user_data);
+            }
+        }
+    }
+    return matched;
+}
+
+// Smallest key past every key that starts with term; false if there is none
+static bool term_successor(uint8_t* term, size_t len) {
+    while (len > 0 && term[len - 1] == 0xFF) len--;
+    if (len == 0) return false;
+    term[len - 1]++;
+    term[len] = '\0';
+    return true;
+}
+
+// Range of index keys whose terms may compare true with operand under op
+static bool term_range(uint8_t op, const Value* operand, TermRange* range) {
+    uint8_t term[INDEX_TERM_MAX + 1];
+    size_t len = value_term(operand, term);
+    if (len == 0) return false;
+    term[len] = '\0';
+
+    // Order only holds within a kind; booleans are one kind
+    uint8_t first = term[0] == TERM_TRUE ? TERM_FALSE : term[0];
+    uint8_t last = term[0] == TERM_FALSE ? TERM_TRUE : term[0];
+    switch (op) {
+        case QUERY_EQ:
+            memcpy(range->start, term, len + 1);
+            range->has_end = term_successor(term, len);
+            memcpy(range->end, term, sizeof(term));
+            return true;
+        case QUERY_GT:
+        case QUERY_GE:
+            memcpy(range->start, term, len + 1);
+            range->end[0] = (uint8_t)(last + 1);
+            range->end[1] = '\0';
+            range->has_end = true;
+            return true;
+        case QUERY_LT:
+        case QUERY_LE:
+            range->start[0] = first;
+            range->start[1] = '\0';
+            range->has_end = term_successor(term, len);
+            memcpy(range->end, term, sizeof(term));
+            return true;
+        default:
+            return false;
+    }
+}
+
+static int range_compare(const void* a, const void* b) {
+    return strcmp((const char*)((const TermRange*)a)->start, (const char*)((const TermRange*)b)->start);
+}
+
+static inline bool index_covers(const Collection* index, const Predicate* p) {
+    return strlen(index->field) == p->field_len && memcmp(index->field, p->field, p->field_len) == 0;
+}
+
+// Index visible in version that can answer p: =, IN or a range
+static Collection* plan_index_for(const IndexList* indexes, const DbVersion* version, const Predicate* p) {
+    if (!indexes || !version || p->op == QUERY_NE || p->op == QUERY_LIKE) return NULL;
+    uint8_t term[INDEX_TERM_MAX];
+    for (size_t i = 0; i < p->operand_count; i++) {
+        if (value_term(p->operands[i], term) == 0) return NULL;
+    }
+    for (size_t i = 0; i < indexes->count; i++) {
+        Collection* index = indexes->items[i];
+        if (index->id < version->root_count && index_covers(index, p)) return index;
+    }
+    return NULL;
+}
+
+// Key ranges of the index for predicate p and every other range bound on its field
+static size_t plan_ranges(const QueryPlan* plan, const Predicate* p, TermRange* ranges) {
+    if (p->op == QUERY_IN) {
+        size_t count = 0;
+        for (size_t i = 0; i < p->operand_count; i++) {
+            if (term_range(QUERY_EQ, p->operands[i], &ranges[count])) count++;
+        }
+
+        // Each document has one term, so distinct ranges never return it twice
+        qsort(ranges, count, sizeof(TermRange), range_compare);
+        size_t unique = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (unique == 0 || strcmp((const char*)ranges[unique - 1].start, (const char*)ranges[i].start) != 0) {
+                ranges[unique++] = ranges[i];
+            }
+        }
+        return unique;
+    }
+    if (!term_range(p->op, p->operands[0], &ranges[0])) return 0;
+    if (p->op == QUERY_EQ) return 1;
+
+    TermRange* range = &ranges[0];
+    for (size_t i = 0; i < plan->count; i++) {
+        const Predicate* other = &plan->predicates[i];
+        TermRange bound;
+        if (other == p || other->op < QUERY_LT || other->op > QUERY_GE ||
+            other->field_len != p->field_len || memcmp(other->field, p->field, p->field_len) != 0 ||
+            !term_range(other->op, other->operands[0], &bound)) continue;
+        if (strcmp((const char*)bound.start, (const char*)range->start) > 0) {
+            memcpy(range->start, bound.start, sizeof(bound.start));
+        }
+        if (bound.has_end && (!range->has_end || strcmp((const char*)bound.end, (const char*)range->end) < 0)) {
+            memcpy(range->end, bound.end, sizeof(bound.end));
+            range->has_end = true;
+        }
+    }
+    return !range->has_end || strcmp((const char*)range->start, (const char*)range->end) < 0 ? 1 : 0;
+}
+
+typedef struct {
+    const PageFile* file;
+    BTreeNode* root;  // The covered collection, in the index's version
+    const QueryPlan* plan;
+    EghactScanFn fn;
+    void* user_data;
+    size_t matched;
+    bool more;
+} IndexVisit;
+
+static bool index_visit(const char* key, size_t len, Value* value, void* user_data) {
+    (void)value;
+    IndexVisit* visit = (IndexVisit*)user_data;
+    size_t term_len = entry_term_len((const uint8_t*)key, len);
+    const char* doc_key = key + term_len;
+    size_t doc_len = len - term_len;
+
+    Value* doc = btree_lookup(visit->file, visit->root, (const uint8_t*)doc_key, doc_len);
+    if (!doc || !plan_match(visit->plan, doc, false)) return true;
+    visit->matched++;
+    visit->more = visit->fn(doc_key, doc_len, doc, visit->user_data);
+    return visit->more;
+}
+
+// Runs a prepared plan in version. ranges holds one per operand of any predicate.
+static size_t plan_run(const PageFile* file, DbVersion* version, Collection* collection,
+                       const QueryPlan* plan, TermRange* ranges, EghactScanFn fn, void* user_data) {
+    // Prefer the narrowest predicate an index answers
+    const IndexList* indexes = __atomic_load_n(&collection->indexes, __ATOMIC_ACQUIRE);
+    const Predicate* chosen = NULL;
+    Collection* index = NULL;
+    int best = 3;
+    for (size_t i = 0; i < plan->count && best > 0; i++) {
+        const Predicate* p = &plan->predicates[i];
+        int rank = p->op == QUERY_EQ ? 0 : (p->op == QUERY_IN ? 1 : 2);
+        Collection* candidate = rank < best ? plan_index_for(indexes, version, p) : NULL;
+        if (candidate) {
+            chosen = p;
+            index = candidate;
+            best = rank;
+        }
+    }
+
+    BTreeNode* root = version_root(file, version, collection);
+    if (!index) {
+        EGHACT_PERF_ADD(perf_db_scan_finds, 1);
+        return plan_scan(file, root, plan, fn, user_data);
+    }
+
+    EGHACT_PERF_ADD(perf_db_index_finds, 1);
+    size_t range_count = plan_ranges(plan, chosen, ranges);
+    IndexVisit visit = { file, root, plan, fn, user_data, 0, true };
+    BTreeNode* index_root = version_root(file, version, index);
+    for (size_t i = 0; i < range_count && visit.more && root && index_root; i++) {
+        btree_scan(file, index_root, (const char*)ranges[i].start,
+                   ranges[i].has_end ? (const char*)ranges[i].end : NULL, false, index_visit, &visit);
+    }
+    return visit.matched;
+}
+
+static size_t query_run(const PageFile* file, DbVersion* version, Collection* collection,
+                        const Query* query, EghactScanFn fn, void* user_data) {
+    size_t count = query_length(query);
+    size_t operands = 1;
+    for (const Query* q = query; q; q = q->next) {
+        if (query_op(q->op) == QUERY_IN && q->value_count > operands) operands = q->value_count;
+    }
+
+    QueryPlan plan;
+    Predicate* predicates = (Predicate*)malloc(count * sizeof(Predicate));
+    TermRange* ranges = (TermRange*)malloc(operands * sizeof(TermRange));
+    size_t matched = 0;
+    if (predicates && ranges && plan_prepare(query, &plan, predicates)) {
+        matched = plan_run(file, version, collection, &plan, ranges, fn, user_data);
+    }
+    free(predicates);
+    free(ranges);
+    return matched;
+}
+
+// Visits the documents matching every predicate in query; returns how many. Like a
+// scan, it sees the collection as it was when it started and fn may write meanwhile.
+size_t eghactdb_find(Collection* collection, const Query* query, EghactScanFn fn, void* user_data) {
+    if (!collection || collection->base || !query || !fn) return 0;
+    EGHACT_PERF_SCOPE("db", "find");
+
+    EghactDB* db = collection->db;
+    _Atomic uint64_t* pin = read_begin(db);
+    size_t matched = query_run(&db->file, version_current(db), collection, query, fn, user_data);
+    read_end(pin);
+    return matched;
+}
+
+// Bulk loading
+//
+// A bulk load sorts its input and merges it with the collection's keys into a new tree
+// built bottom-up. Leaves are packed to BULK_FILL in key order, and every level above is
+// packed from the separators of the one below, so nothing is split along the way. No
+// key is logged. The new tree is published and then made durable by one checkpoint,
+// which goes through the log like any other. checkpoint_lock is held exclusively
+// throughout, so no logged write can land in between, and recovery finds the old tree
+// or the new one. Other writers wait; readers stay on the old version until the publish.
+// Keys already present keep their values, and the first of equal input keys wins.
+
+#define BULK_FILL (PAGE_SIZE - PAGE_SIZE / 16)  // Bytes packed per node; the rest takes later inserts
+
+typedef struct {
+    const uint8_t* key;
+    uint64_t head;    // First 8 bytes, big-endian and zero padded
+    uint16_t len;
+    bool skipped;     // Present already, or repeated in the input
+    size_t order;     // Position in the input
+    Value* value;
+} BulkEntry;
+
+struct EghactBulkLoader {
+    Collection* collection;
+    BulkEntry* entries;   // Keys are offsets into keys until finish
+    size_t count;
+    size_t capacity;
+    uint8_t* keys;
+    size_t key_bytes;
+    size_t key_capacity;
+    bool sorted;          // Added in ascending order so far
+};
+
+// Node of one level after the first, and the separator in front of it
+typedef struct {
+    size_t key;  // Offset into the level's keys
+    uint16_t len;
+    BTreeNode* node;
+} BulkChild;
+
+// Nodes of one level, waiting for the level above
+typedef struct {
+    BTreeNode* first;
+    BulkChild* children;
+    size_t count;
+    size_t capacity;
+    uint8_t* keys;
+    size_t key_bytes;
+    size_t key_capacity;
+} BulkLevel;
+
+// Node being packed
+typedef struct {
+    BTreeEntry entries[BTREE_MAX_SLOTS];
+    size_t count;
+    size_t key_bytes;
+} BulkNode;
+
+static inline uint64_t bulk_head(const uint8_t* key, size_t len) {
+    uint64_t head = 0;
+    for (size_t i = 0; i < 8; i++) {
+        head = head << 8 | (i < len ? key[i] : 0);
+    }
+    return head;
+}
+
+static int bulk_compare(const void* a, const void* b) {
+    const BulkEntry* x = (const BulkEntry*)a;
+    const BulkEntry* y = (const BulkEntry*)b;
+    if (x->head != y->head) return x->head < y->head ? -1 : 1;
+    if (x->len > 8 && y->len > 8) {
+        int cmp = memcmp(x->key + 8, y->key + 8, (x->len < y->len ? x->len : y->len) - 8);
+        if (cmp != 0) return cmp;
+    }
+    if (x->len != y->len) return x->len < y->len ? -1 : 1;
+    return x->order < y->order ? -1 : (x->order > y->order ? 1 : 0);
+}
+
+// Orders a key split across a node's prefix and a slot against a flat key
+static int entry_compare_key(const BTreeEntry* entry, const uint8_t* key, size_t len) {
+    size_t n = entry->a_len < len ? entry->a_len : len;
+    int cmp = memcmp(entry->a, key, n);
+    if (cmp != 0 || n == len) return cmp != 0 ? cmp : (entry_len(entry) > len ? 1 : 0);
+    n = entry->b_len < len - entry->a_len ? entry->b_len : len - entry->a_len;
+    cmp = memcmp(entry->b, key + entry->a_len, n);
+    if (cmp != 0) return cmp;
+    size_t entry_bytes = entry_len(entry);
+    return entry_bytes < len ? -1 : (entry_bytes > len ? 1 : 0);
+}
+
+// Same sum as range_size, with entry appended
+static bool bulk_node_fits(const BulkNode* node, const BTreeEntry* entry, size_t limit) {
+    size_t count = node->count + 1;
+    size_t prefix = node->count > 0 ? entry_common_prefix(&node->entries[0], entry) : 0;
+    return BTREE_HEADER_SIZE + count * sizeof(BTreeSlot) + prefix +
+           node->key_bytes + entry_len(entry) - count * prefix <= limit;
+}
+
+static inline void bulk_node_add(BulkNode* node, const BTreeEntry* entry) {
+    node->entries[node->count++] = *entry;
+    node->key_bytes += entry_len(entry);
+}
+
+static bool bulk_level_add(BulkLevel* level, const BTreeEntry* key, size_t len, BTreeNode* node) {
+    if (!level->first) {
+        level->first = node;
+        return true;
+    }
+    if (level->count >= level->capacity) {
+        size_t capacity = level->capacity == 0 ? 256 : level->capacity * 2;
+        BulkChild* children = (BulkChild*)realloc(level->children, capacity * sizeof(BulkChild));
+        if (!children) return false;
+        level->children = children;
+        level->capacity = capacity;
+    }
+    if (level->key_bytes + len > level->key_capacity) {
+        size_t capacity = level->key_capacity == 0 ? 64 * 1024 : level->key_capacity * 2;
+        uint8_t* keys = (uint8_t*)realloc(level->keys, capacity);
+        if (!keys) return false;
+        level->keys = keys;
+        level->key_capacity = capacity;
+    }
+    entry_copy(key, 0, len, level->keys + level->key_bytes);
+    level->children[level->count++] = (BulkChild){ level->key_bytes, (uint16_t)len, node };
+    level->key_bytes += len;
+    return true;
+}
+
+static BTreeNode* bulk_node_build(EghactDB* db, BulkNode* packed, bool is_leaf, BTreeNode* first_child) {
+    BTreeNode* node = node_new(db, is_leaf);
+    if (!node) return NULL;
+    node_build(node, is_leaf, packed->entries, 0, packed->count);
+    node->first_child = first_child;
+    node->dirty = node->fresh = true;
+    packed->count = 0;
+    packed->key_bytes = 0;
+    return node;
+}
+
+// Builds the packed leaf and hands it to the level above. Leaves get the shortest
+// separator that tells them from the previous one.
+static bool bulk_leaf_flush(EghactDB* db, BulkNode* leaf, BTreeEntry* last, BulkLevel* leaves) {
+    BTreeEntry first = leaf->entries[0];
+    BTreeEntry next_last = leaf->entries[leaf->count - 1];
+    BTreeNode* node = bulk_node_build(db, leaf, true, NULL);
+    if (!node) return false;
+    size_t sep_len = leaves->first ? entry_common_prefix(last, &first) + 1 : 0;
+    *last = next_last;
+    if (bulk_level_add(leaves, &first, sep_len, node)) return true;
+    node_drop(db, node);
+    return false;
+}
+
+// Packs the nodes of below under inner nodes. Like an inner split, the separator of a
+// node that starts a new parent moves up instead of into it. The last separator may
+// use the slack, so no parent is left with first_child alone.
+static bool bulk_level_build(EghactDB* db, const BulkLevel* below, BulkLevel* above, BulkNode* packed) {
+    BTreeNode* first_child = below->first;
+    BTreeEntry start = { 0 };  // Separator in front of the node being packed
+    for (size_t i = 0; i <= below->count; i++) {
+        const BulkChild* child = i < below->count ? &below->children[i] : NULL;
+        BTreeEntry entry = { NULL, 0, child ? below->keys + child->key : NULL, child ? child->len : 0,
+                             child ? child->node : NULL };
+        if (child && bulk_node_fits(packed, &entry, i + 1 < below->count ? BULK_FILL : PAGE_SIZE)) {
+            bulk_node_add(packed, &entry);
+            continue;
+        }
+        BTreeNode* node = bulk_node_build(db, packed, false, first_child);
+        if (!node) return false;
+        if (!bulk_level_add(above, &start, start.b_len, node)) {
+            node_drop(db, node);
+            return false;
+        }
+        start = entry;
+        if (child) first_child = child->node;
+    }
+    return true;
+}
+
+static void bulk_level_free(BulkLevel* level) {
+    free(level->children);
+    free(level->keys);
+    memset(level, 0, sizeof(*level));
+}
+
+// Drops every node of a tree the new one replaces; the values moved over
+static void bulk_release(EghactDB* db, BTreeNode* node) {
+    if (!node->is_leaf) {
+        bulk_release(db, node_load(&db->file, &node->first_child));
+        for (uint16_t i = 0; i < node->num_keys; i++) {
+            bulk_release(db, node_load(&db->file, &node->slots[i].ptr.child));
+        }
+    }
+    node_release(db, node);
+}
+
+// Drops the nodes of a build that failed; nobody has seen them
+static void bulk_discard(EghactDB* db, BulkLevel* level) {
+    if (level->first) node_drop(db, level->first);
+    for (size_t i = 0; i < level->count; i++) {
+        node_drop(db, level->children[i].node);
+    }
+}
+
+// Merges sorted entries, less the skipped ones, into the collection's tree and swaps in
+// the result. Caller holds checkpoint_lock exclusively and the log lock. Entries for keys
+// already present are marked skipped.
+static bool bulk_merge(Collection* collection, BulkEntry* entries, size_t count) {
+    EghactDB* db = collection->db;
+    PageFile* file = &db->file;
+    BulkNode* packed = (BulkNode*)malloc(sizeof(BulkNode));
+    if (!packed) return false;
+    packed->count = 0;
+    packed->key_bytes = 0;
+
+    BTreeNode* old_root = node_load(file, &collection->root);
+    BTreePath path;
+    BTreeNode* leaf = old_root ? btree_find_leaf(file, old_root, (const uint8_t*)"", 0, &path) : NULL;
+    uint16_t pos = 0;
+
+    BulkLevel leaves = { 0 };
+    BTreeEntry last = { 0 };
+    size_t total = 0, next = 0;
+    bool ok = true;
+    while (ok) {
+        while (leaf && pos >= leaf->num_keys) {
+            leaf = btree_next_leaf(file, &path);
+            pos = 0;
+        }
+        while (next < count && entries[next].skipped) next++;
+        if (!leaf && next >= count) break;
+
+        // Values in the mapping are decoded now; their run is freed with the old leaf
+        BTreeEntry entry;
+        int cmp = 1;
+        if (leaf) {
+            const BTreeSlot* slot = &leaf->slots[pos];
+            entry = (BTreeEntry){ node_prefix(leaf), leaf->prefix_len, node_bytes(leaf) + slot->offset,
+                                  slot->length, slot_value(file, &leaf->slots[pos]) };
+            cmp = next < count ? entry_compare_key(&entry, entries[next].key, entries[next].len) : -1;
+        }
+        if (cmp >= 0) {
+            if (cmp == 0) {
+                entries[next++].skipped = true;
+                continue;
+            }
+            BulkEntry* input = &entries[next++];
+            entry = (BTreeEntry){ NULL, 0, input->key, input->len, input->value };
+        } else {
+            pos++;
+        }
+
+        if (packed->count > 0 && !bulk_node_fits(packed, &entry, BULK_FILL)) {
+            ok = bulk_leaf_flush(db, packed, &last, &leaves);
+        }
+        bulk_node_add(packed, &entry);
+        total++;
+    }
+    if (ok && packed->count > 0) ok = bulk_leaf_flush(db, packed, &last, &leaves);
+
+    // Levels above are a small fraction of the leaves, so each is built whole
+    BulkLevel level = leaves;
+    BulkLevel built[BTREE_MAX_DEPTH];
+    int depth = 0;
+    while (ok && level.count > 0 && depth < BTREE_MAX_DEPTH) {
+        BulkLevel above = { 0 };
+        ok = bulk_level_build(db, &level, &above, packed);
+        built[depth++] = level;
+        level = above;
+    }
+    ok = ok && level.count == 0;
+    if (!ok) {
+        for (int i = 0; i < depth; i++) {
+            bulk_discard(db, &built[i]);
+        }
+        bulk_discard(db, &level);
+    }
+    for (int i = 0; i < depth; i++) {
+        bulk_level_free(&built[i]);
+    }
+    free(packed);
+    if (!ok) {
+        bulk_level_free(&level);
+        return false;
+    }
+
+    if (old_root) bulk_release(db, old_root);
+    collection->root = level.first;
+    collection->count = total;
+    bulk_level_free(&level);
+    return true;
+}
+
+// Sorts entries, marks repeated keys skipped, loads them and makes them durable. Takes
+// every value: those that went in belong to the collection and the rest are freed.
+static bool bulk_load(Collection* collection, BulkEntry* entries, size_t count, bool sorted) {
+    EGHACT_PERF_SCOPE("db", "bulk_load");
+    EghactDB* db = collection->db;
+    Wal* wal = &db->wal;
+
+    if (!sorted) qsort(entries, count, sizeof(BulkEntry), bulk_compare);
+    for (size_t i = 1; i < count; i++) {
+        entries[i].skipped = entries[i].len == entries[i - 1].len &&
+                             memcmp(entries[i].key, entries[i - 1].key, entries[i].len) == 0;
+    }
+
+    pthread_rwlock_wrlock(&db->checkpoint_lock);
+    pthread_mutex_lock(&wal->lock);
+    bool merged = !wal->failed && bulk_merge(collection, entries, count);
+    bool ok = merged;
+    if (merged) {
+        for (size_t i = 0; collection->indexes && i < count; i++) {
+            if (!entries[i].skipped) {
+                indexes_apply(collection, (const char*)entries[i].key, entries[i].len, NULL, entries[i].value);
+            }
+        }
+        versions_publish(db);
+    }
+    pthread_mutex_unlock(&wal->lock);
+
+    // Nothing in the log describes the new tree, so no write may follow it until a
+    // checkpoint has made it durable
+    if (ok && !checkpoint_locked(db)) {
+        pthread_mutex_lock(&wal->lock);
+        wal->failed = true;
+        pthread_mutex_unlock(&wal->lock);
+        ok = false;
+    }
+    pthread_rwlock_unlock(&db->checkpoint_lock);
+    EGHACT_PERF_ADD(perf_db_bulk_keys, ok ? count : 0);
+
+    for (size_t i = 0; i < count; i++) {
+        if (!merged || entries[i].skipped) value_free(entries[i].value);
+    }
+    return ok;
+}
+
+// Loads n key/value pairs at once and returns once they are durable. Keys already
+// present keep their values. Unless the arguments are rejected, the values are taken
+// whatever the outcome. If the final checkpoint fails the load stays visible but not
+// durable, and the database refuses further writes.
+bool eghactdb_bulk_insert(Collection* collection, const char** keys, Value** values, size_t n) {
+    if (!collection || collection->base || (n > 0 && (!keys || !values))) return false;
+    for (size_t i = 0; i < n; i++) {
+        if (!keys[i] || !values[i] || strlen(keys[i]) > MAX_KEY_SIZE) return false;
+    }
+
+    BulkEntry* entries = (BulkEntry*)malloc((n > 0 ? n : 1) * sizeof(BulkEntry));
+    if (!entries) return false;
+    bool sorted = true;
+    for (size_t i = 0; i < n; i++) {
+        size_t len = strlen(keys[i]);
+        entries[i] = (BulkEntry){ (const uint8_t*)keys[i], bulk_head((const uint8_t*)keys[i], len),
+                                  (uint16_t)len, false, i, values[i] };
+        if (i > 0 && sorted && bulk_compare(&entries[i - 1], &entries[i]) > 0) sorted = false;
+    }
+
+    bool ok = bulk_load(collection, entries, n, sorted);
+    free(entries);
+    return ok;
+}
+
+// Streaming loader: keys are copied as they are added, and nothing touches the
+// collection until finish. Input that arrives sorted skips the sort.
+EghactBulkLoader* eghactdb_bulk_begin(Collection* collection) {
+    if (!collection || collection->base) return NULL;
+    EghactBulkLoader* loader = (EghactBulkLoader*)calloc(1, sizeof(EghactBulkLoader));
+    if (!loader) return NULL;
+    loader->collection = collection;
+    loader->sorted = true;
+    return loader;
+}
+
+// On success the loader owns value
+bool eghactdb_bulk_add(EghactBulkLoader* loader, const char* key, Value* value) {
+    if (!loader || !key || !value) return false;
+    size_t len = strlen(key);
+    if (len > MAX_KEY_SIZE) return false;
+
+    if (loader->count >= loader->capacity) {
+        size_t capacity = loader->capacity == 0 ? 1024 : loader->capacity * 2;
+        BulkEntry* entries = (BulkEntry*)realloc(loader->entries, capacity * sizeof(BulkEntry));
+        if (!entries) return false;
+        loader->entries = entries;
+        loader->capacity = capacity;
+    }
+    if (loader->key_bytes + len > loader->key_capacity) {
+        size_t capacity = loader->key_capacity == 0 ? 64 * 1024 : loader->key_capacity;
+        while (capacity < loader->key_bytes + len) capacity *= 2;
+        uint8_t* keys = (uint8_t*)realloc(loader->keys, capacity);
+        if (!keys) return false;
+        loader->keys = keys;
+        loader->key_capacity = capacity;
+    }
+
+    memcpy(loader->keys + loader->key_bytes, key, len);
+    BulkEntry* entry = &loader->entries[loader->count];
+    *entry = (BulkEntry){ (const uint8_t*)(uintptr_t)loader->key_bytes, bulk_head((const uint8_t*)key, len),
+                          (uint16_t)len, false, loader->count, value };
+    if (loader->count > 0 && loader->sorted) {
+        const BulkEntry* prev = entry - 1;
+        const uint8_t* prev_key = loader->keys + (uintptr_t)prev->key;
+        BulkEntry a = *prev, b = *entry;
+        a.key = prev_key;
+        b.key = loader->keys + loader->key_bytes;
+        if (bulk_compare(&a, &b) > 0) loader->sorted = false;
+    }
+    loader->key_bytes += len;
+    loader->count++;
+    return true;
+}
+
+static void bulk_loader_free(EghactBulkLoader* loader) {
+    free(loader->entries);
+    free(loader->keys);
+    free(loader);
+}
+
+// Loads everything added and frees the loader; like eghactdb_bulk_insert otherwise
+bool eghactdb_bulk_finish(EghactBulkLoader* loader) {
+    if (!loader) return false;
+    for (size_t i = 0; i < loader->count; i++) {
+        loader->entries[i].key = loader->keys + (uintptr_t)loader->entries[i].key;
+    }
+    bool ok = bulk_load(loader->collection, loader->entries, loader->count, loader->sorted);
+    bulk_loader_free(loader);
+    return ok;
+}
+
+// Frees the loader and every value added to it
+void eghactdb_bulk_abort(EghactBulkLoader* loader) {
+    if (!loader) return;
+    for (size_t i = 0; i < loader->count; i++) {
+        value_free(loader->entries[i].value);
+    }
+    bulk_loader_free(loader);
+}
+
+// Value creation
+Value* value_null() {
+    Value* val = (Value*)calloc(1, sizeof(Value));
+    val->type = TYPE_NULL;
+    return val;
+}
+
+Value* value_bool(bool b) {
+    Value* val = (Value*)calloc(1, sizeof(Value));
+    val->type = TYPE_BOOL;
+    val->data.bool_val = b;
+    return val;
+}
+
+Value* value_int(int64_t i) {
+    Value* val = (Value*)calloc(1, sizeof(Value));
+    val->type = TYPE_INT;
+    val->data.int_val = i;
+    return val;
+}
+
+Value* value_float(double f) {
+    Value* val = (Value*)calloc(1, sizeof(Value));
+    val->type = TYPE_FLOAT;
+    val->data.float_val = f;
+    return val;
+}
+
+Value* value_string(const char* s) {
+    Value* val = (Value*)calloc(1, sizeof(Value));
+    val->type = TYPE_STRING;
+    val->data.string_val = strdup(s);
+    val->size = strlen(s);
+    return val;
+}
+
+Value* value_blob(const void* data, size_t size) {
+    Value* val = (Value*)calloc(1, sizeof(Value));
+    val->type = TYPE_BLOB;
+    val->data.blob_val = malloc(size);
+    memcpy(val->data.blob_val, data, size);
+    val->size = size;
+    return val;
+}
+
+void value_free(Value* val) {
+    if (!val) return;
+    
+    switch (val->type) {
+        case TYPE_STRING:
+            free(val->data.string_val);
+            break;
+        case TYPE_BLOB:
+            free(val->data.blob_val);
+            break;
+        default:
+            break;
     }
     
+    free(val);
+}
+
+// SQL
+//
+// Statements are parsed once into a plan and kept in an LRU cache keyed by their
+// normalized text: the tokens joined by single spaces, keywords in upper case, so
+// "select * from t" and "SELECT *  FROM t" share one. Preparing cached text only lexes
+// it. A statement binds its ? parameters in place and runs the plan on each step
+// without allocating: its predicates, index ranges and row buffers are sized when it is
+// prepared and reused by every execution. SELECT collects its rows at the first step
+// from the version current then, and keeps that version pinned until the step that
+// returns EGHACTDB_DONE, so rows are borrowed rather than copied.
+//
+// The dialect covers the document store, with _key and _value naming a document's key
+// and body:
+//   SELECT * FROM c [WHERE p [AND p]...] [LIMIT n]
+//   INSERT INTO c VALUES (key, value)
+//   UPDATE c SET _value = value WHERE _key = key
+//   DELETE FROM c WHERE _key = key
+// where p is `field op operand`, `field IN (operand, ...)` or `_key = operand`, fields
+// are dotted JSON paths as in eghactdb_find, and operands are literals or ?. A SELECT
+// on _key looks the document up instead of planning a find.
+
+enum {
+    SQL_END,
+    SQL_WORD,
+    SQL_STRING,   // '...', quotes doubled inside
+    SQL_NUMBER,
+    SQL_PARAM,
+    SQL_SYMBOL
+};
+
+enum {
+    SQL_SELECT,
+    SQL_INSERT,
+    SQL_UPDATE,
+    SQL_DELETE
+};
+
+#define SQL_NONE SIZE_MAX  // No such operand
+
+typedef struct {
+    uint8_t kind;  // SQL_END...
+    const char* text;
+    size_t len;
+} SqlToken;
+
+// One WHERE predicate; its operands are [first, first + count)
+typedef struct {
+    char* field;
+    const char* op;
+    size_t first;
+    size_t count;
+} SqlTerm;
+
+// Parsed statement, shared by every statement prepared from the same text. Guarded by
+// the cache lock while it is listed there; otherwise immutable.
+typedef struct SqlPlan {
+    char* text;               // Normalized
+    uint64_t hash;
+    uint8_t kind;             // SQL_SELECT...
+    char* collection;
+    SqlTerm* terms;
+    size_t term_count;
+    Value** literals;         // Per operand; NULL for a parameter
+    size_t operand_count;
+    size_t* params;           // Operand each parameter fills
+    size_t param_count;
+    size_t key;               // Operands, or SQL_NONE
+    size_t value;
+    size_t limit;
+    size_t max_operands;      // Of any term
+    size_t refs;              // Statements, plus one while cached
+    bool cached;
+    struct SqlPlan* bucket_next;
+    struct SqlPlan* newer;
+    struct SqlPlan* older;
+} SqlPlan;
+
+// Row collected by a SELECT; key is an offset into the statement's key buffer
+typedef struct {
+    size_t key;
+    size_t len;
+    Value* value;
+} SqlRow;
+
+struct EghactStmt {
+    EghactDB* db;
+    SqlPlan* plan;
+    Collection* collection;
+    Value** operands;         // Literal or bound value for each operand
+    Value* params;            // Values behind eghactdb_bind_int and eghactdb_bind_text
+    Query* queries;           // One per term, chained, pointing into operands
+    Predicate* predicates;
+    TermRange* ranges;
+    bool running;             // Rows collected; next one is row
+    _Atomic uint64_t* pin;
+    size_t limit;
+    SqlRow* rows;
+    size_t row_count;
+    size_t row_capacity;
+    size_t row;
+    char* keys;
+    size_t key_bytes;
+    size_t key_capacity;
+};
+
+static const char* const g_sql_keywords[] = {
+    "SELECT", "FROM", "WHERE", "AND", "LIMIT", "INSERT", "INTO", "VALUES",
+    "UPDATE", "SET", "DELETE", "IN", "LIKE", "TRUE", "FALSE", "NULL"
+};
+
+static inline bool sql_word_char(char c) {
+    return isalnum((unsigned char)c) || c == '_' || c == '.' || c == '$';
+}
+
+static bool sql_is_keyword(const SqlToken* token) {
+    if (token->kind != SQL_WORD) return false;
+    for (size_t i = 0; i < sizeof(g_sql_keywords) / sizeof(g_sql_keywords[0]); i++) {
+        if (strlen(g_sql_keywords[i]) == token->len && strncasecmp(g_sql_keywords[i], token->text, token->len) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Splits sql into tokens in place; a trailing ; is dropped. False on a stray character,
+// an unterminated string or too many tokens.
+static bool sql_lex(const char* sql, SqlToken* tokens, size_t* count) {
+    size_t n = 0;
+    const char* p = sql;
+    for (;;) {
+        while (isspace((unsigned char)*p)) p++;
+        if (*p == ';') {
+            const char* rest = p + 1;
+            while (isspace((unsigned char)*rest)) rest++;
+            if (*rest == '\0') p = rest;
+        }
+        if (n + 1 >= SQL_MAX_TOKENS) return false;
+        SqlToken* token = &tokens[n++];
+        token->text = p;
+        if (*p == '\0') {
+            token->kind = SQL_END;
+            token->len = 0;
+            *count = n;
+            return true;
+        }
+
+        if (*p == '\'') {
+            for (p++; *p && !(*p == '\'' && p[1] != '\''); p += *p == '\'' ? 2 : 1) {}
+            if (*p != '\'') return false;
+            p++;
+            token->kind = SQL_STRING;
+        } else if (isdigit((unsigned char)*p) || (*p == '-' && isdigit((unsigned char)p[1]))) {
+            for (p++; isdigit((unsigned char)*p); p++) {}
+            if (*p == '.' && isdigit((unsigned char)p[1])) {
+                for (p++; isdigit((unsigned char)*p); p++) {}
+            }
+            if ((*p == 'e' || *p == 'E') && (isdigit((unsigned char)p[1]) ||
+                ((p[1] == '+' || p[1] == '-') && isdigit((unsigned char)p[2])))) {
+                for (p += 2; isdigit((unsigned char)*p); p++) {}
+            }
+            token->kind = SQL_NUMBER;
+        } else if (isalpha((unsigned char)*p) || *p == '_' || *p == '$') {
+            while (sql_word_char(*p)) p++;
+            token->kind = SQL_WORD;
+        } else if (*p == '?') {
+            p++;
+            token->kind = SQL_PARAM;
+        } else if ((p[0] == '<' && (p[1] == '=' || p[1] == '>')) || ((p[0] == '>' || p[0] == '!' || p[0] == '=') && p[1] == '=')) {
+            p += 2;
+            token->kind = SQL_SYMBOL;
+        } else if (strchr("=<>(),*", *p)) {
+            p++;
+            token->kind = SQL_SYMBOL;
+        } else {
+            return false;
+        }
+        token->len = (size_t)(p - token->text);
+    }
+}
+
+// Cache key: tokens joined by single spaces, keywords in upper case. Identifiers keep
+// their case; keywords can't be used as one, so folding them merges nothing else.
+static char* sql_normalize(const SqlToken* tokens, size_t count, size_t* len) {
+    size_t bytes = 1;
+    for (size_t i = 0; i < count; i++) {
+        bytes += tokens[i].len + 1;
+    }
+    char* text = (char*)malloc(bytes);
+    if (!text) return NULL;
+
+    char* out = text;
+    for (size_t i = 0; i + 1 < count; i++) {
+        const SqlToken* token = &tokens[i];
+        if (i > 0) *out++ = ' ';
+        bool fold = sql_is_keyword(token);
+        for (size_t j = 0; j < token->len; j++) {
+            *out++ = fold ? (char)toupper((unsigned char)token->text[j]) : token->text[j];
+        }
+    }
+    *out = '\0';
+    *len = (size_t)(out - text);
+    return text;
+}
+
+static uint64_t sql_hash(const char* text, size_t len) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)text[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static void sql_plan_free(SqlPlan* plan) {
+    for (size_t i = 0; i < plan->term_count; i++) {
+        free(plan->terms[i].field);
+    }
+    for (size_t i = 0; i < plan->operand_count; i++) {
+        value_free(plan->literals[i]);
+    }
+    free(plan->terms);
+    free(plan->literals);
+    free(plan->params);
+    free(plan->collection);
+    free(plan->text);
+    free(plan);
+}
+
+// Parser state over the token array
+typedef struct {
+    const SqlToken* tokens;
+    size_t at;
+    SqlPlan* plan;
+    size_t term_capacity;
+    size_t operand_capacity;
+    size_t param_capacity;
+} SqlParser;
+
+static inline const SqlToken* sql_peek(const SqlParser* parser) {
+    return &parser->tokens[parser->at];
+}
+
+static bool sql_accept(SqlParser* parser, const char* text) {
+    const SqlToken* token = sql_peek(parser);
+    if ((token->kind != SQL_WORD && token->kind != SQL_SYMBOL) || strlen(text) != token->len ||
+        strncasecmp(text, token->text, token->len) != 0) {
+        return false;
+    }
+    parser->at++;
+    return true;
+}
+
+// _key and _value, which are case sensitive like the fields they stand beside
+static bool sql_accept_name(SqlParser* parser, const char* name) {
+    const SqlToken* token = sql_peek(parser);
+    if (token->kind != SQL_WORD || strlen(name) != token->len || memcmp(name, token->text, token->len) != 0) {
+        return false;
+    }
+    parser->at++;
+    return true;
+}
+
+// Collection name or field; keywords are reserved
+static char* sql_name(SqlParser* parser) {
+    const SqlToken* token = sql_peek(parser);
+    if (token->kind != SQL_WORD || sql_is_keyword(token)) return NULL;
+    parser->at++;
+    return strndup(token->text, token->len);
+}
+
+static bool sql_grow(void** items, size_t* capacity, size_t count, size_t size) {
+    if (count < *capacity) return true;
+    size_t grown = *capacity == 0 ? 8 : *capacity * 2;
+    void* resized = realloc(*items, grown * size);
+    if (!resized) return false;
+    *items = resized;
+    *capacity = grown;
+    return true;
+}
+
+static Value* sql_literal(const SqlToken* token) {
+    switch (token->kind) {
+        case SQL_NUMBER: {
+            if (memchr(token->text, '.', token->len) || memchr(token->text, 'e', token->len) ||
+                memchr(token->text, 'E', token->len)) {
+                return value_float(strtod(token->text, NULL));
+            }
+            errno = 0;
+            long long number = strtoll(token->text, NULL, 10);
+            return errno == 0 ? value_int(number) : value_float(strtod(token->text, NULL));
+        }
+        case SQL_STRING: {
+            char* text = (char*)malloc(token->len);
+            if (!text) return NULL;
+            size_t len = 0;
+            for (size_t i = 1; i + 1 < token->len; i++) {
+                text[len++] = token->text[i];
+                if (token->text[i] == '\'') i++;
+            }
+            text[len] = '\0';
+            Value* value = value_string(text);
+            free(text);
+            return value;
+        }
+        case SQL_WORD:
+            if (token->len == 4 && strncasecmp(token->text, "TRUE", 4) == 0) return value_bool(true);
+            if (token->len == 5 && strncasecmp(token->text, "FALSE", 5) == 0) return value_bool(false);
+            if (token->len == 4 && strncasecmp(token->text, "NULL", 4) == 0) return value_null();
+            return NULL;
+        default:
+            return NULL;
+    }
+}
+
+// Literal or ?; returns its index or SQL_NONE
+static size_t sql_operand(SqlParser* parser) {
+    SqlPlan* plan = parser->plan;
+    const SqlToken* token = sql_peek(parser);
+    if (!sql_grow((void**)&plan->literals, &parser->operand_capacity, plan->operand_count, sizeof(Value*))) {
+        return SQL_NONE;
+    }
+
+    Value* literal = NULL;
+    if (token->kind == SQL_PARAM) {
+        if (!sql_grow((void**)&plan->params, &parser->param_capacity, plan->param_count, sizeof(size_t))) {
+            return SQL_NONE;
+        }
+        plan->params[plan->param_count++] = plan->operand_count;
+    } else if (!(literal = sql_literal(token))) {
+        return SQL_NONE;
+    }
+    parser->at++;
+    plan->literals[plan->operand_count] = literal;
+    return plan->operand_count++;
+}
+
+static const char* sql_op(SqlParser* parser) {
+    static const char* const ops[] = { "=", "==", "!=", "<>", "<=", ">=", "<", ">", "LIKE" };
+    for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+        if (sql_accept(parser, ops[i])) return ops[i];
+    }
     return NULL;
 }
+
+// _key = operand, or a term for the find
+static bool sql_predicate(SqlParser* parser) {
+    SqlPlan* plan = parser->plan;
+    if (sql_accept_name(parser, "_key")) {
+        if (plan->key != SQL_NONE || !sql_accept(parser, "=")) return false;
+        plan->key = sql_operand(parser);
+        return plan->key != SQL_NONE;
+    }
+
+    if (!sql_grow((void**)&plan->terms, &parser->term_capacity, plan->term_count, sizeof(SqlTerm))) return false;
+    SqlTerm* term = &plan->terms[plan->term_count];
+    term->field = sql_name(parser);
+    if (!term->field) return false;
+    plan->term_count++;
+    term->first = plan->operand_count;
+
+    if (sql_accept(parser, "IN")) {
+        term->op = "IN";
+        if (!sql_accept(parser, "(")) return false;
+        if (!sql_accept(parser, ")")) {
+            do {
+                if (sql_operand(parser) == SQL_NONE) return false;
+            } while (sql_accept(parser, ","));
+            if (!sql_accept(parser, ")")) return false;
+        }
+    } else {
+        term->op = sql_op(parser);
+        if (!term->op || sql_operand(parser) == SQL_NONE) return false;
+    }
+    term->count = plan->operand_count - term->first;
+    if (term->count > plan->max_operands) plan->max_operands = term->count;
+    return true;
+}
+
+// WHERE _key = operand, the only shape UPDATE and DELETE take
+static bool sql_key_clause(SqlParser* parser) {
+    if (!sql_accept(parser, "WHERE") || !sql_accept_name(parser, "_key") || !sql_accept(parser, "=")) return false;
+    parser->plan->key = sql_operand(parser);
+    return parser->plan->key != SQL_NONE;
+}
+
+static bool sql_parse(SqlParser* parser) {
+    SqlPlan* plan = parser->plan;
+    if (sql_accept(parser, "SELECT")) {
+        plan->kind = SQL_SELECT;
+        if (!sql_accept(parser, "*") || !sql_accept(parser, "FROM")) return false;
+        if (!(plan->collection = sql_name(parser))) return false;
+        if (sql_accept(parser, "WHERE")) {
+            do {
+                if (!sql_predicate(parser)) return false;
+            } while (sql_accept(parser, "AND"));
+        }
+        if (sql_accept(parser, "LIMIT") && (plan->limit = sql_operand(parser)) == SQL_NONE) return false;
+    } else if (sql_accept(parser, "INSERT")) {
+        plan->kind = SQL_INSERT;
+        if (!sql_accept(parser, "INTO") || !(plan->collection = sql_name(parser))) return false;
+        if (!sql_accept(parser, "VALUES") || !sql_accept(parser, "(")) return false;
+        if ((plan->key = sql_operand(parser)) == SQL_NONE || !sql_accept(parser, ",")) return false;
+        if ((plan->value = sql_operand(parser)) == SQL_NONE || !sql_accept(parser, ")")) return false;
+    } else if (sql_accept(parser, "UPDATE")) {
+        plan->kind = SQL_UPDATE;
+        if (!(plan->collection = sql_name(parser))) return false;
+        if (!sql_accept(parser, "SET") || !sql_accept_name(parser, "_value") || !sql_accept(parser, "=")) return false;
+        if ((plan->value = sql_operand(parser)) == SQL_NONE || !sql_key_clause(parser)) return false;
+    } else if (sql_accept(parser, "DELETE")) {
+        plan->kind = SQL_DELETE;
+        if (!sql_accept(parser, "FROM") || !(plan->collection = sql_name(parser))) return false;
+        if (!sql_key_clause(parser)) return false;
+    } else {
+        return false;
+    }
+    return sql_peek(parser)->kind == SQL_END;
+}
+
+static SqlPlan* sql_plan_build(const SqlToken* tokens, char* text, uint64_t hash) {
+    SqlPlan* plan = (SqlPlan*)calloc(1, sizeof(SqlPlan));
+    if (!plan) {
+        free(text);
+        return NULL;
+    }
+    plan->text = text;
+    plan->hash = hash;
+    plan->key = plan->value = plan->limit = SQL_NONE;
+
+    SqlParser parser = { tokens, 0, plan, 0, 0, 0 };
+    if (!sql_parse(&parser)) {
+        sql_plan_free(plan);
+        return NULL;
+    }
+    return plan;
+}
+
+static void sql_lru_unlink(SqlCache* cache, SqlPlan* plan) {
+    if (plan->newer) plan->newer->older = plan->older;
+    else cache->newest = plan->older;
+    if (plan->older) plan->older->newer = plan->newer;
+    else cache->oldest = plan->newer;
+    plan->newer = plan->older = NULL;
+}
+
+static void sql_lru_push(SqlCache* cache, SqlPlan* plan) {
+    plan->older = cache->newest;
+    plan->newer = NULL;
+    if (cache->newest) cache->newest->newer = plan;
+    else cache->oldest = plan;
+    cache->newest = plan;
+}
+
+// Caller holds the cache lock
+static void sql_cache_evict(SqlCache* cache, SqlPlan* plan) {
+    SqlPlan** link = &cache->buckets[plan->hash & (SQL_CACHE_BUCKETS - 1)];
+    while (*link != plan) link = &(*link)->bucket_next;
+    *link = plan->bucket_next;
+    sql_lru_unlink(cache, plan);
+    cache->count--;
+    plan->cached = false;
+    if (--plan->refs == 0) sql_plan_free(plan);
+}
+
+// Cached plan for text with a reference taken, or NULL
+static SqlPlan* sql_cache_get(SqlCache* cache, const char* text, size_t len, uint64_t hash) {
+    pthread_mutex_lock(&cache->lock);
+    SqlPlan* plan = cache->buckets[hash & (SQL_CACHE_BUCKETS - 1)];
+    while (plan && (plan->hash != hash || strncmp(plan->text, text, len + 1) != 0)) {
+        plan = plan->bucket_next;
+    }
+    if (plan) {
+        plan->refs++;
+        if (cache->newest != plan) {
+            sql_lru_unlink(cache, plan);
+            sql_lru_push(cache, plan);
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return plan;
+}
+
+// Caches a new plan with a reference for the caller. If another thread cached the same
+// text first, that plan is returned instead and this one freed.
+static SqlPlan* sql_cache_put(SqlCache* cache, SqlPlan* plan) {
+    SqlPlan* cached = sql_cache_get(cache, plan->text, strlen(plan->text), plan->hash);
+    if (cached) {
+        sql_plan_free(plan);
+        return cached;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    if (cache->count >= SQL_CACHE_PLANS) sql_cache_evict(cache, cache->oldest);
+    SqlPlan** bucket = &cache->buckets[plan->hash & (SQL_CACHE_BUCKETS - 1)];
+    plan->bucket_next = *bucket;
+    *bucket = plan;
+    sql_lru_push(cache, plan);
+    cache->count++;
+    plan->cached = true;
+    plan->refs = 2;
+    pthread_mutex_unlock(&cache->lock);
+    return plan;
+}
+
+static void sql_plan_release(SqlCache* cache, SqlPlan* plan) {
+    pthread_mutex_lock(&cache->lock);
+    bool unused = --plan->refs == 0;
+    pthread_mutex_unlock(&cache->lock);
+    if (unused) sql_plan_free(plan);
+}
+
+static void sql_cache_destroy(SqlCache* cache) {
+    while (cache->oldest) sql_cache_evict(cache, cache->oldest);
+    pthread_mutex_destroy(&cache->lock);
+}
+
+// Deep copy, for reads that outlive their pin and writes that take ownership
+static Value* value_clone(const Value* value) {
+    Value* copy = (Value*)malloc(sizeof(Value));
+    if (!copy) return NULL;
+    *copy = *value;
+    if (value->type == TYPE_STRING || value->type == TYPE_BLOB) {
+        void* data = malloc(value->size + 1);
+        if (!data) {
+            free(copy);
+            return NULL;
+        }
+        memcpy(data, value->type == TYPE_STRING ? (void*)value->data.string_val : value->data.blob_val, value->size);
+        ((char*)data)[value->size] = '\0';
+        if (value->type == TYPE_STRING) copy->data.string_val = (char*)data;
+        else copy->data.blob_val = data;
+    }
+    return copy;
+}
+
+// Parses sql, or finds it in the plan cache, and sets up a statement for it
+EghactStmt* eghactdb_prepare(EghactDB* db, const char* sql) {
+    if (!db || !sql) return NULL;
+    SqlToken tokens[SQL_MAX_TOKENS];
+    size_t count, len;
+    if (!sql_lex(sql, tokens, &count)) return NULL;
+    char* text = sql_normalize(tokens, count, &len);
+    if (!text) return NULL;
+
+    uint64_t hash = sql_hash(text, len);
+    SqlPlan* plan = sql_cache_get(&db->plans, text, len, hash);
+    if (plan) {
+        free(text);
+    } else {
+        plan = sql_plan_build(tokens, text, hash);
+        if (!plan) return NULL;
+        plan = sql_cache_put(&db->plans, plan);
+    }
+
+    EghactStmt* stmt = (EghactStmt*)calloc(1, sizeof(EghactStmt));
+    if (stmt) {
+        stmt->db = db;
+        stmt->plan = plan;
+        stmt->collection = eghactdb_get_collection(db, plan->collection);
+        stmt->operands = (Value**)calloc(plan->operand_count + 1, sizeof(Value*));
+        stmt->params = (Value*)calloc(plan->param_count + 1, sizeof(Value));
+        stmt->queries = (Query*)calloc(plan->term_count + 1, sizeof(Query));
+        stmt->predicates = (Predicate*)malloc((plan->term_count + 1) * sizeof(Predicate));
+        stmt->ranges = (TermRange*)malloc((plan->max_operands + 1) * sizeof(TermRange));
+    }
+    if (!stmt || !stmt->collection || !stmt->operands || !stmt->params || !stmt->queries ||
+        !stmt->predicates || !stmt->ranges) {
+        if (!stmt) sql_plan_release(&db->plans, plan);
+        eghactdb_finalize(stmt);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < plan->operand_count; i++) {
+        stmt->operands[i] = plan->literals[i];
+    }
+    for (size_t i = 0; i < plan->term_count; i++) {
+        const SqlTerm* term = &plan->terms[i];
+        Query* query = &stmt->queries[i];
+        query->field = term->field;
+        query->op = (char*)term->op;
+        query->value = term->count > 0 ? stmt->operands[term->first] : NULL;
+        query->values = &stmt->operands[term->first];
+        query->value_count = term->count;
+        query->next = i + 1 < plan->term_count ? &stmt->queries[i + 1] : NULL;
+    }
+    return stmt;
+}
+
+// Ends an execution: drops the rows and the pin that keeps them valid
+void eghactdb_reset(EghactStmt* stmt) {
+    if (!stmt) return;
+    if (stmt->pin) read_end(stmt->pin);
+    stmt->pin = NULL;
+    stmt->running = false;
+    stmt->row_count = 0;
+    stmt->row = 0;
+    stmt->key_bytes = 0;
+}
+
+// Binds parameter index, counted from 1; value is borrowed until the statement is reset
+// or the parameter bound again
+bool eghactdb_bind(EghactStmt* stmt, size_t index, const Value* value) {
+    if (!stmt || !value || index < 1 || index > stmt->plan->param_count) return false;
+    eghactdb_reset(stmt);
+
+    size_t operand = stmt->plan->params[index - 1];
+    stmt->operands[operand] = (Value*)value;
+    for (size_t i = 0; i < stmt->plan->term_count; i++) {
+        if (stmt->plan->terms[i].first == operand) stmt->queries[i].value = (Value*)value;
+    }
+    return true;
+}
+
+bool eghactdb_bind_int(EghactStmt* stmt, size_t index, int64_t value) {
+    if (!stmt || index < 1 || index > stmt->plan->param_count) return false;
+    Value* param = &stmt->params[index - 1];
+    param->type = TYPE_INT;
+    param->data.int_val = value;
+    return eghactdb_bind(stmt, index, param);
+}
+
+// text is borrowed like a bound value
+bool eghactdb_bind_text(EghactStmt* stmt, size_t index, const char* text) {
+    if (!stmt || !text || index < 1 || index > stmt->plan->param_count) return false;
+    Value* param = &stmt->params[index - 1];
+    param->type = TYPE_STRING;
+    param->data.string_val = (char*)text;
+    param->size = strlen(text);
+    return eghactdb_bind(stmt, index, param);
+}
+
+// Appends a row, growing the buffers only past the largest result so far
+static bool sql_collect(const char* key, size_t len, Value* value, void* user_data) {
+    EghactStmt* stmt = (EghactStmt*)user_data;
+    if (stmt->row_count >= stmt->row_capacity) {
+        size_t capacity = stmt->row_capacity == 0 ? 16 : stmt->row_capacity * 2;
+        SqlRow* rows = (SqlRow*)realloc(stmt->rows, capacity * sizeof(SqlRow));
+        if (!rows) return false;
+        stmt->rows = rows;
+        stmt->row_capacity = capacity;
+    }
+    if (stmt->key_bytes + len + 1 > stmt->key_capacity) {
+        size_t capacity = stmt->key_capacity == 0 ? 1024 : stmt->key_capacity;
+        while (capacity < stmt->key_bytes + len + 1) capacity *= 2;
+        char* keys = (char*)realloc(stmt->keys, capacity);
+        if (!keys) return false;
+        stmt->keys = keys;
+        stmt->key_capacity = capacity;
+    }
+
+    memcpy(stmt->keys + stmt->key_bytes, key, len);
+    stmt->keys[stmt->key_bytes + len] = '\0';
+    stmt->rows[stmt->row_count++] = (SqlRow){ stmt->key_bytes, len, value };
+    stmt->key_bytes += len + 1;
+    return stmt->row_count < stmt->limit;
+}
+
+static const Value* sql_bound(const EghactStmt* stmt, size_t operand) {
+    return operand == SQL_NONE ? NULL : stmt->operands[operand];
+}
+
+// Collects every row under a new pin
+static bool sql_select(EghactStmt* stmt) {
+    const SqlPlan* plan = stmt->plan;
+    const Value* limit = sql_bound(stmt, plan->limit);
+    const Value* key = sql_bound(stmt, plan->key);
+    if ((limit && (limit->type != TYPE_INT || limit->data.int_val < 0)) ||
+        (key && (key->type != TYPE_STRING || key->size > MAX_KEY_SIZE))) {
+        return false;
+    }
+    for (size_t i = 0; i < plan->operand_count; i++) {
+        if (!stmt->operands[i]) return false;  // Never bound
+    }
+    stmt->limit = limit ? (size_t)limit->data.int_val : SIZE_MAX;
+
+    QueryPlan query_plan;
+    if (!plan_prepare(plan->term_count > 0 ? stmt->queries : NULL, &query_plan, stmt->predicates)) return false;
+
+    EghactDB* db = stmt->db;
+    stmt->pin = read_begin(db);
+    DbVersion* version = version_current(db);
+    if (stmt->limit == 0) {
+        // Nothing to collect
+    } else if (key) {
+        BTreeNode* root = version_root(&db->file, version, stmt->collection);
+        Value* doc = btree_lookup(&db->file, root, (const uint8_t*)key->data.string_val, key->size);
+        if (doc && (query_plan.count == 0 || plan_match(&query_plan, doc, false))) {
+            sql_collect(key->data.string_val, key->size, doc, stmt);
+        }
+    } else {
+        plan_run(&db->file, version, stmt->collection, &query_plan, stmt->ranges, sql_collect, stmt);
+    }
+    return true;
+}
+
+static bool sql_write(EghactStmt* stmt) {
+    const SqlPlan* plan = stmt->plan;
+    const Value* key = sql_bound(stmt, plan->key);
+    const Value* value = sql_bound(stmt, plan->value);
+    if (!key || key->type != TYPE_STRING || (plan->kind != SQL_DELETE && !value)) return false;
+    if (plan->kind == SQL_DELETE) return eghactdb_delete(stmt->collection, key->data.string_val);
+
+    Value* copy = value_clone(value);
+    if (!copy) return false;
+    bool ok = plan->kind == SQL_INSERT ? eghactdb_insert(stmt->collection, key->data.string_val, copy)
+                                       : eghactdb_update(stmt->collection, key->data.string_val, copy);
+    if (!ok) value_free(copy);
+    return ok;
+}
+
+// Moves to the next row. A SELECT collects its rows on the first step; a write runs
+// there and returns EGHACTDB_DONE. Stepping after EGHACTDB_DONE or EGHACTDB_ERROR runs
+// the statement again with the same bindings.
+EghactStepResult eghactdb_step(EghactStmt* stmt) {
+    if (!stmt) return EGHACTDB_ERROR;
+    if (!stmt->running) {
+        EGHACT_PERF_SCOPE("db", "step");
+        if (stmt->plan->kind != SQL_SELECT) return sql_write(stmt) ? EGHACTDB_DONE : EGHACTDB_ERROR;
+        bool ok = sql_select(stmt);
+        stmt->running = true;
+        if (!ok) {
+            eghactdb_reset(stmt);
+            return EGHACTDB_ERROR;
+        }
+    } else {
+        stmt->row++;
+    }
+
+    if (stmt->row < stmt->row_count) return EGHACTDB_ROW;
+    eghactdb_reset(stmt);
+    return EGHACTDB_DONE;
+}
+
+// Key of the current row, NUL terminated
+const char* eghactdb_row_key(const EghactStmt* stmt, size_t* len) {
+    if (!stmt || !stmt->running || stmt->row >= stmt->row_count) return NULL;
+    const SqlRow* row = &stmt->rows[stmt->row];
+    if (len) *len = row->len;
+    return stmt->keys + row->key;
+}
+
+Value* eghactdb_row_value(const EghactStmt* stmt) {
+    if (!stmt || !stmt->running || stmt->row >= stmt->row_count) return NULL;
+    return stmt->rows[stmt->row].value;
+}
+
+void eghactdb_finalize(EghactStmt* stmt) {
+    if (!stmt) return;
+    eghactdb_reset(stmt);
+    sql_plan_release(&stmt->db->plans, stmt->plan);
+    free(stmt->operands);
+    free(stmt->params);
+    free(stmt->queries);
+    free(stmt->predicates);
+    free(stmt->ranges);
+    free(stmt->rows);
+    free(stmt->keys);
+    free(stmt);
+}
+
+// Runs one statement without parameters; rows come back as copies
+ResultSet* eghactdb_query(EghactDB* db, const char* sql) {
+    EghactStmt* stmt = eghactdb_prepare(db, sql);
+    if (!stmt) return NULL;
+
+    ResultSet* results = (ResultSet*)calloc(1, sizeof(ResultSet));
+    EghactStepResult step = EGHACTDB_ERROR;
+    while (results && (step = eghactdb_step(stmt)) == EGHACTDB_ROW) {
+        if (results->count >= results->capacity) {
+            size_t capacity = results->capacity == 0 ? 16 : results->capacity * 2;
+            Value** grown = (Value**)realloc(results->results, capacity * sizeof(Value*));
+            if (!grown) break;
+            results->results = grown;
+            results->capacity = capacity;
+        }
+        Value* copy = value_clone(eghactdb_row_value(stmt));
+        if (!copy) break;
+        results->results[results->count++] = copy;
+    }
+    eghactdb_finalize(stmt);
+    if (step != EGHACTDB_DONE) {
+        eghactdb_free_results(results);
+        return NULL;
+    }
+    return results;
+}
+
+void eghactdb_free_results(ResultSet* results) {
+    if (!results) return;
+    
+    for (size_t i = 0; i < results->count; i++) {
+        value_free(results->results[i]);
+    }
+    free(results->results);
+    free(results);
+}
+
+// Transaction support
+Transaction* eghactdb_begin_transaction(EghactDB* db) {
+    if (!db) return NULL;
+    Transaction* tx = (Transaction*)calloc(1, sizeof(Transaction));
+    tx->db = db;
+    tx->active = true;
+    tx->pin = read_begin(db);
+    tx->snapshot = version_current(db);
+    tx->ops = NULL;
+    tx->op_count = 0;
+    tx->op_capacity = 0;
+    pthread_mutex_init(&tx->lock, NULL);
+    return tx;
+}
+
+// Buffers a write; on success the transaction owns value
+static bool tx_add(Transaction* tx, uint8_t op, Collection* collection, const char* key, Value* value) {
+    if (!tx || !tx->active || !collection || collection->db != tx->db || !key) return false;
+    size_t len = strlen(key);
+    if (len > MAX_KEY_SIZE) return false;
+    
+    pthread_mutex_lock(&tx->lock);
+    
+    bool added = false;
+    if (tx->op_count >= tx->op_capacity) {
+        size_t new_capacity = tx->op_capacity == 0 ? 8 : tx->op_capacity * 2;
+        TxOp* ops = (TxOp*)realloc(tx->ops, new_capacity * sizeof(TxOp));
+        if (ops) {
+            tx->ops = ops;
+            tx->op_capacity = new_capacity;
+        }
+    }
+    char* key_copy = tx->op_count < tx->op_capacity ? (char*)malloc(len + 1) : NULL;
+    if (key_copy) {
+        memcpy(key_copy, key, len + 1);
+        tx->ops[tx->op_count++] = (TxOp){ op, collection, key_copy, len, value };
+        added = true;
+    }
+    
+    pthread_mutex_unlock(&tx->lock);
+    
+    return added;
+}
+
+bool eghactdb_tx_insert(Transaction* tx, Collection* collection, const char* key, Value* value) {
+    return value && tx_add(tx, WAL_OP_INSERT, collection, key, value);
+}
+
+bool eghactdb_tx_update(Transaction* tx, Collection* collection, const char* key, Value* value) {
+    return value && tx_add(tx, WAL_OP_UPDATE, collection, key, value);
+}
+
+bool eghactdb_tx_delete(Transaction* tx, Collection* collection, const char* key) {
+    return tx_add(tx, WAL_OP_DELETE, collection, key, NULL);
+}
+
+// Snapshot reads; values stay valid until the transaction ends
+Value* eghactdb_tx_get(Transaction* tx, Collection* collection, const char* key) {
+    if (!tx || !tx->active || !collection || collection->db != tx->db || !key) return NULL;
+    
+    const PageFile* file = &tx->db->file;
+    return btree_lookup(file, version_root(file, tx->snapshot, collection), (const uint8_t*)key, strlen(key));
+}
+
+size_t eghactdb_tx_scan(Transaction* tx, Collection* collection, const char* start, const char* end,
+                        EghactScanFn fn, void* user_data) {
+    if (!tx || !tx->active || !collection || collection->db != tx->db || !fn) return 0;
+    
+    const PageFile* file = &tx->db->file;
+    return btree_scan(file, version_root(file, tx->snapshot, collection), start, end, true, fn, user_data);
+}
+
+size_t eghactdb_tx_find(Transaction* tx, Collection* collection, const Query* query,
+                        EghactScanFn fn, void* user_data) {
+    if (!tx || !tx->active || !collection || collection->db != tx->db || collection->base || !query || !fn) {
+        return 0;
+    }
+    return query_run(&tx->db->file, tx->snapshot, collection, query, fn, user_data);
+}
+
+static void tx_free(Transaction* tx) {
+    read_end(tx->pin);
+    for (size_t i = 0; i < tx->op_count; i++) {
+        free(tx->ops[i].key);
+        value_free(tx->ops[i].value);
+    }
+    pthread_mutex_destroy(&tx->lock);
+    free(tx->ops);
+    free(tx);
+}
+
+// Applies the buffered writes in order as one log frame and waits until it is durable.
+// Writes that don't apply (inserting an existing key, updating or deleting a missing
+// one) are skipped. Concurrent commits share a single fdatasync.
+bool eghactdb_commit_transaction(Transaction* tx) {
+    if (!tx || !tx->active) return false;
+    EGHACT_PERF_SCOPE("db", "commit");
+    EGHACT_PERF_ADD(perf_db_commits, 1);
+    
+    pthread_mutex_lock(&tx->lock);
+    tx->active = false;
+    
+    EghactDB* db = tx->db;
+    Wal* wal = &db->wal;
+    size_t bytes = WAL_FRAME_HEADER;
+    for (size_t i = 0; i < tx->op_count; i++) {
+        bytes += wal_op_size(tx->ops[i].key_len, tx->ops[i].value);
+    }
+    
+    pthread_rwlock_rdlock(&db->checkpoint_lock);
+    pthread_mutex_lock(&wal->lock);
+    
+    bool committed = !wal->failed && wal_reserve(&wal->pending, bytes);
+    if (committed) {
+        size_t start = wal_begin_frame(&wal->pending);
+        for (size_t i = 0; i < tx->op_count; i++) {
+            TxOp* op = &tx->ops[i];
+            if (collection_apply(op->collection, op->op, op->key, op->key_len, op->value)) {
+                wal_put_op(&wal->pending, op->op, op->collection->id, op->key, op->key_len, op->value);
+                op->value = NULL;  // Owned by the tree now
+            }
+        }
+        size_t frame = wal_end_frame(&wal->pending, start);
+        if (frame > 0) {
+            wal->appended_lsn += frame;
+            wal->commits++;
+        }
+        
+        // Every write becomes visible to readers at once
+        versions_publish(db);
+        for (size_t i = 0; i < tx->op_count; i++) {
+            TxOp* op = &tx->ops[i];
+            if (op->op != WAL_OP_INSERT) {
+                cache_invalidate(db->cache, op->collection, op->key, op->key_len);
+            }
+        }
+    }
+    pthread_rwlock_unlock(&db->checkpoint_lock);
+    
+    // Applied writes are visible now; report success once they are durable
+    if (committed) {
+        committed = wal_sync_locked(wal, wal->appended_lsn);
+    }
+    
+    pthread_mutex_unlock(&wal->lock);
+    pthread_mutex_unlock(&tx->lock);
+    tx_free(tx);
+    
+    return committed;
+}
+
+bool eghactdb_rollback_transaction(Transaction* tx) {
+    if (!tx || !tx->active) return false;
+    
+    pthread_mutex_lock(&tx->lock);
+    
+    // Nothing was applied yet; drop the buffered writes
+    tx->active = false;
+    
+    pthread_mutex_unlock(&tx->lock);
+    tx_free(tx);
+    
+    return true;
+}
+
+// WebAssembly exports
+#ifdef __EMSCRIPTEN__
+EMSCRIPTEN_KEEPALIVE
+void* eghactdb_wasm_open(const char* path) {
+    return eghactdb_open(path);
+}
+
+EMSCRIPTEN_KEEPALIVE
+void eghactdb_wasm_close(void* db) {
+    eghactdb_close((EghactDB*)db);
+}
+
+EMSCRIPTEN_KEEPALIVE
+void* eghactdb_wasm_create_collection(void* db, const char* name) {
+    return eghactdb_create_collection((EghactDB*)db, name);
+}
+
+EMSCRIPTEN_KEEPALIVE
+bool eghactdb_wasm_insert(void* collection, const char* key, const char* json_value) {
+    // Parse JSON and create value
+    Value* val = value_string(json_value);  // Simplified
+    if (eghactdb_insert((Collection*)collection, key, val)) return true;
+    value_free(val);
+    return false;
+}
+
+// The caller frees the returned string
+EMSCRIPTEN_KEEPALIVE
+char* eghactdb_wasm_get(void* collection, const char* key) {
+    Value* val = eghactdb_get((Collection*)collection, key);
+    if (!val) return NULL;
+    
+    // Convert to JSON
+    char* json = NULL;
+    if (val->type == TYPE_STRING) {
+        json = val->data.string_val;
+        val->data.string_val = NULL;
+    }
+    value_free(val);
+    
+    return json;
+}
 #endif
\ No newline at end of file
@@ -0,0 +1,412 @@
+/**
+ * EghactDB - Engine Tests
+ * Writes, reopening, crash recovery and concurrent access against scratch databases
+ *
+ * Usage: eghactdb_test [directory]
+ *
+ * Databases are created in directory (default: the current one) and replaced on every
+ * run. The engine is compiled into the test, so checks can look inside collections.
+ */
+
+#include "../src/eghactdb.c"
+#include <limits.h>
+#include <sys/wait.h>
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        exit(1); \
+    } \
+} while (0)
+
+#define CRUD_KEYS 3000
+#define CRASH_KEYS 2000
+#define ACCOUNTS 1000
+#define BALANCE 100
+#define WRITERS 2
+#define WRITER_ROUNDS 300
+#define AUDITORS 2
+#define GETTERS 2
+
+static const char* g_dir = ".";
+
+static void db_path(char* path, size_t size, const char* name) {
+    snprintf(path, size, "%s/%s", g_dir, name);
+    char wal[PATH_MAX + 8];
+    snprintf(wal, sizeof(wal), "%s-wal", path);
+    unlink(path);
+    unlink(wal);
+}
+
+static bool count_row(const char* key, size_t key_len, Value* value, void* user_data) {
+    (*(size_t*)user_data)++;
+    return true;
+}
+
+static size_t count_rows(Collection* collection) {
+    size_t rows = 0;
+    eghactdb_scan(collection, NULL, NULL, count_row, &rows);
+    return rows;
+}
+
+static bool value_is_int(Collection* collection, const char* key, int64_t expected) {
+    Value* value = eghactdb_get(collection, key);
+    bool ok = value && value->type == TYPE_INT && value->data.int_val == expected;
+    value_free(value);
+    return ok;
+}
+
+static bool value_is_string(Collection* collection, const char* key, const char* expected) {
+    Value* value = eghactdb_get(collection, key);
+    bool ok = value && value->type == TYPE_STRING && strcmp(value->data.string_val, expected) == 0;
+    value_free(value);
+    return ok;
+}
+
+static bool value_missing(Collection* collection, const char* key) {
+    Value* value = eghactdb_get(collection, key);
+    value_free(value);
+    return value == NULL;
+}
+
+// Insert, update and delete, single and in transactions
+
+// Key i ends deleted when divisible by 3, a string when even, else the int i
+static void crud_write(EghactDB* db) {
+    Collection* items = eghactdb_create_collection(db, "items");
+    Collection* misc = eghactdb_create_collection(db, "misc");
+    CHECK(items && misc);
+    char key[32], text[32];
+    for (int i = 0; i < CRUD_KEYS; i++) {
+        snprintf(key, sizeof(key), "item%05d", i);
+        CHECK(eghactdb_insert(items, key, value_int(i)));
+    }
+    for (int i = 0; i < CRUD_KEYS; i += 2) {
+        snprintf(key, sizeof(key), "item%05d", i);
+        snprintf(text, sizeof(text), "even %d", i);
+        CHECK(eghactdb_update(items, key, value_string(text)));
+    }
+    for (int i = 0; i < CRUD_KEYS; i += 3) {
+        snprintf(key, sizeof(key), "item%05d", i);
+        CHECK(eghactdb_delete(items, key));
+    }
+
+    // Writes that don't apply leave the value with the caller
+    Value* duplicate = value_int(-1);
+    CHECK(!eghactdb_insert(items, "item00001", duplicate));
+    value_free(duplicate);
+    Value* missing = value_int(-1);
+    CHECK(!eghactdb_update(items, "item00000", missing));
+    value_free(missing);
+    CHECK(!eghactdb_delete(items, "item00000"));
+
+    CHECK(eghactdb_insert(misc, "blob", value_blob("\0\1\2", 3)));
+    CHECK(eghactdb_insert(misc, "float", value_float(2.5)));
+    Transaction* tx = eghactdb_begin_transaction(db);
+    CHECK(eghactdb_tx_insert(tx, misc, "committed", value_bool(true)));
+    CHECK(eghactdb_tx_update(tx, misc, "float", value_float(4.5)));
+    CHECK(eghactdb_commit_transaction(tx));
+    tx = eghactdb_begin_transaction(db);
+    CHECK(eghactdb_tx_insert(tx, misc, "rolled back", value_int(1)));
+    CHECK(eghactdb_rollback_transaction(tx));
+}
+
+static void crud_verify(EghactDB* db) {
+    Collection* items = eghactdb_get_collection(db, "items");
+    Collection* misc = eghactdb_get_collection(db, "misc");
+    CHECK(items && misc);
+    char key[32], text[32];
+    size_t live = 0;
+    for (int i = 0; i < CRUD_KEYS; i++) {
+        snprintf(key, sizeof(key), "item%05d", i);
+        snprintf(text, sizeof(text), "even %d", i);
+        if (i % 3 == 0) {
+            CHECK(value_missing(items, key));
+        } else {
+            CHECK(i % 2 == 0 ? value_is_string(items, key, text) : value_is_int(items, key, i));
+            live++;
+        }
+    }
+    CHECK(items->count == live && count_rows(items) == live);
+
+    Value* blob = eghactdb_get(misc, "blob");
+    CHECK(blob && blob->type == TYPE_BLOB && blob->size == 3 && memcmp(blob->data.blob_val, "\0\1\2", 3) == 0);
+    value_free(blob);
+    Value* number = eghactdb_get(misc, "float");
+    CHECK(number && number->type == TYPE_FLOAT && number->data.float_val == 4.5);
+    value_free(number);
+    Value* flag = eghactdb_get(misc, "committed");
+    CHECK(flag && flag->type == TYPE_BOOL && flag->data.bool_val);
+    value_free(flag);
+    CHECK(value_missing(misc, "rolled back"));
+}
+
+static void test_crud_reopen(void) {
+    char path[PATH_MAX];
+    db_path(path, sizeof(path), "crud.db");
+
+    EghactDB* db = eghactdb_open(path);
+    CHECK(db);
+    crud_write(db);
+    crud_verify(db);
+    eghactdb_close(db);
+
+    // Closing checkpoints into the page file; reopen from it, then from a new checkpoint
+    db = eghactdb_open(path);
+    CHECK(db);
+    crud_verify(db);
+    CHECK(eghactdb_checkpoint(db));
+    EghactWalStats stats;
+    eghactdb_get_wal_stats(db, &stats);
+    CHECK(stats.pending_bytes == 0);
+    eghactdb_close(db);
+
+    db = eghactdb_open(path);
+    CHECK(db);
+    crud_verify(db);
+    eghactdb_close(db);
+    printf("crud and reopen: ok\n");
+}
+
+// Crash recovery
+//
+// A child process commits and then exits without closing, so nothing is checkpointed
+// past what it did explicitly. Reopening must replay the log over the page file.
+
+// Runs fn in a child that _exits without closing the database
+static void crash_after(void (*fn)(const char*), const char* path) {
+    fflush(stdout);
+    pid_t pid = fork();
+    CHECK(pid >= 0);
+    if (pid == 0) {
+        fn(path);
+        _exit(0);
+    }
+    int status;
+    CHECK(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+// Key i holds i + 1 when even, i otherwise; every tenth is deleted
+static void crash_first_run(const char* path) {
+    EghactDB* db = eghactdb_open(path);
+    Collection* keys = eghactdb_create_collection(db, "keys");
+    CHECK(db && keys);
+    char key[32];
+    for (int i = 0; i < CRASH_KEYS; i++) {
+        snprintf(key, sizeof(key), "key%05d", i);
+        CHECK(eghactdb_insert(keys, key, value_int(i)));
+    }
+
+    // The rest lands in the log on top of a checkpointed page file
+    CHECK(eghactdb_checkpoint(db));
+    for (int i = 0; i < CRASH_KEYS; i += 2) {
+        snprintf(key, sizeof(key), "key%05d", i);
+        CHECK(eghactdb_update(keys, key, value_int(i + 1)));
+    }
+    Transaction* tx = eghactdb_begin_transaction(db);
+    for (int i = 0; i < CRASH_KEYS; i += 10) {
+        snprintf(key, sizeof(key), "key%05d", i);
+        CHECK(eghactdb_tx_delete(tx, keys, key));
+    }
+    CHECK(eghactdb_tx_insert(tx, keys, "committed", value_string("yes")));
+    CHECK(eghactdb_commit_transaction(tx));
+
+    // Never committed, so never recovered
+    tx = eghactdb_begin_transaction(db);
+    CHECK(eghactdb_tx_insert(tx, keys, "uncommitted", value_int(1)));
+}
+
+// After the first run was recovered: a new collection and more single writes. Those
+// are durable once a later commit is, so one follows them.
+static void crash_second_run(const char* path) {
+    EghactDB* db = eghactdb_open(path);
+    Collection* keys = eghactdb_get_collection(db, "keys");
+    Collection* later = eghactdb_create_collection(db, "later");
+    CHECK(db && keys && later);
+    CHECK(eghactdb_insert(later, "after recovery", value_int(7)));
+    Transaction* tx = eghactdb_begin_transaction(db);
+    CHECK(eghactdb_tx_update(tx, keys, "committed", value_string("twice")));
+    CHECK(eghactdb_commit_transaction(tx));
+}
+
+static void crash_verify(EghactDB* db, const char* committed) {
+    Collection* keys = eghactdb_get_collection(db, "keys");
+    CHECK(keys);
+    char key[32];
+    size_t live = 1;
+    for (int i = 0; i < CRASH_KEYS; i++) {
+        snprintf(key, sizeof(key), "key%05d", i);
+        if (i % 10 == 0) {
+            CHECK(value_missing(keys, key));
+        } else {
+            CHECK(value_is_int(keys, key, i % 2 == 0 ? i + 1 : i));
+            live++;
+        }
+    }
+    CHECK(value_is_string(keys, "committed", committed));
+    CHECK(value_missing(keys, "uncommitted"));
+    CHECK(keys->count == live && count_rows(keys) == live);
+}
+
+static void test_crash_recovery(void) {
+    char path[PATH_MAX];
+    db_path(path, sizeof(path), "crash.db");
+
+    crash_after(crash_first_run, path);
+    EghactDB* db = eghactdb_open(path);
+    CHECK(db);
+    crash_verify(db, "yes");
+    eghactdb_close(db);
+
+    crash_after(crash_second_run, path);
+    db = eghactdb_open(path);
+    CHECK(db);
+    crash_verify(db, "twice");
+    Collection* later = eghactdb_get_collection(db, "later");
+    CHECK(later && value_is_int(later, "after recovery", 7));
+    eghactdb_close(db);
+    printf("crash recovery: ok\n");
+}
+
+// Concurrent readers and writers
+//
+// Writers move amounts between an account in "from" and the same key in "to", one
+// transaction per round, each over its own share of the accounts. Every snapshot must
+// see the same total. Plain gets run alongside and must always find an account.
+
+typedef struct {
+    EghactDB* db;
+    Collection* from;
+    Collection* to;
+    _Atomic bool stop;
+    _Atomic uint64_t snapshots;
+    _Atomic uint64_t gets;
+    int64_t balance_from[ACCOUNTS];
+    int64_t balance_to[ACCOUNTS];
+} Bank;
+
+typedef struct {
+    Bank* bank;
+    int index;
+} BankThread;
+
+static bool sum_balance(const char* key, size_t key_len, Value* value, void* user_data) {
+    *(int64_t*)user_data += value->data.int_val;
+    return true;
+}
+
+static void* bank_writer(void* arg) {
+    BankThread* thread = arg;
+    Bank* bank = thread->bank;
+    unsigned seed = (unsigned)thread->index + 1;
+    char key[32];
+    for (int round = 0; round < WRITER_ROUNDS; round++) {
+        Transaction* tx = eghactdb_begin_transaction(bank->db);
+        for (int j = 0; j < 8; j++) {
+            seed = seed * 1103515245 + 12345;
+            int account = (int)((seed >> 8) % (ACCOUNTS / WRITERS)) * WRITERS + thread->index;
+            int64_t amount = (seed >> 4) % 7;
+            bank->balance_from[account] -= amount;
+            bank->balance_to[account] += amount;
+            snprintf(key, sizeof(key), "account%05d", account);
+            CHECK(eghactdb_tx_update(tx, bank->from, key, value_int(bank->balance_from[account])));
+            CHECK(eghactdb_tx_update(tx, bank->to, key, value_int(bank->balance_to[account])));
+        }
+        CHECK(eghactdb_commit_transaction(tx));
+        if (thread->index == 0 && round % 100 == 99) CHECK(eghactdb_checkpoint(bank->db));
+    }
+    return NULL;
+}
+
+static void* bank_auditor(void* arg) {
+    Bank* bank = ((BankThread*)arg)->bank;
+    while (!atomic_load(&bank->stop)) {
+        Transaction* tx = eghactdb_begin_transaction(bank->db);
+        int64_t total = 0;
+        size_t rows = eghactdb_tx_scan(tx, bank->from, NULL, NULL, sum_balance, &total);
+        rows += eghactdb_tx_scan(tx, bank->to, NULL, NULL, sum_balance, &total);
+        CHECK(rows == 2 * ACCOUNTS && total == (int64_t)ACCOUNTS * BALANCE);
+
+        // Snapshot values stay valid until the transaction ends
+        Value* first = eghactdb_tx_get(tx, bank->from, "account00000");
+        CHECK(first && first->type == TYPE_INT);
+        CHECK(eghactdb_rollback_transaction(tx));
+        atomic_fetch_add(&bank->snapshots, 1);
+    }
+    return NULL;
+}
+
+static void* bank_getter(void* arg) {
+    BankThread* thread = arg;
+    Bank* bank = thread->bank;
+    unsigned seed = (unsigned)thread->index + 100;
+    char key[32];
+    while (!atomic_load(&bank->stop)) {
+        seed = seed * 1103515245 + 12345;
+        snprintf(key, sizeof(key), "account%05u", (seed >> 8) % ACCOUNTS);
+        Value* value = eghactdb_get((seed & 1) ? bank->from : bank->to, key);
+        CHECK(value && value->type == TYPE_INT);
+        value_free(value);
+        atomic_fetch_add(&bank->gets, 1);
+    }
+    return NULL;
+}
+
+static void test_concurrency(void) {
+    char path[PATH_MAX], key[32];
+    db_path(path, sizeof(path), "concurrent.db");
+
+    Bank* bank = calloc(1, sizeof(Bank));
+    CHECK(bank);
+    bank->db = eghactdb_open(path);
+    CHECK(bank->db);
+    bank->from = eghactdb_create_collection(bank->db, "from");
+    bank->to = eghactdb_create_collection(bank->db, "to");
+    CHECK(bank->from && bank->to);
+    for (int i = 0; i < ACCOUNTS; i++) {
+        snprintf(key, sizeof(key), "account%05d", i);
+        bank->balance_from[i] = BALANCE;
+        CHECK(eghactdb_insert(bank->from, key, value_int(BALANCE)));
+        CHECK(eghactdb_insert(bank->to, key, value_int(0)));
+    }
+
+    pthread_t readers[AUDITORS + GETTERS], writers[WRITERS];
+    BankThread reader_args[AUDITORS + GETTERS], writer_args[WRITERS];
+    for (int i = 0; i < AUDITORS + GETTERS; i++) {
+        reader_args[i] = (BankThread){ bank, i };
+        CHECK(pthread_create(&readers[i], NULL, i < AUDITORS ? bank_auditor : bank_getter, &reader_args[i]) == 0);
+    }
+    for (int i = 0; i < WRITERS; i++) {
+        writer_args[i] = (BankThread){ bank, i };
+        CHECK(pthread_create(&writers[i], NULL, bank_writer, &writer_args[i]) == 0);
+    }
+    for (int i = 0; i < WRITERS; i++) pthread_join(writers[i], NULL);
+    atomic_store(&bank->stop, true);
+    for (int i = 0; i < AUDITORS + GETTERS; i++) pthread_join(readers[i], NULL);
+    CHECK(atomic_load(&bank->snapshots) > 0 && atomic_load(&bank->gets) > 0);
+    eghactdb_close(bank->db);
+
+    bank->db = eghactdb_open(path);
+    CHECK(bank->db);
+    bank->from = eghactdb_get_collection(bank->db, "from");
+    bank->to = eghactdb_get_collection(bank->db, "to");
+    CHECK(bank->from && bank->to);
+    for (int i = 0; i < ACCOUNTS; i++) {
+        snprintf(key, sizeof(key), "account%05d", i);
+        CHECK(value_is_int(bank->from, key, bank->balance_from[i]));
+        CHECK(value_is_int(bank->to, key, bank->balance_to[i]));
+    }
+    eghactdb_close(bank->db);
+    printf("concurrent readers and writers: ok (%llu snapshots, %llu gets)\n",
+           (unsigned long long)atomic_load(&bank->snapshots), (unsigned long long)atomic_load(&bank->gets));
+    free(bank);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1) g_dir = argv[1];
+
+    test_crud_reopen();
+    test_crash_recovery();
+    test_concurrency();
+    return 0;
+}
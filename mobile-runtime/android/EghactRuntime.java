@@ -7,13 +7,19 @@ import android.widget.Button;
 import android.widget.EditText;
 import android.widget.ImageView;
 import android.widget.LinearLayout;
-import android.widget.ListView;
 import android.widget.ScrollView;
 import android.widget.TextView;
 import android.text.TextWatcher;
 import android.text.Editable;
 import android.graphics.Color;
 import android.view.ViewGroup.LayoutParams;
+import android.view.MotionEvent;
+import android.widget.FrameLayout;
+import android.view.ViewParent;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.charset.StandardCharsets;
+import java.util.ArrayList;
 
 /**
  * Eghact Runtime for Android
@@ -24,17 +30,51 @@ public class EghactRuntime {
         System.loadLibrary("eghact_mobile");
     }
     
+    // Command buffer opcodes - keep in sync with android_renderer.c
+    private static final int CMD_CREATE = 1;
+    private static final int CMD_LAYOUT = 2;
+    private static final int CMD_STYLE = 3;
+    private static final int CMD_TEXT = 4;
+    private static final int CMD_ADD_CHILD = 5;
+    private static final int CMD_REMOVE_CHILD = 6;
+    private static final int CMD_DESTROY = 7;
+    
+    // Component types - keep in sync with ComponentType in core.h
+    private static final int TYPE_VIEW = 0;
+    private static final int TYPE_TEXT = 1;
+    private static final int TYPE_IMAGE = 2;
+    private static final int TYPE_BUTTON = 3;
+    private static final int TYPE_INPUT = 4;
+    private static final int TYPE_SCROLL = 5;
+    private static final int TYPE_LIST = 6;
+    
     private Activity activity;
     
+    // Views addressed by id in command buffer mode (index 0 unused)
+    private final ArrayList<View> views = new ArrayList<View>();
+    
     public EghactRuntime(Activity activity) {
         this.activity = activity;
+        views.add(null);
         nativeInit(this);
     }
     
+    /**
+     * Record UI updates into a shared buffer and apply them once per commit
+     * instead of making one JNI call per change. Must be enabled before any
+     * component is created, and disabled only once every component created
+     * through it is destroyed; returns false if the switch is refused.
+     */
+    public boolean setCommandBufferEnabled(boolean enabled, int capacity) {
+        return nativeSetCommandBuffer(enabled, capacity);
+    }
+    
     // Native methods
     private native void nativeInit(EghactRuntime runtime);
+    private native boolean nativeSetCommandBuffer(boolean enabled, int capacity);
     private native void onButtonClick(long componentPtr);
     private native void onTextChanged(long componentPtr, String text);
+    private native void onListScroll(long componentPtr, float delta);
     
     // View creation methods called from native
     public View createView() {
@@ -93,8 +133,30 @@ public class EghactRuntime {
         return new ScrollView(activity);
     }
     
-    public ListView createList() {
-        return new ListView(activity);
+    // Lists are virtualized in native code; the view clips the visible rows and
+    // forwards drags so the runtime can move its window
+    public ViewGroup createList(final long componentPtr) {
+        FrameLayout list = new FrameLayout(activity);
+        list.setClipChildren(true);
+        list.setOnTouchListener(new View.OnTouchListener() {
+            private float lastY;
+            
+            @Override
+            public boolean onTouch(View v, MotionEvent event) {
+                switch (event.getActionMasked()) {
+                    case MotionEvent.ACTION_DOWN:
+                        lastY = event.getY();
+                        return true;
+                    case MotionEvent.ACTION_MOVE:
+                        onListScroll(componentPtr, lastY - event.getY());
+                        lastY = event.getY();
+                        return true;
+                    default:
+                        return false;
+                }
+            }
+        });
+        return list;
     }
     
     // Layout and style methods
@@ -114,7 +176,8 @@ public class EghactRuntime {
     public void updateStyle(View view, Style style) {
         view.setBackgroundColor(style.backgroundColor);
         view.setAlpha(style.opacity);
-        // TODO: Apply more style properties
+        view.setVisibility(style.hidden ? View.GONE : View.VISIBLE);
+        // TODO: Apply border properties
     }
     
     public void addChild(ViewGroup parent, View child) {
@@ -125,10 +188,115 @@ public class EghactRuntime {
         parent.removeView(child);
     }
     
+    // Apply a batch of commands recorded by the native renderer
+    public void applyCommands(ByteBuffer buffer, int length) {
+        ByteBuffer buf = buffer.duplicate().order(ByteOrder.nativeOrder());
+        buf.position(0);
+        buf.limit(length);
+        Style style = new Style();
+        
+        while (buf.hasRemaining()) {
+            int op = buf.getInt();
+            switch (op) {
+                case CMD_CREATE: {
+                    int id = buf.getInt();
+                    int type = buf.getInt();
+                    long componentPtr = buf.getLong();
+                    String str = readString(buf);
+                    setView(id, createForType(type, str, componentPtr));
+                    break;
+                }
+                case CMD_LAYOUT: {
+                    View view = views.get(buf.getInt());
+                    updateLayout(view, buf.getFloat(), buf.getFloat(), buf.getFloat(), buf.getFloat());
+                    break;
+                }
+                case CMD_STYLE: {
+                    View view = views.get(buf.getInt());
+                    style.backgroundColor = buf.getInt();
+                    style.borderColor = buf.getInt();
+                    style.borderWidth = buf.getFloat();
+                    style.borderRadius = buf.getFloat();
+                    style.opacity = buf.getFloat();
+                    style.hidden = buf.getInt() != 0;
+                    updateStyle(view, style);
+                    break;
+                }
+                case CMD_TEXT: {
+                    View view = views.get(buf.getInt());
+                    int color = buf.getInt();
+                    float fontSize = buf.getFloat();
+                    String text = readString(buf);
+                    if (view instanceof TextView) {
+                        TextView textView = (TextView)view;
+                        textView.setText(text);
+                        if (color != 0) textView.setTextColor(color);
+                        if (fontSize > 0) textView.setTextSize(fontSize);
+                    }
+                    break;
+                }
+                case CMD_ADD_CHILD: {
+                    View parent = views.get(buf.getInt());
+                    View child = views.get(buf.getInt());
+                    addChild((ViewGroup)parent, child);
+                    break;
+                }
+                case CMD_REMOVE_CHILD: {
+                    View parent = views.get(buf.getInt());
+                    View child = views.get(buf.getInt());
+                    removeChild((ViewGroup)parent, child);
+                    break;
+                }
+                case CMD_DESTROY: {
+                    int id = buf.getInt();
+                    View view = views.get(id);
+                    ViewParent parent = view != null ? view.getParent() : null;
+                    if (parent instanceof ViewGroup) {
+                        ((ViewGroup)parent).removeView(view);
+                    }
+                    views.set(id, null);
+                    break;
+                }
+                default:
+                    throw new IllegalStateException("Unknown command " + op);
+            }
+        }
+    }
+    
+    private View createForType(int type, String str, long componentPtr) {
+        switch (type) {
+            case TYPE_TEXT: return createText(str);
+            case TYPE_IMAGE: return createImage(str);
+            case TYPE_BUTTON: return createButton(str, componentPtr);
+            case TYPE_INPUT: return createInput(str, componentPtr);
+            case TYPE_SCROLL: return createScroll();
+            case TYPE_LIST: return createList(componentPtr);
+            default: return createView();
+        }
+    }
+    
+    private void setView(int id, View view) {
+        while (views.size() <= id) {
+            views.add(null);
+        }
+        views.set(id, view);
+    }
+    
+    private static String readString(ByteBuffer buf) {
+        int length = buf.getInt();
+        byte[] bytes = new byte[length];
+        buf.get(bytes);
+        buf.position(buf.position() + ((4 - (length & 3)) & 3));
+        return new String(bytes, StandardCharsets.UTF_8);
+    }
+    
     // Style helper class
     public static class Style {
         public int backgroundColor;
         public float opacity;
-        // Add more style properties as needed
+        public int borderColor;
+        public float borderWidth;
+        public float borderRadius;
+        public boolean hidden;
     }
 }
\ No newline at end of file
@@ -0,0 +1,346 @@
+/**
+ * Eghact Native Mobile Runtime - Core Benchmarks
+ * Headless scenarios timed against a silent renderer that only counts calls
+ *
+ * Usage: eghact_core_bench [scenario-substring] [--iterations-scale=N] [--trace=FILE]
+ *
+ * --trace needs a build with -DEGHACT_PERF=ON.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "core.h"
+#include "eghact-perf.h"
+
+// Allocation counting via the linker's --wrap (see CMakeLists.txt)
+#ifdef BENCH_COUNT_ALLOCS
+static size_t g_allocs;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+char* __real_strdup(const char* str);
+
+void* __wrap_malloc(size_t size) { g_allocs++; return __real_malloc(size); }
+void* __wrap_calloc(size_t count, size_t size) { g_allocs++; return __real_calloc(count, size); }
+void* __wrap_realloc(void* ptr, size_t size) { g_allocs++; return __real_realloc(ptr, size); }
+char* __wrap_strdup(const char* str) { g_allocs++; return __real_strdup(str); }
+
+static size_t alloc_count(void) { return g_allocs; }
+#else
+static size_t alloc_count(void) { return 0; }
+#endif
+
+// Counting renderer
+typedef struct {
+    size_t creates;
+    size_t updates;   // Layout and style updates, counted per hook call
+    size_t children;  // add_child + remove_child
+    size_t destroys;
+    size_t flushes;
+} RendererCalls;
+
+static RendererCalls g_calls;
+static uintptr_t g_next_handle = 1;
+
+static void* bench_create(Component* component) {
+    g_calls.creates++;
+    return (void*)g_next_handle++;
+}
+
+static void bench_update_one(Component* component) { g_calls.updates++; }
+static void bench_update(Component* component, uint32_t dirty_flags) { g_calls.updates++; }
+static void bench_child(Component* parent, Component* child) { g_calls.children++; }
+static void bench_destroy(Component* component) { g_calls.destroys++; }
+static void bench_flush(void) { g_calls.flushes++; }
+
+static PlatformRenderer bench_renderer = {
+    .create_view = bench_create,
+    .create_text = bench_create,
+    .create_image = bench_create,
+    .create_button = bench_create,
+    .create_input = bench_create,
+    .create_scroll = bench_create,
+    .create_list = bench_create,
+    .update_layout = bench_update_one,
+    .update_style = bench_update_one,
+    .add_child = bench_child,
+    .remove_child = bench_child,
+    .destroy = bench_destroy,
+    .update = bench_update,
+    .flush = bench_flush
+};
+
+// Harness
+typedef struct {
+    const char* name;
+    size_t iterations;
+    void (*setup)(void);
+    void (*run)(size_t iteration);  // One op
+    void (*teardown)(void);
+} Scenario;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void run_scenario(const Scenario* scenario, size_t scale) {
+    size_t iterations = scenario->iterations * scale;
+    if (scenario->setup) scenario->setup();
+
+    // One untimed pass warms caches, pools and arena chunks
+    scenario->run(0);
+
+    memset(&g_calls, 0, sizeof(g_calls));
+    size_t allocs_before = alloc_count();
+    uint64_t start = now_ns();
+    for (size_t i = 1; i <= iterations; i++) {
+        scenario->run(i);
+    }
+    uint64_t elapsed = now_ns() - start;
+    size_t allocs = alloc_count() - allocs_before;
+    RendererCalls calls = g_calls;
+
+    if (scenario->teardown) scenario->teardown();
+
+    double n = (double)iterations;
+    printf("%-28s %8zu %14.0f", scenario->name, iterations, (double)elapsed / n);
+#ifdef BENCH_COUNT_ALLOCS
+    printf(" %10.1f", (double)allocs / n);
+#else
+    (void)allocs;
+    printf(" %10s", "n/a");
+#endif
+    printf(" %9.1f %9.1f %9.1f %9.1f\n",
+           (double)calls.creates / n, (double)calls.updates / n,
+           (double)calls.children / n, (double)calls.destroys / n);
+}
+
+// Fixed-shape trees keep every run comparable
+#define TREE_NODES 10000
+#define TREE_FANOUT 100
+
+static Component* build_tree(void) {
+    Component* root = eghact_create_view();
+    eghact_set_flex_direction(root, EGHACT_FLEX_COLUMN);
+
+    size_t built = 1;
+    while (built < TREE_NODES) {
+        Component* row = eghact_create_view();
+        eghact_set_flex_direction(row, EGHACT_FLEX_ROW);
+        eghact_add_child(root, row);
+        built++;
+
+        for (size_t i = 0; i < TREE_FANOUT - 1 && built < TREE_NODES; i++, built++) {
+            Component* cell = (i % 2) ? eghact_create_text("cell") : eghact_create_view();
+            eghact_set_size(cell, 10, 10);
+            eghact_add_child(row, cell);
+        }
+    }
+    return root;
+}
+
+// Scenario: build and destroy a 10k-node tree from the heap
+static void tree_heap_run(size_t iteration) {
+    Component* root = build_tree();
+    eghact_layout_compute(root, 1000, -1);
+    eghact_commit();
+    eghact_destroy_component(root);
+}
+
+// Scenario: the same tree from a tree arena that is reset each time
+static EghactTreeArena* g_arena;
+
+static void tree_arena_setup(void) {
+    g_arena = eghact_tree_arena_create(0);
+}
+
+static void tree_arena_run(size_t iteration) {
+    eghact_set_tree_arena(g_arena);
+    Component* root = build_tree();
+    eghact_set_tree_arena(NULL);
+
+    eghact_layout_compute(root, 1000, -1);
+    eghact_commit();
+    eghact_destroy_component(root);
+    eghact_tree_arena_reset(g_arena);
+}
+
+static void tree_arena_teardown(void) {
+    eghact_tree_arena_destroy(g_arena);
+    g_arena = NULL;
+}
+
+// Scenarios: relayout a 1k-child flex column
+#define COLUMN_CHILDREN 1000
+
+static Component* g_column;
+
+static void column_setup(void) {
+    g_column = eghact_create_view();
+    eghact_set_flex_direction(g_column, EGHACT_FLEX_COLUMN);
+    eghact_set_gap(g_column, 2);
+    for (size_t i = 0; i < COLUMN_CHILDREN; i++) {
+        Component* child = eghact_create_text("row label");
+        eghact_add_child(g_column, child);
+    }
+    eghact_layout_compute(g_column, 320, -1);
+    eghact_commit();
+}
+
+static void column_teardown(void) {
+    eghact_destroy_component(g_column);
+    g_column = NULL;
+}
+
+// Full relayout: a width change invalidates every child's measurement
+static void column_full_run(size_t iteration) {
+    eghact_layout_compute(g_column, (iteration % 2) ? 300 : 320, -1);
+    eghact_commit();
+}
+
+// Incremental relayout: one child's text changes, each pass over the column flips it
+static void column_incremental_run(size_t iteration) {
+    Component* child = g_column->children[iteration % COLUMN_CHILDREN];
+    eghact_set_text(child, ((iteration / COLUMN_CHILDREN) % 2) ? "row label" : "a longer row label");
+    eghact_commit();
+}
+
+// Scenario: update text in half of a 1k-row list
+static void list_half_run(size_t iteration) {
+    char text[32];
+    for (size_t i = iteration % 2; i < COLUMN_CHILDREN; i += 2) {
+        snprintf(text, sizeof(text), "item %zu", iteration);
+        eghact_set_text(g_column->children[i], text);
+    }
+    eghact_commit();
+}
+
+// Scenario: add and remove a leaf at the bottom of a 500-deep chain
+#define CHAIN_DEPTH 500
+
+static Component* g_chain;
+static Component* g_chain_tip;
+
+static void chain_setup(void) {
+    g_chain = eghact_create_view();
+    g_chain_tip = g_chain;
+    for (size_t i = 1; i < CHAIN_DEPTH; i++) {
+        Component* node = eghact_create_view();
+        eghact_set_padding(node, 1, 1, 1, 1);
+        eghact_add_child(g_chain_tip, node);
+        g_chain_tip = node;
+    }
+    eghact_layout_compute(g_chain, 1000, 1000);
+    eghact_commit();
+}
+
+static void chain_run(size_t iteration) {
+    Component* leaf = eghact_create_text("leaf");
+    eghact_add_child(g_chain_tip, leaf);
+    eghact_commit();
+    eghact_remove_child(g_chain_tip, leaf);
+    eghact_destroy_component(leaf);
+    eghact_commit();
+}
+
+static void chain_teardown(void) {
+    eghact_destroy_component(g_chain);
+    g_chain = g_chain_tip = NULL;
+}
+
+// Scenario: scroll a 10k-row virtualized list one row per op
+static Component* g_list;
+
+static Component* list_create_row(Component* list, size_t type, void* user_data) {
+    Component* row = eghact_create_view();
+    eghact_add_child(row, eghact_create_text(""));
+    return row;
+}
+
+static void list_bind_row(Component* list, Component* row, size_t index, void* user_data) {
+    char text[32];
+    snprintf(text, sizeof(text), "row %zu", index);
+    eghact_set_text(row->children[0], text);
+}
+
+static void virtual_list_setup(void) {
+    g_list = eghact_create_list();
+    eghact_set_size(g_list, 320, 640);
+
+    EghactListAdapter adapter = {
+        .row_count = 10000,
+        .row_height = 40,
+        .overscan = 2,
+        .create_row = list_create_row,
+        .bind_row = list_bind_row
+    };
+    eghact_list_set_adapter(g_list, &adapter);
+    eghact_layout_compute(g_list, 320, 640);
+    eghact_commit();
+}
+
+static void virtual_list_run(size_t iteration) {
+    eghact_list_set_scroll_offset(g_list, (float)(iteration % 5000) * 40.0f);
+    eghact_commit();
+}
+
+static void virtual_list_teardown(void) {
+    eghact_destroy_component(g_list);
+    g_list = NULL;
+}
+
+static const Scenario g_scenarios[] = {
+    { "tree_10k_build_destroy",     20, NULL, tree_heap_run, NULL },
+    { "tree_10k_arena",             20, tree_arena_setup, tree_arena_run, tree_arena_teardown },
+    { "column_1k_full_relayout",   200, column_setup, column_full_run, column_teardown },
+    { "column_1k_one_text_change", 5000, column_setup, column_incremental_run, column_teardown },
+    { "list_1k_half_text_update",  200, column_setup, list_half_run, column_teardown },
+    { "chain_500_add_remove_leaf", 2000, chain_setup, chain_run, chain_teardown },
+    { "virtual_list_10k_scroll",   5000, virtual_list_setup, virtual_list_run, virtual_list_teardown },
+};
+
+int main(int argc, char** argv) {
+    const char* filter = NULL;
+    size_t scale = 1;
+    const char* trace_file = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--iterations-scale=", 19) == 0) {
+            scale = (size_t)strtoul(argv[i] + 19, NULL, 10);
+            if (scale == 0) scale = 1;
+        } else if (strncmp(argv[i], "--trace=", 8) == 0) {
+            trace_file = argv[i] + 8;
+        } else {
+            filter = argv[i];
+        }
+    }
+
+    eghact_init();
+    eghact_set_renderer(&bench_renderer);
+
+    printf("%-28s %8s %14s %10s %9s %9s %9s %9s\n",
+           "scenario", "ops", "ns/op", "allocs/op", "creates", "updates", "children", "destroys");
+    for (size_t i = 0; i < sizeof(g_scenarios) / sizeof(g_scenarios[0]); i++) {
+        if (filter && !strstr(g_scenarios[i].name, filter)) continue;
+        run_scenario(&g_scenarios[i], scale);
+    }
+
+    eghact_shutdown();
+    
+    if (trace_file) {
+#ifdef EGHACT_PERF_ENABLED
+        if (eghact_perf_write_trace(trace_file) != 0) {
+            fprintf(stderr, "cannot write trace to %s\n", trace_file);
+            return 1;
+        }
+#else
+        fprintf(stderr, "--trace needs a build with -DEGHACT_PERF=ON\n");
+        return 1;
+#endif
+    }
+    return 0;
+}
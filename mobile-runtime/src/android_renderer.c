@@ -5,6 +5,7 @@
 
 #include <jni.h>
 #include <android/log.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include "core.h"
@@ -28,6 +29,53 @@ static jmethodID g_update_layout_method = NULL;
 static jmethodID g_update_style_method = NULL;
 static jmethodID g_add_child_method = NULL;
 static jmethodID g_remove_child_method = NULL;
+static jmethodID g_apply_commands_method = NULL;
+
+// Style object and view classes, resolved once and reused for every update
+static jclass g_style_class = NULL;
+static jobject g_style = NULL;
+static jfieldID g_style_bgcolor_field = NULL;
+static jfieldID g_style_opacity_field = NULL;
+static jfieldID g_style_border_color_field = NULL;
+static jfieldID g_style_border_width_field = NULL;
+static jfieldID g_style_border_radius_field = NULL;
+static jfieldID g_style_hidden_field = NULL;
+static jclass g_text_view_class = NULL;
+static jmethodID g_set_text_method = NULL;
+static jclass g_view_class = NULL;
+static jmethodID g_get_parent_method = NULL;
+static jclass g_view_group_class = NULL;
+static jmethodID g_remove_view_method = NULL;
+static bool g_ids_resolved = false;
+
+// Command buffer opcodes - keep in sync with EghactRuntime.java
+enum {
+    CMD_CREATE = 1,      // id, type, component ptr (8), string
+    CMD_LAYOUT = 2,      // id, x, y, width, height
+    CMD_STYLE = 3,       // id, background, border color, border width, radius, opacity, hidden
+    CMD_TEXT = 4,        // id, color, font size, string
+    CMD_ADD_CHILD = 5,   // parent id, child id
+    CMD_REMOVE_CHILD = 6,
+    CMD_DESTROY = 7      // id
+};
+
+#define CMD_DEFAULT_CAPACITY (64 * 1024)
+
+// Packed native command buffer shared with Java as a direct ByteBuffer
+static struct {
+    bool enabled;
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+    jobject byte_buffer;
+
+    // View ids handed out as native handles in command buffer mode
+    int32_t next_view_id;
+    int32_t* free_ids;
+    size_t free_count;
+    size_t free_capacity;
+    size_t live_views;  // Components whose native handle is a view id
+} g_commands;
 
 // Get JNI environment
 JNIEnv* get_jni_env() {
@@ -43,14 +91,285 @@ jstring to_jstring(JNIEnv* env, const char* str) {
     return (*env)->NewStringUTF(env, str ? str : "");
 }
 
+static jclass find_global_class(JNIEnv* env, const char* name) {
+    jclass local = (*env)->FindClass(env, name);
+    if (!local) {
+        LOGE("Class not found: %s", name);
+        return NULL;
+    }
+    jclass global = (jclass)(*env)->NewGlobalRef(env, local);
+    (*env)->DeleteLocalRef(env, local);
+    return global;
+}
+
+// Resolve every class, field and method ID the renderer uses after startup
+static void resolve_jni_ids(JNIEnv* env) {
+    if (g_ids_resolved || !g_activity) return;
+
+    jclass activity_class = (*env)->GetObjectClass(env, g_activity);
+    g_create_view_method = (*env)->GetMethodID(env, activity_class, "createView", "()Landroid/view/View;");
+    g_create_text_method = (*env)->GetMethodID(env, activity_class, "createText", "(Ljava/lang/String;)Landroid/widget/TextView;");
+    g_create_image_method = (*env)->GetMethodID(env, activity_class, "createImage", "(Ljava/lang/String;)Landroid/widget/ImageView;");
+    g_create_button_method = (*env)->GetMethodID(env, activity_class, "createButton", "(Ljava/lang/String;J)Landroid/widget/Button;");
+    g_create_input_method = (*env)->GetMethodID(env, activity_class, "createInput", "(Ljava/lang/String;J)Landroid/widget/EditText;");
+    g_create_scroll_method = (*env)->GetMethodID(env, activity_class, "createScroll", "()Landroid/widget/ScrollView;");
+    g_create_list_method = (*env)->GetMethodID(env, activity_class, "createList", "(J)Landroid/view/ViewGroup;");
+    g_update_layout_method = (*env)->GetMethodID(env, activity_class, "updateLayout", "(Landroid/view/View;FFFF)V");
+    g_update_style_method = (*env)->GetMethodID(env, activity_class, "updateStyle", "(Landroid/view/View;Lcom/eghact/runtime/EghactRuntime$Style;)V");
+    g_add_child_method = (*env)->GetMethodID(env, activity_class, "addChild", "(Landroid/view/ViewGroup;Landroid/view/View;)V");
+    g_remove_child_method = (*env)->GetMethodID(env, activity_class, "removeChild", "(Landroid/view/ViewGroup;Landroid/view/View;)V");
+    g_apply_commands_method = (*env)->GetMethodID(env, activity_class, "applyCommands", "(Ljava/nio/ByteBuffer;I)V");
+    (*env)->DeleteLocalRef(env, activity_class);
+
+    g_style_class = find_global_class(env, "com/eghact/runtime/EghactRuntime$Style");
+    if (g_style_class) {
+        jmethodID style_constructor = (*env)->GetMethodID(env, g_style_class, "<init>", "()V");
+        jobject style = (*env)->NewObject(env, g_style_class, style_constructor);
+        g_style = (*env)->NewGlobalRef(env, style);
+        (*env)->DeleteLocalRef(env, style);
+
+        g_style_bgcolor_field = (*env)->GetFieldID(env, g_style_class, "backgroundColor", "I");
+        g_style_opacity_field = (*env)->GetFieldID(env, g_style_class, "opacity", "F");
+        g_style_border_color_field = (*env)->GetFieldID(env, g_style_class, "borderColor", "I");
+        g_style_border_width_field = (*env)->GetFieldID(env, g_style_class, "borderWidth", "F");
+        g_style_border_radius_field = (*env)->GetFieldID(env, g_style_class, "borderRadius", "F");
+        g_style_hidden_field = (*env)->GetFieldID(env, g_style_class, "hidden", "Z");
+    }
+
+    g_text_view_class = find_global_class(env, "android/widget/TextView");
+    if (g_text_view_class) {
+        g_set_text_method = (*env)->GetMethodID(env, g_text_view_class, "setText", "(Ljava/lang/CharSequence;)V");
+    }
+
+    g_view_class = find_global_class(env, "android/view/View");
+    if (g_view_class) {
+        g_get_parent_method = (*env)->GetMethodID(env, g_view_class, "getParent", "()Landroid/view/ViewParent;");
+    }
+
+    g_view_group_class = find_global_class(env, "android/view/ViewGroup");
+    if (g_view_group_class) {
+        g_remove_view_method = (*env)->GetMethodID(env, g_view_group_class, "removeView", "(Landroid/view/View;)V");
+    }
+
+    g_ids_resolved = true;
+}
+
+// Command buffer recording
+static void* command_handle(int32_t id) {
+    return (void*)(intptr_t)id;
+}
+
+static int32_t command_id(const Component* component) {
+    return (int32_t)(intptr_t)component->native_handle;
+}
+
+static int32_t alloc_view_id(void) {
+    if (g_commands.free_count > 0) {
+        return g_commands.free_ids[--g_commands.free_count];
+    }
+    return ++g_commands.next_view_id;
+}
+
+static void release_view_id(int32_t id) {
+    if (g_commands.free_count >= g_commands.free_capacity) {
+        size_t new_capacity = g_commands.free_capacity == 0 ? 64 : g_commands.free_capacity * 2;
+        int32_t* ids = (int32_t*)realloc(g_commands.free_ids, new_capacity * sizeof(int32_t));
+        if (!ids) return;
+        g_commands.free_ids = ids;
+        g_commands.free_capacity = new_capacity;
+    }
+    g_commands.free_ids[g_commands.free_count++] = id;
+}
+
+static void android_flush(void);
+
+// Rebuild the direct ByteBuffer around a (re)allocated native block
+static bool command_buffer_alloc(JNIEnv* env, size_t capacity) {
+    uint8_t* data = (uint8_t*)malloc(capacity);
+    if (!data) return false;
+
+    jobject buffer = (*env)->NewDirectByteBuffer(env, data, (jlong)capacity);
+    if (!buffer) {
+        free(data);
+        return false;
+    }
+
+    if (g_commands.byte_buffer) {
+        (*env)->DeleteGlobalRef(env, g_commands.byte_buffer);
+    }
+    free(g_commands.data);
+
+    g_commands.byte_buffer = (*env)->NewGlobalRef(env, buffer);
+    (*env)->DeleteLocalRef(env, buffer);
+    g_commands.data = data;
+    g_commands.capacity = capacity;
+    g_commands.size = 0;
+    return true;
+}
+
+// Make room for one record, delivering what is queued if the buffer is full
+static bool command_reserve(size_t bytes) {
+    if (g_commands.size + bytes <= g_commands.capacity) return true;
+
+    android_flush();
+    if (bytes <= g_commands.capacity) return true;
+
+    size_t capacity = g_commands.capacity;
+    while (capacity < bytes) capacity *= 2;
+    return command_buffer_alloc(get_jni_env(), capacity);
+}
+
+static void put_i32(int32_t value) {
+    memcpy(g_commands.data + g_commands.size, &value, sizeof(value));
+    g_commands.size += sizeof(value);
+}
+
+static void put_f32(float value) {
+    memcpy(g_commands.data + g_commands.size, &value, sizeof(value));
+    g_commands.size += sizeof(value);
+}
+
+static void put_i64(int64_t value) {
+    memcpy(g_commands.data + g_commands.size, &value, sizeof(value));
+    g_commands.size += sizeof(value);
+}
+
+// Strings are a byte length followed by UTF-8, padded to 4 bytes
+static size_t string_record_size(const char* str) {
+    size_t len = str ? strlen(str) : 0;
+    return sizeof(int32_t) + ((len + 3) & ~(size_t)3);
+}
+
+static void put_string(const char* str) {
+    size_t len = str ? strlen(str) : 0;
+    put_i32((int32_t)len);
+    if (len > 0) memcpy(g_commands.data + g_commands.size, str, len);
+    size_t padded = (len + 3) & ~(size_t)3;
+    memset(g_commands.data + g_commands.size + len, 0, padded - len);
+    g_commands.size += padded;
+}
+
+static const char* component_string(const Component* component) {
+    switch (component->type) {
+        case COMPONENT_TEXT: return component->data.text_data.text;
+        case COMPONENT_IMAGE: return component->data.image_data.src;
+        case COMPONENT_BUTTON: return component->data.button_data.title;
+        case COMPONENT_INPUT: return component->data.input_data.placeholder;
+        default: return NULL;
+    }
+}
+
+static void* record_create(Component* component) {
+    const char* str = component_string(component);
+    if (!command_reserve(4 * sizeof(int32_t) + sizeof(int64_t) + string_record_size(str))) return NULL;
+
+    int32_t id = alloc_view_id();
+    g_commands.live_views++;
+    put_i32(CMD_CREATE);
+    put_i32(id);
+    put_i32((int32_t)component->type);
+    put_i64((int64_t)(intptr_t)component);
+    put_string(str);
+    return command_handle(id);
+}
+
+static void record_layout(Component* component) {
+    if (!command_reserve(6 * sizeof(int32_t))) return;
+    put_i32(CMD_LAYOUT);
+    put_i32(command_id(component));
+    put_f32(component->style.x);
+    put_f32(component->style.y);
+    put_f32(component->style.width);
+    put_f32(component->style.height);
+}
+
+static void record_style(Component* component) {
+    if (!command_reserve(8 * sizeof(int32_t))) return;
+    put_i32(CMD_STYLE);
+    put_i32(command_id(component));
+    put_i32((int32_t)component->style.background_color);
+    put_i32((int32_t)component->style.border_color);
+    put_f32(component->style.border_width);
+    put_f32(component->style.border_radius);
+    put_f32(component->style.opacity);
+    put_i32(component->style.hidden ? 1 : 0);
+
+    // Content goes in the same frame as the style it belongs to
+    const char* text = NULL;
+    uint32_t color = 0;
+    float font_size = 0;
+    switch (component->type) {
+        case COMPONENT_TEXT:
+            text = component->data.text_data.text;
+            color = component->data.text_data.color;
+            font_size = component->data.text_data.font_size;
+            break;
+        case COMPONENT_BUTTON:
+            text = component->data.button_data.title;
+            break;
+        default:
+            return;
+    }
+
+    if (!command_reserve(4 * sizeof(int32_t) + string_record_size(text))) return;
+    put_i32(CMD_TEXT);
+    put_i32(command_id(component));
+    put_i32((int32_t)color);
+    put_f32(font_size);
+    put_string(text);
+}
+
+static void record_pair(int32_t op, Component* parent, Component* child) {
+    if (!command_reserve(3 * sizeof(int32_t))) return;
+    put_i32(op);
+    put_i32(command_id(parent));
+    put_i32(command_id(child));
+}
+
+// Views created in one mode cannot be driven by the other, so the mode only changes
+// while none is alive. Turning it off delivers whatever is still recorded, such as the
+// removals of the last buffered views.
+bool eghact_android_set_command_buffer(bool enabled, size_t capacity) {
+    if (enabled == g_commands.enabled) return true;
+
+    if (!enabled) {
+        if (g_commands.live_views > 0) {
+            LOGE("Command buffer still owns views; destroy them before turning it off");
+            return false;
+        }
+        android_flush();
+        g_commands.enabled = false;
+        return true;
+    }
+
+    EghactRuntime* runtime = eghact_get_runtime();
+    if (runtime && runtime->component_count > 0) {
+        LOGE("Command buffer must be selected before any component is created");
+        return false;
+    }
+    if (!g_jvm || !g_apply_commands_method) return false;
+
+    JNIEnv* env = get_jni_env();
+    if (!g_commands.data && !command_buffer_alloc(env, capacity > 0 ? capacity : CMD_DEFAULT_CAPACITY)) {
+        LOGE("Failed to allocate command buffer");
+        return false;
+    }
+    g_commands.enabled = true;
+    return true;
+}
+
 // Platform renderer functions
 void* android_create_view(Component* component) {
+    if (g_commands.enabled) return record_create(component);
+
     JNIEnv* env = get_jni_env();
     jobject view = (*env)->CallObjectMethod(env, g_activity, g_create_view_method);
     return (*env)->NewGlobalRef(env, view);
 }
 
 void* android_create_text(Component* component) {
+    if (g_commands.enabled) return record_create(component);
+
     JNIEnv* env = get_jni_env();
     jstring text = to_jstring(env, component->data.text_data.text);
     jobject view = (*env)->CallObjectMethod(env, g_activity, g_create_text_method, text);
@@ -59,6 +378,8 @@ void* android_create_text(Component* component) {
 }
 
 void* android_create_image(Component* component) {
+    if (g_commands.enabled) return record_create(component);
+
     JNIEnv* env = get_jni_env();
     jstring src = to_jstring(env, component->data.image_data.src);
     jobject view = (*env)->CallObjectMethod(env, g_activity, g_create_image_method, src);
@@ -67,6 +388,8 @@ void* android_create_image(Component* component) {
 }
 
 void* android_create_button(Component* component) {
+    if (g_commands.enabled) return record_create(component);
+
     JNIEnv* env = get_jni_env();
     jstring title = to_jstring(env, component->data.button_data.title);
     jobject view = (*env)->CallObjectMethod(env, g_activity, g_create_button_method, title, (jlong)component);
@@ -75,6 +398,8 @@ void* android_create_button(Component* component) {
 }
 
 void* android_create_input(Component* component) {
+    if (g_commands.enabled) return record_create(component);
+
     JNIEnv* env = get_jni_env();
     jstring placeholder = to_jstring(env, component->data.input_data.placeholder);
     jobject view = (*env)->CallObjectMethod(env, g_activity, g_create_input_method, placeholder, (jlong)component);
@@ -83,23 +408,31 @@ void* android_create_input(Component* component) {
 }
 
 void* android_create_scroll(Component* component) {
+    if (g_commands.enabled) return record_create(component);
+
     JNIEnv* env = get_jni_env();
     jobject view = (*env)->CallObjectMethod(env, g_activity, g_create_scroll_method);
     return (*env)->NewGlobalRef(env, view);
 }
 
 void* android_create_list(Component* component) {
+    if (g_commands.enabled) return record_create(component);
+
     JNIEnv* env = get_jni_env();
-    jobject view = (*env)->CallObjectMethod(env, g_activity, g_create_list_method);
+    jobject view = (*env)->CallObjectMethod(env, g_activity, g_create_list_method, (jlong)component);
     return (*env)->NewGlobalRef(env, view);
 }
 
 void android_update_layout(Component* component) {
     if (!component || !component->native_handle) return;
-    
+    if (g_commands.enabled) {
+        record_layout(component);
+        return;
+    }
+
     JNIEnv* env = get_jni_env();
     jobject view = (jobject)component->native_handle;
-    
+
     (*env)->CallVoidMethod(env, g_activity, g_update_layout_method, view,
                           (jfloat)component->style.x, (jfloat)component->style.y,
                           (jfloat)component->style.width, (jfloat)component->style.height);
@@ -107,90 +440,113 @@ void android_update_layout(Component* component) {
 
 void android_update_style(Component* component) {
     if (!component || !component->native_handle) return;
-    
+    if (g_commands.enabled) {
+        record_style(component);
+        return;
+    }
+
     JNIEnv* env = get_jni_env();
     jobject view = (jobject)component->native_handle;
-    
-    // Create style object with all properties
-    jclass style_class = (*env)->FindClass(env, "com/eghact/runtime/Style");
-    jmethodID style_constructor = (*env)->GetMethodID(env, style_class, "<init>", "()V");
-    jobject style = (*env)->NewObject(env, style_class, style_constructor);
-    
-    // Set style properties
-    jfieldID bgcolor_field = (*env)->GetFieldID(env, style_class, "backgroundColor", "I");
-    (*env)->SetIntField(env, style, bgcolor_field, component->style.background_color);
-    
-    jfieldID opacity_field = (*env)->GetFieldID(env, style_class, "opacity", "F");
-    (*env)->SetFloatField(env, style, opacity_field, component->style.opacity);
-    
+
+    // Fill the shared style object; updates always run on the UI thread
+    (*env)->SetIntField(env, g_style, g_style_bgcolor_field, (jint)component->style.background_color);
+    (*env)->SetFloatField(env, g_style, g_style_opacity_field, component->style.opacity);
+    (*env)->SetIntField(env, g_style, g_style_border_color_field, (jint)component->style.border_color);
+    (*env)->SetFloatField(env, g_style, g_style_border_width_field, component->style.border_width);
+    (*env)->SetFloatField(env, g_style, g_style_border_radius_field, component->style.border_radius);
+    (*env)->SetBooleanField(env, g_style, g_style_hidden_field, component->style.hidden ? JNI_TRUE : JNI_FALSE);
+
     // Update view with style
-    (*env)->CallVoidMethod(env, g_activity, g_update_style_method, view, style);
-    
+    (*env)->CallVoidMethod(env, g_activity, g_update_style_method, view, g_style);
+
     // Component-specific updates
+    const char* text = NULL;
     switch (component->type) {
-        case COMPONENT_TEXT: {
-            jmethodID set_text = (*env)->GetMethodID(env, (*env)->GetObjectClass(env, view), 
-                                                     "setText", "(Ljava/lang/CharSequence;)V");
-            jstring text = to_jstring(env, component->data.text_data.text);
-            (*env)->CallVoidMethod(env, view, set_text, text);
-            (*env)->DeleteLocalRef(env, text);
+        case COMPONENT_TEXT:
+            text = component->data.text_data.text;
             break;
-        }
-        case COMPONENT_BUTTON: {
-            jmethodID set_text = (*env)->GetMethodID(env, (*env)->GetObjectClass(env, view), 
-                                                     "setText", "(Ljava/lang/CharSequence;)V");
-            jstring text = to_jstring(env, component->data.button_data.title);
-            (*env)->CallVoidMethod(env, view, set_text, text);
-            (*env)->DeleteLocalRef(env, text);
+        case COMPONENT_BUTTON:
+            text = component->data.button_data.title;
             break;
-        }
         default:
-            break;
+            return;
     }
-    
-    (*env)->DeleteLocalRef(env, style);
+
+    jstring jtext = to_jstring(env, text);
+    (*env)->CallVoidMethod(env, view, g_set_text_method, jtext);
+    (*env)->DeleteLocalRef(env, jtext);
+}
+
+void android_update(Component* component, uint32_t dirty_flags) {
+    if (dirty_flags & EGHACT_DIRTY_LAYOUT) android_update_layout(component);
+    if (dirty_flags & EGHACT_DIRTY_STYLE) android_update_style(component);
 }
 
 void android_add_child(Component* parent, Component* child) {
     if (!parent || !child || !parent->native_handle || !child->native_handle) return;
-    
+    if (g_commands.enabled) {
+        record_pair(CMD_ADD_CHILD, parent, child);
+        return;
+    }
+
     JNIEnv* env = get_jni_env();
     jobject parent_view = (jobject)parent->native_handle;
     jobject child_view = (jobject)child->native_handle;
-    
+
     (*env)->CallVoidMethod(env, g_activity, g_add_child_method, parent_view, child_view);
 }
 
 void android_remove_child(Component* parent, Component* child) {
     if (!parent || !child || !parent->native_handle || !child->native_handle) return;
-    
+    if (g_commands.enabled) {
+        record_pair(CMD_REMOVE_CHILD, parent, child);
+        return;
+    }
+
     JNIEnv* env = get_jni_env();
     jobject parent_view = (jobject)parent->native_handle;
     jobject child_view = (jobject)child->native_handle;
-    
+
     (*env)->CallVoidMethod(env, g_activity, g_remove_child_method, parent_view, child_view);
 }
 
 void android_destroy(Component* component) {
     if (!component || !component->native_handle) return;
-    
+    if (g_commands.enabled) {
+        if (command_reserve(2 * sizeof(int32_t))) {
+            put_i32(CMD_DESTROY);
+            put_i32(command_id(component));
+        }
+        release_view_id(command_id(component));
+        g_commands.live_views--;
+        return;
+    }
+
     JNIEnv* env = get_jni_env();
     jobject view = (jobject)component->native_handle;
-    
+
     // Remove from parent and clean up
-    jclass view_class = (*env)->GetObjectClass(env, view);
-    jmethodID get_parent = (*env)->GetMethodID(env, view_class, "getParent", "()Landroid/view/ViewParent;");
-    jobject parent = (*env)->CallObjectMethod(env, view, get_parent);
-    
+    jobject parent = (*env)->CallObjectMethod(env, view, g_get_parent_method);
     if (parent) {
-        jclass view_group_class = (*env)->FindClass(env, "android/view/ViewGroup");
-        jmethodID remove_view = (*env)->GetMethodID(env, view_group_class, "removeView", "(Landroid/view/View;)V");
-        (*env)->CallVoidMethod(env, parent, remove_view, view);
+        if ((*env)->IsInstanceOf(env, parent, g_view_group_class)) {
+            (*env)->CallVoidMethod(env, parent, g_remove_view_method, view);
+        }
+        (*env)->DeleteLocalRef(env, parent);
     }
-    
+
     (*env)->DeleteGlobalRef(env, view);
 }
 
+// Deliver everything recorded since the last commit in one JNI call
+static void android_flush(void) {
+    if (!g_commands.enabled || g_commands.size == 0) return;
+
+    JNIEnv* env = get_jni_env();
+    (*env)->CallVoidMethod(env, g_activity, g_apply_commands_method,
+                          g_commands.byte_buffer, (jint)g_commands.size);
+    g_commands.size = 0;
+}
+
 // Platform renderer implementation
 static PlatformRenderer android_renderer = {
     .create_view = android_create_view,
@@ -204,11 +560,16 @@ static PlatformRenderer android_renderer = {
     .update_style = android_update_style,
     .add_child = android_add_child,
     .remove_child = android_remove_child,
-    .destroy = android_destroy
+    .destroy = android_destroy,
+    .update = android_update,
+    .flush = android_flush
 };
 
 // Initialize Android renderer
 PlatformRenderer* eghact_android_renderer_init() {
+    if (g_jvm) {
+        resolve_jni_ids(get_jni_env());
+    }
     return &android_renderer;
 }
 
@@ -217,30 +578,26 @@ JNIEXPORT void JNICALL
 Java_com_eghact_runtime_EghactRuntime_nativeInit(JNIEnv* env, jobject activity) {
     (*env)->GetJavaVM(env, &g_jvm);
     g_activity = (*env)->NewGlobalRef(env, activity);
-    
-    // Cache method IDs
-    jclass activity_class = (*env)->GetObjectClass(env, activity);
-    g_create_view_method = (*env)->GetMethodID(env, activity_class, "createView", "()Landroid/view/View;");
-    g_create_text_method = (*env)->GetMethodID(env, activity_class, "createText", "(Ljava/lang/String;)Landroid/widget/TextView;");
-    g_create_image_method = (*env)->GetMethodID(env, activity_class, "createImage", "(Ljava/lang/String;)Landroid/widget/ImageView;");
-    g_create_button_method = (*env)->GetMethodID(env, activity_class, "createButton", "(Ljava/lang/String;J)Landroid/widget/Button;");
-    g_create_input_method = (*env)->GetMethodID(env, activity_class, "createInput", "(Ljava/lang/String;J)Landroid/widget/EditText;");
-    g_create_scroll_method = (*env)->GetMethodID(env, activity_class, "createScroll", "()Landroid/widget/ScrollView;");
-    g_create_list_method = (*env)->GetMethodID(env, activity_class, "createList", "()Landroid/widget/ListView;");
-    g_update_layout_method = (*env)->GetMethodID(env, activity_class, "updateLayout", "(Landroid/view/View;FFFF)V");
-    g_update_style_method = (*env)->GetMethodID(env, activity_class, "updateStyle", "(Landroid/view/View;Lcom/eghact/runtime/Style;)V");
-    g_add_child_method = (*env)->GetMethodID(env, activity_class, "addChild", "(Landroid/view/ViewGroup;Landroid/view/View;)V");
-    g_remove_child_method = (*env)->GetMethodID(env, activity_class, "removeChild", "(Landroid/view/ViewGroup;Landroid/view/View;)V");
-    
+
+    // Resolve IDs here, on a thread whose class loader can see the app's classes
+    resolve_jni_ids(env);
+
     LOGI("Eghact Android Runtime initialized");
 }
 
+// Switch to command buffer mode from Java
+JNIEXPORT jboolean JNICALL
+Java_com_eghact_runtime_EghactRuntime_nativeSetCommandBuffer(JNIEnv* env, jobject thiz, jboolean enabled, jint capacity) {
+    return eghact_android_set_command_buffer(enabled == JNI_TRUE, capacity > 0 ? (size_t)capacity : 0) ? JNI_TRUE : JNI_FALSE;
+}
+
 // Button click callback
 JNIEXPORT void JNICALL
 Java_com_eghact_runtime_EghactRuntime_onButtonClick(JNIEnv* env, jobject thiz, jlong component_ptr) {
     Component* component = (Component*)component_ptr;
     if (component && component->data.button_data.on_press) {
         component->data.button_data.on_press();
+        eghact_commit();
     }
 }
 
@@ -250,21 +607,31 @@ Java_com_eghact_runtime_EghactRuntime_onTextChanged(JNIEnv* env, jobject thiz, j
     Component* component = (Component*)component_ptr;
     if (component && component->data.input_data.on_change) {
         const char* text_str = (*env)->GetStringUTFChars(env, text, NULL);
-        
+
         // Update component value
-        free(component->data.input_data.value);
-        component->data.input_data.value = strdup(text_str);
-        
+        eghact_component_set_string(component, &component->data.input_data.value, text_str);
+
         // Call callback
         component->data.input_data.on_change(text_str);
-        
+        eghact_commit();
+
         (*env)->ReleaseStringUTFChars(env, text, text_str);
     }
 }
 
+// List drag callback - rows are virtualized natively, the view only reports scrolling
+JNIEXPORT void JNICALL
+Java_com_eghact_runtime_EghactRuntime_onListScroll(JNIEnv* env, jobject thiz, jlong component_ptr, jfloat delta) {
+    Component* component = (Component*)component_ptr;
+    if (component) {
+        eghact_list_scroll_by(component, delta);
+        eghact_commit();
+    }
+}
+
 // Android run loop
 void eghact_android_run_loop(EghactRuntime* runtime) {
     // The Android UI runs in the main thread managed by the Activity
     // This function would typically be called from the Activity's onCreate
     LOGI("Eghact Android run loop started");
-}
\ No newline at end of file
+}
@@ -9,6 +9,9 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include "core.h"
+#include "eghact-perf.h"
 
 #ifdef __APPLE__
     #include <TargetConditionals.h>
@@ -19,96 +22,13 @@
     #define PLATFORM_ANDROID
 #endif
 
-// Component types
-typedef enum {
-    COMPONENT_VIEW,
-    COMPONENT_TEXT,
-    COMPONENT_IMAGE,
-    COMPONENT_BUTTON,
-    COMPONENT_INPUT,
-    COMPONENT_SCROLL,
-    COMPONENT_LIST
-} ComponentType;
-
-// Style properties
-typedef struct {
-    float x, y, width, height;
-    float padding_top, padding_right, padding_bottom, padding_left;
-    float margin_top, margin_right, margin_bottom, margin_left;
-    uint32_t background_color;
-    uint32_t border_color;
-    float border_width;
-    float border_radius;
-    float opacity;
-    bool hidden;
-} Style;
-
-// Base component structure
-typedef struct Component {
-    ComponentType type;
-    char* id;
-    Style style;
-    void* native_handle;  // Platform-specific handle
-    struct Component* parent;
-    struct Component** children;
-    size_t child_count;
-    size_t child_capacity;
-    
-    // Component-specific data
-    union {
-        struct {
-            char* text;
-            uint32_t color;
-            float font_size;
-        } text_data;
-        
-        struct {
-            char* src;
-            int resize_mode;
-        } image_data;
-        
-        struct {
-            char* title;
-            void (*on_press)(void);
-        } button_data;
-        
-        struct {
-            char* value;
-            char* placeholder;
-            void (*on_change)(const char*);
-        } input_data;
-    } data;
-} Component;
-
-// Runtime context
-typedef struct {
-    Component* root;
-    void* platform_context;
-    size_t component_count;
-    bool is_running;
-} EghactRuntime;
-
-// Platform-specific rendering interface
-typedef struct {
-    void* (*create_view)(Component* component);
-    void* (*create_text)(Component* component);
-    void* (*create_image)(Component* component);
-    void* (*create_button)(Component* component);
-    void* (*create_input)(Component* component);
-    void* (*create_scroll)(Component* component);
-    void* (*create_list)(Component* component);
-    
-    void (*update_layout)(Component* component);
-    void (*update_style)(Component* component);
-    void (*add_child)(Component* parent, Component* child);
-    void (*remove_child)(Component* parent, Component* child);
-    void (*destroy)(Component* component);
-} PlatformRenderer;
-
 // Global runtime instance
 static EghactRuntime* g_runtime = NULL;
 static PlatformRenderer* g_renderer = NULL;
 
+EGHACT_PERF_COUNTER(perf_components_created, "ui.components.created");
+EGHACT_PERF_HISTOGRAM(perf_commit_nodes, "ui.commit.nodes");
+
 // Forward declarations
 Component* eghact_create_component(ComponentType type);
 void eghact_destroy_component(Component* component);
@@ -123,6 +43,13 @@ EghactRuntime* eghact_init() {
     g_runtime->platform_context = NULL;
     g_runtime->component_count = 0;
     g_runtime->is_running = false;
+    g_runtime->arena = NULL;
+    g_runtime->dirty_head = NULL;
+    g_runtime->dirty_tail = NULL;
+    g_runtime->dirty_count = 0;
+    g_runtime->layout_queue = NULL;
+    g_runtime->layout_queue_count = 0;
+    g_runtime->layout_queue_capacity = 0;
     
     // Initialize platform-specific renderer
     #ifdef PLATFORM_IOS
@@ -131,14 +58,250 @@ EghactRuntime* eghact_init() {
         g_renderer = eghact_android_renderer_init();
     #else
         g_renderer = eghact_default_renderer_init();
+        eghact_loop_init();
     #endif
     
     return g_runtime;
 }
 
+EghactRuntime* eghact_get_runtime(void) {
+    return g_runtime;
+}
+
+PlatformRenderer* eghact_get_renderer(void) {
+    return g_renderer;
+}
+
+// Swap the platform renderer, e.g. for benchmarks. Only safe while no components exist.
+void eghact_set_renderer(PlatformRenderer* renderer) {
+    if (renderer) g_renderer = renderer;
+}
+
+// Tree arena - bump-allocated chunks with slab free lists for components and child blocks
+#define ARENA_DEFAULT_CHUNK_SIZE (64 * 1024)
+#define ARENA_ALIGNMENT 16
+#define ARENA_ALIGN(n) (((n) + (ARENA_ALIGNMENT - 1)) & ~(size_t)(ARENA_ALIGNMENT - 1))
+#define ARENA_CHILD_CLASSES 24  // Child blocks of 4, 8, 16, ... pointers
+
+typedef struct ArenaChunk {
+    struct ArenaChunk* next;
+    size_t size;
+    size_t used;
+    bool oversized;
+    _Alignas(ARENA_ALIGNMENT) unsigned char data[];
+} ArenaChunk;
+
+typedef struct ArenaFreeBlock {
+    struct ArenaFreeBlock* next;
+} ArenaFreeBlock;
+
+struct EghactTreeArena {
+    ArenaChunk* chunks;
+    ArenaChunk* current;
+    size_t chunk_size;
+    ArenaFreeBlock* free_components;
+    ArenaFreeBlock* free_child_blocks[ARENA_CHILD_CLASSES];
+    EghactArenaStats stats;
+};
+
+static ArenaChunk* arena_new_chunk(EghactTreeArena* arena, size_t size, bool oversized) {
+    ArenaChunk* chunk = (ArenaChunk*)malloc(sizeof(ArenaChunk) + size);
+    if (!chunk) return NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    chunk->oversized = oversized;
+    
+    // Link after the current chunk so any emptied chunks further down stay reachable
+    if (arena->current) {
+        chunk->next = arena->current->next;
+        arena->current->next = chunk;
+    } else {
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+    }
+    
+    arena->stats.bytes_reserved += size;
+    arena->stats.chunk_count++;
+    return chunk;
+}
+
+static void arena_track(EghactTreeArena* arena, size_t size) {
+    arena->stats.bytes_in_use += size;
+    if (arena->stats.bytes_in_use > arena->stats.peak_bytes_in_use) {
+        arena->stats.peak_bytes_in_use = arena->stats.bytes_in_use;
+    }
+}
+
+static void* arena_alloc(EghactTreeArena* arena, size_t size) {
+    size = ARENA_ALIGN(size);
+    
+    ArenaChunk* chunk = arena->current;
+    while (chunk && chunk->used + size > chunk->size) {
+        chunk = chunk->next;
+    }
+    
+    if (!chunk) {
+        bool oversized = size > arena->chunk_size;
+        chunk = arena_new_chunk(arena, oversized ? size : arena->chunk_size, oversized);
+        if (!chunk) return NULL;
+    }
+    arena->current = chunk;
+    
+    void* ptr = chunk->data + chunk->used;
+    chunk->used += size;
+    arena_track(arena, size);
+    return ptr;
+}
+
+static size_t arena_child_class(size_t capacity) {
+    size_t cls = 0;
+    while (((size_t)4 << cls) < capacity) cls++;
+    return cls;
+}
+
+static Component** arena_alloc_children(EghactTreeArena* arena, size_t capacity) {
+    size_t cls = arena_child_class(capacity);
+    size_t bytes = ((size_t)4 << cls) * sizeof(Component*);
+    
+    if (cls < ARENA_CHILD_CLASSES && arena->free_child_blocks[cls]) {
+        ArenaFreeBlock* block = arena->free_child_blocks[cls];
+        arena->free_child_blocks[cls] = block->next;
+        arena_track(arena, bytes);
+        return (Component**)block;
+    }
+    return (Component**)arena_alloc(arena, bytes);
+}
+
+static void arena_free_children(EghactTreeArena* arena, Component** children, size_t capacity) {
+    if (!children) return;
+    
+    size_t cls = arena_child_class(capacity);
+    if (cls >= ARENA_CHILD_CLASSES) return;  // Reclaimed on reset
+    
+    ArenaFreeBlock* block = (ArenaFreeBlock*)children;
+    block->next = arena->free_child_blocks[cls];
+    arena->free_child_blocks[cls] = block;
+    arena->stats.bytes_in_use -= ((size_t)4 << cls) * sizeof(Component*);
+}
+
+EghactTreeArena* eghact_tree_arena_create(size_t chunk_size) {
+    EghactTreeArena* arena = (EghactTreeArena*)calloc(1, sizeof(EghactTreeArena));
+    if (!arena) return NULL;
+    arena->chunk_size = chunk_size > 0 ? ARENA_ALIGN(chunk_size) : ARENA_DEFAULT_CHUNK_SIZE;
+    return arena;
+}
+
+void eghact_tree_arena_reset(EghactTreeArena* arena) {
+    if (!arena) return;
+    
+    // Keep regular chunks for the next screen, release one-off oversized ones
+    ArenaChunk** link = &arena->chunks;
+    while (*link) {
+        ArenaChunk* chunk = *link;
+        if (chunk->oversized) {
+            *link = chunk->next;
+            arena->stats.bytes_reserved -= chunk->size;
+            arena->stats.chunk_count--;
+            free(chunk);
+        } else {
+            chunk->used = 0;
+            link = &chunk->next;
+        }
+    }
+    
+    arena->current = arena->chunks;
+    arena->free_components = NULL;
+    memset(arena->free_child_blocks, 0, sizeof(arena->free_child_blocks));
+    arena->stats.bytes_in_use = 0;
+    arena->stats.peak_bytes_in_use = 0;
+    arena->stats.component_count = 0;
+}
+
+void eghact_tree_arena_destroy(EghactTreeArena* arena) {
+    if (!arena) return;
+    
+    if (g_runtime && g_runtime->arena == arena) {
+        g_runtime->arena = NULL;
+    }
+    
+    ArenaChunk* chunk = arena->chunks;
+    while (chunk) {
+        ArenaChunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(arena);
+}
+
+void eghact_tree_arena_get_stats(const EghactTreeArena* arena, EghactArenaStats* stats) {
+    if (!arena || !stats) return;
+    *stats = arena->stats;
+}
+
+void eghact_set_tree_arena(EghactTreeArena* arena) {
+    if (!g_runtime) return;
+    g_runtime->arena = arena;
+}
+
+EghactTreeArena* eghact_get_tree_arena(void) {
+    return g_runtime ? g_runtime->arena : NULL;
+}
+
+// Component-owned strings are interned and shared between components
+bool eghact_component_set_string(Component* component, const char** slot, const char* value) {
+    if (!component || !slot) return false;
+    
+    // Same text, nothing to intern, free or push to the platform
+    if (!value) value = "";
+    if (*slot && (*slot == value || strcmp(*slot, value) == 0)) return false;
+    
+    const char* interned = eghact_string_intern(value);
+    if (!interned) return false;
+    eghact_string_release(*slot);
+    *slot = interned;
+    return true;
+}
+
+static Component* component_alloc(EghactTreeArena* arena) {
+    if (!arena) return (Component*)calloc(1, sizeof(Component));
+    
+    Component* component;
+    if (arena->free_components) {
+        component = (Component*)arena->free_components;
+        arena->free_components = arena->free_components->next;
+        arena_track(arena, ARENA_ALIGN(sizeof(Component)));
+    } else {
+        component = (Component*)arena_alloc(arena, sizeof(Component));
+        if (!component) return NULL;
+    }
+    
+    memset(component, 0, sizeof(Component));
+    component->arena = arena;
+    arena->stats.component_count++;
+    return component;
+}
+
+static void component_release(Component* component) {
+    EghactTreeArena* arena = component->arena;
+    if (!arena) {
+        free(component->children);
+        free(component);
+        return;
+    }
+    
+    arena_free_children(arena, component->children, component->child_capacity);
+    
+    ArenaFreeBlock* block = (ArenaFreeBlock*)component;
+    block->next = arena->free_components;
+    arena->free_components = block;
+    arena->stats.bytes_in_use -= ARENA_ALIGN(sizeof(Component));
+    arena->stats.component_count--;
+}
+
 // Create component
-Component* eghact_create_component(ComponentType type) {
-    Component* component = (Component*)calloc(1, sizeof(Component));
+static Component* component_new(ComponentType type) {
+    Component* component = component_alloc(g_runtime->arena);
+    if (!component) return NULL;
     component->type = type;
     component->id = NULL;
     component->parent = NULL;
@@ -154,9 +317,14 @@ Component* eghact_create_component(ComponentType type) {
     component->style.opacity = 1.0f;
     component->style.hidden = false;
     component->style.background_color = 0x00000000; // Transparent
-    
-    // Create native component
-    switch (type) {
+    eghact_layout_init_node(component);
+    return component;
+}
+
+// Create the native view once the component's data is filled in
+static Component* component_realize(Component* component) {
+    EGHACT_PERF_ADD(perf_components_created, 1);
+    switch (component->type) {
         case COMPONENT_VIEW:
             component->native_handle = g_renderer->create_view(component);
             break;
@@ -184,38 +352,58 @@ Component* eghact_create_component(ComponentType type) {
     return component;
 }
 
+Component* eghact_create_component(ComponentType type) {
+    Component* component = component_new(type);
+    if (!component) return NULL;
+    return component_realize(component);
+}
+
 // Component factory functions
 Component* eghact_create_view() {
     return eghact_create_component(COMPONENT_VIEW);
 }
 
 Component* eghact_create_text(const char* text) {
-    Component* component = eghact_create_component(COMPONENT_TEXT);
-    component->data.text_data.text = strdup(text);
+    Component* component = component_new(COMPONENT_TEXT);
+    if (!component) return NULL;
+    component->data.text_data.text = eghact_string_intern(text);
     component->data.text_data.color = 0xFF000000; // Black
     component->data.text_data.font_size = 16.0f;
-    return component;
+    return component_realize(component);
 }
 
 Component* eghact_create_image(const char* src) {
-    Component* component = eghact_create_component(COMPONENT_IMAGE);
-    component->data.image_data.src = strdup(src);
+    Component* component = component_new(COMPONENT_IMAGE);
+    if (!component) return NULL;
+    component->data.image_data.src = eghact_string_intern(src);
     component->data.image_data.resize_mode = 0; // Cover
-    return component;
+    return component_realize(component);
 }
 
 Component* eghact_create_button(const char* title, void (*on_press)(void)) {
-    Component* component = eghact_create_component(COMPONENT_BUTTON);
-    component->data.button_data.title = strdup(title);
+    Component* component = component_new(COMPONENT_BUTTON);
+    if (!component) return NULL;
+    component->data.button_data.title = eghact_string_intern(title);
     component->data.button_data.on_press = on_press;
-    return component;
+    return component_realize(component);
 }
 
 Component* eghact_create_input(const char* placeholder) {
-    Component* component = eghact_create_component(COMPONENT_INPUT);
-    component->data.input_data.value = strdup("");
-    component->data.input_data.placeholder = strdup(placeholder);
+    Component* component = component_new(COMPONENT_INPUT);
+    if (!component) return NULL;
+    component->data.input_data.value = eghact_string_intern("");
+    component->data.input_data.placeholder = eghact_string_intern(placeholder);
     component->data.input_data.on_change = NULL;
+    return component_realize(component);
+}
+
+Component* eghact_create_scroll() {
+    return eghact_create_component(COMPONENT_SCROLL);
+}
+
+Component* eghact_create_list() {
+    Component* component = eghact_create_component(COMPONENT_LIST);
+    component->data.list_data.state = NULL;
     return component;
 }
 
@@ -226,12 +414,25 @@ void eghact_add_child(Component* parent, Component* child) {
     // Grow children array if needed
     if (parent->child_count >= parent->child_capacity) {
         size_t new_capacity = parent->child_capacity == 0 ? 4 : parent->child_capacity * 2;
-        parent->children = (Component**)realloc(parent->children, new_capacity * sizeof(Component*));
+        if (parent->arena) {
+            Component** children = arena_alloc_children(parent->arena, new_capacity);
+            if (!children) return;
+            if (parent->child_count > 0) {
+                memcpy(children, parent->children, parent->child_count * sizeof(Component*));
+            }
+            arena_free_children(parent->arena, parent->children, parent->child_capacity);
+            parent->children = children;
+        } else {
+            Component** children = (Component**)realloc(parent->children, new_capacity * sizeof(Component*));
+            if (!children) return;
+            parent->children = children;
+        }
         parent->child_capacity = new_capacity;
     }
     
     parent->children[parent->child_count++] = child;
     child->parent = parent;
+    eghact_layout_invalidate(parent);
     
     // Update native hierarchy
     if (g_renderer && g_renderer->add_child) {
@@ -239,25 +440,146 @@ void eghact_add_child(Component* parent, Component* child) {
     }
 }
 
+// Remove child from parent without destroying it
+static bool detach_child(Component* parent, Component* child) {
+    for (size_t i = 0; i < parent->child_count; i++) {
+        if (parent->children[i] == child) {
+            memmove(&parent->children[i], &parent->children[i + 1],
+                    (parent->child_count - i - 1) * sizeof(Component*));
+            parent->child_count--;
+            child->parent = NULL;
+            eghact_layout_invalidate(parent);
+            return true;
+        }
+    }
+    return false;
+}
+
+void eghact_remove_child(Component* parent, Component* child) {
+    if (!parent || !child || child->parent != parent) return;
+    if (!detach_child(parent, child)) return;
+    
+    // Update native hierarchy
+    if (g_renderer && g_renderer->remove_child) {
+        g_renderer->remove_child(parent, child);
+    }
+}
+
+// Dirty tracking - setters only record what changed, eghact_commit flushes it
+void eghact_mark_dirty(Component* component, uint32_t flags) {
+    if (!component || !g_runtime) return;
+    
+    if (component->dirty == 0) {
+        // Append to the runtime's dirty list so nodes flush in the order they changed
+        component->dirty_prev = g_runtime->dirty_tail;
+        component->dirty_next = NULL;
+        if (g_runtime->dirty_tail) {
+            g_runtime->dirty_tail->dirty_next = component;
+        } else {
+            g_runtime->dirty_head = component;
+        }
+        g_runtime->dirty_tail = component;
+        g_runtime->dirty_count++;
+    }
+    component->dirty |= flags;
+}
+
+static void unlink_dirty(Component* component) {
+    if (component->dirty == 0) return;
+    
+    if (component->dirty_prev) {
+        component->dirty_prev->dirty_next = component->dirty_next;
+    } else {
+        g_runtime->dirty_head = component->dirty_next;
+    }
+    if (component->dirty_next) {
+        component->dirty_next->dirty_prev = component->dirty_prev;
+    } else {
+        g_runtime->dirty_tail = component->dirty_prev;
+    }
+    
+    component->dirty_prev = NULL;
+    component->dirty_next = NULL;
+    component->dirty = 0;
+    g_runtime->dirty_count--;
+}
+
+size_t eghact_commit(void) {
+    if (!g_runtime || !g_renderer) return 0;
+    EGHACT_PERF_SCOPE("ui", "commit");
+    
+    // Re-run layout for invalidated subtrees first so frames are final
+    eghact_layout_flush();
+    
+    size_t flushed = 0;
+    while (g_runtime->dirty_head) {
+        Component* component = g_runtime->dirty_head;
+        uint32_t flags = component->dirty;
+        
+        // Unlink before calling out so the renderer may dirty nodes again
+        unlink_dirty(component);
+        
+        if (g_renderer->update) {
+            g_renderer->update(component, flags);
+        } else {
+            if ((flags & EGHACT_DIRTY_LAYOUT) && g_renderer->update_layout) {
+                g_renderer->update_layout(component);
+            }
+            if ((flags & EGHACT_DIRTY_STYLE) && g_renderer->update_style) {
+                g_renderer->update_style(component);
+            }
+        }
+        flushed++;
+    }
+    
+    if (g_renderer->flush) {
+        g_renderer->flush();
+    }
+    
+    EGHACT_PERF_RECORD(perf_commit_nodes, flushed);
+    return flushed;
+}
+
+size_t eghact_pending_updates(void) {
+    return g_runtime ? g_runtime->dirty_count : 0;
+}
+
 // Style setters
 void eghact_set_position(Component* component, float x, float y) {
     if (!component) return;
+    if (component->style.x == x && component->style.y == y) return;
     component->style.x = x;
     component->style.y = y;
-    g_renderer->update_layout(component);
+    eghact_mark_dirty(component, EGHACT_DIRTY_LAYOUT);
+    
+    // Manually placed children define their container's content bounds
+    if (component->parent && component->parent->flex.direction == EGHACT_FLEX_NONE) {
+        eghact_layout_invalidate(component->parent);
+    }
 }
 
 void eghact_set_size(Component* component, float width, float height) {
     if (!component) return;
+    if (component->flex.width == width && component->flex.height == height &&
+        component->style.width == width && component->style.height == height) return;
+    component->flex.width = width;
+    component->flex.height = height;
     component->style.width = width;
     component->style.height = height;
-    g_renderer->update_layout(component);
+    eghact_mark_dirty(component, EGHACT_DIRTY_LAYOUT);
+    eghact_layout_invalidate_outer(component);
+    
+    // A virtualized list's viewport is its specified size
+    if (component->type == COMPONENT_LIST) {
+        eghact_list_refresh(component);
+    }
 }
 
 void eghact_set_background_color(Component* component, uint32_t color) {
     if (!component) return;
+    if (component->style.background_color == color) return;
     component->style.background_color = color;
-    g_renderer->update_style(component);
+    eghact_mark_dirty(component, EGHACT_DIRTY_STYLE);
 }
 
 void eghact_set_padding(Component* component, float top, float right, float bottom, float left) {
@@ -266,104 +588,166 @@ void eghact_set_padding(Component* component, float top, float right, float bott
     component->style.padding_right = right;
     component->style.padding_bottom = bottom;
     component->style.padding_left = left;
-    g_renderer->update_layout(component);
+    eghact_mark_dirty(component, EGHACT_DIRTY_LAYOUT);
+    eghact_layout_invalidate_outer(component);
+}
+
+void eghact_set_margin(Component* component, float top, float right, float bottom, float left) {
+    if (!component) return;
+    component->style.margin_top = top;
+    component->style.margin_right = right;
+    component->style.margin_bottom = bottom;
+    component->style.margin_left = left;
+    eghact_mark_dirty(component, EGHACT_DIRTY_LAYOUT);
+    eghact_layout_invalidate_outer(component);
+}
+
+void eghact_set_border(Component* component, float width, uint32_t color, float radius) {
+    if (!component) return;
+    component->style.border_width = width;
+    component->style.border_color = color;
+    component->style.border_radius = radius;
+    eghact_mark_dirty(component, EGHACT_DIRTY_STYLE);
+}
+
+void eghact_set_opacity(Component* component, float opacity) {
+    if (!component) return;
+    if (component->style.opacity == opacity) return;
+    component->style.opacity = opacity;
+    eghact_mark_dirty(component, EGHACT_DIRTY_STYLE);
+}
+
+void eghact_set_hidden(Component* component, bool hidden) {
+    if (!component) return;
+    if (component->style.hidden == hidden) return;
+    component->style.hidden = hidden;
+    eghact_mark_dirty(component, EGHACT_DIRTY_STYLE);
+    if (component->parent) {
+        eghact_layout_invalidate(component->parent);
+    }
+}
+
+// Content setters
+void eghact_set_image_source(Component* component, const char* src) {
+    if (!component || component->type != COMPONENT_IMAGE) return;
+    
+    if (!eghact_component_set_string(component, &component->data.image_data.src, src)) return;
+    eghact_mark_dirty(component, EGHACT_DIRTY_STYLE);
+}
+
+void eghact_set_button_title(Component* component, const char* title) {
+    if (!component || component->type != COMPONENT_BUTTON) return;
+    
+    if (!eghact_component_set_string(component, &component->data.button_data.title, title)) return;
+    eghact_mark_dirty(component, EGHACT_DIRTY_STYLE);
+    eghact_layout_invalidate(component);
 }
 
 // Text-specific setters
 void eghact_set_text(Component* component, const char* text) {
     if (!component || component->type != COMPONENT_TEXT) return;
     
-    free(component->data.text_data.text);
-    component->data.text_data.text = strdup(text);
-    g_renderer->update_style(component);
+    if (!eghact_component_set_string(component, &component->data.text_data.text, text)) return;
+    eghact_mark_dirty(component, EGHACT_DIRTY_STYLE);
+    eghact_layout_invalidate(component);
 }
 
 void eghact_set_text_color(Component* component, uint32_t color) {
     if (!component || component->type != COMPONENT_TEXT) return;
     
+    if (component->data.text_data.color == color) return;
     component->data.text_data.color = color;
-    g_renderer->update_style(component);
+    eghact_mark_dirty(component, EGHACT_DIRTY_STYLE);
 }
 
 void eghact_set_font_size(Component* component, float size) {
     if (!component || component->type != COMPONENT_TEXT) return;
     
+    if (component->data.text_data.font_size == size) return;
     component->data.text_data.font_size = size;
-    g_renderer->update_style(component);
+    eghact_mark_dirty(component, EGHACT_DIRTY_STYLE);
+    eghact_layout_invalidate(component);
 }
 
-// Layout engine - simplified flexbox-like layout
-void eghact_layout_flex_row(Component* container, float spacing) {
-    if (!container || container->child_count == 0) return;
-    
-    float x = container->style.padding_left;
-    float y = container->style.padding_top;
-    float available_width = container->style.width - container->style.padding_left - container->style.padding_right;
+// Input-specific setters
+void eghact_set_input_value(Component* component, const char* value) {
+    if (!component || component->type != COMPONENT_INPUT) return;
     
-    for (size_t i = 0; i < container->child_count; i++) {
-        Component* child = container->children[i];
-        if (child->style.hidden) continue;
-        
-        eghact_set_position(child, x, y);
-        x += child->style.width + spacing;
-    }
+    if (!eghact_component_set_string(component, &component->data.input_data.value, value)) return;
+    eghact_mark_dirty(component, EGHACT_DIRTY_STYLE);
 }
 
-void eghact_layout_flex_column(Component* container, float spacing) {
-    if (!container || container->child_count == 0) return;
+void eghact_set_input_placeholder(Component* component, const char* placeholder) {
+    if (!component || component->type != COMPONENT_INPUT) return;
     
-    float x = container->style.padding_left;
-    float y = container->style.padding_top;
+    if (!eghact_component_set_string(component, &component->data.input_data.placeholder, placeholder)) return;
+    eghact_mark_dirty(component, EGHACT_DIRTY_STYLE);
+}
+
+void eghact_set_input_change_handler(Component* component, void (*on_change)(const char*)) {
+    if (!component || component->type != COMPONENT_INPUT) return;
     
-    for (size_t i = 0; i < container->child_count; i++) {
-        Component* child = container->children[i];
-        if (child->style.hidden) continue;
-        
-        eghact_set_position(child, x, y);
-        y += child->style.height + spacing;
-    }
+    component->data.input_data.on_change = on_change;
 }
 
 // Destroy component and its children
-void eghact_destroy_component(Component* component) {
-    if (!component) return;
-    
+static void destroy_tree(Component* component) {
     // Destroy children first
     for (size_t i = 0; i < component->child_count; i++) {
-        eghact_destroy_component(component->children[i]);
+        destroy_tree(component->children[i]);
     }
     
     // Free component-specific data
     switch (component->type) {
         case COMPONENT_TEXT:
-            free(component->data.text_data.text);
+            eghact_string_release(component->data.text_data.text);
             break;
         case COMPONENT_IMAGE:
-            free(component->data.image_data.src);
+            eghact_string_release(component->data.image_data.src);
             break;
         case COMPONENT_BUTTON:
-            free(component->data.button_data.title);
+            eghact_string_release(component->data.button_data.title);
             break;
         case COMPONENT_INPUT:
-            free(component->data.input_data.value);
-            free(component->data.input_data.placeholder);
+            eghact_string_release(component->data.input_data.value);
+            eghact_string_release(component->data.input_data.placeholder);
+            break;
+        case COMPONENT_LIST:
+            // Visible rows went with the children above; this releases the pooled ones
+            eghact_list_destroy_state(component);
             break;
         default:
             break;
     }
     
+    // Drop any pending update for this node
+    unlink_dirty(component);
+    eghact_layout_forget(component);
+    #if !defined(PLATFORM_IOS) && !defined(PLATFORM_ANDROID)
+        eghact_loop_forget(component);
+    #endif
+    
     // Destroy native component
     if (g_renderer && g_renderer->destroy) {
         g_renderer->destroy(component);
     }
     
-    free(component->id);
-    free(component->children);
-    free(component);
+    eghact_string_release(component->id);
+    component_release(component);
     
     g_runtime->component_count--;
 }
 
+void eghact_destroy_component(Component* component) {
+    if (!component) return;
+    
+    // Children of a destroyed subtree go with it; only the top needs detaching
+    if (component->parent) {
+        detach_child(component->parent, component);
+    }
+    destroy_tree(component);
+}
+
 // Run the app
 void eghact_run(Component* root) {
     if (!g_runtime || !root) return;
@@ -371,16 +755,27 @@ void eghact_run(Component* root) {
     g_runtime->root = root;
     g_runtime->is_running = true;
     
+    // Flush everything the app set up before handing over to the platform
+    eghact_commit();
+    
     // Platform-specific run loop
     #ifdef PLATFORM_IOS
         eghact_ios_run_loop(g_runtime);
     #elif defined(PLATFORM_ANDROID)
         eghact_android_run_loop(g_runtime);
     #else
-        // Default run loop for testing
-        while (g_runtime->is_running) {
-            // Process events, update, render
-        }
+        eghact_loop_run(g_runtime);
+    #endif
+}
+
+// Ask the run loop to return
+void eghact_stop() {
+    if (!g_runtime) return;
+    
+    #if !defined(PLATFORM_IOS) && !defined(PLATFORM_ANDROID)
+        eghact_loop_stop(g_runtime);
+    #else
+        g_runtime->is_running = false;
     #endif
 }
 
@@ -394,41 +789,13 @@ void eghact_shutdown() {
         eghact_destroy_component(g_runtime->root);
     }
     
+    #if !defined(PLATFORM_IOS) && !defined(PLATFORM_ANDROID)
+        eghact_loop_shutdown();
+    #endif
+    
+    free(g_runtime->layout_queue);
+    eghact_strings_shutdown();
+    
     free(g_runtime);
     g_runtime = NULL;
 }
-
-// Export for WebAssembly
-#ifdef __EMSCRIPTEN__
-    #include <emscripten.h>
-    
-    EMSCRIPTEN_KEEPALIVE
-    void* eghact_wasm_init() {
-        return eghact_init();
-    }
-    
-    EMSCRIPTEN_KEEPALIVE
-    void* eghact_wasm_create_view() {
-        return eghact_create_view();
-    }
-    
-    EMSCRIPTEN_KEEPALIVE
-    void* eghact_wasm_create_text(const char* text) {
-        return eghact_create_text(text);
-    }
-    
-    EMSCRIPTEN_KEEPALIVE
-    void eghact_wasm_add_child(void* parent, void* child) {
-        eghact_add_child((Component*)parent, (Component*)child);
-    }
-    
-    EMSCRIPTEN_KEEPALIVE
-    void eghact_wasm_set_position(void* component, float x, float y) {
-        eghact_set_position((Component*)component, x, y);
-    }
-    
-    EMSCRIPTEN_KEEPALIVE
-    void eghact_wasm_set_size(void* component, float width, float height) {
-        eghact_set_size((Component*)component, width, height);
-    }
-#endif
\ No newline at end of file
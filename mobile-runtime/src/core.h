@@ -43,11 +43,246 @@ typedef struct {
     bool hidden;
 } Style;
 
+// Flexbox layout properties
+#define EGHACT_SIZE_AUTO (-1.0f)
+
+typedef enum {
+    EGHACT_FLEX_NONE,    // Children keep the positions set by the app
+    EGHACT_FLEX_ROW,
+    EGHACT_FLEX_COLUMN
+} FlexDirection;
+
+typedef enum {
+    EGHACT_JUSTIFY_START,
+    EGHACT_JUSTIFY_END,
+    EGHACT_JUSTIFY_CENTER,
+    EGHACT_JUSTIFY_SPACE_BETWEEN,
+    EGHACT_JUSTIFY_SPACE_AROUND,
+    EGHACT_JUSTIFY_SPACE_EVENLY
+} FlexJustify;
+
+typedef enum {
+    EGHACT_ALIGN_AUTO,   // align_self only: inherit the parent's align_items
+    EGHACT_ALIGN_START,
+    EGHACT_ALIGN_END,
+    EGHACT_ALIGN_CENTER,
+    EGHACT_ALIGN_STRETCH
+} FlexAlign;
+
+typedef struct {
+    FlexDirection direction;
+    bool wrap;
+    FlexJustify justify_content;
+    FlexAlign align_items;
+    FlexAlign align_self;
+    float grow;
+    float shrink;
+    float basis;          // EGHACT_SIZE_AUTO to use the specified or measured size
+    float gap;            // Spacing between children and between wrapped lines
+    float width, height;  // Specified size, EGHACT_SIZE_AUTO to size from content
+} FlexStyle;
+
+// Measured size for one set of constraints
+typedef struct {
+    float available_width, available_height;
+    uint8_t width_mode, height_mode;
+    float width, height;
+    bool valid;
+} LayoutCacheEntry;
+
+// Per-node layout state
+typedef struct {
+    LayoutCacheEntry measure;  // Last size-only query from a parent
+    LayoutCacheEntry layout;   // Constraints the current child frames were computed for
+    bool dirty;                // Node or a descendant changed since its last layout
+    bool laid_out;             // Has been through at least one full layout
+    bool is_root;              // Laid out directly by eghact_layout_compute
+    bool queued;               // Waiting in the runtime's relayout queue
+} LayoutCache;
+
+// Layout engine counters
+typedef struct {
+    size_t nodes_computed;   // Layout or measure passes that missed the cache
+    size_t cache_hits;
+    size_t text_measures;
+    size_t relayout_roots;   // Queued subtrees re-run by eghact_layout_flush
+} EghactLayoutStats;
+
+// Dirty flags recorded by setters and flushed by eghact_commit
+typedef enum {
+    EGHACT_DIRTY_LAYOUT = 1 << 0,  // Position, size, padding or margin changed
+    EGHACT_DIRTY_STYLE  = 1 << 1   // Colors, border, opacity, visibility or content changed
+} DirtyFlags;
+
+// Stable id of an interned string, 0 for none. Ids are never reused.
+typedef uint32_t EghactStringId;
+
+// String table counters
+typedef struct {
+    size_t unique_strings;
+    size_t bytes;    // Bytes held by live strings, including terminators
+    size_t lookups;  // eghact_string_intern calls
+    size_t hits;     // Lookups answered by an existing string
+} EghactStringStats;
+
+// Tree arena for per-screen component allocation (opaque)
+typedef struct EghactTreeArena EghactTreeArena;
+
+// Virtualized list state owned by a COMPONENT_LIST (opaque)
+typedef struct EghactListState EghactListState;
+
+// Supplies rows to a virtualized list. Rows are created per type on demand, then
+// detached into that type's pool when they scroll out and rebound to new indices.
+typedef struct {
+    size_t row_count;
+    float row_height;
+    size_t overscan;  // Extra rows kept alive beyond each edge of the viewport
+    size_t type_count;  // Number of distinct row layouts, 0 is treated as 1
+    
+    // Optional: layout type of a row, in [0, type_count). NULL means every row is type 0.
+    size_t (*row_type)(Component* list, size_t index, void* user_data);
+    // Build an unbound row of the given type; called only when its pool is empty.
+    Component* (*create_row)(Component* list, size_t type, void* user_data);
+    // Fill a row with the content for index.
+    void (*bind_row)(Component* list, Component* row, size_t index, void* user_data);
+    void* user_data;
+} EghactListAdapter;
+
+// Virtualized list counters
+typedef struct {
+    size_t visible_rows;  // Rows currently attached to the list
+    size_t pooled_rows;   // Detached rows waiting to be rebound
+    size_t rows_created;  // create_row calls
+    size_t rows_bound;    // bind_row calls
+} EghactListStats;
+
+// Base component structure
+struct Component {
+    ComponentType type;
+    const char* id;
+    Style style;
+    void* native_handle;  // Platform-specific handle
+    struct Component* parent;
+    struct Component** children;
+    size_t child_count;
+    size_t child_capacity;
+    EghactTreeArena* arena;  // Owning arena, NULL for heap-allocated components
+    uint32_t dirty;          // Pending DirtyFlags, 0 when not queued
+    struct Component* dirty_prev;
+    struct Component* dirty_next;
+    FlexStyle flex;
+    LayoutCache layout;
+    
+    // Component-specific data
+    union {
+        struct {
+            const char* text;
+            uint32_t color;
+            float font_size;
+        } text_data;
+        
+        struct {
+            const char* src;  // Interned; eghact_string_id(src) is shared by equal sources
+            int resize_mode;
+        } image_data;
+        
+        struct {
+            const char* title;
+            void (*on_press)(void);
+        } button_data;
+        
+        struct {
+            const char* value;
+            const char* placeholder;
+            void (*on_change)(const char*);
+        } input_data;
+        
+        struct {
+            EghactListState* state;  // NULL until an adapter is set
+        } list_data;
+    } data;
+};
+
+// Runtime context
+struct EghactRuntime {
+    Component* root;
+    void* platform_context;
+    size_t component_count;
+    bool is_running;
+    EghactTreeArena* arena;  // Arena used for new components, NULL for heap
+    Component* dirty_head;   // Components waiting for eghact_commit
+    Component* dirty_tail;
+    size_t dirty_count;
+    Component** layout_queue;  // Relayout boundaries invalidated since the last flush
+    size_t layout_queue_count;
+    size_t layout_queue_capacity;
+};
+
+// Platform-specific rendering interface
+struct PlatformRenderer {
+    void* (*create_view)(Component* component);
+    void* (*create_text)(Component* component);
+    void* (*create_image)(Component* component);
+    void* (*create_button)(Component* component);
+    void* (*create_input)(Component* component);
+    void* (*create_scroll)(Component* component);
+    void* (*create_list)(Component* component);
+    
+    void (*update_layout)(Component* component);
+    void (*update_style)(Component* component);
+    void (*add_child)(Component* parent, Component* child);
+    void (*remove_child)(Component* parent, Component* child);
+    void (*destroy)(Component* component);
+    
+    // Optional: apply all pending changes for a node in one call. When NULL,
+    // eghact_commit falls back to update_layout/update_style per dirty flag.
+    void (*update)(Component* component, uint32_t dirty_flags);
+    
+    // Optional: measure text/button content for the layout engine. max_width is
+    // INFINITY when unconstrained. When NULL the runtime uses a font-size estimate.
+    void (*measure)(Component* component, float max_width, float* width, float* height);
+    
+    // Optional: called once at the end of every eghact_commit, after all updates were
+    // issued. Renderers that record commands deliver them here in one native call.
+    void (*flush)(void);
+    
+    // Optional: the last reference to an interned string went away. Renderers that cache
+    // resources by string id (e.g. decoded images keyed by an image source) evict here.
+    void (*string_released)(EghactStringId id);
+};
+
+// Arena usage counters
+typedef struct {
+    size_t bytes_in_use;       // Bytes handed out and not yet returned to a free list
+    size_t peak_bytes_in_use;  // High-water mark since creation or last reset
+    size_t bytes_reserved;     // Chunk memory currently owned by the arena
+    size_t chunk_count;
+    size_t component_count;    // Live components allocated from the arena
+} EghactArenaStats;
+
 // Runtime functions
 EghactRuntime* eghact_init(void);
 void eghact_run(Component* root);
+void eghact_stop(void);
 void eghact_shutdown(void);
 
+// Run loop (desktop, headless and WASM hosts)
+// Where the platform has no UI loop of its own, eghact_run processes posted events and
+// timers, commits pending updates once per frame, and sleeps while there is nothing to
+// do. Events may be posted from any thread; timers and every other runtime call belong
+// on the loop thread. eghact_run_once runs one iteration for hosts that own the loop,
+// without eghact_run, waiting at most timeout_ms (negative = until there is work); it
+// returns false once eghact_stop has been called.
+typedef uint32_t EghactTimerId;  // 0 is never a valid id
+
+void eghact_set_frame_rate(uint32_t hz);  // Default 60; 0 on WASM follows requestAnimationFrame
+bool eghact_run_once(int timeout_ms);
+bool eghact_post_event(void (*handler)(void* data), void* data);
+bool eghact_post_press(Component* button);
+bool eghact_post_text_change(Component* input, const char* text);
+EghactTimerId eghact_set_timer(uint32_t delay_ms, uint32_t interval_ms, void (*callback)(void* data), void* data);
+void eghact_clear_timer(EghactTimerId id);
+
 // Component creation
 Component* eghact_create_view(void);
 Component* eghact_create_text(const char* text);
@@ -62,6 +297,35 @@ void eghact_add_child(Component* parent, Component* child);
 void eghact_remove_child(Component* parent, Component* child);
 void eghact_destroy_component(Component* component);
 
+// Tree arenas
+// Components created while an arena is active (via eghact_set_tree_arena) take their
+// struct and child arrays from the arena instead of the heap. Destroying such a
+// tree only releases native views; memory is recycled by the arena and returned in one go
+// by eghact_tree_arena_reset/_destroy, which must only be called once the tree is gone.
+EghactTreeArena* eghact_tree_arena_create(size_t chunk_size);
+void eghact_tree_arena_reset(EghactTreeArena* arena);
+void eghact_tree_arena_destroy(EghactTreeArena* arena);
+void eghact_tree_arena_get_stats(const EghactTreeArena* arena, EghactArenaStats* stats);
+void eghact_set_tree_arena(EghactTreeArena* arena);
+EghactTreeArena* eghact_get_tree_arena(void);
+
+// Interned strings
+// Component text, titles, placeholders and image sources are interned: equal strings
+// share one ref-counted copy and id, and setters given the current value do nothing.
+// Interned strings are immutable.
+const char* eghact_string_intern(const char* str);  // Returns a new reference
+void eghact_string_retain(const char* interned);
+void eghact_string_release(const char* interned);
+EghactStringId eghact_string_id(const char* interned);
+void eghact_string_get_stats(EghactStringStats* stats);
+
+// Batched updates
+// Setters only mark components dirty. eghact_commit sends one coalesced update per
+// dirty node to the platform renderer and returns the number of nodes flushed.
+size_t eghact_commit(void);
+size_t eghact_pending_updates(void);
+void eghact_mark_dirty(Component* component, uint32_t flags);
+
 // Style setters
 void eghact_set_position(Component* component, float x, float y);
 void eghact_set_size(Component* component, float width, float height);
@@ -72,6 +336,10 @@ void eghact_set_border(Component* component, float width, uint32_t color, float
 void eghact_set_opacity(Component* component, float opacity);
 void eghact_set_hidden(Component* component, bool hidden);
 
+// Content setters
+void eghact_set_image_source(Component* component, const char* src);
+void eghact_set_button_title(Component* component, const char* title);
+
 // Text-specific functions
 void eghact_set_text(Component* component, const char* text);
 void eghact_set_text_color(Component* component, uint32_t color);
@@ -82,6 +350,35 @@ void eghact_set_input_value(Component* component, const char* value);
 void eghact_set_input_placeholder(Component* component, const char* placeholder);
 void eghact_set_input_change_handler(Component* component, void (*on_change)(const char*));
 
+// Flexbox layout
+// eghact_layout_compute lays out a whole tree for the given size (negative = unconstrained).
+// Afterwards, setters invalidate only the changed node and its ancestors up to the nearest
+// fixed-size boundary; eghact_layout_flush (run by eghact_commit) re-lays those subtrees,
+// reusing cached measurements for every untouched sibling.
+void eghact_set_flex_direction(Component* component, FlexDirection direction);
+void eghact_set_flex_wrap(Component* component, bool wrap);
+void eghact_set_justify_content(Component* component, FlexJustify justify);
+void eghact_set_align_items(Component* component, FlexAlign align);
+void eghact_set_align_self(Component* component, FlexAlign align);
+void eghact_set_flex(Component* component, float grow, float shrink, float basis);
+void eghact_set_gap(Component* component, float gap);
+void eghact_layout_compute(Component* root, float available_width, float available_height);
+size_t eghact_layout_flush(void);
+void eghact_layout_get_stats(EghactLayoutStats* stats);
+void eghact_layout_reset_stats(void);
+
+// Virtualized lists
+// A list with an adapter keeps only the rows inside its viewport (plus overscan) as
+// components, positioned relative to the current scroll offset. The viewport is the
+// list's specified size, so give it one with eghact_set_size.
+void eghact_list_set_adapter(Component* list, const EghactListAdapter* adapter);
+void eghact_list_set_row_count(Component* list, size_t row_count);
+void eghact_list_set_scroll_offset(Component* list, float offset);
+void eghact_list_scroll_by(Component* list, float delta);
+float eghact_list_get_scroll_offset(const Component* list);
+void eghact_list_reload(Component* list);  // Rebind every visible row
+void eghact_list_get_stats(const Component* list, EghactListStats* stats);
+
 // Layout helpers
 void eghact_layout_flex_row(Component* container, float spacing);
 void eghact_layout_flex_column(Component* container, float spacing);
@@ -102,9 +399,38 @@ extern PlatformRenderer* eghact_ios_renderer_init(void);
 extern PlatformRenderer* eghact_android_renderer_init(void);
 extern PlatformRenderer* eghact_default_renderer_init(void);
 
+// Replace an interned string owned by a component; false if it already held value (internal use)
+extern bool eghact_component_set_string(Component* component, const char** slot, const char* value);
+extern void eghact_strings_shutdown(void);
+
+// Layout engine hooks used by core.c (internal use)
+extern void eghact_layout_init_node(Component* component);
+extern void eghact_layout_invalidate(Component* component);
+extern void eghact_layout_invalidate_outer(Component* component);
+extern void eghact_layout_forget(Component* component);
+
+// Virtualized list hooks used by core.c (internal use)
+extern void eghact_list_refresh(Component* list);
+extern void eghact_list_destroy_state(Component* list);
+extern PlatformRenderer* eghact_get_renderer(void);
+extern void eghact_set_renderer(PlatformRenderer* renderer);
+extern EghactRuntime* eghact_get_runtime(void);
+
+// Android command buffer mode: records create/layout/style/child ops into a direct
+// ByteBuffer that EghactRuntime.java applies once per commit. Must be selected before
+// any component is created, since view handles become integer ids, and can only be
+// turned off again once every component created through it is destroyed. Returns false
+// when the switch is refused.
+extern bool eghact_android_set_command_buffer(bool enabled, size_t capacity);
+
 // Platform-specific run loops (internal use)
 extern void eghact_ios_run_loop(EghactRuntime* runtime);
 extern void eghact_android_run_loop(EghactRuntime* runtime);
+extern void eghact_loop_init(void);
+extern void eghact_loop_run(EghactRuntime* runtime);
+extern void eghact_loop_stop(EghactRuntime* runtime);
+extern void eghact_loop_shutdown(void);
+extern void eghact_loop_forget(Component* component);
 
 #ifdef __cplusplus
 }
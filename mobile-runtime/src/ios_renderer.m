@@ -14,13 +14,14 @@ UIImageView* ios_create_image(Component* component);
 UIButton* ios_create_button(Component* component);
 UITextField* ios_create_input(Component* component);
 UIScrollView* ios_create_scroll(Component* component);
-UITableView* ios_create_list(Component* component);
+UIView* ios_create_list(Component* component);
 
 void ios_update_layout(Component* component);
 void ios_update_style(Component* component);
 void ios_add_child(Component* parent, Component* child);
 void ios_remove_child(Component* parent, Component* child);
 void ios_destroy(Component* component);
+static void ios_string_released(EghactStringId id);
 
 // Platform renderer implementation
 static PlatformRenderer ios_renderer = {
@@ -35,7 +36,8 @@ static PlatformRenderer ios_renderer = {
     .update_style = ios_update_style,
     .add_child = ios_add_child,
     .remove_child = ios_remove_child,
-    .destroy = ios_destroy
+    .destroy = ios_destroy,
+    .string_released = ios_string_released
 };
 
 // Initialize iOS renderer
@@ -68,25 +70,86 @@ UILabel* ios_create_text(Component* component) {
     return label;
 }
 
-// Create UIImageView
-UIImageView* ios_create_image(Component* component) {
-    UIImageView* imageView = [[UIImageView alloc] init];
+// Decoded images shared by every view showing the same interned source, keyed by
+// string id and evicted when the last component using that source goes away
+static NSMutableDictionary<NSNumber*, UIImage*>* g_image_cache = nil;
+static NSMutableDictionary<NSNumber*, NSHashTable<UIImageView*>*>* g_image_loads = nil;
+
+static void ios_apply_image(UIImageView* imageView, NSNumber* key, UIImage* image) {
+    // The view may have been rebound to another source while loading
+    NSNumber* current = objc_getAssociatedObject(imageView, "eghact_image_id");
+    if ([current isEqualToNumber:key]) {
+        imageView.image = image;
+    }
+}
+
+static void ios_load_image(UIImageView* imageView, Component* component) {
+    const char* src_str = component->data.image_data.src;
+    NSNumber* key = @(eghact_string_id(src_str));
+    
+    NSNumber* current = objc_getAssociatedObject(imageView, "eghact_image_id");
+    if ([current isEqualToNumber:key]) return;
+    objc_setAssociatedObject(imageView, "eghact_image_id", key, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
     
-    NSString* src = [NSString stringWithUTF8String:component->data.image_data.src];
+    if (!g_image_cache) {
+        g_image_cache = [NSMutableDictionary dictionary];
+        g_image_loads = [NSMutableDictionary dictionary];
+    }
+    
+    UIImage* cached = g_image_cache[key];
+    if (cached) {
+        imageView.image = cached;
+        return;
+    }
+    imageView.image = nil;
+    
+    NSString* src = [NSString stringWithUTF8String:src_str];
     if ([src hasPrefix:@"http"]) {
-        // Load from URL
+        // One download per source; views asking while it is in flight wait for it
+        NSHashTable<UIImageView*>* waiters = g_image_loads[key];
+        if (waiters) {
+            [waiters addObject:imageView];
+            return;
+        }
+        waiters = [NSHashTable weakObjectsHashTable];
+        [waiters addObject:imageView];
+        g_image_loads[key] = waiters;
+        
         NSURL* url = [NSURL URLWithString:src];
         dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
             NSData* data = [NSData dataWithContentsOfURL:url];
             UIImage* image = [UIImage imageWithData:data];
             dispatch_async(dispatch_get_main_queue(), ^{
-                imageView.image = image;
+                NSHashTable<UIImageView*>* views = g_image_loads[key];
+                [g_image_loads removeObjectForKey:key];
+                
+                // Only cache while the source is still interned, i.e. still in use
+                if (image && views) {
+                    g_image_cache[key] = image;
+                }
+                for (UIImageView* view in views) {
+                    ios_apply_image(view, key, image);
+                }
             });
         });
     } else {
         // Load from bundle
-        imageView.image = [UIImage imageNamed:src];
+        UIImage* image = [UIImage imageNamed:src];
+        if (image) g_image_cache[key] = image;
+        imageView.image = image;
     }
+}
+
+static void ios_string_released(EghactStringId id) {
+    NSNumber* key = @(id);
+    [g_image_cache removeObjectForKey:key];
+    [g_image_loads removeObjectForKey:key];
+}
+
+// Create UIImageView
+UIImageView* ios_create_image(Component* component) {
+    UIImageView* imageView = [[UIImageView alloc] init];
+    ios_load_image(imageView, component);
     
     // Set content mode based on resize mode
     switch (component->data.image_data.resize_mode) {
@@ -132,7 +195,10 @@ UIButton* ios_create_button(Component* component) {
     NSValue* callbackValue = objc_getAssociatedObject(self, "eghact_callback");
     if (callbackValue) {
         void (*callback)(void) = [callbackValue pointerValue];
-        if (callback) callback();
+        if (callback) {
+            callback();
+            eghact_commit();
+        }
     }
 }
 @end
@@ -167,6 +233,7 @@ UITextField* ios_create_input(Component* component) {
         if (component && component->data.input_data.on_change) {
             const char* text = [self.text UTF8String];
             component->data.input_data.on_change(text);
+            eghact_commit();
         }
     }
 }
@@ -180,13 +247,35 @@ UIScrollView* ios_create_scroll(Component* component) {
     return scrollView;
 }
 
-// Create UITableView
-UITableView* ios_create_list(Component* component) {
-    UITableView* tableView = [[UITableView alloc] initWithFrame:CGRectZero 
-                                                          style:UITableViewStylePlain];
-    // Would need to implement data source and delegate
-    return tableView;
+// Create list container - rows are virtualized in core, the view clips them and
+// reports drags so the runtime can move its window
+UIView* ios_create_list(Component* component) {
+    UIView* listView = [[UIView alloc] init];
+    listView.clipsToBounds = YES;
+    
+    objc_setAssociatedObject(listView, "eghact_component", 
+                            [NSValue valueWithPointer:component], 
+                            OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+    
+    UIPanGestureRecognizer* pan = [[UIPanGestureRecognizer alloc] initWithTarget:listView 
+                                                                          action:@selector(eghact_list_panned:)];
+    [listView addGestureRecognizer:pan];
+    return listView;
+}
+
+// List drag handler
+@implementation UIView (EghactListCallback)
+- (void)eghact_list_panned:(UIPanGestureRecognizer*)pan {
+    NSValue* componentValue = objc_getAssociatedObject(self, "eghact_component");
+    if (componentValue) {
+        Component* component = [componentValue pointerValue];
+        CGPoint translation = [pan translationInView:self];
+        [pan setTranslation:CGPointZero inView:self];
+        eghact_list_scroll_by(component, -translation.y);
+        eghact_commit();
+    }
 }
+@end
 
 // Update layout
 void ios_update_layout(Component* component) {
@@ -237,6 +326,9 @@ void ios_update_style(Component* component) {
             textField.text = [NSString stringWithUTF8String:component->data.input_data.value];
             break;
         }
+        case COMPONENT_IMAGE:
+            ios_load_image((UIImageView*)view, component);
+            break;
         default:
             break;
     }
@@ -270,7 +362,7 @@ void ios_destroy(Component* component) {
     // Clear associated objects
     if (component->type == COMPONENT_BUTTON) {
         objc_setAssociatedObject(view, "eghact_callback", nil, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
-    } else if (component->type == COMPONENT_INPUT) {
+    } else if (component->type == COMPONENT_INPUT || component->type == COMPONENT_LIST) {
         objc_setAssociatedObject(view, "eghact_component", nil, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
     }
 }
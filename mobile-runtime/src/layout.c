@@ -0,0 +1,673 @@
+/**
+ * Eghact Native Mobile Runtime - Layout Engine
+ * Flexbox layout over the Component tree with per-node measurement caching
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "core.h"
+
+// Constraint modes for one axis
+typedef enum {
+    MEASURE_UNDEFINED,  // Size from content
+    MEASURE_EXACT,      // Size is fixed by the parent
+    MEASURE_AT_MOST     // Size from content, capped at the available space
+} MeasureMode;
+
+// Per-child scratch state for one flex pass
+typedef struct {
+    Component* child;
+    float basis;
+    float main;
+    float cross;
+    float margin_main_lead, margin_main_trail;
+    float margin_cross_lead, margin_cross_trail;
+    FlexAlign align;
+    bool stretch;
+    bool flexible;  // False when the child specifies its main size, which always wins
+} FlexItem;
+
+#define FLEX_INLINE_ITEMS 32
+#define TEXT_CHAR_WIDTH 0.5f   // Fallback glyph advance, in font sizes
+#define TEXT_LINE_HEIGHT 1.2f  // Fallback line height, in font sizes
+
+static EghactLayoutStats g_layout_stats;
+
+static void layout_node(Component* node, float aw, uint8_t wm, float ah, uint8_t hm,
+                        bool perform_layout, float* out_w, float* out_h);
+
+// Node state
+void eghact_layout_init_node(Component* component) {
+    memset(&component->flex, 0, sizeof(component->flex));
+    component->flex.direction = EGHACT_FLEX_NONE;
+    component->flex.justify_content = EGHACT_JUSTIFY_START;
+    component->flex.align_items = EGHACT_ALIGN_STRETCH;
+    component->flex.align_self = EGHACT_ALIGN_AUTO;
+    component->flex.basis = EGHACT_SIZE_AUTO;
+    component->flex.width = EGHACT_SIZE_AUTO;
+    component->flex.height = EGHACT_SIZE_AUTO;
+
+    // New nodes have never been measured, so they start out dirty
+    memset(&component->layout, 0, sizeof(component->layout));
+    component->layout.dirty = true;
+}
+
+static bool is_layout_boundary(const Component* component) {
+    if (!component->parent || component->layout.is_root) return true;
+
+    // A node with a fixed size cannot change its parent's layout from the inside
+    return component->flex.width >= 0 && component->flex.height >= 0;
+}
+
+static void queue_relayout(Component* component) {
+    EghactRuntime* runtime = eghact_get_runtime();
+    if (!runtime || component->layout.queued) return;
+
+    if (runtime->layout_queue_count >= runtime->layout_queue_capacity) {
+        size_t new_capacity = runtime->layout_queue_capacity == 0 ? 16 : runtime->layout_queue_capacity * 2;
+        Component** queue = (Component**)realloc(runtime->layout_queue, new_capacity * sizeof(Component*));
+        if (!queue) return;
+        runtime->layout_queue = queue;
+        runtime->layout_queue_capacity = new_capacity;
+    }
+
+    runtime->layout_queue[runtime->layout_queue_count++] = component;
+    component->layout.queued = true;
+}
+
+void eghact_layout_invalidate(Component* component) {
+    while (component) {
+        LayoutCache* cache = &component->layout;
+        bool already_invalid = cache->dirty && !cache->layout.valid && !cache->measure.valid;
+
+        cache->dirty = true;
+        cache->layout.valid = false;
+        cache->measure.valid = false;
+
+        // Ancestors were invalidated when this node first became dirty
+        if (already_invalid) return;
+
+        if (cache->laid_out && is_layout_boundary(component)) {
+            queue_relayout(component);
+            return;
+        }
+        component = component->parent;
+    }
+}
+
+void eghact_layout_invalidate_outer(Component* component) {
+    if (!component) return;
+    eghact_layout_invalidate(component);
+    if (component->parent) {
+        eghact_layout_invalidate(component->parent);
+    }
+}
+
+void eghact_layout_forget(Component* component) {
+    EghactRuntime* runtime = eghact_get_runtime();
+    if (!runtime || !component->layout.queued) return;
+
+    for (size_t i = 0; i < runtime->layout_queue_count; i++) {
+        if (runtime->layout_queue[i] == component) {
+            runtime->layout_queue[i] = runtime->layout_queue[--runtime->layout_queue_count];
+            break;
+        }
+    }
+    component->layout.queued = false;
+}
+
+// Cache
+static bool cache_matches(const LayoutCacheEntry* entry, float aw, uint8_t wm, float ah, uint8_t hm) {
+    if (!entry->valid || entry->width_mode != wm || entry->height_mode != hm) return false;
+    if (wm != MEASURE_UNDEFINED && entry->available_width != aw) return false;
+    if (hm != MEASURE_UNDEFINED && entry->available_height != ah) return false;
+    return true;
+}
+
+static void cache_store(LayoutCacheEntry* entry, float aw, uint8_t wm, float ah, uint8_t hm, float w, float h) {
+    entry->available_width = aw;
+    entry->available_height = ah;
+    entry->width_mode = wm;
+    entry->height_mode = hm;
+    entry->width = w;
+    entry->height = h;
+    entry->valid = true;
+}
+
+// Axis helpers
+static float padding_lead(const Component* c, bool row) {
+    return row ? c->style.padding_left : c->style.padding_top;
+}
+
+static float padding_trail(const Component* c, bool row) {
+    return row ? c->style.padding_right : c->style.padding_bottom;
+}
+
+static float margin_lead(const Component* c, bool row) {
+    return row ? c->style.margin_left : c->style.margin_top;
+}
+
+static float margin_trail(const Component* c, bool row) {
+    return row ? c->style.margin_right : c->style.margin_bottom;
+}
+
+static float specified_size(const Component* c, bool row) {
+    return row ? c->flex.width : c->flex.height;
+}
+
+static float resolve_size(float content, float available, uint8_t mode) {
+    if (mode == MEASURE_EXACT) return available;
+    if (mode == MEASURE_AT_MOST && content > available) return available;
+    return content;
+}
+
+static float inner_available(float available, uint8_t mode, float lead, float trail) {
+    if (mode == MEASURE_UNDEFINED) return NAN;
+    float inner = available - lead - trail;
+    return inner > 0 ? inner : 0;
+}
+
+// Write a computed frame, queueing a native update only when it moved
+static void apply_frame(Component* c, float x, float y, float w, float h) {
+    if (c->style.x == x && c->style.y == y && c->style.width == w && c->style.height == h) return;
+    c->style.x = x;
+    c->style.y = y;
+    c->style.width = w;
+    c->style.height = h;
+    eghact_mark_dirty(c, EGHACT_DIRTY_LAYOUT);
+}
+
+// Leaf measurement
+static void measure_content(Component* c, float max_w, float* w, float* h) {
+    *w = 0;
+    *h = 0;
+
+    const char* text = NULL;
+    float font_size = 16.0f;
+    if (c->type == COMPONENT_TEXT) {
+        text = c->data.text_data.text;
+        font_size = c->data.text_data.font_size;
+    } else if (c->type == COMPONENT_BUTTON) {
+        text = c->data.button_data.title;
+    } else {
+        return;
+    }
+
+    g_layout_stats.text_measures++;
+
+    PlatformRenderer* renderer = eghact_get_renderer();
+    if (renderer && renderer->measure) {
+        renderer->measure(c, isnan(max_w) ? INFINITY : max_w, w, h);
+        return;
+    }
+
+    // Estimate: fixed advance per character, wrapping at max_w
+    size_t len = text ? strlen(text) : 0;
+    float line_width = (float)len * font_size * TEXT_CHAR_WIDTH;
+    float line_height = font_size * TEXT_LINE_HEIGHT;
+
+    if (!isnan(max_w) && max_w > 0 && line_width > max_w) {
+        *w = max_w;
+        *h = ceilf(line_width / max_w) * line_height;
+    } else {
+        *w = line_width;
+        *h = len > 0 ? line_height : 0;
+    }
+}
+
+static void layout_leaf(Component* node, float aw, uint8_t wm, float ah, uint8_t hm, float* out_w, float* out_h) {
+    float pad_w = node->style.padding_left + node->style.padding_right;
+    float pad_h = node->style.padding_top + node->style.padding_bottom;
+
+    float content_w = 0, content_h = 0;
+    if (wm != MEASURE_EXACT || hm != MEASURE_EXACT) {
+        measure_content(node, inner_available(aw, wm, node->style.padding_left, node->style.padding_right),
+                        &content_w, &content_h);
+    }
+
+    *out_w = resolve_size(content_w + pad_w, aw, wm);
+    *out_h = resolve_size(content_h + pad_h, ah, hm);
+}
+
+// Children keep the positions the app gave them; only their sizes are resolved
+static void layout_absolute(Component* node, float aw, uint8_t wm, float ah, uint8_t hm,
+                            bool perform_layout, float* out_w, float* out_h) {
+    float content_w = 0, content_h = 0;
+
+    for (size_t i = 0; i < node->child_count; i++) {
+        Component* child = node->children[i];
+        if (child->style.hidden) continue;
+
+        float cw, ch;
+        if (perform_layout) child->layout.is_root = false;
+        layout_node(child, 0, MEASURE_UNDEFINED, 0, MEASURE_UNDEFINED, perform_layout, &cw, &ch);
+        if (perform_layout) {
+            apply_frame(child, child->style.x, child->style.y, cw, ch);
+        }
+
+        if (child->style.x + cw + child->style.margin_right > content_w) {
+            content_w = child->style.x + cw + child->style.margin_right;
+        }
+        if (child->style.y + ch + child->style.margin_bottom > content_h) {
+            content_h = child->style.y + ch + child->style.margin_bottom;
+        }
+    }
+
+    *out_w = resolve_size(content_w + node->style.padding_right, aw, wm);
+    *out_h = resolve_size(content_h + node->style.padding_bottom, ah, hm);
+}
+
+// Lay out one child along the container's axes
+static void layout_item(FlexItem* item, bool row, float main, uint8_t main_mode,
+                        float cross, uint8_t cross_mode, bool perform_layout) {
+    float w, h;
+    if (perform_layout) item->child->layout.is_root = false;
+    if (row) {
+        layout_node(item->child, main, main_mode, cross, cross_mode, perform_layout, &w, &h);
+        item->main = w;
+        item->cross = h;
+    } else {
+        layout_node(item->child, cross, cross_mode, main, main_mode, perform_layout, &w, &h);
+        item->main = h;
+        item->cross = w;
+    }
+}
+
+static void layout_flex(Component* node, float aw, uint8_t wm, float ah, uint8_t hm,
+                        bool perform_layout, float* out_w, float* out_h) {
+    bool row = node->flex.direction == EGHACT_FLEX_ROW;
+    float gap = node->flex.gap;
+
+    float avail_main = row ? aw : ah;
+    float avail_cross = row ? ah : aw;
+    uint8_t main_mode = row ? wm : hm;
+    uint8_t cross_mode = row ? hm : wm;
+
+    float pad_main_lead = padding_lead(node, row), pad_main_trail = padding_trail(node, row);
+    float pad_cross_lead = padding_lead(node, !row), pad_cross_trail = padding_trail(node, !row);
+
+    // Scroll containers let content run past their bounds on the main axis
+    if (node->type == COMPONENT_SCROLL) main_mode = MEASURE_UNDEFINED;
+
+    float inner_main = inner_available(avail_main, main_mode, pad_main_lead, pad_main_trail);
+    float inner_cross = inner_available(avail_cross, cross_mode, pad_cross_lead, pad_cross_trail);
+
+    FlexItem inline_items[FLEX_INLINE_ITEMS];
+    FlexItem* items = inline_items;
+    if (node->child_count > FLEX_INLINE_ITEMS) {
+        items = (FlexItem*)malloc(node->child_count * sizeof(FlexItem));
+        if (!items) {
+            *out_w = resolve_size(0, aw, wm);
+            *out_h = resolve_size(0, ah, hm);
+            return;
+        }
+    }
+
+    // Flex basis for every visible child
+    size_t count = 0;
+    for (size_t i = 0; i < node->child_count; i++) {
+        Component* child = node->children[i];
+        if (child->style.hidden) continue;
+
+        FlexItem* item = &items[count++];
+        item->child = child;
+        item->margin_main_lead = margin_lead(child, row);
+        item->margin_main_trail = margin_trail(child, row);
+        item->margin_cross_lead = margin_lead(child, !row);
+        item->margin_cross_trail = margin_trail(child, !row);
+        item->align = child->flex.align_self != EGHACT_ALIGN_AUTO ? child->flex.align_self : node->flex.align_items;
+        item->stretch = item->align == EGHACT_ALIGN_STRETCH && specified_size(child, !row) < 0;
+        item->flexible = specified_size(child, row) < 0;
+
+        float margins_cross = item->margin_cross_lead + item->margin_cross_trail;
+        float item_cross = isnan(inner_cross) ? 0 : fmaxf(0, inner_cross - margins_cross);
+        uint8_t item_cross_mode = isnan(inner_cross) ? MEASURE_UNDEFINED :
+            (item->stretch && !node->flex.wrap && cross_mode == MEASURE_EXACT ? MEASURE_EXACT : MEASURE_AT_MOST);
+
+        if (!item->flexible) {
+            item->basis = specified_size(child, row);
+        } else if (child->flex.basis >= 0) {
+            item->basis = child->flex.basis;
+        } else {
+            float margins_main = item->margin_main_lead + item->margin_main_trail;
+            float item_main = isnan(inner_main) ? 0 : fmaxf(0, inner_main - margins_main);
+            layout_item(item, row, item_main, isnan(inner_main) ? MEASURE_UNDEFINED : MEASURE_AT_MOST,
+                        item_cross, item_cross_mode, false);
+            item->basis = item->main;
+        }
+    }
+
+    float content_main = 0;
+    float content_cross = 0;
+    float line_cross_offset = 0;
+    size_t line_start = 0;
+    size_t line_count = 0;
+
+    while (line_start < count) {
+        // Collect one line
+        size_t line_end = line_start;
+        float line_used = 0;
+        while (line_end < count) {
+            FlexItem* item = &items[line_end];
+            float outer = item->basis + item->margin_main_lead + item->margin_main_trail;
+            float next = line_used + (line_end > line_start ? gap : 0) + outer;
+            if (node->flex.wrap && !isnan(inner_main) && line_end > line_start && next > inner_main) break;
+            line_used = next;
+            line_end++;
+        }
+
+        // Resolve flexible lengths
+        float total_grow = 0, total_shrink = 0;
+        for (size_t i = line_start; i < line_end; i++) {
+            if (!items[i].flexible) continue;
+            total_grow += items[i].child->flex.grow;
+            total_shrink += items[i].child->flex.shrink * items[i].basis;
+        }
+
+        float free_space = isnan(inner_main) ? 0 : inner_main - line_used;
+        for (size_t i = line_start; i < line_end; i++) {
+            FlexItem* item = &items[i];
+            item->main = item->basis;
+            if (!item->flexible) continue;
+            if (free_space > 0 && total_grow > 0 && main_mode == MEASURE_EXACT) {
+                item->main += free_space * item->child->flex.grow / total_grow;
+            } else if (free_space < 0 && total_shrink > 0) {
+                item->main += free_space * item->child->flex.shrink * item->basis / total_shrink;
+                if (item->main < 0) item->main = 0;
+            }
+        }
+
+        // Cross sizes; a single line in a fixed container spans its full cross size
+        bool line_cross_known = !node->flex.wrap && cross_mode == MEASURE_EXACT;
+        float line_cross = line_cross_known ? inner_cross : 0;
+        float line_main = 0;
+
+        for (size_t i = line_start; i < line_end; i++) {
+            FlexItem* item = &items[i];
+            float final_main = item->main;
+            float margins_cross = item->margin_cross_lead + item->margin_cross_trail;
+
+            if (item->stretch && line_cross_known) {
+                layout_item(item, row, final_main, MEASURE_EXACT,
+                            fmaxf(0, line_cross - margins_cross), MEASURE_EXACT, perform_layout);
+            } else {
+                float limit = isnan(inner_cross) ? 0 : fmaxf(0, inner_cross - margins_cross);
+                layout_item(item, row, final_main, MEASURE_EXACT,
+                            limit, isnan(inner_cross) ? MEASURE_UNDEFINED : MEASURE_AT_MOST,
+                            perform_layout && !item->stretch);
+            }
+            item->main = final_main;
+
+            if (!line_cross_known && item->cross + margins_cross > line_cross) {
+                line_cross = item->cross + margins_cross;
+            }
+            line_main += item->main + item->margin_main_lead + item->margin_main_trail;
+        }
+        line_main += gap * (float)(line_end - line_start - 1);
+
+        // Stretched items need the line's cross size before their final pass
+        if (!line_cross_known) {
+            for (size_t i = line_start; i < line_end; i++) {
+                FlexItem* item = &items[i];
+                if (!item->stretch) continue;
+                float margins_cross = item->margin_cross_lead + item->margin_cross_trail;
+                float final_main = item->main;
+                layout_item(item, row, final_main, MEASURE_EXACT,
+                            fmaxf(0, line_cross - margins_cross), MEASURE_EXACT, perform_layout);
+                item->main = final_main;
+            }
+        }
+
+        if (perform_layout) {
+            // Distribute leftover main-axis space
+            float remaining = (main_mode == MEASURE_EXACT && !isnan(inner_main)) ? inner_main - line_main : 0;
+            if (remaining < 0) remaining = 0;
+
+            size_t n = line_end - line_start;
+            float lead = 0, between = 0;
+            switch (node->flex.justify_content) {
+                case EGHACT_JUSTIFY_END:
+                    lead = remaining;
+                    break;
+                case EGHACT_JUSTIFY_CENTER:
+                    lead = remaining / 2;
+                    break;
+                case EGHACT_JUSTIFY_SPACE_BETWEEN:
+                    between = n > 1 ? remaining / (float)(n - 1) : 0;
+                    break;
+                case EGHACT_JUSTIFY_SPACE_AROUND:
+                    between = remaining / (float)n;
+                    lead = between / 2;
+                    break;
+                case EGHACT_JUSTIFY_SPACE_EVENLY:
+                    between = remaining / (float)(n + 1);
+                    lead = between;
+                    break;
+                default:
+                    break;
+            }
+
+            float cursor = pad_main_lead + lead;
+            for (size_t i = line_start; i < line_end; i++) {
+                FlexItem* item = &items[i];
+                float outer_cross = item->cross + item->margin_cross_lead + item->margin_cross_trail;
+
+                float align_offset = 0;
+                if (item->align == EGHACT_ALIGN_END) {
+                    align_offset = line_cross - outer_cross;
+                } else if (item->align == EGHACT_ALIGN_CENTER) {
+                    align_offset = (line_cross - outer_cross) / 2;
+                }
+
+                float main_pos = cursor + item->margin_main_lead;
+                float cross_pos = pad_cross_lead + line_cross_offset + align_offset + item->margin_cross_lead;
+
+                if (row) {
+                    apply_frame(item->child, main_pos, cross_pos, item->main, item->cross);
+                } else {
+                    apply_frame(item->child, cross_pos, main_pos, item->cross, item->main);
+                }
+
+                cursor = main_pos + item->main + item->margin_main_trail + gap + between;
+            }
+        }
+
+        if (line_main > content_main) content_main = line_main;
+        line_cross_offset += line_cross + gap;
+        content_cross += line_cross;
+        line_count++;
+        line_start = line_end;
+    }
+
+    if (line_count > 1) content_cross += gap * (float)(line_count - 1);
+
+    if (items != inline_items) free(items);
+
+    float content_w = row ? content_main + pad_main_lead + pad_main_trail : content_cross + pad_cross_lead + pad_cross_trail;
+    float content_h = row ? content_cross + pad_cross_lead + pad_cross_trail : content_main + pad_main_lead + pad_main_trail;
+    *out_w = resolve_size(content_w, aw, wm);
+    *out_h = resolve_size(content_h, ah, hm);
+}
+
+static void layout_node(Component* node, float aw, uint8_t wm, float ah, uint8_t hm,
+                        bool perform_layout, float* out_w, float* out_h) {
+    // A specified size always wins over what the parent offers
+    if (node->flex.width >= 0) {
+        aw = node->flex.width;
+        wm = MEASURE_EXACT;
+    }
+    if (node->flex.height >= 0) {
+        ah = node->flex.height;
+        hm = MEASURE_EXACT;
+    }
+
+    LayoutCache* cache = &node->layout;
+    if (cache_matches(&cache->layout, aw, wm, ah, hm)) {
+        g_layout_stats.cache_hits++;
+        *out_w = cache->layout.width;
+        *out_h = cache->layout.height;
+        return;
+    }
+    if (!perform_layout) {
+        if (wm == MEASURE_EXACT && hm == MEASURE_EXACT) {
+            *out_w = aw;
+            *out_h = ah;
+            return;
+        }
+        if (cache_matches(&cache->measure, aw, wm, ah, hm)) {
+            g_layout_stats.cache_hits++;
+            *out_w = cache->measure.width;
+            *out_h = cache->measure.height;
+            return;
+        }
+    }
+
+    g_layout_stats.nodes_computed++;
+
+    if (node->child_count == 0) {
+        layout_leaf(node, aw, wm, ah, hm, out_w, out_h);
+    } else if (node->flex.direction == EGHACT_FLEX_NONE) {
+        layout_absolute(node, aw, wm, ah, hm, perform_layout, out_w, out_h);
+    } else {
+        layout_flex(node, aw, wm, ah, hm, perform_layout, out_w, out_h);
+    }
+
+    if (perform_layout) {
+        cache_store(&cache->layout, aw, wm, ah, hm, *out_w, *out_h);
+        cache->dirty = false;
+        cache->laid_out = true;
+    } else {
+        cache_store(&cache->measure, aw, wm, ah, hm, *out_w, *out_h);
+    }
+}
+
+// Public API
+void eghact_layout_compute(Component* root, float available_width, float available_height) {
+    if (!root) return;
+
+    bool has_width = available_width >= 0 && !isnan(available_width);
+    bool has_height = available_height >= 0 && !isnan(available_height);
+
+    float w, h;
+    layout_node(root, has_width ? available_width : 0, has_width ? MEASURE_EXACT : MEASURE_UNDEFINED,
+                has_height ? available_height : 0, has_height ? MEASURE_EXACT : MEASURE_UNDEFINED,
+                true, &w, &h);
+
+    root->layout.is_root = true;
+    eghact_layout_forget(root);
+    apply_frame(root, root->style.x, root->style.y, w, h);
+}
+
+size_t eghact_layout_flush(void) {
+    EghactRuntime* runtime = eghact_get_runtime();
+    if (!runtime) return 0;
+
+    size_t relaid = 0;
+
+    // Boundaries keep the size they had, so each one is re-run with its last constraints
+    // and the parent never needs to be revisited
+    while (runtime->layout_queue_count > 0) {
+        Component* node = runtime->layout_queue[--runtime->layout_queue_count];
+        node->layout.queued = false;
+        if (!node->layout.dirty) continue;
+
+        LayoutCacheEntry* last = &node->layout.layout;
+        float w, h;
+        layout_node(node, last->available_width, last->width_mode,
+                    last->available_height, last->height_mode, true, &w, &h);
+        apply_frame(node, node->style.x, node->style.y, w, h);
+
+        g_layout_stats.relayout_roots++;
+        relaid++;
+    }
+
+    return relaid;
+}
+
+void eghact_layout_get_stats(EghactLayoutStats* stats) {
+    if (stats) *stats = g_layout_stats;
+}
+
+void eghact_layout_reset_stats(void) {
+    memset(&g_layout_stats, 0, sizeof(g_layout_stats));
+}
+
+// Property setters
+void eghact_set_flex_direction(Component* component, FlexDirection direction) {
+    if (!component || component->flex.direction == direction) return;
+    component->flex.direction = direction;
+    eghact_layout_invalidate_outer(component);
+}
+
+void eghact_set_flex_wrap(Component* component, bool wrap) {
+    if (!component || component->flex.wrap == wrap) return;
+    component->flex.wrap = wrap;
+    eghact_layout_invalidate_outer(component);
+}
+
+void eghact_set_justify_content(Component* component, FlexJustify justify) {
+    if (!component || component->flex.justify_content == justify) return;
+    component->flex.justify_content = justify;
+    eghact_layout_invalidate(component);
+}
+
+void eghact_set_align_items(Component* component, FlexAlign align) {
+    if (!component || component->flex.align_items == align) return;
+    component->flex.align_items = align;
+    eghact_layout_invalidate_outer(component);
+}
+
+void eghact_set_align_self(Component* component, FlexAlign align) {
+    if (!component || component->flex.align_self == align) return;
+    component->flex.align_self = align;
+    eghact_layout_invalidate_outer(component);
+}
+
+void eghact_set_flex(Component* component, float grow, float shrink, float basis) {
+    if (!component) return;
+    component->flex.grow = grow;
+    component->flex.shrink = shrink;
+    component->flex.basis = basis;
+    eghact_layout_invalidate_outer(component);
+}
+
+void eghact_set_gap(Component* component, float gap) {
+    if (!component || component->flex.gap == gap) return;
+    component->flex.gap = gap;
+    eghact_layout_invalidate_outer(component);
+}
+
+// Layout helpers
+static void layout_container(Component* container) {
+    eghact_layout_compute(container,
+                          container->flex.width >= 0 ? container->flex.width : container->style.width,
+                          container->flex.height >= 0 ? container->flex.height : container->style.height);
+}
+
+void eghact_layout_flex_row(Component* container, float spacing) {
+    if (!container || container->child_count == 0) return;
+
+    eghact_set_flex_direction(container, EGHACT_FLEX_ROW);
+    eghact_set_gap(container, spacing);
+    layout_container(container);
+}
+
+void eghact_layout_flex_column(Component* container, float spacing) {
+    if (!container || container->child_count == 0) return;
+
+    eghact_set_flex_direction(container, EGHACT_FLEX_COLUMN);
+    eghact_set_gap(container, spacing);
+    layout_container(container);
+}
+
+void eghact_layout_center(Component* container) {
+    if (!container || container->child_count == 0) return;
+
+    if (container->flex.direction == EGHACT_FLEX_NONE) {
+        eghact_set_flex_direction(container, EGHACT_FLEX_COLUMN);
+    }
+    eghact_set_justify_content(container, EGHACT_JUSTIFY_CENTER);
+    eghact_set_align_items(container, EGHACT_ALIGN_CENTER);
+    layout_container(container);
+}
@@ -0,0 +1,312 @@
+/**
+ * Eghact Native Mobile Runtime - Virtualized Lists
+ * Windowed COMPONENT_LIST rows with per-type recycling pools
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "core.h"
+
+// One attached row
+typedef struct {
+    Component* row;
+    size_t type;
+} ListSlot;
+
+// Detached rows of one type, ready to be rebound
+typedef struct {
+    Component** rows;
+    size_t count;
+    size_t capacity;
+} RowPool;
+
+struct EghactListState {
+    EghactListAdapter adapter;
+    float scroll_offset;
+
+    // Rows for indices [first, first + visible), in index order
+    size_t first;
+    size_t visible;
+    ListSlot* slots;
+    ListSlot* scratch;  // Next window while it is being built
+    size_t slot_capacity;
+
+    RowPool* pools;  // One per row type
+    size_t pool_count;
+
+    EghactListStats stats;
+};
+
+static EghactListState* list_state(const Component* list) {
+    if (!list || list->type != COMPONENT_LIST) return NULL;
+    return list->data.list_data.state;
+}
+
+static size_t row_type_of(Component* list, EghactListState* state, size_t index) {
+    if (!state->adapter.row_type) return 0;
+    size_t type = state->adapter.row_type(list, index, state->adapter.user_data);
+    return type < state->pool_count ? type : 0;
+}
+
+static float max_scroll_offset(const Component* list, const EghactListState* state) {
+    float content = (float)state->adapter.row_count * state->adapter.row_height;
+    float viewport = list->flex.height > 0 ? list->flex.height : 0;
+    return content > viewport ? content - viewport : 0;
+}
+
+// Pools
+static Component* pool_take(RowPool* pool) {
+    return pool->count > 0 ? pool->rows[--pool->count] : NULL;
+}
+
+static bool pool_put(RowPool* pool, Component* row) {
+    if (pool->count >= pool->capacity) {
+        size_t new_capacity = pool->capacity == 0 ? 8 : pool->capacity * 2;
+        Component** rows = (Component**)realloc(pool->rows, new_capacity * sizeof(Component*));
+        if (!rows) return false;
+        pool->rows = rows;
+        pool->capacity = new_capacity;
+    }
+    pool->rows[pool->count++] = row;
+    return true;
+}
+
+// Place a bound row in the viewport at its index
+static void position_row(Component* list, EghactListState* state, Component* row, size_t index) {
+    float y = (float)index * state->adapter.row_height - state->scroll_offset;
+    eghact_set_size(row, list->flex.width > 0 ? list->flex.width : row->flex.width, state->adapter.row_height);
+    eghact_set_position(row, 0, y);
+}
+
+static Component* acquire_row(Component* list, EghactListState* state, size_t index, size_t type) {
+    Component* row = pool_take(&state->pools[type]);
+    if (!row) {
+        row = state->adapter.create_row(list, type, state->adapter.user_data);
+        if (!row) return NULL;
+        state->stats.rows_created++;
+    }
+
+    state->adapter.bind_row(list, row, index, state->adapter.user_data);
+    state->stats.rows_bound++;
+    position_row(list, state, row, index);
+    eghact_add_child(list, row);
+    return row;
+}
+
+// Detach a row and keep its native view for the next index of the same type
+static void release_row(Component* list, EghactListState* state, ListSlot* slot) {
+    eghact_remove_child(list, slot->row);
+    if (!pool_put(&state->pools[slot->type], slot->row)) {
+        eghact_destroy_component(slot->row);
+    }
+}
+
+static void release_all(Component* list, EghactListState* state) {
+    for (size_t i = 0; i < state->visible; i++) {
+        release_row(list, state, &state->slots[i]);
+    }
+    state->visible = 0;
+}
+
+static bool reserve_slots(EghactListState* state, size_t count) {
+    if (count <= state->slot_capacity) return true;
+
+    size_t new_capacity = state->slot_capacity == 0 ? 16 : state->slot_capacity;
+    while (new_capacity < count) new_capacity *= 2;
+
+    ListSlot* slots = (ListSlot*)realloc(state->slots, new_capacity * sizeof(ListSlot));
+    if (!slots) return false;
+    state->slots = slots;
+
+    ListSlot* scratch = (ListSlot*)realloc(state->scratch, new_capacity * sizeof(ListSlot));
+    if (!scratch) return false;
+    state->scratch = scratch;
+
+    state->slot_capacity = new_capacity;
+    return true;
+}
+
+// Bring the attached rows in line with the viewport. Rows that stay visible keep their
+// binding and only move; rows that leave go to their pool before new ones are acquired,
+// so a scroll step rebinds the rows it just released instead of creating views.
+static void update_window(Component* list, EghactListState* state) {
+    const EghactListAdapter* adapter = &state->adapter;
+
+    size_t new_first = 0, new_end = 0;
+    if (adapter->row_height > 0 && adapter->row_count > 0 && list->flex.height > 0) {
+        size_t top = (size_t)floorf(state->scroll_offset / adapter->row_height);
+        size_t bottom = (size_t)ceilf((state->scroll_offset + list->flex.height) / adapter->row_height);
+        new_first = top > adapter->overscan ? top - adapter->overscan : 0;
+        new_end = bottom + adapter->overscan;
+        if (new_end > adapter->row_count) new_end = adapter->row_count;
+        if (new_first > new_end) new_first = new_end;
+    }
+
+    size_t new_count = new_end - new_first;
+    if (!reserve_slots(state, new_count)) return;
+
+    size_t old_first = state->first;
+    size_t old_end = state->first + state->visible;
+
+    // Release rows that left the window, or whose index now wants another type
+    for (size_t i = 0; i < state->visible; i++) {
+        size_t index = old_first + i;
+        ListSlot* slot = &state->slots[i];
+        if (index < new_first || index >= new_end || row_type_of(list, state, index) != slot->type) {
+            release_row(list, state, slot);
+            slot->row = NULL;
+        }
+    }
+
+    // Build the new window, reusing surviving rows in place
+    for (size_t i = 0; i < new_count; i++) {
+        size_t index = new_first + i;
+        ListSlot* target = &state->scratch[i];
+
+        if (index >= old_first && index < old_end && state->slots[index - old_first].row) {
+            *target = state->slots[index - old_first];
+            position_row(list, state, target->row, index);
+            continue;
+        }
+
+        target->type = row_type_of(list, state, index);
+        target->row = acquire_row(list, state, index, target->type);
+    }
+
+    // Drop slots whose row could not be created so the window stays in index order
+    size_t visible = 0;
+    for (size_t i = 0; i < new_count; i++) {
+        if (!state->scratch[i].row) break;
+        visible++;
+    }
+    for (size_t i = visible; i < new_count; i++) {
+        if (state->scratch[i].row) release_row(list, state, &state->scratch[i]);
+    }
+
+    ListSlot* swap = state->slots;
+    state->slots = state->scratch;
+    state->scratch = swap;
+    state->first = new_first;
+    state->visible = visible;
+}
+
+// Public API
+void eghact_list_set_adapter(Component* list, const EghactListAdapter* adapter) {
+    if (!list || list->type != COMPONENT_LIST) return;
+
+    EghactListState* state = list->data.list_data.state;
+    if (state) {
+        // Rows built by the previous adapter cannot be rebound by the new one
+        release_all(list, state);
+        eghact_list_destroy_state(list);
+        state = NULL;
+    }
+    if (!adapter || !adapter->create_row || !adapter->bind_row) return;
+
+    state = (EghactListState*)calloc(1, sizeof(EghactListState));
+    if (!state) return;
+
+    state->adapter = *adapter;
+    state->pool_count = adapter->type_count > 0 ? adapter->type_count : 1;
+    state->pools = (RowPool*)calloc(state->pool_count, sizeof(RowPool));
+    if (!state->pools) {
+        free(state);
+        return;
+    }
+    list->data.list_data.state = state;
+
+    // Rows are placed by the list, not by flex layout
+    eghact_set_flex_direction(list, EGHACT_FLEX_NONE);
+    update_window(list, state);
+}
+
+void eghact_list_set_row_count(Component* list, size_t row_count) {
+    EghactListState* state = list_state(list);
+    if (!state || state->adapter.row_count == row_count) return;
+
+    state->adapter.row_count = row_count;
+    float max_offset = max_scroll_offset(list, state);
+    if (state->scroll_offset > max_offset) state->scroll_offset = max_offset;
+    update_window(list, state);
+}
+
+void eghact_list_set_scroll_offset(Component* list, float offset) {
+    EghactListState* state = list_state(list);
+    if (!state) return;
+
+    float max_offset = max_scroll_offset(list, state);
+    if (offset > max_offset) offset = max_offset;
+    if (offset < 0 || isnan(offset)) offset = 0;
+    if (offset == state->scroll_offset) return;
+
+    state->scroll_offset = offset;
+    update_window(list, state);
+}
+
+void eghact_list_scroll_by(Component* list, float delta) {
+    EghactListState* state = list_state(list);
+    if (!state) return;
+    eghact_list_set_scroll_offset(list, state->scroll_offset + delta);
+}
+
+float eghact_list_get_scroll_offset(const Component* list) {
+    EghactListState* state = list_state(list);
+    return state ? state->scroll_offset : 0;
+}
+
+void eghact_list_reload(Component* list) {
+    EghactListState* state = list_state(list);
+    if (!state) return;
+
+    // Rows whose type changed are swapped by the window update; the rest are rebound
+    update_window(list, state);
+    for (size_t i = 0; i < state->visible; i++) {
+        state->adapter.bind_row(list, state->slots[i].row, state->first + i, state->adapter.user_data);
+        state->stats.rows_bound++;
+    }
+}
+
+void eghact_list_get_stats(const Component* list, EghactListStats* stats) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(EghactListStats));
+
+    EghactListState* state = list_state(list);
+    if (!state) return;
+
+    *stats = state->stats;
+    stats->visible_rows = state->visible;
+    for (size_t i = 0; i < state->pool_count; i++) {
+        stats->pooled_rows += state->pools[i].count;
+    }
+}
+
+// Internal hooks
+void eghact_list_refresh(Component* list) {
+    EghactListState* state = list_state(list);
+    if (!state) return;
+
+    float max_offset = max_scroll_offset(list, state);
+    if (state->scroll_offset > max_offset) state->scroll_offset = max_offset;
+    update_window(list, state);
+}
+
+void eghact_list_destroy_state(Component* list) {
+    EghactListState* state = list_state(list);
+    if (!state) return;
+
+    // Attached rows are children of the list and are destroyed with it
+    for (size_t i = 0; i < state->pool_count; i++) {
+        RowPool* pool = &state->pools[i];
+        for (size_t j = 0; j < pool->count; j++) {
+            eghact_destroy_component(pool->rows[j]);
+        }
+        free(pool->rows);
+    }
+
+    free(state->pools);
+    free(state->slots);
+    free(state->scratch);
+    free(state);
+    list->data.list_data.state = NULL;
+}
@@ -0,0 +1,494 @@
+/**
+ * Eghact Native Mobile Runtime - Run Loop
+ * Event queue, timer wheel and frame pacing for hosts without a native UI loop
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "core.h"
+
+#ifdef __EMSCRIPTEN__
+    #include <emscripten.h>
+#endif
+
+#define DEFAULT_FRAME_RATE 60
+#define WHEEL_SLOTS 256           // One slot per millisecond tick
+#define MAX_TIMERS 0xFFFF         // Timer ids keep the slot index in their low 16 bits
+#define NS_PER_MS 1000000ULL
+#define NS_PER_SEC 1000000000ULL
+
+// Queued callback
+typedef struct {
+    void (*handler)(void* data);
+    void* data;
+} LoopEvent;
+
+typedef struct {
+    LoopEvent* items;
+    size_t count;
+    size_t capacity;
+} EventBuffer;
+
+// Timer slots live in one table and are linked into wheel buckets by index
+typedef struct {
+    void (*callback)(void* data);
+    void* data;
+    uint64_t deadline;  // Absolute tick
+    uint32_t interval;  // Milliseconds, 0 for one-shot
+    uint16_t generation;
+    bool active;
+    int32_t prev, next;
+} LoopTimer;
+
+static struct {
+    bool initialized;
+    bool stopped;  // Set by eghact_stop, under lock; eghact_run clears it
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+
+    // Events posted from any thread; drained on the loop thread by swapping buffers
+    EventBuffer pending;
+    EventBuffer draining;
+    size_t dispatch_next;  // Index in draining of the next event to run
+
+    // Timer wheel, loop thread only
+    LoopTimer* timers;
+    size_t timer_capacity;
+    int32_t free_timer;
+    int32_t wheel[WHEEL_SLOTS];
+    size_t active_timers;
+    uint64_t tick;  // Last tick the wheel was advanced to
+
+    // Frame pacing
+    uint32_t frame_rate;
+    uint64_t next_frame_ns;
+} g_loop;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NS_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+// Called from eghact_init, before any thread can post
+void eghact_loop_init(void) {
+    if (g_loop.initialized) return;
+
+    pthread_mutex_init(&g_loop.lock, NULL);
+    pthread_cond_init(&g_loop.wake, NULL);
+    for (size_t i = 0; i < WHEEL_SLOTS; i++) {
+        g_loop.wheel[i] = -1;
+    }
+    g_loop.free_timer = -1;
+    g_loop.frame_rate = DEFAULT_FRAME_RATE;
+    g_loop.tick = now_ns() / NS_PER_MS;
+    g_loop.initialized = true;
+}
+
+// Event queue
+bool eghact_post_event(void (*handler)(void* data), void* data) {
+    if (!handler) return false;
+    eghact_loop_init();
+
+    pthread_mutex_lock(&g_loop.lock);
+    EventBuffer* buffer = &g_loop.pending;
+    if (buffer->count >= buffer->capacity) {
+        size_t new_capacity = buffer->capacity == 0 ? 32 : buffer->capacity * 2;
+        LoopEvent* items = (LoopEvent*)realloc(buffer->items, new_capacity * sizeof(LoopEvent));
+        if (!items) {
+            pthread_mutex_unlock(&g_loop.lock);
+            return false;
+        }
+        buffer->items = items;
+        buffer->capacity = new_capacity;
+    }
+    buffer->items[buffer->count].handler = handler;
+    buffer->items[buffer->count].data = data;
+    buffer->count++;
+    pthread_cond_signal(&g_loop.wake);
+    pthread_mutex_unlock(&g_loop.lock);
+    return true;
+}
+
+static void dispatch_nothing(void* data) {
+}
+
+static void dispatch_press(void* data) {
+    Component* component = (Component*)data;
+    if (component->data.button_data.on_press) {
+        component->data.button_data.on_press();
+    }
+}
+
+bool eghact_post_press(Component* button) {
+    if (!button || button->type != COMPONENT_BUTTON) return false;
+    return eghact_post_event(dispatch_press, button);
+}
+
+// Text is copied at post time so the caller's buffer can go away
+typedef struct {
+    Component* component;
+    char text[];
+} TextChange;
+
+static void dispatch_text_change(void* data) {
+    TextChange* change = (TextChange*)data;
+    Component* component = change->component;
+
+    eghact_component_set_string(component, &component->data.input_data.value, change->text);
+    if (component->data.input_data.on_change) {
+        component->data.input_data.on_change(change->text);
+    }
+    free(change);
+}
+
+bool eghact_post_text_change(Component* input, const char* text) {
+    if (!input || input->type != COMPONENT_INPUT) return false;
+
+    size_t len = text ? strlen(text) : 0;
+    TextChange* change = (TextChange*)malloc(sizeof(TextChange) + len + 1);
+    if (!change) return false;
+    change->component = input;
+    if (len > 0) memcpy(change->text, text, len);
+    change->text[len] = '\0';
+
+    if (!eghact_post_event(dispatch_text_change, change)) {
+        free(change);
+        return false;
+    }
+    return true;
+}
+
+// Handlers may post more events; those run on the next iteration
+static size_t drain_events(void) {
+    pthread_mutex_lock(&g_loop.lock);
+    EventBuffer swap = g_loop.draining;
+    g_loop.draining = g_loop.pending;
+    g_loop.pending = swap;
+    g_loop.pending.count = 0;
+    pthread_mutex_unlock(&g_loop.lock);
+
+    size_t count = g_loop.draining.count;
+    for (g_loop.dispatch_next = 0; g_loop.dispatch_next < count; ) {
+        LoopEvent event = g_loop.draining.items[g_loop.dispatch_next++];
+        event.handler(event.data);
+    }
+    g_loop.draining.count = 0;
+    return count;
+}
+
+// Neutralizes the events in buffer from index from on that target component
+static void forget_events(EventBuffer* buffer, size_t from, const Component* component) {
+    for (size_t i = from; i < buffer->count; i++) {
+        LoopEvent* event = &buffer->items[i];
+        if (event->handler == dispatch_press && event->data == component) {
+            event->handler = dispatch_nothing;
+        } else if (event->handler == dispatch_text_change &&
+                   ((TextChange*)event->data)->component == component) {
+            free(event->data);
+            event->handler = dispatch_nothing;
+            event->data = NULL;
+        }
+    }
+}
+
+// Called as a button or input is destroyed, so nothing posted for it runs afterwards.
+// A handler earlier in the batch being dispatched may be the one destroying it.
+void eghact_loop_forget(Component* component) {
+    if (!g_loop.initialized) return;
+
+    pthread_mutex_lock(&g_loop.lock);
+    forget_events(&g_loop.pending, 0, component);
+    pthread_mutex_unlock(&g_loop.lock);
+    forget_events(&g_loop.draining, g_loop.dispatch_next, component);
+}
+
+// Timer wheel
+static void wheel_insert(int32_t index) {
+    LoopTimer* timer = &g_loop.timers[index];
+    int32_t* bucket = &g_loop.wheel[timer->deadline % WHEEL_SLOTS];
+    timer->prev = -1;
+    timer->next = *bucket;
+    if (*bucket >= 0) g_loop.timers[*bucket].prev = index;
+    *bucket = index;
+}
+
+static void wheel_remove(int32_t index) {
+    LoopTimer* timer = &g_loop.timers[index];
+    if (timer->prev >= 0) {
+        g_loop.timers[timer->prev].next = timer->next;
+    } else {
+        g_loop.wheel[timer->deadline % WHEEL_SLOTS] = timer->next;
+    }
+    if (timer->next >= 0) g_loop.timers[timer->next].prev = timer->prev;
+    timer->prev = timer->next = -1;
+}
+
+static void release_timer(int32_t index) {
+    LoopTimer* timer = &g_loop.timers[index];
+    timer->active = false;
+    timer->callback = NULL;
+    timer->generation++;
+    timer->next = g_loop.free_timer;
+    g_loop.free_timer = index;
+    g_loop.active_timers--;
+}
+
+static int32_t alloc_timer(void) {
+    if (g_loop.free_timer >= 0) {
+        int32_t index = g_loop.free_timer;
+        g_loop.free_timer = g_loop.timers[index].next;
+        return index;
+    }
+    if (g_loop.timer_capacity >= MAX_TIMERS) return -1;
+
+    size_t new_capacity = g_loop.timer_capacity == 0 ? 16 : g_loop.timer_capacity * 2;
+    if (new_capacity > MAX_TIMERS) new_capacity = MAX_TIMERS;
+    LoopTimer* timers = (LoopTimer*)realloc(g_loop.timers, new_capacity * sizeof(LoopTimer));
+    if (!timers) return -1;
+    memset(timers + g_loop.timer_capacity, 0, (new_capacity - g_loop.timer_capacity) * sizeof(LoopTimer));
+
+    // Chain the new slots onto the free list, keeping the first one for the caller
+    for (size_t i = new_capacity - 1; i > g_loop.timer_capacity; i--) {
+        timers[i].next = g_loop.free_timer;
+        g_loop.free_timer = (int32_t)i;
+    }
+    int32_t index = (int32_t)g_loop.timer_capacity;
+    g_loop.timers = timers;
+    g_loop.timer_capacity = new_capacity;
+    return index;
+}
+
+EghactTimerId eghact_set_timer(uint32_t delay_ms, uint32_t interval_ms, void (*callback)(void* data), void* data) {
+    if (!callback) return 0;
+    eghact_loop_init();
+
+    int32_t index = alloc_timer();
+    if (index < 0) return 0;
+
+    // Ticks that have passed but not been processed yet belong to the present
+    uint64_t now_tick = now_ns() / NS_PER_MS;
+    if (now_tick < g_loop.tick) now_tick = g_loop.tick;
+
+    LoopTimer* timer = &g_loop.timers[index];
+    timer->callback = callback;
+    timer->data = data;
+    timer->deadline = now_tick + (delay_ms > 0 ? delay_ms : 1);
+    timer->interval = interval_ms;
+    timer->active = true;
+    wheel_insert(index);
+    g_loop.active_timers++;
+
+    return ((EghactTimerId)timer->generation << 16) | (EghactTimerId)(index + 1);
+}
+
+void eghact_clear_timer(EghactTimerId id) {
+    int32_t index = (int32_t)(id & 0xFFFF) - 1;
+    if (index < 0 || (size_t)index >= g_loop.timer_capacity) return;
+
+    LoopTimer* timer = &g_loop.timers[index];
+    if (!timer->active || timer->generation != (uint16_t)(id >> 16)) return;
+
+    wheel_remove(index);
+    release_timer(index);
+}
+
+// Fire one bucket's due timers. The bucket is unlinked first so callbacks can
+// set and clear timers freely; entries for later revolutions go straight back.
+static size_t fire_bucket(size_t slot, uint64_t now_tick) {
+    size_t fired = 0;
+    int32_t index = g_loop.wheel[slot];
+    g_loop.wheel[slot] = -1;
+
+    while (index >= 0) {
+        LoopTimer* timer = &g_loop.timers[index];
+        int32_t next = timer->next;
+        timer->prev = timer->next = -1;
+
+        if (timer->deadline > now_tick) {
+            wheel_insert(index);
+        } else if (timer->interval > 0) {
+            timer->deadline += timer->interval;
+            if (timer->deadline <= now_tick) timer->deadline = now_tick + timer->interval;
+            wheel_insert(index);
+            timer->callback(timer->data);
+            fired++;
+        } else {
+            void (*callback)(void*) = timer->callback;
+            void* data = timer->data;
+            release_timer(index);
+            callback(data);
+            fired++;
+        }
+        index = next;
+    }
+    return fired;
+}
+
+static size_t advance_timers(uint64_t now_tick) {
+    if (now_tick <= g_loop.tick) return 0;
+
+    uint64_t from = g_loop.tick + 1;
+    g_loop.tick = now_tick;
+    if (g_loop.active_timers == 0) return 0;
+
+    // After a long stall every bucket is visited once; otherwise only the elapsed ones
+    size_t fired = 0;
+    uint64_t elapsed = now_tick - from + 1;
+    size_t steps = elapsed >= WHEEL_SLOTS ? WHEEL_SLOTS : (size_t)elapsed;
+    for (size_t i = 0; i < steps; i++) {
+        fired += fire_bucket((size_t)((from + i) % WHEEL_SLOTS), now_tick);
+    }
+    return fired;
+}
+
+// Earliest tick that has a timer bucket, or 0 when none are scheduled
+static uint64_t next_timer_tick(void) {
+    if (g_loop.active_timers == 0) return 0;
+
+    for (uint64_t t = g_loop.tick + 1; t <= g_loop.tick + WHEEL_SLOTS; t++) {
+        if (g_loop.wheel[t % WHEEL_SLOTS] >= 0) return t;
+    }
+    return g_loop.tick + WHEEL_SLOTS;
+}
+
+// Frame pacing
+void eghact_set_frame_rate(uint32_t hz) {
+    eghact_loop_init();
+    g_loop.frame_rate = hz > 0 ? hz : DEFAULT_FRAME_RATE;
+
+#ifdef __EMSCRIPTEN__
+    // 0 lets the browser pace frames with requestAnimationFrame
+    if (hz == 0) g_loop.frame_rate = 0;
+#endif
+}
+
+static bool has_pending_frame(void) {
+    EghactRuntime* runtime = eghact_get_runtime();
+    return runtime && (runtime->dirty_count > 0 || runtime->layout_queue_count > 0);
+}
+
+static uint64_t frame_period_ns(void) {
+    return g_loop.frame_rate > 0 ? NS_PER_SEC / g_loop.frame_rate : NS_PER_SEC / DEFAULT_FRAME_RATE;
+}
+
+// Commit on frame boundaries only, so a burst of events produces one commit
+static bool run_frame(uint64_t now) {
+    if (!has_pending_frame()) return false;
+    if (g_loop.frame_rate > 0 && now < g_loop.next_frame_ns) return false;
+
+    eghact_commit();
+
+    // Stay on the original cadence unless a frame was missed entirely
+    uint64_t period = frame_period_ns();
+    g_loop.next_frame_ns += period;
+    if (g_loop.next_frame_ns <= now) g_loop.next_frame_ns = now + period;
+    return true;
+}
+
+static bool loop_running(void) {
+    return !g_loop.stopped;
+}
+
+// Block until an event is posted or timeout_ns passes; UINT64_MAX waits indefinitely
+static void wait_for_work(uint64_t timeout_ns) {
+    pthread_mutex_lock(&g_loop.lock);
+    if (g_loop.pending.count == 0 && loop_running()) {
+        if (timeout_ns == UINT64_MAX) {
+            pthread_cond_wait(&g_loop.wake, &g_loop.lock);
+        } else {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            uint64_t ns = (uint64_t)deadline.tv_nsec + timeout_ns;
+            deadline.tv_sec += (time_t)(ns / NS_PER_SEC);
+            deadline.tv_nsec = (long)(ns % NS_PER_SEC);
+            pthread_cond_timedwait(&g_loop.wake, &g_loop.lock, &deadline);
+        }
+    }
+    pthread_mutex_unlock(&g_loop.lock);
+}
+
+bool eghact_run_once(int timeout_ms) {
+    eghact_loop_init();
+    if (!loop_running()) return false;
+
+    uint64_t now = now_ns();
+    drain_events();
+    advance_timers(now / NS_PER_MS);
+    run_frame(now_ns());
+    if (!loop_running()) return false;
+
+    // Sleep until the next frame if one is owed, otherwise until the next timer
+    now = now_ns();
+    uint64_t wait = UINT64_MAX;
+    if (has_pending_frame()) {
+        wait = g_loop.next_frame_ns > now ? g_loop.next_frame_ns - now : 0;
+    }
+    uint64_t timer_tick = next_timer_tick();
+    if (timer_tick > 0) {
+        uint64_t due = timer_tick * NS_PER_MS;
+        uint64_t timer_wait = due > now ? due - now : 0;
+        if (timer_wait < wait) wait = timer_wait;
+    }
+    if (timeout_ms >= 0 && (uint64_t)timeout_ms * NS_PER_MS < wait) {
+        wait = (uint64_t)timeout_ms * NS_PER_MS;
+    }
+
+    if (wait > 0) wait_for_work(wait);
+    return loop_running();
+}
+
+// Stop under the lock so a sleeping loop cannot miss the wakeup
+void eghact_loop_stop(EghactRuntime* runtime) {
+    eghact_loop_init();
+    pthread_mutex_lock(&g_loop.lock);
+    g_loop.stopped = true;
+    runtime->is_running = false;
+    pthread_cond_broadcast(&g_loop.wake);
+    pthread_mutex_unlock(&g_loop.lock);
+}
+
+#ifdef __EMSCRIPTEN__
+// The browser owns the loop; each animation frame runs one non-blocking iteration
+static void browser_frame(void) {
+    if (!eghact_run_once(0)) {
+        emscripten_cancel_main_loop();
+    }
+}
+#endif
+
+// Internal hooks
+void eghact_loop_run(EghactRuntime* runtime) {
+    eghact_loop_init();
+    g_loop.next_frame_ns = now_ns();
+    pthread_mutex_lock(&g_loop.lock);
+    g_loop.stopped = false;
+    pthread_mutex_unlock(&g_loop.lock);
+
+#ifdef __EMSCRIPTEN__
+    emscripten_set_main_loop(browser_frame, (int)g_loop.frame_rate, 0);
+#else
+    while (eghact_run_once(-1)) {
+    }
+#endif
+}
+
+void eghact_loop_shutdown(void) {
+    if (!g_loop.initialized) return;
+
+    // Undelivered text changes own a copy of their text
+    for (size_t i = 0; i < g_loop.pending.count; i++) {
+        if (g_loop.pending.items[i].handler == dispatch_text_change) {
+            free(g_loop.pending.items[i].data);
+        }
+    }
+
+    free(g_loop.pending.items);
+    free(g_loop.draining.items);
+    free(g_loop.timers);
+    pthread_cond_destroy(&g_loop.wake);
+    pthread_mutex_destroy(&g_loop.lock);
+    memset(&g_loop, 0, sizeof(g_loop));
+}
@@ -0,0 +1,156 @@
+/**
+ * Eghact Native Mobile Runtime - String Table
+ * Interned, ref-counted strings shared by every component
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "core.h"
+
+#define INITIAL_BUCKETS 256
+
+// Header in front of each interned string; components hold pointers to data
+typedef struct InternString {
+    struct InternString* next;  // Bucket chain
+    uint32_t hash;
+    uint32_t refs;
+    EghactStringId id;
+    uint32_t length;
+    char data[];
+} InternString;
+
+static struct {
+    InternString** buckets;
+    size_t bucket_count;  // Power of two
+    EghactStringId next_id;
+    EghactStringStats stats;
+} g_strings;
+
+static inline InternString* header_of(const char* interned) {
+    return (InternString*)(interned - offsetof(InternString, data));
+}
+
+// FNV-1a, also returns the length so callers don't walk the string twice
+static uint32_t hash_string(const char* str, uint32_t* length) {
+    uint32_t hash = 2166136261u;
+    const unsigned char* p = (const unsigned char*)str;
+    while (*p) {
+        hash ^= *p++;
+        hash *= 16777619u;
+    }
+    *length = (uint32_t)(p - (const unsigned char*)str);
+    return hash;
+}
+
+static bool grow_buckets(void) {
+    size_t new_count = g_strings.bucket_count == 0 ? INITIAL_BUCKETS : g_strings.bucket_count * 2;
+    InternString** buckets = (InternString**)calloc(new_count, sizeof(InternString*));
+    if (!buckets) return false;
+
+    for (size_t i = 0; i < g_strings.bucket_count; i++) {
+        InternString* entry = g_strings.buckets[i];
+        while (entry) {
+            InternString* next = entry->next;
+            size_t slot = entry->hash & (new_count - 1);
+            entry->next = buckets[slot];
+            buckets[slot] = entry;
+            entry = next;
+        }
+    }
+
+    free(g_strings.buckets);
+    g_strings.buckets = buckets;
+    g_strings.bucket_count = new_count;
+    return true;
+}
+
+const char* eghact_string_intern(const char* str) {
+    if (!str) str = "";
+
+    uint32_t length;
+    uint32_t hash = hash_string(str, &length);
+    g_strings.stats.lookups++;
+
+    if (g_strings.bucket_count > 0) {
+        for (InternString* entry = g_strings.buckets[hash & (g_strings.bucket_count - 1)]; entry; entry = entry->next) {
+            if (entry->hash == hash && entry->length == length && memcmp(entry->data, str, length) == 0) {
+                entry->refs++;
+                g_strings.stats.hits++;
+                return entry->data;
+            }
+        }
+    }
+
+    // Keep the load factor at or below one
+    if (g_strings.stats.unique_strings >= g_strings.bucket_count && !grow_buckets()) {
+        if (g_strings.bucket_count == 0) return NULL;
+    }
+
+    InternString* entry = (InternString*)malloc(sizeof(InternString) + length + 1);
+    if (!entry) return NULL;
+    entry->hash = hash;
+    entry->refs = 1;
+    entry->id = ++g_strings.next_id;
+    entry->length = length;
+    memcpy(entry->data, str, length + 1);
+
+    size_t slot = hash & (g_strings.bucket_count - 1);
+    entry->next = g_strings.buckets[slot];
+    g_strings.buckets[slot] = entry;
+
+    g_strings.stats.unique_strings++;
+    g_strings.stats.bytes += length + 1;
+    return entry->data;
+}
+
+void eghact_string_retain(const char* interned) {
+    if (interned) header_of(interned)->refs++;
+}
+
+void eghact_string_release(const char* interned) {
+    if (!interned) return;
+
+    InternString* entry = header_of(interned);
+    if (--entry->refs > 0) return;
+
+    InternString** link = &g_strings.buckets[entry->hash & (g_strings.bucket_count - 1)];
+    while (*link != entry) link = &(*link)->next;
+    *link = entry->next;
+
+    g_strings.stats.unique_strings--;
+    g_strings.stats.bytes -= entry->length + 1;
+
+    // Let the renderer drop anything it cached under this id (e.g. decoded images)
+    PlatformRenderer* renderer = eghact_get_renderer();
+    if (renderer && renderer->string_released) {
+        renderer->string_released(entry->id);
+    }
+    free(entry);
+}
+
+EghactStringId eghact_string_id(const char* interned) {
+    return interned ? header_of(interned)->id : 0;
+}
+
+void eghact_string_get_stats(EghactStringStats* stats) {
+    if (stats) *stats = g_strings.stats;
+}
+
+// Internal hooks
+void eghact_strings_shutdown(void) {
+    for (size_t i = 0; i < g_strings.bucket_count; i++) {
+        InternString* entry = g_strings.buckets[i];
+        while (entry) {
+            InternString* next = entry->next;
+            free(entry);
+            entry = next;
+        }
+    }
+    free(g_strings.buckets);
+
+    // Ids stay unique for the life of the process so stale renderer keys never alias
+    EghactStringId next_id = g_strings.next_id;
+    memset(&g_strings, 0, sizeof(g_strings));
+    g_strings.next_id = next_id;
+}
@@ -0,0 +1,311 @@
+/**
+ * Eghact Native Mobile Runtime - WebAssembly Bridge
+ * Per-call exports and a batched command ring shared with JS through linear memory
+ */
+
+#ifdef __EMSCRIPTEN__
+
+#include <emscripten.h>
+#include <stdlib.h>
+#include <string.h>
+#include "core.h"
+
+// Command ring opcodes - operands follow as 32-bit words
+enum {
+    WASM_CMD_CREATE = 1,          // type                       -> handle
+    WASM_CMD_CREATE_TEXT = 2,     // string                     -> handle
+    WASM_CMD_CREATE_IMAGE = 3,    // string                     -> handle
+    WASM_CMD_ADD_CHILD = 4,       // parent, child
+    WASM_CMD_REMOVE_CHILD = 5,    // parent, child
+    WASM_CMD_DESTROY = 6,         // component
+    WASM_CMD_SET_POSITION = 7,    // component, x, y
+    WASM_CMD_SET_SIZE = 8,        // component, width, height
+    WASM_CMD_SET_BACKGROUND = 9,  // component, color
+    WASM_CMD_SET_OPACITY = 10,    // component, opacity
+    WASM_CMD_SET_HIDDEN = 11,     // component, hidden
+    WASM_CMD_SET_TEXT = 12,       // component, string
+    WASM_CMD_SET_TEXT_COLOR = 13, // component, color
+    WASM_CMD_SET_FONT_SIZE = 14,  // component, size
+    WASM_CMD_SET_PADDING = 15,    // component, top, right, bottom, left
+    WASM_CMD_SET_FLEX = 16,       // component, direction, justify, align_items, gap
+    WASM_CMD_LAYOUT = 17,         // root, width, height
+    WASM_CMD_COMMIT = 18
+};
+
+// Ring of 32-bit words in linear memory. JS writes at its own cursor; read is
+// free-running and masked on access, so commands may wrap past the end.
+static struct {
+    int32_t* words;
+    uint32_t mask;
+    uint32_t read;
+    void** results;  // Handles produced by the current flush, in order
+    uint32_t result_capacity;
+    uint32_t result_count;
+    char* scratch;   // Strings are reassembled here, NUL-terminated
+    size_t scratch_capacity;
+} g_ring;
+
+static inline int32_t ring_word(void) {
+    return g_ring.words[g_ring.read++ & g_ring.mask];
+}
+
+static inline float ring_float(void) {
+    int32_t word = ring_word();
+    float value;
+    memcpy(&value, &word, sizeof(value));
+    return value;
+}
+
+// Handles are component pointers. A negative operand -n names the n-th handle
+// created earlier in the same flush, so a tree can be built without round trips.
+static inline Component* ring_component(void) {
+    int32_t word = ring_word();
+    if (word >= 0) return (Component*)(intptr_t)word;
+
+    uint32_t index = (uint32_t)(-(int64_t)word) - 1;
+    return index < g_ring.result_count ? (Component*)g_ring.results[index] : NULL;
+}
+
+// Strings are a byte length followed by UTF-8 packed into ceil(length / 4) words. False
+// if the length can't be right; *text is NULL, with the words skipped, if it can't be
+// copied out.
+static bool ring_string(const char** text) {
+    uint32_t length = (uint32_t)ring_word();
+    *text = NULL;
+    if (length > ((uint64_t)g_ring.mask + 1) * 4) return false;
+
+    uint32_t word_count = (uint32_t)(((uint64_t)length + 3) / 4);
+    if ((size_t)length + 1 > g_ring.scratch_capacity) {
+        size_t capacity = g_ring.scratch_capacity == 0 ? 256 : g_ring.scratch_capacity;
+        while (capacity < (size_t)length + 1) capacity *= 2;
+        char* scratch = (char*)realloc(g_ring.scratch, capacity);
+        if (!scratch) {
+            g_ring.read += word_count;
+            return true;
+        }
+        g_ring.scratch = scratch;
+        g_ring.scratch_capacity = capacity;
+    }
+
+    uint32_t start = g_ring.read & g_ring.mask;
+    uint32_t contiguous = g_ring.mask + 1 - start;
+    if (word_count <= contiguous) {
+        memcpy(g_ring.scratch, &g_ring.words[start], length);
+    } else {
+        size_t head = (size_t)contiguous * 4;
+        memcpy(g_ring.scratch, &g_ring.words[start], head);
+        memcpy(g_ring.scratch + head, g_ring.words, length - head);
+    }
+    g_ring.read += word_count;
+    g_ring.scratch[length] = '\0';
+    *text = g_ring.scratch;
+    return true;
+}
+
+static bool push_result(void* handle) {
+    if (g_ring.result_count >= g_ring.result_capacity) return false;
+    g_ring.results[g_ring.result_count++] = handle;
+    return true;
+}
+
+static Component* create_of_type(int32_t type) {
+    switch (type) {
+        case COMPONENT_VIEW: return eghact_create_view();
+        case COMPONENT_SCROLL: return eghact_create_scroll();
+        case COMPONENT_LIST: return eghact_create_list();
+        case COMPONENT_INPUT: return eghact_create_input("");
+        default: return NULL;
+    }
+}
+
+static bool apply_command(void) {
+    int32_t op = ring_word();
+    Component* component;
+    const char* text;
+
+    switch (op) {
+        case WASM_CMD_CREATE:
+            return push_result(create_of_type(ring_word()));
+        case WASM_CMD_CREATE_TEXT:
+            return ring_string(&text) && push_result(eghact_create_text(text));
+        case WASM_CMD_CREATE_IMAGE:
+            return ring_string(&text) && push_result(eghact_create_image(text));
+        case WASM_CMD_ADD_CHILD:
+            component = ring_component();
+            eghact_add_child(component, ring_component());
+            return true;
+        case WASM_CMD_REMOVE_CHILD:
+            component = ring_component();
+            eghact_remove_child(component, ring_component());
+            return true;
+        case WASM_CMD_DESTROY:
+            eghact_destroy_component(ring_component());
+            return true;
+        case WASM_CMD_SET_POSITION: {
+            component = ring_component();
+            float x = ring_float();
+            float y = ring_float();
+            eghact_set_position(component, x, y);
+            return true;
+        }
+        case WASM_CMD_SET_SIZE: {
+            component = ring_component();
+            float width = ring_float();
+            float height = ring_float();
+            eghact_set_size(component, width, height);
+            return true;
+        }
+        case WASM_CMD_SET_BACKGROUND:
+            component = ring_component();
+            eghact_set_background_color(component, (uint32_t)ring_word());
+            return true;
+        case WASM_CMD_SET_OPACITY:
+            component = ring_component();
+            eghact_set_opacity(component, ring_float());
+            return true;
+        case WASM_CMD_SET_HIDDEN:
+            component = ring_component();
+            eghact_set_hidden(component, ring_word() != 0);
+            return true;
+        case WASM_CMD_SET_TEXT:
+            component = ring_component();
+            if (!ring_string(&text)) return false;
+            eghact_set_text(component, text);
+            return true;
+        case WASM_CMD_SET_TEXT_COLOR:
+            component = ring_component();
+            eghact_set_text_color(component, (uint32_t)ring_word());
+            return true;
+        case WASM_CMD_SET_FONT_SIZE:
+            component = ring_component();
+            eghact_set_font_size(component, ring_float());
+            return true;
+        case WASM_CMD_SET_PADDING: {
+            component = ring_component();
+            float top = ring_float();
+            float right = ring_float();
+            float bottom = ring_float();
+            float left = ring_float();
+            eghact_set_padding(component, top, right, bottom, left);
+            return true;
+        }
+        case WASM_CMD_SET_FLEX: {
+            component = ring_component();
+            FlexDirection direction = (FlexDirection)ring_word();
+            FlexJustify justify = (FlexJustify)ring_word();
+            FlexAlign align = (FlexAlign)ring_word();
+            float gap = ring_float();
+            eghact_set_flex_direction(component, direction);
+            eghact_set_justify_content(component, justify);
+            eghact_set_align_items(component, align);
+            eghact_set_gap(component, gap);
+            return true;
+        }
+        case WASM_CMD_LAYOUT: {
+            component = ring_component();
+            float width = ring_float();
+            float height = ring_float();
+            eghact_layout_compute(component, width, height);
+            return true;
+        }
+        case WASM_CMD_COMMIT:
+            eghact_commit();
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Allocate the ring (capacity in 32-bit words, rounded up to a power of two) and the
+// result buffer. Returns the ring's address; JS views it through HEAP32/HEAPF32.
+EMSCRIPTEN_KEEPALIVE
+int32_t* eghact_wasm_ring_init(uint32_t capacity) {
+    uint32_t words = 1024;
+    while (words < capacity) words <<= 1;
+
+    int32_t* ring = (int32_t*)realloc(g_ring.words, (size_t)words * sizeof(int32_t));
+    if (!ring) return NULL;
+
+    // The old ring is gone either way, so adopt the new one before the next allocation
+    g_ring.words = ring;
+    g_ring.mask = words - 1;
+    g_ring.read = 0;
+
+    // Every handle-producing command takes at least two words
+    void** results = (void**)realloc(g_ring.results, (size_t)(words / 2) * sizeof(void*));
+    if (!results) return NULL;
+
+    g_ring.results = results;
+    g_ring.result_capacity = words / 2;
+    g_ring.result_count = 0;
+    return ring;
+}
+
+EMSCRIPTEN_KEEPALIVE
+uint32_t eghact_wasm_ring_capacity(void) {
+    return g_ring.words ? g_ring.mask + 1 : 0;
+}
+
+// Word index the next flush starts decoding at
+EMSCRIPTEN_KEEPALIVE
+uint32_t eghact_wasm_ring_read_index(void) {
+    return g_ring.read;
+}
+
+// Handles from the last flush, one per create command in the order they were written
+EMSCRIPTEN_KEEPALIVE
+void** eghact_wasm_ring_results(void) {
+    return g_ring.results;
+}
+
+// Apply count commands from the ring. Returns the number of handles written to the
+// result buffer. If a command was malformed it returns -(n + 1) instead, where n is
+// the number of handles the commands before it created; those are in the result
+// buffer and owned by JS as usual. The ring is then reset to empty and JS must
+// restart writing at index 0.
+EMSCRIPTEN_KEEPALIVE
+int32_t eghact_wasm_flush(uint32_t count) {
+    if (!g_ring.words) return -1;
+
+    g_ring.result_count = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (!apply_command()) {
+            g_ring.read = 0;
+            return -(int32_t)g_ring.result_count - 1;
+        }
+    }
+    return (int32_t)g_ring.result_count;
+}
+
+// Per-call exports, kept for small updates and existing hosts
+EMSCRIPTEN_KEEPALIVE
+void* eghact_wasm_init() {
+    return eghact_init();
+}
+
+EMSCRIPTEN_KEEPALIVE
+void* eghact_wasm_create_view() {
+    return eghact_create_view();
+}
+
+EMSCRIPTEN_KEEPALIVE
+void* eghact_wasm_create_text(const char* text) {
+    return eghact_create_text(text);
+}
+
+EMSCRIPTEN_KEEPALIVE
+void eghact_wasm_add_child(void* parent, void* child) {
+    eghact_add_child((Component*)parent, (Component*)child);
+}
+
+EMSCRIPTEN_KEEPALIVE
+void eghact_wasm_set_position(void* component, float x, float y) {
+    eghact_set_position((Component*)component, x, y);
+}
+
+EMSCRIPTEN_KEEPALIVE
+void eghact_wasm_set_size(void* component, float width, float height) {
+    eghact_set_size((Component*)component, width, height);
+}
+
+#endif // __EMSCRIPTEN__
@@ -0,0 +1,97 @@
+/**
+ * Eghact Native Mobile Runtime - Layout Tests
+ * An incremental relayout must put every node where a full pass over the same tree would
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "core.h"
+
+static int g_failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        g_failures++; \
+    } \
+} while (0)
+
+typedef struct {
+    Component* root;
+    Component* label;  // Text inside the fixed-size child
+} Tree;
+
+// A row mixing a fixed-size child with flexible siblings, wide or narrow enough that
+// the line has to grow or shrink
+static Tree build_tree(float width, const char* label) {
+    Tree tree;
+    tree.root = eghact_create_view();
+    eghact_set_flex_direction(tree.root, EGHACT_FLEX_ROW);
+    eghact_set_gap(tree.root, 4);
+
+    Component* fixed = eghact_create_view();
+    eghact_set_size(fixed, 80, 40);
+    eghact_set_flex(fixed, 1, 1, EGHACT_SIZE_AUTO);
+    eghact_set_flex_direction(fixed, EGHACT_FLEX_COLUMN);
+    tree.label = eghact_create_text(label);
+    eghact_add_child(fixed, tree.label);
+    eghact_add_child(tree.root, fixed);
+
+    Component* grow = eghact_create_view();
+    eghact_set_flex(grow, 1, 1, 60);
+    eghact_add_child(tree.root, grow);
+
+    Component* text = eghact_create_text("caption");
+    eghact_set_flex(text, 0, 1, EGHACT_SIZE_AUTO);
+    eghact_add_child(tree.root, text);
+
+    eghact_layout_compute(tree.root, width, 100);
+    return tree;
+}
+
+static void check_same_frames(const Component* a, const Component* b) {
+    CHECK(a->child_count == b->child_count);
+    CHECK(a->style.x == b->style.x && a->style.y == b->style.y);
+    CHECK(a->style.width == b->style.width && a->style.height == b->style.height);
+    for (size_t i = 0; i < a->child_count && i < b->child_count; i++) {
+        check_same_frames(a->children[i], b->children[i]);
+    }
+}
+
+static void test_incremental_matches_full(float width) {
+    Tree incremental = build_tree(width, "a");
+    eghact_commit();
+
+    // Relaid from the fixed-size child, which is a layout boundary
+    eghact_set_text(incremental.label, "a longer label");
+    eghact_commit();
+
+    Tree full = build_tree(width, "a longer label");
+    eghact_commit();
+
+    check_same_frames(incremental.root, full.root);
+
+    // The fixed-size child keeps its size whether the line grew or shrank
+    const Component* fixed = full.root->children[0];
+    CHECK(fixed->style.width == 80 && fixed->style.height == 40);
+
+    eghact_destroy_component(incremental.root);
+    eghact_destroy_component(full.root);
+}
+
+int main(void) {
+    eghact_init();
+
+    test_incremental_matches_full(400);  // Free space: the line grows
+    test_incremental_matches_full(120);  // Overflow: the line shrinks
+
+    eghact_shutdown();
+
+    if (g_failures) {
+        fprintf(stderr, "%d check(s) failed\n", g_failures);
+        return 1;
+    }
+    printf("layout tests passed\n");
+    return 0;
+}
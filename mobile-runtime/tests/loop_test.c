@@ -0,0 +1,87 @@
+/**
+ * Eghact Native Mobile Runtime - Run Loop Tests
+ * Drives the built-in loop through eghact_run_once, as a host that owns its loop would
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "core.h"
+
+static int g_failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        g_failures++; \
+    } \
+} while (0)
+
+static int g_timer_fired;
+static int g_presses;
+static int g_changes;
+
+static void on_timer(void* data) {
+    g_timer_fired++;
+}
+
+static void on_press(void) {
+    g_presses++;
+}
+
+static void on_change(const char* text) {
+    g_changes++;
+}
+
+// run_once must work without eghact_run having been called
+static void test_run_once_without_run(void) {
+    g_timer_fired = 0;
+    CHECK(eghact_set_timer(0, 0, on_timer, NULL) != 0);
+    // The first iteration may only sleep until the timer's tick comes due
+    for (int i = 0; i < 100 && !g_timer_fired; i++) {
+        CHECK(eghact_run_once(10));
+    }
+    CHECK(g_timer_fired == 1);
+}
+
+// Events posted before their component is destroyed must not be delivered
+static void test_destroyed_component_events(void) {
+    Component* gone = eghact_create_button("Gone", on_press);
+    Component* kept = eghact_create_button("Kept", on_press);
+    Component* input = eghact_create_input("Name");
+    eghact_set_input_change_handler(input, on_change);
+
+    g_presses = 0;
+    g_changes = 0;
+    CHECK(eghact_post_press(gone));
+    CHECK(eghact_post_text_change(input, "ignored"));
+    CHECK(eghact_post_press(kept));
+    eghact_destroy_component(gone);
+    eghact_destroy_component(input);
+    CHECK(eghact_run_once(0));
+    CHECK(g_presses == 1);
+    CHECK(g_changes == 0);
+
+    eghact_destroy_component(kept);
+}
+
+static void test_stop(void) {
+    eghact_stop();
+    CHECK(!eghact_run_once(0));
+}
+
+int main(void) {
+    eghact_init();
+
+    test_run_once_without_run();
+    test_destroyed_component_events();
+    test_stop();
+
+    eghact_shutdown();
+
+    if (g_failures) {
+        fprintf(stderr, "%d check(s) failed\n", g_failures);
+        return 1;
+    }
+    printf("loop tests passed\n");
+    return 0;
+}
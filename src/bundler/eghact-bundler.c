@@ -5,10 +5,34 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <fcntl.h>
 #include <dirent.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include "eghact-core.h"
 #include "acorn-parser.h" // Our own JS parser
+#include "../perf/eghact-perf.h"
+
+#define BUNDLER_CACHE_VERSION 3         // Bump whenever a transform's output changes
+#define BUNDLER_CACHE_MAGIC "EGHC"
+#define BUNDLER_MAX_WORKERS 64
+#define BUNDLER_WATCH_INTERVAL_MS 100
+#define BUNDLER_IOV_BATCH 64            // Pieces per gathered write
+#define TRANSFORM_LINE_SLACK 256        // Output headroom per line beyond the 2x expansion
+#define HASH_SEED 14695981039346656037ull  // FNV-1a offset basis
+
+EGHACT_PERF_COUNTER(perf_modules_parsed, "bundler.modules.parsed");
+EGHACT_PERF_COUNTER(perf_cache_hits, "bundler.cache.hits");
+EGHACT_PERF_COUNTER(perf_cache_misses, "bundler.cache.misses");
+EGHACT_PERF_HISTOGRAM(perf_module_bytes, "bundler.module.bytes");
+EGHACT_PERF_HISTOGRAM(perf_bundle_bytes, "bundler.bundle.bytes");
 
 // Module types
 typedef enum {
@@ -20,16 +44,47 @@ typedef enum {
     MODULE_ASSET
 } ModuleType;
 
+// What one import statement takes from its dependency
+typedef struct {
+    char** names;               // Exports it uses by name
+    int num_names;
+    int all;                    // Namespace import, require() or export *: every export
+} ModuleImport;
+
+// A name the module exports
+typedef struct {
+    char* name;
+    int from;                   // Import it is re-exported from, or -1 if declared here
+    char* imported;             // Its name in that dependency; NULL for the namespace
+    int used;                   // Set by the last shake
+} ModuleExport;
+
 // Module structure
 typedef struct Module {
     char* id;
     char* path;
-    char* content;
-    char* transformed_content;
+    char* content;              // Only while building
+    char* transformed_content;  // NULL once the cache entry holds it; unshaken
+    off_t output_offset;        // Where the output starts in the cache entry
+    int source_lines;           // Index of the content's last line, for the source map
+    int shaken;                 // Some exports are unused; emitting drops them
     ModuleType type;
     struct Module** dependencies;
+    char** dependency_paths;    // Resolved; dependencies[i] is the module at [i]
+    ModuleImport* imports;      // What the import at [i] takes
     int num_dependencies;
+    ModuleExport* exports;      // Sorted by name
+    int num_exports;
     int processed;
+    int live;                   // Kept by the last shake
+    
+    // Incremental state
+    uint64_t hash;              // Path and content; with the config, the cache key
+    time_t mtime;               // When last read
+    off_t size;
+    int built;                  // The output matches hash
+    int changed;                // Content changed in this watch round
+    int force;                  // Rebuild even if the content didn't change
 } Module;
 
 // Bundle configuration
@@ -42,6 +97,10 @@ typedef struct {
     char* target; // "browser" or "node"
     char** externals;
     int num_externals;
+    char* cache_dir;  // Transform cache; NULL disables it
+    int jobs;         // Worker threads; 0 = one per CPU
+    int watch;        // Rebuild on changes until killed
+    int pure_modules; // Modules have no side effects; shaking drops the unused ones
 } BundleConfig;
 
 // AST node for tree shaking
@@ -59,6 +118,14 @@ typedef struct ASTNode {
     int num_references;
 } ASTNode;
 
+// Modules by path or id; open addressing with linear probing
+typedef struct {
+    uint64_t* hashes;
+    Module** slots;          // NULL when free
+    size_t capacity;         // Power of two
+    size_t count;
+} ModuleMap;
+
 // Bundle context
 typedef struct {
     Module** modules;
@@ -66,12 +133,33 @@ typedef struct {
     ASTNode** ast_nodes;
     int num_ast_nodes;
     BundleConfig* config;
-    char* output_code;
+    
+    // Graph discovery, shared with the worker pool through lock
+    Module* entry;
+    int modules_capacity;
+    ModuleMap by_path;
+    ModuleMap by_id;
+    pthread_mutex_t lock;
+    pthread_cond_t work;     // Jobs queued, or stopping
+    pthread_cond_t idle;     // No job queued or running
+    Module** jobs;           // Modules waiting for a worker
+    int num_jobs;
+    int jobs_capacity;
+    int running;             // Jobs taken and not finished
+    int stopping;
+    int failures;            // Modules that couldn't be built this round
+    int rebuilt;             // Modules built this round
+    pthread_t workers[BUNDLER_MAX_WORKERS];
+    int num_workers;
+    uint64_t config_hash;    // Every option a transform reads
 } BundleContext;
 
-// Parse JavaScript/Eghact module
-Module* parse_module(const char* path) {
-    Module* module = malloc(sizeof(Module));
+static int module_read(Module* module);
+static char* cache_read_output(const BundleContext* ctx, const Module* module);
+
+// New module for path; nothing is read yet
+static Module* module_new(const char* path) {
+    Module* module = calloc(1, sizeof(Module));
     module->path = strdup(path);
     module->id = generate_module_id(path);
     module->dependencies = NULL;
@@ -93,87 +181,332 @@ Module* parse_module(const char* path) {
         module->type = MODULE_ASSET;
     }
     
-    // Read content
-    module->content = read_file(path);
-    if (!module->content) {
+    return module;
+}
+
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t len) {
+    const unsigned char* bytes = data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Reads the module's content again and rehashes it; 0 if it can't be read
+static int module_read(Module* module) {
+    struct stat st;
+    char* content = stat(module->path, &st) == 0 ? read_file(module->path) : NULL;
+    if (!content) {
+        // Watch mode waits for it to come back rather than retrying every poll
+        module->mtime = 0;
+        module->size = -1;
+        return 0;
+    }
+    free(module->content);
+    module->content = content;
+    module->mtime = st.st_mtime;
+    module->size = st.st_size;
+    
+    uint64_t hash = hash_bytes(HASH_SEED, module->path, strlen(module->path) + 1);
+    module->hash = hash_bytes(hash, content, strlen(content));
+    
+    EGHACT_PERF_ADD(perf_modules_parsed, 1);
+    EGHACT_PERF_RECORD(perf_module_bytes, strlen(content));
+    return 1;
+}
+
+// Parse JavaScript/Eghact module
+Module* parse_module(const char* path) {
+    EGHACT_PERF_SCOPE("bundler", "parse");
+    Module* module = module_new(path);
+    if (!module_read(module)) {
+        free(module->path);
+        free(module->id);
         free(module);
         return NULL;
     }
-    
     return module;
 }
 
+// Records a resolved import; the graph links it to a module once this one is built.
+// The returned binding takes nothing until filled in, and moves on the next call.
+static ModuleImport* module_add_dependency(Module* module, char* resolved) {
+    module->num_dependencies++;
+    module->dependency_paths = realloc(module->dependency_paths,
+        sizeof(char*) * module->num_dependencies);
+    module->imports = realloc(module->imports,
+        sizeof(ModuleImport) * module->num_dependencies);
+    module->dependency_paths[module->num_dependencies - 1] = resolved;
+    
+    ModuleImport* binding = &module->imports[module->num_dependencies - 1];
+    memset(binding, 0, sizeof(*binding));
+    return binding;
+}
+
+static void import_add_name(ModuleImport* binding, char* name) {
+    binding->names = realloc(binding->names, sizeof(char*) * (binding->num_names + 1));
+    binding->names[binding->num_names++] = name;
+}
+
+static void module_add_export(Module* module, char* name, int from, char* imported) {
+    module->exports = realloc(module->exports, sizeof(ModuleExport) * (module->num_exports + 1));
+    module->exports[module->num_exports++] = (ModuleExport){ name, from, imported, 0 };
+}
+
+static int compare_exports(const void* a, const void* b) {
+    return strcmp(((const ModuleExport*)a)->name, ((const ModuleExport*)b)->name);
+}
+
+// Index of the export called name, or -1
+static int module_find_export(const Module* module, const char* name) {
+    if (module->num_exports == 0) return -1;
+    ModuleExport key = { .name = (char*)name };
+    const ModuleExport* found = bsearch(&key, module->exports, module->num_exports,
+                                        sizeof(ModuleExport), compare_exports);
+    return found ? (int)(found - module->exports) : -1;
+}
+
+// Drops what the last build derived from the content
+static void module_clear_build(Module* module) {
+    for (int i = 0; i < module->num_dependencies; i++) {
+        free(module->dependency_paths[i]);
+        for (int j = 0; j < module->imports[i].num_names; j++) {
+            free(module->imports[i].names[j]);
+        }
+        free(module->imports[i].names);
+    }
+    for (int i = 0; i < module->num_exports; i++) {
+        free(module->exports[i].name);
+        free(module->exports[i].imported);
+    }
+    free(module->dependency_paths);
+    free(module->imports);
+    free(module->exports);
+    free(module->dependencies);
+    free(module->transformed_content);
+    module->dependency_paths = NULL;
+    module->imports = NULL;
+    module->exports = NULL;
+    module->dependencies = NULL;
+    module->num_dependencies = 0;
+    module->num_exports = 0;
+    module->transformed_content = NULL;
+    module->output_offset = 0;
+    module->shaken = 0;
+    module->built = 0;
+}
+
+// Import and export parsing
+//
+// Statements are read where the transform rewrites them, at the start of a line. Each
+// import records the dependency and the names it takes; each export records the name
+// and, for export ... from, where it comes from. Tree shaking follows uses through
+// these from export to export. Whatever isn't understood takes the whole dependency.
+
+static inline int is_identifier_char(char c) {
+    return isalnum((unsigned char)c) || c == '_' || c == '$';
+}
+
+static const char* skip_space(const char* p) {
+    while (isspace((unsigned char)*p)) p++;
+    return p;
+}
+
+// Whole word keyword at p, after any space; *p is moved past it on a match
+static int accept_keyword(const char** p, const char* keyword) {
+    const char* start = skip_space(*p);
+    size_t len = strlen(keyword);
+    if (strncmp(start, keyword, len) != 0 || is_identifier_char(start[len])) return 0;
+    *p = start + len;
+    return 1;
+}
+
+static char* read_identifier(const char** p) {
+    const char* start = *p = skip_space(*p);
+    while (is_identifier_char(**p)) (*p)++;
+    return *p > start ? strndup(start, *p - start) : NULL;
+}
+
+// Quoted specifier at p resolved against the module, or NULL
+static char* read_specifier(const Module* module, const char** p) {
+    const char* quote = *p = skip_space(*p);
+    if (*quote != '"' && *quote != '\'') return NULL;
+    const char* end = strchr(quote + 1, *quote);
+    if (!end) return NULL;
+    
+    char* specifier = strndup(quote + 1, end - quote - 1);
+    char* resolved = resolve_dependency(module->path, specifier);
+    free(specifier);
+    *p = end + 1;
+    return resolved;
+}
+
+// "{ a, b as c }" at p into parallel name lists, the second holding the alias or the
+// name again; *p is moved past the brace. 0 if it doesn't parse.
+static int read_bindings(const char** p, char*** names, char*** aliases, int* count) {
+    const char* c = skip_space(*p);
+    if (*c++ != '{') return 0;
+    for (;;) {
+        c = skip_space(c);
+        if (*c == '}') break;
+        
+        char* name = read_identifier(&c);
+        if (!name) return 0;
+        char* alias = accept_keyword(&c, "as") ? read_identifier(&c) : strdup(name);
+        if (!alias) {
+            free(name);
+            return 0;
+        }
+        *names = realloc(*names, sizeof(char*) * (*count + 1));
+        *aliases = realloc(*aliases, sizeof(char*) * (*count + 1));
+        (*names)[*count] = name;
+        (*aliases)[*count] = alias;
+        (*count)++;
+        
+        c = skip_space(c);
+        if (*c == ',') c++;
+        else if (*c != '}') return 0;
+    }
+    *p = c + 1;
+    return 1;
+}
+
+static void free_names(char** names, int count) {
+    for (int i = 0; i < count; i++) free(names[i]);
+    free(names);
+}
+
+// After "import": import "x", import a, { b as c }, * as d from "x"
+static void parse_import(Module* module, const char* p) {
+    char* resolved = read_specifier(module, &p);
+    if (resolved) {
+        module_add_dependency(module, resolved);  // Only for its side effects
+        return;
+    }
+    
+    char **names = NULL, **aliases = NULL;
+    int count = 0, all = 0, uses_default = 0;
+    if (is_identifier_char(*skip_space(p))) {
+        free(read_identifier(&p));
+        uses_default = 1;
+        p = skip_space(p);
+        if (*p == ',') p++;
+    }
+    p = skip_space(p);
+    if (*p == '*') {
+        p++;
+        if (accept_keyword(&p, "as")) free(read_identifier(&p));
+        all = 1;
+    } else if (*p == '{') {
+        all = !read_bindings(&p, &names, &aliases, &count);
+    }
+    
+    resolved = accept_keyword(&p, "from") ? read_specifier(module, &p) : NULL;
+    if (resolved) {
+        ModuleImport* binding = module_add_dependency(module, resolved);
+        binding->all = all;
+        if (uses_default) import_add_name(binding, strdup("default"));
+        for (int i = 0; i < count && !all; i++) {
+            import_add_name(binding, names[i]);
+            names[i] = NULL;
+        }
+    }
+    free_names(names, count);
+    free_names(aliases, count);
+}
+
+// After "export": declarations, default, { a as b } [from "x"], * [as c] from "x"
+static void parse_export(Module* module, const char* p) {
+    if (accept_keyword(&p, "default")) {
+        module_add_export(module, strdup("default"), -1, NULL);
+        return;
+    }
+    
+    const char* c = skip_space(p);
+    if (*c == '*') {
+        c++;
+        char* alias = accept_keyword(&c, "as") ? read_identifier(&c) : NULL;
+        char* resolved = accept_keyword(&c, "from") ? read_specifier(module, &c) : NULL;
+        if (resolved) {
+            ModuleImport* binding = module_add_dependency(module, resolved);
+            if (alias) {
+                module_add_export(module, alias, module->num_dependencies - 1, NULL);
+                alias = NULL;
+            } else {
+                binding->all = 1;  // Whatever it exports, this module does too
+            }
+        }
+        free(alias);
+        return;
+    }
+    
+    if (*c == '{') {
+        char **names = NULL, **aliases = NULL;
+        int count = 0;
+        if (read_bindings(&c, &names, &aliases, &count)) {
+            char* resolved = accept_keyword(&c, "from") ? read_specifier(module, &c) : NULL;
+            int from = -1;
+            if (resolved) {
+                module_add_dependency(module, resolved);
+                from = module->num_dependencies - 1;
+            }
+            for (int i = 0; i < count; i++) {
+                module_add_export(module, aliases[i], from, from >= 0 ? names[i] : NULL);
+                if (from < 0) free(names[i]);
+            }
+            free(names);
+            free(aliases);
+        } else {
+            free_names(names, count);
+            free_names(aliases, count);
+        }
+        return;
+    }
+    
+    // A declaration: the first name after its keywords
+    while (accept_keyword(&c, "async") || accept_keyword(&c, "function") ||
+           accept_keyword(&c, "class") || accept_keyword(&c, "const") ||
+           accept_keyword(&c, "let") || accept_keyword(&c, "var")) {
+        c = skip_space(c);
+        if (*c == '*') c++;  // Generator
+    }
+    char* name = read_identifier(&c);
+    if (name) module_add_export(module, name, -1, NULL);
+}
+
 // Extract dependencies from module
 void extract_dependencies(Module* module) {
     if (module->type != MODULE_JS && module->type != MODULE_EGH) {
         return;
     }
     
-    // Parse imports/requires
-    char* content = module->content;
-    char* import_pos = content;
-    
-    while ((import_pos = strstr(import_pos, "import")) != NULL) {
-        // Parse import statement
-        char* from_pos = strstr(import_pos, "from");
-        if (from_pos) {
-            char* quote_start = strchr(from_pos, '"');
-            if (!quote_start) quote_start = strchr(from_pos, '\'');
-            
-            if (quote_start) {
-                char* quote_end = strchr(quote_start + 1, quote_start[0]);
-                if (quote_end) {
-                    int len = quote_end - quote_start - 1;
-                    char* dep_path = malloc(len + 1);
-                    strncpy(dep_path, quote_start + 1, len);
-                    dep_path[len] = '\0';
-                    
-                    // Resolve dependency path
-                    char* resolved = resolve_dependency(module->path, dep_path);
-                    
-                    // Add to dependencies
-                    module->num_dependencies++;
-                    module->dependencies = realloc(module->dependencies,
-                        sizeof(Module*) * module->num_dependencies);
-                    module->dependencies[module->num_dependencies - 1] = 
-                        parse_module(resolved);
-                    
-                    free(dep_path);
-                    free(resolved);
-                }
-            }
+    // Parse import and export statements
+    for (const char* line = module->content; *line; ) {
+        const char* p = line;
+        if (accept_keyword(&p, "import") && *p != '(') {
+            parse_import(module, p);
+        } else if (accept_keyword(&p, "export")) {
+            parse_export(module, p);
         }
         
-        import_pos += 6; // Move past "import"
+        const char* newline = strchr(line, '\n');
+        if (!newline) break;
+        line = newline + 1;
+    }
+    if (module->num_exports > 1) {
+        qsort(module->exports, module->num_exports, sizeof(ModuleExport), compare_exports);
     }
     
     // Also handle require() for CommonJS
+    char* content = module->content;
     char* require_pos = content;
     while ((require_pos = strstr(require_pos, "require(")) != NULL) {
-        char* paren_start = require_pos + 8;
-        char* quote_start = strchr(paren_start, '"');
-        if (!quote_start) quote_start = strchr(paren_start, '\'');
+        const char* specifier = require_pos + 8;
+        char* resolved = read_specifier(module, &specifier);
         
-        if (quote_start) {
-            char* quote_end = strchr(quote_start + 1, quote_start[0]);
-            if (quote_end) {
-                int len = quote_end - quote_start - 1;
-                char* dep_path = malloc(len + 1);
-                strncpy(dep_path, quote_start + 1, len);
-                dep_path[len] = '\0';
-                
-                // Add dependency
-                char* resolved = resolve_dependency(module->path, dep_path);
-                module->num_dependencies++;
-                module->dependencies = realloc(module->dependencies,
-                    sizeof(Module*) * module->num_dependencies);
-                module->dependencies[module->num_dependencies - 1] = 
-                    parse_module(resolved);
-                
-                free(dep_path);
-                free(resolved);
-            }
-        }
+        // Add dependency
+        if (resolved) module_add_dependency(module, resolved)->all = 1;
         
         require_pos += 8;
     }
@@ -181,6 +514,7 @@ void extract_dependencies(Module* module) {
 
 // Transform module content
 void transform_module(Module* module, BundleContext* ctx) {
+    EGHACT_PERF_SCOPE("bundler", "transform");
     switch (module->type) {
         case MODULE_JS:
             module->transformed_content = transform_javascript(module, ctx);
@@ -207,70 +541,181 @@ void transform_module(Module* module, BundleContext* ctx) {
     }
 }
 
+// Module output under construction, grown geometrically
+typedef struct {
+    char* data;
+    size_t len;
+    size_t capacity;
+} OutputBuffer;
+
+static int output_reserve(OutputBuffer* out, size_t extra) {
+    if (out->len + extra <= out->capacity) return 1;
+    size_t capacity = out->capacity ? out->capacity : 256;
+    while (capacity < out->len + extra) capacity *= 2;
+    char* data = realloc(out->data, capacity);
+    if (!data) return 0;
+    out->data = data;
+    out->capacity = capacity;
+    return 1;
+}
+
 // Transform JavaScript
 char* transform_javascript(Module* module, BundleContext* ctx) {
-    char* output = malloc(strlen(module->content) * 2);
-    char* out_ptr = output;
+    size_t length = strlen(module->content);
+    OutputBuffer out = {0};
+    if (!output_reserve(&out, length + length / 4 + strlen(module->id) + TRANSFORM_LINE_SLACK)) {
+        return NULL;
+    }
     
     // Wrap in module closure
-    out_ptr += sprintf(out_ptr, 
+    out.len += sprintf(out.data,
         "__eghact_modules__['%s'] = function(module, exports, require) {\n",
         module->id);
     
-    // Transform import/export to CommonJS
-    char* content = strdup(module->content);
-    char* line = strtok(content, "\n");
-    
-    while (line) {
-        if (strstr(line, "import ") == line) {
-            // Transform ES6 import
-            out_ptr += transform_import_statement(line, out_ptr);
-        } else if (strstr(line, "export ") == line) {
-            // Transform ES6 export
-            out_ptr += transform_export_statement(line, out_ptr);
+    // Transform import/export to CommonJS line by line. Blank lines are kept so output
+    // lines stay in step with the source for the source map.
+    char* line = module->content;
+    char* end = module->content + length;
+    while (line < end) {
+        char* newline = memchr(line, '\n', end - line);
+        size_t line_len = (newline ? newline : end) - line;
+        
+        // A statement transform expands its line at most twofold
+        if (!output_reserve(&out, line_len * 2 + TRANSFORM_LINE_SLACK)) {
+            free(out.data);
+            return NULL;
+        }
+        
+        int is_import = strncmp(line, "import ", 7) == 0;
+        if (is_import || strncmp(line, "export ", 7) == 0) {
+            // The transforms read a terminated line; end it in place rather than copying
+            char saved = line[line_len];
+            line[line_len] = '\0';
+            out.len += is_import
+                ? transform_import_statement(line, out.data + out.len)
+                : transform_export_statement(line, out.data + out.len);
+            line[line_len] = saved;
         } else {
             // Copy line as-is
-            out_ptr += sprintf(out_ptr, "%s\n", line);
+            memcpy(out.data + out.len, line, line_len);
+            out.len += line_len;
+            out.data[out.len++] = '\n';
         }
         
-        line = strtok(NULL, "\n");
+        line += line_len + 1;
     }
     
     // Close module wrapper
-    out_ptr += sprintf(out_ptr, "\n};\n");
-    
-    free(content);
+    memcpy(out.data + out.len, "\n};\n", sizeof("\n};\n"));
+    out.len += sizeof("\n};\n") - 1;
     
     // Minify if requested
     if (ctx->config->minify) {
-        char* minified = minify_javascript(output);
-        free(output);
-        output = minified;
+        char* minified = minify_javascript(out.data);
+        free(out.data);
+        return minified;
     }
     
-    return output;
+    // Without a cache the output stays resident for the graph, so drop the slack
+    char* output = realloc(out.data, out.len + 1);
+    return output ? output : out.data;
+}
+
+// Tree shaking
+//
+// Uses propagate over a worklist from the entry, each module and export entering it at
+// most once. A module is kept when it's the entry, when a kept module imports it and it
+// may have side effects, or when one of its exports is used. Keeping a module uses
+// what each of its imports takes; using a re-export uses the name it comes from.
+// Names a dependency doesn't declare keep all of it, as a namespace import does.
+
+typedef struct {
+    Module* module;
+    int export_index;       // -1 for the module itself
+} ShakeItem;
+
+typedef struct {
+    ShakeItem* items;
+    int count;
+    int capacity;
+} ShakeList;
+
+static void shake_push(ShakeList* list, Module* module, int export_index) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 256;
+        list->items = realloc(list->items, sizeof(ShakeItem) * list->capacity);
+    }
+    list->items[list->count++] = (ShakeItem){ module, export_index };
+}
+
+static void shake_keep(ShakeList* list, Module* module) {
+    if (module->live) return;
+    module->live = 1;
+    shake_push(list, module, -1);
+}
+
+static void shake_use(ShakeList* list, Module* module, int export_index) {
+    if (module->exports[export_index].used) return;
+    module->exports[export_index].used = 1;
+    shake_push(list, module, export_index);
+    shake_keep(list, module);
+}
+
+// Uses name from module, or everything it exports when name is NULL
+static void shake_use_name(ShakeList* list, Module* module, const char* name) {
+    int export_index = name ? module_find_export(module, name) : -1;
+    if (export_index >= 0) {
+        shake_use(list, module, export_index);
+        return;
+    }
+    for (int i = 0; i < module->num_exports; i++) {
+        shake_use(list, module, i);
+    }
+    shake_keep(list, module);
+}
+
+// CSS injects itself, so only scripts and data can be dropped
+static int module_pure(const BundleContext* ctx, const Module* module) {
+    return ctx->config->pure_modules && module->type != MODULE_CSS;
 }
 
 // Tree shaking - mark used exports
 void mark_used_exports(BundleContext* ctx) {
-    // Start from entry module
-    Module* entry = find_module_by_path(ctx, ctx->config->entry);
-    if (!entry) return;
+    for (int i = 0; i < ctx->num_modules; i++) {
+        Module* module = ctx->modules[i];
+        module->live = 0;
+        for (int j = 0; j < module->num_exports; j++) {
+            module->exports[j].used = 0;
+        }
+    }
     
-    // Mark all exports from entry as used
-    mark_module_exports_used(entry, ctx);
+    // Start from entry module; everything it exports is used
+    ShakeList list = {0};
+    shake_use_name(&list, ctx->entry, NULL);
     
-    // Traverse dependency graph
-    int changed = 1;
-    while (changed) {
-        changed = 0;
-        for (int i = 0; i < ctx->num_modules; i++) {
-            Module* module = ctx->modules[i];
-            if (check_and_mark_used_imports(module, ctx)) {
-                changed = 1;
+    while (list.count > 0) {
+        ShakeItem item = list.items[--list.count];
+        Module* module = item.module;
+        
+        if (item.export_index >= 0) {
+            const ModuleExport* export = &module->exports[item.export_index];
+            if (export->from >= 0) {
+                shake_use_name(&list, module->dependencies[export->from], export->imported);
             }
+            continue;
+        }
+        
+        for (int i = 0; i < module->num_dependencies; i++) {
+            const ModuleImport* binding = &module->imports[i];
+            Module* dependency = module->dependencies[i];
+            if (binding->all) shake_use_name(&list, dependency, NULL);
+            for (int j = 0; j < binding->num_names; j++) {
+                shake_use_name(&list, dependency, binding->names[j]);
+            }
+            if (!module_pure(ctx, dependency)) shake_keep(&list, dependency);
         }
     }
+    free(list.items);
 }
 
 // Remove unused code
@@ -279,158 +724,860 @@ void shake_tree(BundleContext* ctx) {
     
     mark_used_exports(ctx);
     
-    // Remove unused exports from each module
+    // Flag the modules with unused exports; emitting removes them. Which are used
+    // depends on the whole graph, so the cached output stays as it was.
     for (int i = 0; i < ctx->num_modules; i++) {
         Module* module = ctx->modules[i];
-        module->transformed_content = remove_unused_exports(
-            module->transformed_content, ctx);
+        module->shaken = 0;
+        if (!module->live) continue;
+        
+        for (int j = 0; j < module->num_exports && !module->shaken; j++) {
+            module->shaken = !module->exports[j].used;
+        }
     }
 }
 
-// Generate source maps
-char* generate_source_map(BundleContext* ctx) {
-    if (!ctx->config->sourcemaps) return NULL;
-    
-    // Create source map in JSON format
-    char* sourcemap = malloc(1024 * 1024); // 1MB initial
-    char* ptr = sourcemap;
-    
-    ptr += sprintf(ptr, "{\n");
-    ptr += sprintf(ptr, "  \"version\": 3,\n");
-    ptr += sprintf(ptr, "  \"sources\": [");
+// Modules the shake dropped are left out of the bundle and its source map
+static inline int module_emitted(const BundleContext* ctx, const Module* module) {
+    return !ctx->config->tree_shaking || module->live;
+}
+
+// Bundle emission
+//
+// The bundle is streamed to the output file with gathered writes: the runtime prologue,
+// each module's output straight from its buffer, then the entry epilogue, up to
+// BUNDLER_IOV_BATCH pieces per writev. Nothing is concatenated. With a transform cache
+// the graph holds no outputs: each is read back from its entry, shaken if need be,
+// written and freed before the next, so emitting holds one module's output at a time.
+// Without one, outputs stay resident and only shaken copies come and go.
+//
+// The source map is written in the same pass through a buffered stream, one VLQ segment
+// per generated line. Output lines map to source lines in order, which is exact for
+// transforms that keep the line structure; lines past the end of a source map to its
+// last line.
+
+static const char bundle_prologue[] =
+    "// Eghact Bundle Runtime\n"
+    "(function() {\n"
+    "  var __eghact_modules__ = {};\n"
+    "  var __eghact_cache__ = {};\n"
+    "  \n"
+    "  function __eghact_require__(id) {\n"
+    "    if (__eghact_cache__[id]) {\n"
+    "      return __eghact_cache__[id].exports;\n"
+    "    }\n"
+    "    var module = { exports: {} };\n"
+    "    __eghact_cache__[id] = module;\n"
+    "    __eghact_modules__[id](module, module.exports, __eghact_require__);\n"
+    "    return module.exports;\n"
+    "  }\n"
+    "  \n";
+
+// The module's output as emitted, or NULL if its cache entry can't be read. *owned is
+// set when the caller frees it: it was read back or shaken.
+static char* module_output(const BundleContext* ctx, const Module* module, int* owned) {
+    char* output = module->transformed_content;
+    *owned = output == NULL;
+    if (!output && !(output = cache_read_output(ctx, module))) return NULL;
+    if (module->shaken) {
+        char* shaken = remove_unused_exports(output, module->exports, module->num_exports);
+        if (*owned) free(output);
+        output = shaken;
+        *owned = 1;
+    }
+    return output;
+}
+
+typedef struct {
+    int fd;
+    struct iovec iov[BUNDLER_IOV_BATCH];
+    int count;
+    size_t written;
+    int failed;
+} BundleWriter;
+
+static void writer_flush(BundleWriter* writer) {
+    struct iovec* iov = writer->iov;
+    int count = writer->count;
+    while (count > 0 && !writer->failed) {
+        ssize_t n = writev(writer->fd, iov, count);
+        if (n < 0) {
+            if (errno != EINTR) writer->failed = 1;
+            continue;
+        }
+        writer->written += n;
+        
+        // Short write: skip what went out and resume mid-piece
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char*)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    writer->count = 0;
+}
+
+// data must stay valid until the next flush
+static void writer_add(BundleWriter* writer, const void* data, size_t len) {
+    if (len == 0) return;
+    if (writer->count == BUNDLER_IOV_BATCH) writer_flush(writer);
+    writer->iov[writer->count].iov_base = (void*)data;
+    writer->iov[writer->count].iov_len = len;
+    writer->count++;
+}
+
+#define writer_add_literal(writer, text) writer_add((writer), (text), sizeof(text) - 1)
+
+static void vlq_write(FILE* out, int value) {
+    static const char digits[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    unsigned int vlq = value < 0 ? ((unsigned int)-value << 1) | 1 : (unsigned int)value << 1;
+    do {
+        unsigned int digit = vlq & 31;
+        vlq >>= 5;
+        if (vlq) digit |= 32;  // Continuation
+        putc(digits[digit], out);
+    } while (vlq);
+}
+
+static void json_string_write(FILE* out, const char* text) {
+    putc('"', out);
+    for (const unsigned char* c = (const unsigned char*)text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            putc('\\', out);
+            putc(*c, out);
+        } else if (*c < 0x20) {
+            fprintf(out, "\\u%04x", *c);
+        } else {
+            putc(*c, out);
+        }
+    }
+    putc('"', out);
+}
+
+static int count_lines(const char* text) {
+    int lines = 0;
+    for (const char* c = text; (c = strchr(c, '\n')); c++) lines++;
+    return lines;
+}
+
+// Source map under way; segment fields are deltas from the last one
+typedef struct {
+    FILE* out;
+    int source_index;
+    int previous_source;
+    int previous_line;
+} SourceMap;
+
+static void source_map_begin(BundleContext* ctx, SourceMap* map) {
+    FILE* out = map->out;
+    fputs("{\n  \"version\": 3,\n  \"sources\": [", out);
     
     // List all source files
-    for (int i = 0; i < ctx->num_modules; i++) {
-        if (i > 0) ptr += sprintf(ptr, ", ");
-        ptr += sprintf(ptr, "\"%s\"", ctx->modules[i]->path);
+    for (int i = 0, sources = 0; i < ctx->num_modules; i++) {
+        if (!module_emitted(ctx, ctx->modules[i])) continue;
+        if (sources++ > 0) fputs(", ", out);
+        json_string_write(out, ctx->modules[i]->path);
     }
     
-    ptr += sprintf(ptr, "],\n");
-    ptr += sprintf(ptr, "  \"mappings\": \"");
-    
-    // Generate VLQ-encoded mappings
-    ptr += generate_vlq_mappings(ctx, ptr);
-    
-    ptr += sprintf(ptr, "\"\n}\n");
+    fputs("],\n  \"names\": [],\n  \"mappings\": \"", out);
     
-    return sourcemap;
+    // The runtime maps to nothing
+    for (int i = count_lines(bundle_prologue); i > 0; i--) putc(';', out);
+    map->source_index = -1;
 }
 
-// Bundle all modules
-void create_bundle(BundleContext* ctx) {
-    // Calculate bundle size
-    size_t bundle_size = 0;
-    for (int i = 0; i < ctx->num_modules; i++) {
-        bundle_size += strlen(ctx->modules[i]->transformed_content);
+// One segment at column 0 per non-empty line of the module's output
+static void source_map_add(SourceMap* map, const Module* module, const char* output) {
+    FILE* out = map->out;
+    int source_index = ++map->source_index;
+    
+    // Line 0 is the closure wrapper, standing in for the module's first line. Each
+    // ';' ends a line, at its own newline or, for the last, at the separator.
+    const char* line = output;
+    for (int generated = 0; *line; generated++) {
+        int source_line = generated > 0 ? generated - 1 : 0;
+        if (source_line > module->source_lines) source_line = module->source_lines;
+        
+        vlq_write(out, 0);
+        vlq_write(out, source_index - map->previous_source);
+        vlq_write(out, source_line - map->previous_line);
+        vlq_write(out, 0);
+        putc(';', out);
+        map->previous_source = source_index;
+        map->previous_line = source_line;
+        
+        const char* newline = strchr(line, '\n');
+        line = newline ? newline + 1 : line + strlen(line);
     }
-    bundle_size += 10240; // Runtime overhead
     
-    ctx->output_code = malloc(bundle_size);
-    char* ptr = ctx->output_code;
+    // The separator alone ends an empty line
+    if (*output == '\0' || ends_with(output, "\n")) putc(';', out);
+}
+
+static void source_map_end(SourceMap* map) {
+    fputs("\"\n}\n", map->out);
+}
+
+// Bundle all modules into fd, and their source map into map unless it is NULL; 0 if the
+// bundle can't be written
+static int create_bundle(BundleContext* ctx, int fd, FILE* map_file) {
+    EGHACT_PERF_SCOPE("bundler", "emit");
+    BundleWriter writer = { .fd = fd };
+    SourceMap map = { .out = map_file };
+    if (map_file) source_map_begin(ctx, &map);
     
     // Add runtime
-    ptr += sprintf(ptr, 
-        "// Eghact Bundle Runtime\n"
-        "(function() {\n"
-        "  var __eghact_modules__ = {};\n"
-        "  var __eghact_cache__ = {};\n"
-        "  \n"
-        "  function __eghact_require__(id) {\n"
-        "    if (__eghact_cache__[id]) {\n"
-        "      return __eghact_cache__[id].exports;\n"
-        "    }\n"
-        "    var module = { exports: {} };\n"
-        "    __eghact_cache__[id] = module;\n"
-        "    __eghact_modules__[id](module, module.exports, __eghact_require__);\n"
-        "    return module.exports;\n"
-        "  }\n"
-        "  \n");
+    writer_add_literal(&writer, bundle_prologue);
     
     // Add all modules
-    for (int i = 0; i < ctx->num_modules; i++) {
-        ptr += sprintf(ptr, "%s\n", ctx->modules[i]->transformed_content);
+    for (int i = 0; i < ctx->num_modules && !writer.failed; i++) {
+        Module* module = ctx->modules[i];
+        if (!module_emitted(ctx, module)) continue;
+        int owned;
+        char* output = module_output(ctx, module, &owned);
+        if (!output) {
+            fprintf(stderr, "Error: Cannot read the output of %s from the cache\n", module->path);
+            writer.failed = 1;
+            break;
+        }
+        writer_add(&writer, output, strlen(output));
+        writer_add_literal(&writer, "\n");
+        if (map_file) source_map_add(&map, module, output);
+        
+        // Goes out before the next one is read
+        if (owned) {
+            writer_flush(&writer);
+            free(output);
+        }
     }
     
     // Add entry point
-    ptr += sprintf(ptr, 
-        "  // Entry point\n"
-        "  __eghact_require__('%s');\n"
-        "})();\n",
-        ctx->modules[0]->id);
+    writer_add_literal(&writer, "  // Entry point\n  __eghact_require__('");
+    writer_add(&writer, ctx->modules[0]->id, strlen(ctx->modules[0]->id));
+    writer_add_literal(&writer, "');\n})();\n");
     
     // Add source map reference
     if (ctx->config->sourcemaps) {
-        ptr += sprintf(ptr, "//# sourceMappingURL=%s.map\n", 
-                      ctx->config->output);
+        writer_add_literal(&writer, "//# sourceMappingURL=");
+        writer_add(&writer, ctx->config->output, strlen(ctx->config->output));
+        writer_add_literal(&writer, ".map\n");
     }
+    writer_flush(&writer);
+    if (map_file) source_map_end(&map);
+    
+    EGHACT_PERF_RECORD(perf_bundle_bytes, writer.written);
+    return !writer.failed;
 }
 
-// Main bundler function
-int eghact_bundle(BundleConfig* config) {
-    printf("Bundling %s...\n", config->entry);
+// Transform cache
+//
+// One entry per module build, in <cache_dir>/<key>.mod: the resolved dependency paths,
+// the import and export bindings and the transformed output. The key hashes the
+// module's path and content with every config option a transform reads, so a module
+// that hasn't changed is never parsed or transformed again, in this run or a later one.
+// Entries are written to a temporary file and renamed into place, so a crash or a
+// concurrent build leaves whole entries or none. Stale entries are simply never looked
+// up again; delete the directory to reclaim them.
+
+static uint64_t config_hash(const BundleConfig* config) {
+    uint64_t hash = HASH_SEED;
+    int version = BUNDLER_CACHE_VERSION;
+    hash = hash_bytes(hash, &version, sizeof(version));
+    hash = hash_bytes(hash, &config->minify, sizeof(config->minify));
+    const char* target = config->target ? config->target : "";
+    hash = hash_bytes(hash, target, strlen(target) + 1);
+    for (int i = 0; i < config->num_externals; i++) {
+        hash = hash_bytes(hash, config->externals[i], strlen(config->externals[i]) + 1);
+    }
+    return hash;
+}
+
+static void cache_entry_path(const BundleContext* ctx, uint64_t key, char* path, size_t size) {
+    snprintf(path, size, "%s/%016llx.mod", ctx->config->cache_dir, (unsigned long long)key);
+}
+
+static inline uint64_t cache_key(const BundleContext* ctx, const Module* module) {
+    return hash_bytes(module->hash, &ctx->config_hash, sizeof(ctx->config_hash));
+}
+
+static int read_exact(FILE* file, void* data, size_t len) {
+    return fread(data, 1, len, file) == len;
+}
+
+// Reads a length-prefixed string; NULL if the entry is cut short
+static char* read_string(FILE* file, uint64_t max) {
+    uint64_t len;
+    if (!read_exact(file, &len, sizeof(len)) || len > max) return NULL;
+    char* text = malloc(len + 1);
+    if (!text) return NULL;
+    if (!read_exact(file, text, len)) {
+        free(text);
+        return NULL;
+    }
+    text[len] = '\0';
+    return text;
+}
+
+static int write_string(FILE* file, const char* text) {
+    uint64_t len = strlen(text);
+    return fwrite(&len, sizeof(len), 1, file) == 1 && fwrite(text, 1, len, file) == len;
+}
+
+static inline int read_u32(FILE* file, uint32_t* value) {
+    return read_exact(file, value, sizeof(*value));
+}
+
+static inline int write_u32(FILE* file, uint32_t value) {
+    return fwrite(&value, sizeof(value), 1, file) == 1;
+}
+
+// Fills the module's build from its cache entry; 0 on a miss
+static int cache_load(BundleContext* ctx, Module* module) {
+    if (!ctx->config->cache_dir) return 0;
+    uint64_t key = cache_key(ctx, module);
+    char path[PATH_MAX];
+    cache_entry_path(ctx, key, path, sizeof(path));
+    FILE* file = fopen(path, "rb");
+    if (!file) return 0;
     
-    BundleContext ctx = {0};
-    ctx.config = config;
+    struct stat st;
+    char magic[4];
+    uint32_t version, num_dependencies;
+    uint64_t stored_key;
+    int ok = fstat(fileno(file), &st) == 0 &&
+             read_exact(file, magic, sizeof(magic)) && memcmp(magic, BUNDLER_CACHE_MAGIC, 4) == 0 &&
+             read_exact(file, &version, sizeof(version)) && version == BUNDLER_CACHE_VERSION &&
+             read_exact(file, &stored_key, sizeof(stored_key)) && stored_key == key &&
+             read_exact(file, &num_dependencies, sizeof(num_dependencies));
     
-    // Parse entry module
-    Module* entry = parse_module(config->entry);
-    if (!entry) {
-        fprintf(stderr, "Error: Cannot read entry file: %s\n", config->entry);
-        return 1;
+    for (uint32_t i = 0; ok && i < num_dependencies; i++) {
+        char* dependency = read_string(file, PATH_MAX);
+        uint32_t all, num_names;
+        if (!dependency) {
+            ok = 0;
+            break;
+        }
+        ModuleImport* binding = module_add_dependency(module, dependency);
+        ok = read_u32(file, &all) && read_u32(file, &num_names);
+        binding->all = all;
+        for (uint32_t j = 0; ok && j < num_names; j++) {
+            char* name = read_string(file, PATH_MAX);
+            if (name) import_add_name(binding, name);
+            else ok = 0;
+        }
     }
     
-    // Build dependency graph
-    ctx.modules = malloc(sizeof(Module*) * 1024);
-    ctx.num_modules = 0;
+    uint32_t num_exports = 0;
+    ok = ok && read_u32(file, &num_exports);
+    for (uint32_t i = 0; ok && i < num_exports; i++) {
+        char* name = read_string(file, PATH_MAX);
+        uint32_t from, has_imported;
+        ok = name && read_u32(file, &from) && read_u32(file, &has_imported) &&
+             (from == UINT32_MAX || from < num_dependencies);
+        char* imported = ok && has_imported ? read_string(file, PATH_MAX) : NULL;
+        if (ok && has_imported && !imported) ok = 0;
+        if (ok) {
+            module_add_export(module, name, from == UINT32_MAX ? -1 : (int)from, imported);
+        } else {
+            free(name);
+        }
+    }
     
-    build_dependency_graph(entry, &ctx);
+    // The output ends the entry; it stays there until emitted
+    uint64_t len;
+    long offset = ok ? ftell(file) : -1;
+    ok = ok && offset > 0 && read_exact(file, &len, sizeof(len)) &&
+         len == (uint64_t)st.st_size - offset - sizeof(len);
+    if (ok) module->output_offset = offset;
+    fclose(file);
     
-    // Transform all modules
-    for (int i = 0; i < ctx.num_modules; i++) {
-        transform_module(ctx.modules[i], &ctx);
+    if (!ok) module_clear_build(module);
+    return ok;
+}
+
+// Best effort: a build that can't write its cache still succeeds. Returns where the
+// output starts in the entry, or 0 if it wasn't stored.
+static off_t cache_store(BundleContext* ctx, const Module* module) {
+    if (!ctx->config->cache_dir) return 0;
+    uint64_t key = cache_key(ctx, module);
+    char path[PATH_MAX], temp[PATH_MAX + 32];
+    cache_entry_path(ctx, key, path, sizeof(path));
+    snprintf(temp, sizeof(temp), "%s.%ld.%lx", path, (long)getpid(), (unsigned long)pthread_self());
+    FILE* file = fopen(temp, "wb");
+    if (!file) return 0;
+    
+    uint32_t version = BUNDLER_CACHE_VERSION;
+    uint32_t num_dependencies = (uint32_t)module->num_dependencies;
+    int ok = fwrite(BUNDLER_CACHE_MAGIC, 1, 4, file) == 4 &&
+             fwrite(&version, sizeof(version), 1, file) == 1 &&
+             fwrite(&key, sizeof(key), 1, file) == 1 &&
+             fwrite(&num_dependencies, sizeof(num_dependencies), 1, file) == 1;
+    for (int i = 0; ok && i < module->num_dependencies; i++) {
+        const ModuleImport* binding = &module->imports[i];
+        ok = write_string(file, module->dependency_paths[i]) &&
+             write_u32(file, binding->all) && write_u32(file, binding->num_names);
+        for (int j = 0; ok && j < binding->num_names; j++) {
+            ok = write_string(file, binding->names[j]);
+        }
+    }
+    ok = ok && write_u32(file, module->num_exports);
+    for (int i = 0; ok && i < module->num_exports; i++) {
+        const ModuleExport* export = &module->exports[i];
+        ok = write_string(file, export->name) && write_u32(file, (uint32_t)export->from) &&
+             write_u32(file, export->imported != NULL) &&
+             (!export->imported || write_string(file, export->imported));
     }
+    long offset = ok ? ftell(file) : -1;
+    ok = ok && offset > 0 && write_string(file, module->transformed_content);
+    ok = fclose(file) == 0 && ok;
     
-    // Tree shaking
-    shake_tree(&ctx);
+    if (ok && rename(temp, path) == 0) return offset;
+    unlink(temp);
+    return 0;
+}
+
+// Reads the output back from the module's cache entry; NULL if it's gone
+static char* cache_read_output(const BundleContext* ctx, const Module* module) {
+    char path[PATH_MAX];
+    cache_entry_path(ctx, cache_key(ctx, module), path, sizeof(path));
+    FILE* file = fopen(path, "rb");
+    if (!file) return NULL;
     
-    // Create bundle
-    create_bundle(&ctx);
+    struct stat st;
+    char* output = fstat(fileno(file), &st) == 0 && fseeko(file, module->output_offset, SEEK_SET) == 0
+        ? read_string(file, (uint64_t)st.st_size) : NULL;
+    fclose(file);
+    return output;
+}
+
+// Module graph
+//
+// Modules are built by a pool of workers as the graph is discovered. Building one reads
+// it, then takes its output and imports from the cache or extracts and transforms it.
+// Its imports are then linked under the context lock: each path seen for the first time
+// becomes a new module and a job for the pool. The build is done once no job is queued
+// or running. The order modules were discovered in depends on timing, so the bundle
+// orders them depth first from the entry instead. Modules are found by path and by id
+// through hash maps, which are rebuilt whenever the graph drops modules.
+
+static inline const char* module_key(const Module* module, int by_id) {
+    return by_id ? module->id : module->path;
+}
+
+static inline uint64_t key_hash(const char* key) {
+    return hash_bytes(HASH_SEED, key, strlen(key));
+}
+
+static Module* map_find(const ModuleMap* map, const char* key, int by_id) {
+    if (map->capacity == 0) return NULL;
+    uint64_t hash = key_hash(key);
+    for (size_t i = hash & (map->capacity - 1); map->slots[i]; i = (i + 1) & (map->capacity - 1)) {
+        if (map->hashes[i] == hash && strcmp(module_key(map->slots[i], by_id), key) == 0) {
+            return map->slots[i];
+        }
+    }
+    return NULL;
+}
+
+static void map_place(ModuleMap* map, Module* module, uint64_t hash) {
+    size_t i = hash & (map->capacity - 1);
+    while (map->slots[i]) i = (i + 1) & (map->capacity - 1);
+    map->hashes[i] = hash;
+    map->slots[i] = module;
+    map->count++;
+}
+
+// Module must not be in the map yet
+static void map_insert(ModuleMap* map, Module* module, int by_id) {
+    // Kept under half full so probes stay short
+    if ((map->count + 1) * 2 > map->capacity) {
+        ModuleMap grown = { .capacity = map->capacity ? map->capacity * 2 : 1024 };
+        grown.hashes = malloc(sizeof(uint64_t) * grown.capacity);
+        grown.slots = calloc(grown.capacity, sizeof(Module*));
+        for (size_t i = 0; i < map->capacity; i++) {
+            if (map->slots[i]) map_place(&grown, map->slots[i], map->hashes[i]);
+        }
+        free(map->hashes);
+        free(map->slots);
+        *map = grown;
+    }
+    map_place(map, module, key_hash(module_key(module, by_id)));
+}
+
+static void map_clear(ModuleMap* map) {
+    if (map->slots) memset(map->slots, 0, sizeof(Module*) * map->capacity);
+    map->count = 0;
+}
+
+static void map_free(ModuleMap* map) {
+    free(map->hashes);
+    free(map->slots);
+    memset(map, 0, sizeof(*map));
+}
+
+// Caller holds ctx->lock
+static void graph_index(BundleContext* ctx, Module* module) {
+    Module* other = map_find(&ctx->by_id, module->id, 1);
+    if (other) {
+        fprintf(stderr, "Warning: %s and %s share module id %s\n",
+                other->path, module->path, module->id);
+    } else {
+        map_insert(&ctx->by_id, module, 1);
+    }
+    map_insert(&ctx->by_path, module, 0);
+}
+
+// Caller holds ctx->lock
+static void graph_queue(BundleContext* ctx, Module* module) {
+    if (ctx->num_jobs == ctx->jobs_capacity) {
+        ctx->jobs_capacity = ctx->jobs_capacity ? ctx->jobs_capacity * 2 : 256;
+        ctx->jobs = realloc(ctx->jobs, sizeof(Module*) * ctx->jobs_capacity);
+    }
+    ctx->jobs[ctx->num_jobs++] = module;
+    pthread_cond_signal(&ctx->work);
+}
+
+// Module at path, added and queued for a build if it is new. Caller holds ctx->lock.
+static Module* graph_add(BundleContext* ctx, const char* path) {
+    Module* found = map_find(&ctx->by_path, path, 0);
+    if (found) return found;
     
-    // Write output
-    FILE* out = fopen(config->output, "w");
-    if (!out) {
-        fprintf(stderr, "Error: Cannot write output file: %s\n", config->output);
-        return 1;
+    if (ctx->num_modules == ctx->modules_capacity) {
+        ctx->modules_capacity = ctx->modules_capacity ? ctx->modules_capacity * 2 : 1024;
+        ctx->modules = realloc(ctx->modules, sizeof(Module*) * ctx->modules_capacity);
     }
+    Module* module = module_new(path);
+    ctx->modules[ctx->num_modules++] = module;
+    graph_index(ctx, module);
+    graph_queue(ctx, module);
+    return module;
+}
+
+// Points the module's dependencies at their modules. Caller holds ctx->lock.
+static void graph_link(BundleContext* ctx, Module* module) {
+    module->dependencies = realloc(module->dependencies,
+        sizeof(Module*) * (module->num_dependencies ? module->num_dependencies : 1));
+    for (int i = 0; i < module->num_dependencies; i++) {
+        module->dependencies[i] = graph_add(ctx, module->dependency_paths[i]);
+    }
+}
+
+// Reads and builds one module outside the lock; 0 on failure
+static int module_build(BundleContext* ctx, Module* module) {
+    EGHACT_PERF_SCOPE("bundler", "module");
+    uint64_t previous = module->hash;
+    if (!module_read(module)) {
+        fprintf(stderr, "Error: Cannot read module: %s\n", module->path);
+        return 0;
+    }
+    module->changed = module->hash != previous;
+    if (!module->built || module->changed || module->force) {
+        module_clear_build(module);
+        if (cache_load(ctx, module)) {
+            EGHACT_PERF_ADD(perf_cache_hits, 1);
+        } else {
+            EGHACT_PERF_ADD(perf_cache_misses, 1);
+            extract_dependencies(module);
+            transform_module(module, ctx);
+            if (!module->transformed_content) {
+                fprintf(stderr, "Error: Cannot transform module: %s\n", module->path);
+                return 0;
+            }
+            
+            // Emitting reads the output back from the entry
+            module->output_offset = cache_store(ctx, module);
+            if (module->output_offset) {
+                free(module->transformed_content);
+                module->transformed_content = NULL;
+            }
+        }
+        module->built = 1;
+    }
+    
+    // Of the content, the source map only needs the line count
+    const char* content = module->content;
+    module->source_lines = count_lines(content) - (ends_with(content, "\n") ? 1 : 0);
+    if (module->source_lines < 0) module->source_lines = 0;
+    free(module->content);
+    module->content = NULL;
+    return 1;
+}
+
+static void* bundle_worker(void* arg) {
+    BundleContext* ctx = arg;
+#ifdef EGHACT_PERF_ENABLED
+    eghact_perf_set_thread_name("bundler-worker");
+#endif
     
-    fprintf(out, "%s", ctx.output_code);
-    fclose(out);
+    pthread_mutex_lock(&ctx->lock);
+    for (;;) {
+        while (ctx->num_jobs == 0 && !ctx->stopping) {
+            pthread_cond_wait(&ctx->work, &ctx->lock);
+        }
+        if (ctx->num_jobs == 0) break;
+        
+        Module* module = ctx->jobs[--ctx->num_jobs];
+        ctx->running++;
+        pthread_mutex_unlock(&ctx->lock);
+        
+        int ok = module_build(ctx, module);
+        
+        pthread_mutex_lock(&ctx->lock);
+        module->force = 0;
+        ctx->rebuilt++;
+        if (ok) graph_link(ctx, module);
+        else ctx->failures++;
+        if (--ctx->running == 0 && ctx->num_jobs == 0) {
+            pthread_cond_broadcast(&ctx->idle);
+        }
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    return NULL;
+}
+
+static int pool_start(BundleContext* ctx) {
+    int jobs = ctx->config->jobs;
+    if (jobs <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = cpus > 0 ? (int)cpus : 1;
+    }
+    if (jobs > BUNDLER_MAX_WORKERS) jobs = BUNDLER_MAX_WORKERS;
     
-    // Write source map
+    pthread_mutex_init(&ctx->lock, NULL);
+    pthread_cond_init(&ctx->work, NULL);
+    pthread_cond_init(&ctx->idle, NULL);
+    for (int i = 0; i < jobs; i++) {
+        if (pthread_create(&ctx->workers[i], NULL, bundle_worker, ctx) != 0) break;
+        ctx->num_workers++;
+    }
+    return ctx->num_workers > 0;
+}
+
+static void pool_stop(BundleContext* ctx) {
+    pthread_mutex_lock(&ctx->lock);
+    ctx->stopping = 1;
+    pthread_cond_broadcast(&ctx->work);
+    pthread_mutex_unlock(&ctx->lock);
+    for (int i = 0; i < ctx->num_workers; i++) {
+        pthread_join(ctx->workers[i], NULL);
+    }
+    pthread_cond_destroy(&ctx->idle);
+    pthread_cond_destroy(&ctx->work);
+    pthread_mutex_destroy(&ctx->lock);
+}
+
+// Waits until every queued module and whatever it imports is built; returns how many
+// failed
+static int pool_wait(BundleContext* ctx) {
+    pthread_mutex_lock(&ctx->lock);
+    while (ctx->num_jobs > 0 || ctx->running > 0) {
+        pthread_cond_wait(&ctx->idle, &ctx->lock);
+    }
+    int failures = ctx->failures;
+    ctx->failures = 0;
+    pthread_mutex_unlock(&ctx->lock);
+    return failures;
+}
+
+static void module_destroy(Module* module) {
+    module_clear_build(module);
+    free_module(module);
+}
+
+// Orders the modules depth first from the entry, entry first, and frees any that
+// nothing imports anymore. Workers are idle.
+static void graph_order(BundleContext* ctx) {
+    for (int i = 0; i < ctx->num_modules; i++) {
+        ctx->modules[i]->processed = 0;
+    }
+    
+    Module** order = malloc(sizeof(Module*) * ctx->modules_capacity);
+    Module** stack = malloc(sizeof(Module*) * ctx->modules_capacity);
+    int count = 0, depth = 0;
+    stack[depth++] = ctx->entry;
+    ctx->entry->processed = 1;
+    while (depth > 0) {
+        Module* module = stack[--depth];
+        order[count++] = module;
+        
+        // Pushed in reverse so the first import comes out first
+        for (int i = module->num_dependencies - 1; i >= 0; i--) {
+            Module* dependency = module->dependencies[i];
+            if (!dependency->processed) {
+                dependency->processed = 1;
+                stack[depth++] = dependency;
+            }
+        }
+    }
+    free(stack);
+    
+    for (int i = 0; i < ctx->num_modules; i++) {
+        if (!ctx->modules[i]->processed) module_destroy(ctx->modules[i]);
+    }
+    free(ctx->modules);
+    ctx->modules = order;
+    if (count == ctx->num_modules) return;
+    
+    ctx->num_modules = count;
+    map_clear(&ctx->by_path);
+    map_clear(&ctx->by_id);
+    for (int i = 0; i < count; i++) {
+        graph_index(ctx, order[i]);
+    }
+}
+
+// Shakes, emits and writes the bundle from a completed graph
+static int bundle_write(BundleContext* ctx) {
+    BundleConfig* config = ctx->config;
+    graph_order(ctx);
+    
+    // Tree shaking
+    EGHACT_PERF_SPAN_BEGIN(shake_span, "bundler", "tree-shake");
+    shake_tree(ctx);
+    EGHACT_PERF_SPAN_END(shake_span);
+    
+    // Write output, and the source map alongside it
+    int fd = open(config->output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Cannot write output file: %s\n", config->output);
+        return 1;
+    }
+    char mapfile[PATH_MAX];
+    FILE* map = NULL;
     if (config->sourcemaps) {
-        char mapfile[PATH_MAX];
         snprintf(mapfile, sizeof(mapfile), "%s.map", config->output);
-        
-        char* sourcemap = generate_source_map(&ctx);
-        FILE* map = fopen(mapfile, "w");
-        fprintf(map, "%s", sourcemap);
-        fclose(map);
-        free(sourcemap);
+        map = fopen(mapfile, "w");
+        if (!map) fprintf(stderr, "Error: Cannot write source map: %s\n", mapfile);
+    }
+    int written = create_bundle(ctx, fd, map);
+    off_t size = lseek(fd, 0, SEEK_CUR);
+    if (map) {
+        int ok = !ferror(map);
+        if (fclose(map) != 0 || !ok) fprintf(stderr, "Error: Cannot write source map: %s\n", mapfile);
+    }
+    if (close(fd) != 0 || !written) {
+        fprintf(stderr, "Error: Cannot write output file: %s\n", config->output);
+        return 1;
     }
     
     // Print stats
+    printf("✓ Bundle created: %s (%ld KB)\n", config->output, (long)(size / 1024));
+    return 0;
+}
+
+// Watch mode
+//
+// The graph stays in memory between builds. Every BUNDLER_WATCH_INTERVAL_MS the watcher
+// stats each module, and one whose size or mtime moved is queued again. If its content
+// changed after all, it is rebuilt and so are the modules importing it; every other
+// module keeps its output. The bundle is then shaken and emitted again from the graph.
+
+static int module_stale(const Module* module) {
     struct stat st;
-    stat(config->output, &st);
-    printf("✓ Bundle created: %s (%ld KB)\n", config->output, st.st_size / 1024);
+    if (stat(module->path, &st) != 0) return module->size != -1;
+    return st.st_mtime != module->mtime || st.st_size != module->size;
+}
+
+static void bundle_watch(BundleContext* ctx) {
+    printf("Watching for changes...\n");
+    const struct timespec interval = {
+        BUNDLER_WATCH_INTERVAL_MS / 1000, (BUNDLER_WATCH_INTERVAL_MS % 1000) * 1000000L
+    };
+    
+    for (;;) {
+        nanosleep(&interval, NULL);
+        
+        pthread_mutex_lock(&ctx->lock);
+        ctx->rebuilt = 0;
+        int stale = 0;
+        for (int i = 0; i < ctx->num_modules; i++) {
+            Module* module = ctx->modules[i];
+            module->changed = 0;
+            if (module_stale(module)) {
+                graph_queue(ctx, module);
+                stale++;
+            }
+        }
+        pthread_mutex_unlock(&ctx->lock);
+        if (stale == 0) continue;
+        
+        EGHACT_PERF_SCOPE("bundler", "rebuild");
+        int failures = pool_wait(ctx);
+        
+        // Importers of what changed, found by scanning the edges
+        pthread_mutex_lock(&ctx->lock);
+        int changed = 0;
+        for (int i = 0; i < ctx->num_modules; i++) {
+            Module* module = ctx->modules[i];
+            for (int j = 0; j < module->num_dependencies; j++) {
+                if (module->dependencies[j]->changed && !module->force) {
+                    module->force = 1;
+                    graph_queue(ctx, module);
+                }
+            }
+            changed += module->changed;
+        }
+        pthread_mutex_unlock(&ctx->lock);
+        failures += pool_wait(ctx);
+        
+        if (changed == 0 && failures == 0) continue;
+        if (failures > 0) {
+            fprintf(stderr, "Error: %d module(s) failed; waiting for changes\n", failures);
+            continue;
+        }
+        printf("Rebuilt %d module(s)\n", ctx->rebuilt);
+        bundle_write(ctx);
+    }
+}
+
+// Main bundler function
+int eghact_bundle(BundleConfig* config) {
+    EGHACT_PERF_SCOPE("bundler", "bundle");
+    printf("Bundling %s...\n", config->entry);
+    
+    BundleContext ctx = {0};
+    ctx.config = config;
+    ctx.config_hash = config_hash(config);
+    if (config->cache_dir && mkdir(config->cache_dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Warning: Cannot create cache directory %s; building without it\n",
+                config->cache_dir);
+        config->cache_dir = NULL;
+    }
+    
+    struct stat st;
+    if (stat(config->entry, &st) != 0) {
+        fprintf(stderr, "Error: Cannot read entry file: %s\n", config->entry);
+        return 1;
+    }
+    if (!pool_start(&ctx)) {
+        fprintf(stderr, "Error: Cannot start worker threads\n");
+        return 1;
+    }
+    
+    // Build dependency graph, transforming modules as they are found
+    pthread_mutex_lock(&ctx.lock);
+    ctx.entry = graph_add(&ctx, config->entry);
+    pthread_mutex_unlock(&ctx.lock);
+    int result = pool_wait(&ctx) > 0 ? 1 : bundle_write(&ctx);
+    
+    if (config->watch) bundle_watch(&ctx);
     
     // Cleanup
+    pool_stop(&ctx);
     for (int i = 0; i < ctx.num_modules; i++) {
-        free_module(ctx.modules[i]);
+        module_destroy(ctx.modules[i]);
     }
     free(ctx.modules);
-    free(ctx.output_code);
+    map_free(&ctx.by_path);
+    map_free(&ctx.by_id);
+    free(ctx.jobs);
     
-    return 0;
+    return result;
 }
 
 // CLI entry point
@@ -442,8 +1589,16 @@ int main(int argc, char* argv[]) {
         printf("  --minify          Minify output\n");
         printf("  --sourcemaps      Generate source maps\n");
         printf("  --tree-shaking    Remove unused exports\n");
+        printf("  --pure-modules    With --tree-shaking, drop modules whose exports are unused\n");
         printf("  --target <env>    Target environment (browser/node)\n");
         printf("  --external <mod>  Mark module as external\n");
+        printf("  --jobs <n>        Worker threads (default: one per CPU)\n");
+        printf("  --cache-dir <dir> Transform cache (default: .eghact-cache)\n");
+        printf("  --no-cache        Build every module from scratch\n");
+        printf("  --watch           Rebuild changed modules until interrupted\n");
+#ifdef EGHACT_PERF_ENABLED
+        printf("  --trace <file>    Write a Chrome trace of the build phases\n");
+#endif
         return 0;
     }
     
@@ -451,6 +1606,8 @@ int main(int argc, char* argv[]) {
     config.entry = argv[1];
     config.output = argv[2];
     config.target = "browser";
+    config.cache_dir = ".eghact-cache";
+    const char* trace_file = NULL;
     
     // Parse options
     for (int i = 3; i < argc; i++) {
@@ -460,10 +1617,32 @@ int main(int argc, char* argv[]) {
             config.sourcemaps = 1;
         } else if (strcmp(argv[i], "--tree-shaking") == 0) {
             config.tree_shaking = 1;
+        } else if (strcmp(argv[i], "--pure-modules") == 0) {
+            config.pure_modules = 1;
         } else if (strcmp(argv[i], "--target") == 0 && i + 1 < argc) {
             config.target = argv[++i];
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            config.jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--cache-dir") == 0 && i + 1 < argc) {
+            config.cache_dir = argv[++i];
+        } else if (strcmp(argv[i], "--no-cache") == 0) {
+            config.cache_dir = NULL;
+        } else if (strcmp(argv[i], "--watch") == 0) {
+            config.watch = 1;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_file = argv[++i];
         }
     }
     
-    return eghact_bundle(&config);
+    int result = eghact_bundle(&config);
+    
+#ifdef EGHACT_PERF_ENABLED
+    if (trace_file && eghact_perf_write_trace(trace_file) != 0) {
+        fprintf(stderr, "Error: Cannot write trace file: %s\n", trace_file);
+    }
+#else
+    (void)trace_file;
+#endif
+    
+    return result;
 }
\ No newline at end of file
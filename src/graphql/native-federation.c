@@ -4,9 +4,29 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+#include <curl/curl.h>
+#include <json-c/json.h>
 #include "eghact-core.h"
 
+#define ARENA_BLOCK_SIZE 4096
+#define QUERY_CACHE_CAPACITY 1024     // Plans kept
+#define QUERY_CACHE_BUCKETS 2048      // Power of two
+#define QUERY_MAX_DEPTH 64            // Nesting allowed in a query
+#define QUERY_ERROR_SIZE 160
+#define QUERY_STACK_SIZE 4096         // Queries shorter than this normalize on the stack
+#define HASH_SEED 14695981039346656037ull  // FNV-1a offset basis
+#define FETCH_TIMEOUT_MS 10000
+#define FETCH_POLL_MS 1000
+// Entities are referenced by __typename and this field; schemas carry no @key
+#define ENTITY_KEY_FIELD "id"
+#define ENTITY_TYPENAME_ALIAS "_entityTypename"
+#define ENTITY_KEY_ALIAS "_entityKey"
+
 // GraphQL Type System
 typedef enum {
     GQL_SCALAR,
@@ -59,58 +79,217 @@ typedef struct {
     int num_owned_types;
 } FederatedService;
 
-typedef struct {
-    FederatedService** services;
-    int num_services;
-    GraphQLSchema* gateway_schema;
-} FederationGateway;
-
 // Query Parser
+//
+// Tokens are slices of the query text, so lexing allocates nothing. Commas, whitespace
+// and comments are insignificant in GraphQL and never become tokens.
 typedef enum {
     TOKEN_LBRACE,
     TOKEN_RBRACE,
     TOKEN_LPAREN,
     TOKEN_RPAREN,
+    TOKEN_LBRACKET,
+    TOKEN_RBRACKET,
     TOKEN_COLON,
-    TOKEN_COMMA,
+    TOKEN_EQUALS,
+    TOKEN_BANG,
+    TOKEN_DOLLAR,
+    TOKEN_AT,
+    TOKEN_SPREAD,
     TOKEN_IDENTIFIER,
-    TOKEN_STRING,
+    TOKEN_STRING,               // Quotes and escapes included, as written
     TOKEN_NUMBER,
+    TOKEN_ERROR,                // Text that isn't a token, or an unterminated string
     TOKEN_EOF
 } TokenType;
 
+typedef struct {
+    const char* data;
+    int length;
+} Slice;
+
 typedef struct {
     TokenType type;
-    char* value;
+    Slice text;
 } Token;
 
 typedef struct {
-    char* query;
+    const char* query;
     int position;
     int length;
 } Lexer;
 
-// AST Nodes
+// Bump allocator; everything in it is freed at once by arena_free
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t used;
+    size_t capacity;
+    _Alignas(max_align_t) char data[];
+} ArenaBlock;
+
+typedef struct {
+    ArenaBlock* head;
+} Arena;
+
+// AST Nodes, allocated in an arena; their slices point into the text that was parsed
+typedef struct ASTValue {
+    enum {
+        AST_VALUE_VARIABLE,
+        AST_VALUE_NUMBER,
+        AST_VALUE_STRING,
+        AST_VALUE_BOOLEAN,
+        AST_VALUE_NULL,
+        AST_VALUE_ENUM,
+        AST_VALUE_LIST,
+        AST_VALUE_OBJECT
+    } kind;
+    Slice text;                 // Variable name without $, or the literal as written
+    struct ASTValue** items;    // Lists
+    struct ASTArgument** fields;    // Objects
+    int num_items;
+} ASTValue;
+
+typedef struct ASTArgument {
+    Slice name;
+    Slice type;                 // Variable definitions only
+    ASTValue* value;            // Default value of a variable definition, or NULL
+} ASTArgument;
+
 typedef struct ASTNode {
     enum {
+        AST_DOCUMENT,
         AST_QUERY,
         AST_FIELD,
-        AST_ARGUMENT,
-        AST_FRAGMENT
+        AST_FRAGMENT,
+        AST_FRAGMENT_SPREAD,
+        AST_INLINE_FRAGMENT,
+        AST_DIRECTIVE
     } type;
-    char* name;
-    struct ASTNode** children;
+    Slice name;
+    Slice alias;                // Fields; empty without one
+    Slice operation;            // query, mutation or subscription
+    Slice type_condition;       // Fragments; empty on an inline fragment without one
+    struct ASTNode** children;  // Definitions of a document, or the selection set
     int num_children;
-    struct ASTArgument** arguments;
+    struct ASTArgument** arguments;     // Variable definitions of an operation
     int num_arguments;
+    struct ASTNode** directives;
+    int num_directives;
 } ASTNode;
 
+// Query execution
+typedef struct {
+    void* data;                 // json_object, owned by the result
+    char** errors;
+    int num_errors;
+} ExecutionResult;
+
+// Execution planning
+//
+// A plan is a DAG of steps. Root steps fetch the operation's top-level fields, one per
+// service. Entity steps fetch fields that another service adds to objects found at
+// path in their parent's results. Steps without unfinished dependencies run at once.
+typedef struct {
+    FederatedService* service;
+    char* type_name;            // Entity type; NULL for a root step
+    int any_type;               // type_name is abstract, so entities aren't filtered by it
+    char* text;                 // Root step: the operation. Entity step: {...on T{...}}
+    int* variables;             // Operation variables text uses
+    int num_variables;
+    char** path;                // Response keys from data to the entities
+    int path_length;
+    int parent;                 // Step whose results hold the entities; -1 for a root step
+    int* dependents;
+    int num_dependents;
+    int num_dependencies;       // Parent, or the previous mutation step
+} ExecutionStep;
+
+typedef struct {
+    ExecutionStep* steps;
+    int num_steps;
+    int capacity;
+    char** variable_definitions;    // $name:Type=default for each operation variable
+    int num_variables;
+    int has_entities;
+} ExecutionPlan;
+
+// Parsed queries and their plans, cached by the hash of their normalized text
+typedef struct CachedQuery {
+    uint64_t hash;
+    char* text;                 // Normalized query, in arena; the AST points into it
+    int length;
+    Arena arena;
+    ASTNode* ast;
+    ExecutionPlan* plan;
+    int refs;                   // Requests using it, guarded by the cache lock
+    int cached;                 // Reachable from the table
+    struct CachedQuery* bucket_next;
+    struct CachedQuery* lru_prev;   // Toward the most recently used
+    struct CachedQuery* lru_next;
+} CachedQuery;
+
+typedef struct {
+    pthread_mutex_t lock;
+    CachedQuery* buckets[QUERY_CACHE_BUCKETS];
+    CachedQuery* lru_head;
+    CachedQuery* lru_tail;
+    int count;
+    int capacity;               // 0 plans every request and frees it after
+} QueryCache;
+
+typedef struct {
+    FederatedService** services;
+    int num_services;
+    GraphQLSchema* gateway_schema;
+    QueryCache query_cache;
+    CURLSH* connections;        // Keep-alive connections shared by every fetch
+    pthread_mutex_t connection_locks[CURL_LOCK_DATA_LAST];
+} FederationGateway;
+
+ExecutionPlan* create_execution_plan(FederationGateway* gateway, ASTNode* ast, char* error);
+void free_execution_plan(ExecutionPlan* plan);
+void execute_plan(FederationGateway* gateway, const ExecutionPlan* plan, ExecutionResult* result,
+                  void* variables, void* context);
+void merge_schemas(FederationGateway* gateway);
+static void query_cache_init(QueryCache* cache);
+static void query_cache_clear(QueryCache* cache);
+
+static pthread_once_t curl_once = PTHREAD_ONCE_INIT;
+
+static void curl_init(void) {
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+}
+
+static void connection_lock(CURL* handle, curl_lock_data data, curl_lock_access access, void* user) {
+    (void)handle;
+    (void)access;
+    pthread_mutex_lock(&((FederationGateway*)user)->connection_locks[data]);
+}
+
+static void connection_unlock(CURL* handle, curl_lock_data data, void* user) {
+    (void)handle;
+    pthread_mutex_unlock(&((FederationGateway*)user)->connection_locks[data]);
+}
+
 // Create federation gateway
 FederationGateway* eghact_create_federation_gateway() {
     FederationGateway* gateway = malloc(sizeof(FederationGateway));
     gateway->services = NULL;
     gateway->num_services = 0;
     gateway->gateway_schema = malloc(sizeof(GraphQLSchema));
+    query_cache_init(&gateway->query_cache);
+    
+    // Connections and DNS lookups are shared by the fetches of every request
+    pthread_once(&curl_once, curl_init);
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        pthread_mutex_init(&gateway->connection_locks[i], NULL);
+    }
+    gateway->connections = curl_share_init();
+    curl_share_setopt(gateway->connections, CURLSHOPT_LOCKFUNC, connection_lock);
+    curl_share_setopt(gateway->connections, CURLSHOPT_UNLOCKFUNC, connection_unlock);
+    curl_share_setopt(gateway->connections, CURLSHOPT_USERDATA, gateway);
+    curl_share_setopt(gateway->connections, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    curl_share_setopt(gateway->connections, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
     return gateway;
 }
 
@@ -136,153 +315,1957 @@ int eghact_register_federated_service(FederationGateway* gateway,
     // Merge schemas
     merge_schemas(gateway);
     
+    // Plans made against the old schema may route fields to the wrong services
+    query_cache_clear(&gateway->query_cache);
+    
     return 0;
 }
 
-// Parse GraphQL query
-ASTNode* parse_graphql_query(const char* query) {
-    Lexer* lexer = create_lexer(query);
-    return parse_document(lexer);
+// Arena allocation
+static void* arena_alloc(Arena* arena, size_t size) {
+    size = (size + _Alignof(max_align_t) - 1) & ~(_Alignof(max_align_t) - 1);
+    ArenaBlock* block = arena->head;
+    if (!block || block->capacity - block->used < size) {
+        size_t capacity = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        block = malloc(sizeof(ArenaBlock) + capacity);
+        if (!block) return NULL;
+        block->next = arena->head;
+        block->used = 0;
+        block->capacity = capacity;
+        arena->head = block;
+    }
+    void* memory = block->data + block->used;
+    block->used += size;
+    return memory;
+}
+
+static void arena_free(Arena* arena) {
+    ArenaBlock* block = arena->head;
+    while (block) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->head = NULL;
+}
+
+// Array built up one item at a time in an arena; doubling when full leaves the old
+// copy behind, which is cheap next to allocating every node separately
+typedef struct {
+    void** items;
+    int count;
+    int capacity;
+} ArenaList;
+
+static int arena_list_push(Arena* arena, ArenaList* list, void* item) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 4;
+        void** items = arena_alloc(arena, sizeof(void*) * capacity);
+        if (!items) return 0;
+        if (list->count) memcpy(items, list->items, sizeof(void*) * list->count);
+        list->items = items;
+        list->capacity = capacity;
+    }
+    list->items[list->count++] = item;
+    return 1;
 }
 
 // Lexer implementation
-Lexer* create_lexer(const char* query) {
-    Lexer* lexer = malloc(sizeof(Lexer));
-    lexer->query = strdup(query);
-    lexer->position = 0;
-    lexer->length = strlen(query);
+Lexer create_lexer(const char* query, int length) {
+    Lexer lexer = { .query = query, .position = 0, .length = length };
     return lexer;
 }
 
-Token* next_token(Lexer* lexer) {
-    // Skip whitespace
-    while (lexer->position < lexer->length && 
-           isspace(lexer->query[lexer->position])) {
-        lexer->position++;
+static inline int is_name_start(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static inline int is_name_char(char c) {
+    return is_name_start(c) || (c >= '0' && c <= '9');
+}
+
+static inline int is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// End of the string starting at position, or -1 if it isn't terminated
+static int lex_string(const char* query, int position, int length) {
+    if (length - position >= 3 && query[position + 1] == '"' && query[position + 2] == '"') {
+        // Block string; only \""" is escaped inside one
+        for (int i = position + 3; i + 2 < length; i++) {
+            if (query[i] == '\\' && i + 3 < length && !strncmp(query + i + 1, "\"\"\"", 3)) {
+                i += 3;
+            } else if (!strncmp(query + i, "\"\"\"", 3)) {
+                return i + 3;
+            }
+        }
+        return -1;
+    }
+    for (int i = position + 1; i < length; i++) {
+        char c = query[i];
+        if (c == '"') return i + 1;
+        if (c == '\n' || c == '\r') return -1;
+        if (c == '\\') i++;
+    }
+    return -1;
+}
+
+// End of the number starting at position, or -1 if it is malformed
+static int lex_number(const char* query, int position, int length) {
+    int i = position;
+    if (query[i] == '-') i++;
+    if (i >= length || !is_digit(query[i])) return -1;
+    while (i < length && is_digit(query[i])) i++;
+    if (i < length && query[i] == '.') {
+        if (++i >= length || !is_digit(query[i])) return -1;
+        while (i < length && is_digit(query[i])) i++;
     }
+    if (i < length && (query[i] == 'e' || query[i] == 'E')) {
+        i++;
+        if (i < length && (query[i] == '+' || query[i] == '-')) i++;
+        if (i >= length || !is_digit(query[i])) return -1;
+        while (i < length && is_digit(query[i])) i++;
+    }
+    // 1a or 1.5.3 are errors, not two tokens
+    if (i < length && (is_name_start(query[i]) || query[i] == '.')) return -1;
+    return i;
+}
+
+Token next_token(Lexer* lexer) {
+    const char* query = lexer->query;
+    int length = lexer->length;
+    int position = lexer->position;
     
-    if (lexer->position >= lexer->length) {
-        Token* token = malloc(sizeof(Token));
-        token->type = TOKEN_EOF;
-        token->value = NULL;
-        return token;
+    // Skip whitespace, commas, comments and byte order marks
+    while (position < length) {
+        unsigned char c = (unsigned char)query[position];
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == ',') {
+            position++;
+        } else if (c == '#') {
+            while (position < length && query[position] != '\n' && query[position] != '\r') {
+                position++;
+            }
+        } else if (c == 0xEF && length - position >= 3 &&
+                   (unsigned char)query[position + 1] == 0xBB &&
+                   (unsigned char)query[position + 2] == 0xBF) {
+            position += 3;
+        } else {
+            break;
+        }
     }
     
-    Token* token = malloc(sizeof(Token));
-    char c = lexer->query[lexer->position];
+    Token token = { .type = TOKEN_EOF, .text = { query + position, 0 } };
+    if (position >= length) {
+        lexer->position = position;
+        return token;
+    }
     
-    switch (c) {
-        case '{':
-            token->type = TOKEN_LBRACE;
-            token->value = strdup("{");
-            lexer->position++;
+    int end = position + 1;
+    switch (query[position]) {
+        case '{': token.type = TOKEN_LBRACE; break;
+        case '}': token.type = TOKEN_RBRACE; break;
+        case '(': token.type = TOKEN_LPAREN; break;
+        case ')': token.type = TOKEN_RPAREN; break;
+        case '[': token.type = TOKEN_LBRACKET; break;
+        case ']': token.type = TOKEN_RBRACKET; break;
+        case ':': token.type = TOKEN_COLON; break;
+        case '=': token.type = TOKEN_EQUALS; break;
+        case '!': token.type = TOKEN_BANG; break;
+        case '$': token.type = TOKEN_DOLLAR; break;
+        case '@': token.type = TOKEN_AT; break;
+        case '.':
+            if (length - position >= 3 && query[position + 1] == '.' && query[position + 2] == '.') {
+                token.type = TOKEN_SPREAD;
+                end = position + 3;
+            } else {
+                token.type = TOKEN_ERROR;
+            }
             break;
-        case '}':
-            token->type = TOKEN_RBRACE;
-            token->value = strdup("}");
-            lexer->position++;
+        case '"':
+            end = lex_string(query, position, length);
+            token.type = end < 0 ? TOKEN_ERROR : TOKEN_STRING;
             break;
-        case '(':
-            token->type = TOKEN_LPAREN;
-            token->value = strdup("(");
-            lexer->position++;
+        default:
+            if (is_name_start(query[position])) {
+                while (end < length && is_name_char(query[end])) end++;
+                token.type = TOKEN_IDENTIFIER;
+            } else if (is_digit(query[position]) || query[position] == '-') {
+                end = lex_number(query, position, length);
+                token.type = end < 0 ? TOKEN_ERROR : TOKEN_NUMBER;
+            } else {
+                token.type = TOKEN_ERROR;
+            }
             break;
-        case ')':
-            token->type = TOKEN_RPAREN;
-            token->value = strdup(")");
-            lexer->position++;
+    }
+    if (token.type == TOKEN_ERROR) end = position + 1;
+    
+    token.text.length = end - position;
+    lexer->position = end;
+    return token;
+}
+
+// Normalization
+//
+// A query's normalized form is its tokens with nothing between them, except a space
+// where two would otherwise lex as one. Queries differing only in layout, commas and
+// comments normalize alike and share a cache entry. Separators were needed in the
+// original wherever one is put back, so the normalized text is never longer.
+
+static int tokens_need_space(TokenType prev, TokenType next) {
+    int prev_word = prev == TOKEN_IDENTIFIER || prev == TOKEN_NUMBER;
+    int next_word = next == TOKEN_IDENTIFIER || next == TOKEN_NUMBER;
+    return (prev_word && next_word) ||
+           (prev == TOKEN_STRING && next == TOKEN_STRING) ||   // "" "a" is not """a"
+           (prev == TOKEN_NUMBER && next == TOKEN_SPREAD);
+}
+
+// Writes the normalized query to out, which has room for length + 1 bytes, and returns
+// its length; -1 with a message in error if the query doesn't lex
+static int query_normalize(const char* query, int length, char* out, char* error) {
+    Lexer lexer = create_lexer(query, length);
+    TokenType prev = TOKEN_EOF;
+    int written = 0;
+    for (Token token = next_token(&lexer); token.type != TOKEN_EOF; token = next_token(&lexer)) {
+        if (token.type == TOKEN_ERROR) {
+            snprintf(error, QUERY_ERROR_SIZE, "Syntax Error: Unexpected character at offset %d",
+                     (int)(token.text.data - query));
+            return -1;
+        }
+        if (tokens_need_space(prev, token.type)) out[written++] = ' ';
+        memcpy(out + written, token.text.data, token.text.length);
+        written += token.text.length;
+        prev = token.type;
+    }
+    out[written] = '\0';
+    return written;
+}
+
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t len) {
+    const unsigned char* bytes = data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Parser
+//
+// Recursive descent over the executable part of the grammar: operations, fragments,
+// selections, arguments, values, variable definitions and directives. Nothing is
+// copied; every node and list comes from the parser's arena.
+
+typedef struct {
+    Lexer lexer;
+    Token token;                // Current
+    const char* last_end;       // End of the token before it
+    Arena* arena;
+    int depth;
+    int failed;
+    char* error;                // QUERY_ERROR_SIZE bytes for the first error
+} Parser;
+
+static void parser_advance(Parser* parser) {
+    parser->last_end = parser->token.text.data + parser->token.text.length;
+    parser->token = next_token(&parser->lexer);
+}
+
+static void* parser_fail(Parser* parser, const char* expected) {
+    if (!parser->failed) {
+        parser->failed = 1;
+        if (parser->token.type == TOKEN_EOF) {
+            snprintf(parser->error, QUERY_ERROR_SIZE, "Syntax Error: Expected %s, found <EOF>",
+                     expected);
+        } else {
+            snprintf(parser->error, QUERY_ERROR_SIZE, "Syntax Error: Expected %s, found \"%.*s\"",
+                     expected, parser->token.text.length > 32 ? 32 : parser->token.text.length,
+                     parser->token.text.data);
+        }
+    }
+    return NULL;
+}
+
+static void* parser_out_of_memory(Parser* parser) {
+    if (!parser->failed) {
+        parser->failed = 1;
+        snprintf(parser->error, QUERY_ERROR_SIZE, "Out of memory parsing query");
+    }
+    return NULL;
+}
+
+static inline int parser_at_keyword(const Parser* parser, const char* keyword) {
+    size_t length = strlen(keyword);
+    return parser->token.type == TOKEN_IDENTIFIER &&
+           (size_t)parser->token.text.length == length &&
+           !memcmp(parser->token.text.data, keyword, length);
+}
+
+// Takes the current token if it has type
+static inline int parser_accept(Parser* parser, TokenType type) {
+    if (parser->token.type != type) return 0;
+    parser_advance(parser);
+    return 1;
+}
+
+static int parser_name(Parser* parser, Slice* name) {
+    if (parser->token.type != TOKEN_IDENTIFIER) return parser_fail(parser, "Name"), 0;
+    *name = parser->token.text;
+    parser_advance(parser);
+    return 1;
+}
+
+static ASTNode* parser_node(Parser* parser, int type) {
+    ASTNode* node = arena_alloc(parser->arena, sizeof(ASTNode));
+    if (!node) return parser_out_of_memory(parser);
+    *node = (ASTNode){ .type = type };
+    return node;
+}
+
+static int parser_enter(Parser* parser) {
+    if (++parser->depth > QUERY_MAX_DEPTH) {
+        if (!parser->failed) {
+            parser->failed = 1;
+            snprintf(parser->error, QUERY_ERROR_SIZE, "Query nested deeper than %d levels",
+                     QUERY_MAX_DEPTH);
+        }
+        return 0;
+    }
+    return 1;
+}
+
+static ASTValue* parse_value(Parser* parser, int is_const);
+static int parse_selection_set(Parser* parser, ASTNode* parent);
+
+// (name: value ...) into arguments; nothing if there is no (
+static int parse_arguments(Parser* parser, ASTArgument*** arguments, int* count, int is_const) {
+    if (!parser_accept(parser, TOKEN_LPAREN)) return 1;
+    ArenaList list = {0};
+    do {
+        ASTArgument* argument = arena_alloc(parser->arena, sizeof(ASTArgument));
+        if (!argument) return parser_out_of_memory(parser), 0;
+        *argument = (ASTArgument){0};
+        if (!parser_name(parser, &argument->name)) return 0;
+        if (!parser_accept(parser, TOKEN_COLON)) return parser_fail(parser, "\":\""), 0;
+        if (!(argument->value = parse_value(parser, is_const))) return 0;
+        if (!arena_list_push(parser->arena, &list, argument)) return parser_out_of_memory(parser), 0;
+    } while (!parser_accept(parser, TOKEN_RPAREN));
+    *arguments = (ASTArgument**)list.items;
+    *count = list.count;
+    return 1;
+}
+
+static ASTValue* parse_value(Parser* parser, int is_const) {
+    if (!parser_enter(parser)) return NULL;
+    ASTValue* value = arena_alloc(parser->arena, sizeof(ASTValue));
+    if (!value) return parser_out_of_memory(parser);
+    *value = (ASTValue){ .text = parser->token.text };
+    
+    switch (parser->token.type) {
+        case TOKEN_DOLLAR:
+            if (is_const) return parser_fail(parser, "constant value");
+            parser_advance(parser);
+            value->kind = AST_VALUE_VARIABLE;
+            if (!parser_name(parser, &value->text)) return NULL;
             break;
-        case ':':
-            token->type = TOKEN_COLON;
-            token->value = strdup(":");
-            lexer->position++;
+        case TOKEN_NUMBER:
+            value->kind = AST_VALUE_NUMBER;
+            parser_advance(parser);
             break;
-        case ',':
-            token->type = TOKEN_COMMA;
-            token->value = strdup(",");
-            lexer->position++;
+        case TOKEN_STRING:
+            value->kind = AST_VALUE_STRING;
+            parser_advance(parser);
             break;
-        case '"':
-            // Parse string
-            token->type = TOKEN_STRING;
-            token->value = parse_string(lexer);
+        case TOKEN_IDENTIFIER:
+            value->kind = parser_at_keyword(parser, "true") || parser_at_keyword(parser, "false")
+                        ? AST_VALUE_BOOLEAN
+                        : parser_at_keyword(parser, "null") ? AST_VALUE_NULL : AST_VALUE_ENUM;
+            parser_advance(parser);
             break;
-        default:
-            if (isalpha(c) || c == '_') {
-                // Parse identifier
-                token->type = TOKEN_IDENTIFIER;
-                token->value = parse_identifier(lexer);
-            } else if (isdigit(c)) {
-                // Parse number
-                token->type = TOKEN_NUMBER;
-                token->value = parse_number(lexer);
+        case TOKEN_LBRACKET: {
+            parser_advance(parser);
+            value->kind = AST_VALUE_LIST;
+            ArenaList items = {0};
+            while (!parser_accept(parser, TOKEN_RBRACKET)) {
+                ASTValue* item = parse_value(parser, is_const);
+                if (!item) return NULL;
+                if (!arena_list_push(parser->arena, &items, item)) return parser_out_of_memory(parser);
             }
+            value->items = (ASTValue**)items.items;
+            value->num_items = items.count;
             break;
+        }
+        case TOKEN_LBRACE: {
+            parser_advance(parser);
+            value->kind = AST_VALUE_OBJECT;
+            ArenaList fields = {0};
+            while (!parser_accept(parser, TOKEN_RBRACE)) {
+                ASTArgument* field = arena_alloc(parser->arena, sizeof(ASTArgument));
+                if (!field) return parser_out_of_memory(parser);
+                *field = (ASTArgument){0};
+                if (!parser_name(parser, &field->name)) return NULL;
+                if (!parser_accept(parser, TOKEN_COLON)) return parser_fail(parser, "\":\"");
+                if (!(field->value = parse_value(parser, is_const))) return NULL;
+                if (!arena_list_push(parser->arena, &fields, field)) return parser_out_of_memory(parser);
+            }
+            value->fields = (ASTArgument**)fields.items;
+            value->num_items = fields.count;
+            break;
+        }
+        default:
+            return parser_fail(parser, "value");
     }
     
-    return token;
+    value->text.length = (int)(parser->last_end - value->text.data);
+    parser->depth--;
+    return value;
+}
+
+static int parse_directives(Parser* parser, ASTNode* node) {
+    ArenaList list = {0};
+    while (parser_accept(parser, TOKEN_AT)) {
+        ASTNode* directive = parser_node(parser, AST_DIRECTIVE);
+        if (!directive || !parser_name(parser, &directive->name)) return 0;
+        if (!parse_arguments(parser, &directive->arguments, &directive->num_arguments, 0)) return 0;
+        if (!arena_list_push(parser->arena, &list, directive)) return parser_out_of_memory(parser), 0;
+    }
+    node->directives = (ASTNode**)list.items;
+    node->num_directives = list.count;
+    return 1;
+}
+
+// Name, [Type] or either followed by !
+static int parse_type(Parser* parser, Slice* type) {
+    if (!parser_enter(parser)) return 0;
+    const char* start = parser->token.text.data;
+    if (parser_accept(parser, TOKEN_LBRACKET)) {
+        Slice inner;
+        if (!parse_type(parser, &inner)) return 0;
+        if (!parser_accept(parser, TOKEN_RBRACKET)) return parser_fail(parser, "\"]\""), 0;
+    } else {
+        Slice name;
+        if (!parser_name(parser, &name)) return 0;
+    }
+    parser_accept(parser, TOKEN_BANG);
+    *type = (Slice){ start, (int)(parser->last_end - start) };
+    parser->depth--;
+    return 1;
+}
+
+static int parse_variable_definitions(Parser* parser, ASTNode* operation) {
+    if (!parser_accept(parser, TOKEN_LPAREN)) return 1;
+    ArenaList list = {0};
+    do {
+        ASTArgument* variable = arena_alloc(parser->arena, sizeof(ASTArgument));
+        if (!variable) return parser_out_of_memory(parser), 0;
+        *variable = (ASTArgument){0};
+        if (!parser_accept(parser, TOKEN_DOLLAR)) return parser_fail(parser, "\"$\""), 0;
+        if (!parser_name(parser, &variable->name)) return 0;
+        if (!parser_accept(parser, TOKEN_COLON)) return parser_fail(parser, "\":\""), 0;
+        if (!parse_type(parser, &variable->type)) return 0;
+        if (parser_accept(parser, TOKEN_EQUALS) && !(variable->value = parse_value(parser, 1))) {
+            return 0;
+        }
+        ASTNode ignored;        // Directives on variables aren't kept
+        if (!parse_directives(parser, &ignored)) return 0;
+        if (!arena_list_push(parser->arena, &list, variable)) return parser_out_of_memory(parser), 0;
+    } while (!parser_accept(parser, TOKEN_RPAREN));
+    operation->arguments = (ASTArgument**)list.items;
+    operation->num_arguments = list.count;
+    return 1;
+}
+
+static ASTNode* parse_selection(Parser* parser) {
+    if (parser_accept(parser, TOKEN_SPREAD)) {
+        if (parser->token.type == TOKEN_IDENTIFIER && !parser_at_keyword(parser, "on")) {
+            ASTNode* spread = parser_node(parser, AST_FRAGMENT_SPREAD);
+            if (!spread || !parser_name(parser, &spread->name)) return NULL;
+            return parse_directives(parser, spread) ? spread : NULL;
+        }
+        ASTNode* fragment = parser_node(parser, AST_INLINE_FRAGMENT);
+        if (!fragment) return NULL;
+        if (parser_at_keyword(parser, "on")) {
+            parser_advance(parser);
+            if (!parser_name(parser, &fragment->type_condition)) return NULL;
+        }
+        if (!parse_directives(parser, fragment) || !parse_selection_set(parser, fragment)) return NULL;
+        return fragment;
+    }
+    
+    ASTNode* field = parser_node(parser, AST_FIELD);
+    if (!field || !parser_name(parser, &field->name)) return NULL;
+    if (parser_accept(parser, TOKEN_COLON)) {
+        field->alias = field->name;
+        if (!parser_name(parser, &field->name)) return NULL;
+    }
+    if (!parse_arguments(parser, &field->arguments, &field->num_arguments, 0) ||
+        !parse_directives(parser, field)) {
+        return NULL;
+    }
+    if (parser->token.type == TOKEN_LBRACE && !parse_selection_set(parser, field)) return NULL;
+    return field;
+}
+
+// { selection ... } into the children of parent
+static int parse_selection_set(Parser* parser, ASTNode* parent) {
+    if (!parser_enter(parser)) return 0;
+    if (!parser_accept(parser, TOKEN_LBRACE)) return parser_fail(parser, "\"{\""), 0;
+    ArenaList list = {0};
+    do {
+        ASTNode* selection = parse_selection(parser);
+        if (!selection) return 0;
+        if (!arena_list_push(parser->arena, &list, selection)) return parser_out_of_memory(parser), 0;
+    } while (!parser_accept(parser, TOKEN_RBRACE));
+    parent->children = (ASTNode**)list.items;
+    parent->num_children = list.count;
+    parser->depth--;
+    return 1;
+}
+
+static ASTNode* parse_definition(Parser* parser) {
+    if (parser_at_keyword(parser, "fragment")) {
+        parser_advance(parser);
+        ASTNode* fragment = parser_node(parser, AST_FRAGMENT);
+        if (!fragment) return NULL;
+        if (parser_at_keyword(parser, "on")) return parser_fail(parser, "fragment name");
+        if (!parser_name(parser, &fragment->name)) return NULL;
+        if (!parser_at_keyword(parser, "on")) return parser_fail(parser, "\"on\"");
+        parser_advance(parser);
+        if (!parser_name(parser, &fragment->type_condition) ||
+            !parse_directives(parser, fragment) || !parse_selection_set(parser, fragment)) {
+            return NULL;
+        }
+        return fragment;
+    }
+    
+    ASTNode* operation = parser_node(parser, AST_QUERY);
+    if (!operation) return NULL;
+    if (parser->token.type == TOKEN_LBRACE) {
+        operation->operation = (Slice){ "query", 5 };   // Shorthand
+    } else if (parser_at_keyword(parser, "query") || parser_at_keyword(parser, "mutation") ||
+               parser_at_keyword(parser, "subscription")) {
+        operation->operation = parser->token.text;
+        parser_advance(parser);
+        if (parser->token.type == TOKEN_IDENTIFIER) parser_name(parser, &operation->name);
+        if (!parse_variable_definitions(parser, operation) || !parse_directives(parser, operation)) {
+            return NULL;
+        }
+    } else {
+        return parser_fail(parser, "definition");
+    }
+    return parse_selection_set(parser, operation) ? operation : NULL;
+}
+
+static ASTNode* parse_document(Parser* parser) {
+    ASTNode* document = parser_node(parser, AST_DOCUMENT);
+    if (!document) return NULL;
+    ArenaList list = {0};
+    do {
+        ASTNode* definition = parse_definition(parser);
+        if (!definition) return NULL;
+        if (!arena_list_push(parser->arena, &list, definition)) return parser_out_of_memory(parser);
+    } while (parser->token.type != TOKEN_EOF);
+    document->children = (ASTNode**)list.items;
+    document->num_children = list.count;
+    return document;
+}
+
+// Parse GraphQL query. The AST lives in arena and points into query, which must outlive
+// it; NULL with a message in error if the query is invalid.
+ASTNode* parse_graphql_query(Arena* arena, const char* query, int length, char* error) {
+    Parser parser = {
+        .lexer = create_lexer(query, length),
+        .arena = arena,
+        .error = error,
+    };
+    parser.token = next_token(&parser.lexer);
+    if (parser.token.type == TOKEN_ERROR) return parser_fail(&parser, "token");
+    return parse_document(&parser);
+}
+
+// Query cache
+//
+// Requests look their query up by normalized text and run the plan they find, so a
+// repeated query is lexed once and neither parsed nor planned again. An entry owns one
+// arena holding its text and AST. Entries are counted while requests use them, and an
+// entry pushed out by the LRU limit or a schema change is freed by the last request to
+// let go of it. execute_plan only reads a plan, so requests share it freely.
+//
+// Persisted queries are looked up by the hash alone, which clients get from
+// eghact_query_hash, and only find queries already in the cache.
+
+static void query_cache_init(QueryCache* cache) {
+    pthread_mutex_init(&cache->lock, NULL);
+    memset(cache->buckets, 0, sizeof(cache->buckets));
+    cache->lru_head = NULL;
+    cache->lru_tail = NULL;
+    cache->count = 0;
+    cache->capacity = QUERY_CACHE_CAPACITY;
+}
+
+static void cached_query_free(CachedQuery* entry) {
+    if (entry->plan) free_execution_plan(entry->plan);
+    arena_free(&entry->arena);
+    free(entry);
+}
+
+static void lru_unlink(QueryCache* cache, CachedQuery* entry) {
+    if (entry->lru_prev) entry->lru_prev->lru_next = entry->lru_next;
+    else cache->lru_head = entry->lru_next;
+    if (entry->lru_next) entry->lru_next->lru_prev = entry->lru_prev;
+    else cache->lru_tail = entry->lru_prev;
+}
+
+static void lru_push_front(QueryCache* cache, CachedQuery* entry) {
+    entry->lru_prev = NULL;
+    entry->lru_next = cache->lru_head;
+    if (cache->lru_head) cache->lru_head->lru_prev = entry;
+    else cache->lru_tail = entry;
+    cache->lru_head = entry;
+}
+
+// Takes entry out of the table; true if nobody holds it. Caller holds the lock.
+static int query_cache_remove(QueryCache* cache, CachedQuery* entry) {
+    CachedQuery** link = &cache->buckets[entry->hash & (QUERY_CACHE_BUCKETS - 1)];
+    while (*link != entry) link = &(*link)->bucket_next;
+    *link = entry->bucket_next;
+    lru_unlink(cache, entry);
+    entry->cached = 0;
+    cache->count--;
+    return entry->refs == 0;
+}
+
+// Entry for hash, and for text too unless it is NULL, held for the caller. Caller holds
+// the lock.
+static CachedQuery* query_cache_find(QueryCache* cache, uint64_t hash, const char* text, int length) {
+    CachedQuery* entry = cache->buckets[hash & (QUERY_CACHE_BUCKETS - 1)];
+    for (; entry; entry = entry->bucket_next) {
+        if (entry->hash == hash &&
+            (!text || (entry->length == length && !memcmp(entry->text, text, length)))) {
+            break;
+        }
+    }
+    if (entry) {
+        entry->refs++;
+        lru_unlink(cache, entry);
+        lru_push_front(cache, entry);
+    }
+    return entry;
+}
+
+// Adds entry, already held by the caller, unless the cache is off, evicting the least
+// recently used past capacity; returns an entry for the same query added meanwhile
+// instead if there is one.
+static CachedQuery* query_cache_insert(QueryCache* cache, CachedQuery* entry) {
+    CachedQuery* evicted = NULL;
+    pthread_mutex_lock(&cache->lock);
+    CachedQuery* existing = query_cache_find(cache, entry->hash, entry->text, entry->length);
+    if (!existing && cache->capacity > 0) {
+        CachedQuery** bucket = &cache->buckets[entry->hash & (QUERY_CACHE_BUCKETS - 1)];
+        entry->bucket_next = *bucket;
+        *bucket = entry;
+        lru_push_front(cache, entry);
+        entry->cached = 1;
+        cache->count++;
+        while (cache->count > cache->capacity) {
+            CachedQuery* oldest = cache->lru_tail;
+            if (query_cache_remove(cache, oldest)) {
+                oldest->bucket_next = evicted;
+                evicted = oldest;
+            }
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+    
+    while (evicted) {
+        CachedQuery* next = evicted->bucket_next;
+        cached_query_free(evicted);
+        evicted = next;
+    }
+    if (existing) {
+        cached_query_free(entry);
+        return existing;
+    }
+    return entry;
+}
+
+static void query_cache_release(QueryCache* cache, CachedQuery* entry) {
+    pthread_mutex_lock(&cache->lock);
+    int unused = --entry->refs == 0 && !entry->cached;
+    pthread_mutex_unlock(&cache->lock);
+    if (unused) cached_query_free(entry);
+}
+
+// Drops every entry; those in use are freed when released
+static void query_cache_clear(QueryCache* cache) {
+    CachedQuery* unused = NULL;
+    pthread_mutex_lock(&cache->lock);
+    while (cache->lru_head) {
+        CachedQuery* entry = cache->lru_head;
+        if (query_cache_remove(cache, entry)) {
+            entry->bucket_next = unused;
+            unused = entry;
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+    
+    while (unused) {
+        CachedQuery* next = unused->bucket_next;
+        cached_query_free(unused);
+        unused = next;
+    }
+}
+
+// Parses and plans the normalized query text into a new entry held by the caller
+static CachedQuery* cached_query_build(FederationGateway* gateway, uint64_t hash,
+                                       const char* text, int length, char* error) {
+    CachedQuery* entry = calloc(1, sizeof(CachedQuery));
+    if (!entry) {
+        snprintf(error, QUERY_ERROR_SIZE, "Out of memory parsing query");
+        return NULL;
+    }
+    entry->hash = hash;
+    entry->length = length;
+    entry->refs = 1;
+    entry->text = arena_alloc(&entry->arena, (size_t)length + 1);
+    if (entry->text) {
+        memcpy(entry->text, text, (size_t)length + 1);
+        entry->ast = parse_graphql_query(&entry->arena, entry->text, length, error);
+    } else {
+        snprintf(error, QUERY_ERROR_SIZE, "Out of memory parsing query");
+    }
+    if (!entry->ast) {
+        cached_query_free(entry);
+        return NULL;
+    }
+    entry->plan = create_execution_plan(gateway, entry->ast, error);
+    if (!entry->plan) {
+        cached_query_free(entry);
+        return NULL;
+    }
+    return entry;
+}
+
+// Entry for query held for the caller, parsed and planned now if it isn't cached; NULL
+// with a message in error if the query is invalid
+static CachedQuery* query_cache_acquire(FederationGateway* gateway, const char* query, char* error) {
+    size_t query_length = strlen(query);
+    if (query_length >= INT_MAX) {
+        snprintf(error, QUERY_ERROR_SIZE, "Query too long");
+        return NULL;
+    }
+    int length = (int)query_length;
+    char stack[QUERY_STACK_SIZE];
+    char* text = length < QUERY_STACK_SIZE ? stack : malloc((size_t)length + 1);
+    if (!text) {
+        snprintf(error, QUERY_ERROR_SIZE, "Out of memory parsing query");
+        return NULL;
+    }
+    
+    CachedQuery* entry = NULL;
+    int normalized = query_normalize(query, length, text, error);
+    if (normalized >= 0) {
+        uint64_t hash = hash_bytes(HASH_SEED, text, (size_t)normalized);
+        QueryCache* cache = &gateway->query_cache;
+        pthread_mutex_lock(&cache->lock);
+        entry = query_cache_find(cache, hash, text, normalized);
+        pthread_mutex_unlock(&cache->lock);
+        if (!entry) {
+            entry = cached_query_build(gateway, hash, text, normalized, error);
+            if (entry) entry = query_cache_insert(cache, entry);
+        }
+    }
+    
+    if (text != stack) free(text);
+    return entry;
+}
+
+// Hash a client sends in place of query to eghact_execute_persisted_query; 0 if the
+// query doesn't lex
+uint64_t eghact_query_hash(const char* query) {
+    size_t length = strlen(query);
+    char error[QUERY_ERROR_SIZE];
+    char* text = length < INT_MAX ? malloc(length + 1) : NULL;
+    if (!text) return 0;
+    int normalized = query_normalize(query, (int)length, text, error);
+    uint64_t hash = normalized < 0 ? 0 : hash_bytes(HASH_SEED, text, (size_t)normalized);
+    free(text);
+    return hash;
+}
+
+// Sets how many plans are kept; 0 turns the cache off
+void eghact_set_query_cache_capacity(FederationGateway* gateway, int capacity) {
+    QueryCache* cache = &gateway->query_cache;
+    pthread_mutex_lock(&cache->lock);
+    cache->capacity = capacity < 0 ? 0 : capacity;
+    pthread_mutex_unlock(&cache->lock);
+    if (capacity <= 0) query_cache_clear(cache);
 }
 
 // Query execution
-typedef struct {
-    void* data;
-    char** errors;
-    int num_errors;
-} ExecutionResult;
+static ExecutionResult* execution_result_create(void) {
+    ExecutionResult* result = malloc(sizeof(ExecutionResult));
+    result->data = NULL;
+    result->errors = NULL;
+    result->num_errors = 0;
+    return result;
+}
+
+static void execution_result_add_error(ExecutionResult* result, const char* message) {
+    char** errors = realloc(result->errors, sizeof(char*) * (result->num_errors + 1));
+    if (!errors) return;
+    result->errors = errors;
+    result->errors[result->num_errors++] = strdup(message);
+}
 
 ExecutionResult* eghact_execute_federated_query(FederationGateway* gateway,
                                                 const char* query,
                                                 void* variables,
                                                 void* context) {
-    // Parse query
-    ASTNode* ast = parse_graphql_query(query);
+    ExecutionResult* result = execution_result_create();
     
-    // Create execution plan
-    ExecutionPlan* plan = create_execution_plan(gateway, ast);
+    // Parse and plan, or find both cached
+    char error[QUERY_ERROR_SIZE];
+    CachedQuery* entry = query_cache_acquire(gateway, query, error);
+    if (!entry) {
+        execution_result_add_error(result, error);
+        return result;
+    }
     
     // Execute plan
-    ExecutionResult* result = malloc(sizeof(ExecutionResult));
-    result->data = NULL;
-    result->errors = NULL;
-    result->num_errors = 0;
+    execute_plan(gateway, entry->plan, result, variables, context);
     
-    execute_plan(plan, result, variables, context);
+    query_cache_release(&gateway->query_cache, entry);
+    return result;
+}
+
+// Runs the cached query whose eghact_query_hash is query_hash; fails with
+// PersistedQueryNotFound if it isn't cached, and the client sends the full query
+ExecutionResult* eghact_execute_persisted_query(FederationGateway* gateway,
+                                                uint64_t query_hash,
+                                                void* variables,
+                                                void* context) {
+    ExecutionResult* result = execution_result_create();
+    QueryCache* cache = &gateway->query_cache;
+    pthread_mutex_lock(&cache->lock);
+    CachedQuery* entry = query_cache_find(cache, query_hash, NULL, 0);
+    pthread_mutex_unlock(&cache->lock);
+    if (!entry) {
+        execution_result_add_error(result, "PersistedQueryNotFound");
+        return result;
+    }
     
-    // Clean up
-    free_ast(ast);
-    free_execution_plan(plan);
+    execute_plan(gateway, entry->plan, result, variables, context);
     
+    query_cache_release(cache, entry);
     return result;
 }
 
 // Execution planning
-typedef struct ExecutionStep {
-    FederatedService* service;
-    ASTNode* query_fragment;
-    char** required_fields;
-    int num_required_fields;
-    struct ExecutionStep* next;
-} ExecutionStep;
+//
+// The planner walks the operation once. A field stays in the current step when that
+// step's service has it on the type in hand. Fields that other services add are split
+// off into an entity step per service, and the current step fetches the objects'
+// __typename and key instead, under aliases the executor removes at the end. A query's
+// root fields are grouped by the service that has them. A mutation's root fields are
+// split into runs by service, each waiting on the one before, since mutations run in
+// order. Fragment spreads are written out inline, so steps need no fragment definitions.
 
 typedef struct {
-    ExecutionStep* steps;
-    int num_steps;
-} ExecutionPlan;
+    char* data;
+    size_t length;
+    size_t capacity;
+    int failed;
+} TextBuffer;
+
+static void text_append(TextBuffer* text, const char* data, size_t length) {
+    if (text->failed) return;
+    if (text->length + length + 1 > text->capacity) {
+        size_t capacity = text->capacity ? text->capacity * 2 : 256;
+        while (capacity < text->length + length + 1) capacity *= 2;
+        char* grown = realloc(text->data, capacity);
+        if (!grown) {
+            text->failed = 1;
+            return;
+        }
+        text->data = grown;
+        text->capacity = capacity;
+    }
+    memcpy(text->data + text->length, data, length);
+    text->length += length;
+    text->data[text->length] = '\0';
+}
+
+#define text_append_literal(text, literal) text_append(text, literal, sizeof(literal) - 1)
+
+static inline void text_append_slice(TextBuffer* text, Slice slice) {
+    text_append(text, slice.data, (size_t)slice.length);
+}
+
+static inline void text_append_string(TextBuffer* text, const char* string) {
+    text_append(text, string, strlen(string));
+}
+
+static inline int slice_equals(Slice slice, const char* string) {
+    size_t length = strlen(string);
+    return (size_t)slice.length == length && !memcmp(slice.data, string, length);
+}
+
+// A step's text as it is built, and the operation variables it uses
+typedef struct {
+    TextBuffer text;
+    unsigned char* used;
+} StepText;
+
+typedef struct {
+    FederationGateway* gateway;
+    ExecutionPlan* plan;
+    ASTNode* document;
+    ASTNode* operation;
+    Slice path[QUERY_MAX_DEPTH];    // Response keys down to the selections in hand
+    int path_length;
+    int depth;
+    int failed;
+    char* error;
+} Planner;
+
+static void planner_fail(Planner* planner, const char* format, ...) {
+    if (planner->failed) return;
+    planner->failed = 1;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(planner->error, QUERY_ERROR_SIZE, format, args);
+    va_end(args);
+}
+
+static GraphQLType* unwrap_type(GraphQLType* type) {
+    while (type && (type->kind == GQL_LIST || type->kind == GQL_NON_NULL)) type = type->of_type;
+    return type;
+}
+
+static GraphQLType* service_type(FederatedService* service, const char* name) {
+    GraphQLSchema* schema = service->schema;
+    if (!schema) return NULL;
+    for (int i = 0; i < schema->num_types; i++) {
+        if (!strcmp(schema->types[i]->name, name)) return schema->types[i];
+    }
+    return NULL;
+}
+
+static GraphQLField* type_field(GraphQLType* type, Slice name) {
+    if (!type) return NULL;
+    for (int i = 0; i < type->num_fields; i++) {
+        if (slice_equals(name, type->fields[i]->name)) return type->fields[i];
+    }
+    return NULL;
+}
+
+static int service_owns(FederatedService* service, const char* type_name) {
+    for (int i = 0; i < service->num_owned_types; i++) {
+        if (!strcmp(service->owned_types[i], type_name)) return 1;
+    }
+    return 0;
+}
+
+static GraphQLType* root_type(FederatedService* service, Slice operation) {
+    if (!service->schema) return NULL;
+    if (slice_equals(operation, "mutation")) return service->schema->mutation_type;
+    if (slice_equals(operation, "subscription")) return service->schema->subscription_type;
+    return service->schema->query_type;
+}
+
+// Service to resolve name on type_name: current if it can, then one owning the type,
+// then any that has the field. type_name NULL means the operation's root type.
+static FederatedService* field_service(Planner* planner, FederatedService* current,
+                                       const char* type_name, Slice name, GraphQLField** field) {
+    FederationGateway* gateway = planner->gateway;
+    Slice operation = planner->operation->operation;
+    if (current) {
+        *field = type_field(type_name ? service_type(current, type_name) : root_type(current, operation), name);
+        if (*field) return current;
+    }
+    FederatedService* fallback = NULL;
+    GraphQLField* fallback_field = NULL;
+    for (int i = 0; i < gateway->num_services; i++) {
+        FederatedService* service = gateway->services[i];
+        if (service == current) continue;
+        GraphQLType* type = type_name ? service_type(service, type_name) : root_type(service, operation);
+        GraphQLField* found = type_field(type, name);
+        if (!found) continue;
+        if (type_name && service_owns(service, type_name)) {
+            *field = found;
+            return service;
+        }
+        if (!fallback) {
+            fallback = service;
+            fallback_field = found;
+        }
+    }
+    *field = fallback_field;
+    return fallback;
+}
+
+static int plan_add_step(Planner* planner, FederatedService* service) {
+    ExecutionPlan* plan = planner->plan;
+    if (plan->num_steps == plan->capacity) {
+        int capacity = plan->capacity ? plan->capacity * 2 : 4;
+        ExecutionStep* steps = realloc(plan->steps, sizeof(ExecutionStep) * capacity);
+        if (!steps) {
+            planner_fail(planner, "Out of memory planning query");
+            return -1;
+        }
+        plan->steps = steps;
+        plan->capacity = capacity;
+    }
+    plan->steps[plan->num_steps] = (ExecutionStep){ .service = service, .parent = -1 };
+    return plan->num_steps++;
+}
+
+static void plan_add_dependency(Planner* planner, int step, int dependent) {
+    ExecutionStep* before = &planner->plan->steps[step];
+    int* dependents = realloc(before->dependents, sizeof(int) * (before->num_dependents + 1));
+    if (!dependents) {
+        planner_fail(planner, "Out of memory planning query");
+        return;
+    }
+    before->dependents = dependents;
+    before->dependents[before->num_dependents++] = dependent;
+    planner->plan->steps[dependent].num_dependencies++;
+}
+
+static int step_text_begin(Planner* planner, StepText* out) {
+    *out = (StepText){0};
+    out->used = calloc((size_t)planner->plan->num_variables + 1, 1);
+    if (!out->used) planner_fail(planner, "Out of memory planning query");
+    return out->used != NULL;
+}
+
+// Hands the text to step, prefixed by keyword and the variable definitions it needs if
+// keyword isn't NULL
+static void step_text_finish(Planner* planner, int step, StepText* out, const Slice* keyword) {
+    ExecutionPlan* plan = planner->plan;
+    ExecutionStep* target = &plan->steps[step];
+    int count = 0;
+    for (int i = 0; i < plan->num_variables; i++) count += out->used[i];
+    target->variables = count ? malloc(sizeof(int) * count) : NULL;
+    for (int i = 0; i < plan->num_variables && target->variables; i++) {
+        if (out->used[i]) target->variables[target->num_variables++] = i;
+    }
+    
+    if (keyword) {
+        TextBuffer text = {0};
+        text_append_slice(&text, *keyword);
+        for (int i = 0; i < target->num_variables; i++) {
+            text_append(&text, i ? "," : "(", 1);
+            text_append_string(&text, plan->variable_definitions[target->variables[i]]);
+        }
+        if (target->num_variables) text_append_literal(&text, ")");
+        text_append_literal(&text, "{");
+        text_append(&text, out->text.data, out->text.length);
+        text_append_literal(&text, "}");
+        free(out->text.data);
+        out->text = text;
+    }
+    if (out->text.failed || (count && !target->variables)) {
+        planner_fail(planner, "Out of memory planning query");
+    }
+    target->text = out->text.data;
+    free(out->used);
+    *out = (StepText){0};
+}
+
+static void use_variables(Planner* planner, StepText* out, const ASTValue* value) {
+    if (value->kind == AST_VALUE_VARIABLE) {
+        ASTNode* operation = planner->operation;
+        for (int i = 0; i < operation->num_arguments; i++) {
+            if (operation->arguments[i]->name.length == value->text.length &&
+                !memcmp(operation->arguments[i]->name.data, value->text.data, value->text.length)) {
+                out->used[i] = 1;
+                return;
+            }
+        }
+        planner_fail(planner, "Variable \"$%.*s\" is not defined", value->text.length, value->text.data);
+    } else if (value->kind == AST_VALUE_LIST) {
+        for (int i = 0; i < value->num_items; i++) use_variables(planner, out, value->items[i]);
+    } else if (value->kind == AST_VALUE_OBJECT) {
+        for (int i = 0; i < value->num_items; i++) use_variables(planner, out, value->fields[i]->value);
+    }
+}
+
+static void emit_arguments(Planner* planner, StepText* out, ASTArgument** arguments, int count) {
+    for (int i = 0; i < count; i++) {
+        text_append(&out->text, i ? "," : "(", 1);
+        text_append_slice(&out->text, arguments[i]->name);
+        text_append_literal(&out->text, ":");
+        ASTValue* value = arguments[i]->value;
+        if (value->kind == AST_VALUE_VARIABLE) text_append_literal(&out->text, "$");
+        text_append_slice(&out->text, value->text);
+        use_variables(planner, out, value);
+    }
+    if (count) text_append_literal(&out->text, ")");
+}
+
+static void emit_directives(Planner* planner, StepText* out, ASTNode** directives, int count) {
+    for (int i = 0; i < count; i++) {
+        text_append_literal(&out->text, "@");
+        text_append_slice(&out->text, directives[i]->name);
+        emit_arguments(planner, out, directives[i]->arguments, directives[i]->num_arguments);
+    }
+}
+
+// Space before a selection unless it opens a selection set
+static void emit_separator(StepText* out) {
+    if (out->text.length && out->text.data[out->text.length - 1] != '{') {
+        text_append_literal(&out->text, " ");
+    }
+}
+
+static ASTNode* find_fragment(Planner* planner, Slice name) {
+    for (int i = 0; i < planner->document->num_children; i++) {
+        ASTNode* definition = planner->document->children[i];
+        if (definition->type == AST_FRAGMENT && definition->name.length == name.length &&
+            !memcmp(definition->name.data, name.data, name.length)) {
+            return definition;
+        }
+    }
+    return NULL;
+}
+
+static void plan_selections(Planner* planner, int step, FederatedService* service,
+                            const char* type_name, ASTNode** selections, int count, StepText* out);
 
-ExecutionPlan* create_execution_plan(FederationGateway* gateway, ASTNode* ast) {
-    ExecutionPlan* plan = malloc(sizeof(ExecutionPlan));
-    plan->steps = NULL;
-    plan->num_steps = 0;
+// Writes selection, a field service resolves, and whatever of its subselection it can
+static void plan_field(Planner* planner, int step, FederatedService* service, GraphQLField* field,
+                       ASTNode* selection, StepText* out) {
+    emit_separator(out);
+    if (selection->alias.length) {
+        text_append_slice(&out->text, selection->alias);
+        text_append_literal(&out->text, ":");
+    }
+    text_append_slice(&out->text, selection->name);
+    emit_arguments(planner, out, selection->arguments, selection->num_arguments);
+    emit_directives(planner, out, selection->directives, selection->num_directives);
+    if (!selection->num_children) return;
+    
+    GraphQLType* type = unwrap_type(field->type);
+    if (!type || !type->name) {
+        planner_fail(planner, "Field \"%.*s\" has no type to select from",
+                     selection->name.length, selection->name.data);
+        return;
+    }
+    if (planner->path_length == QUERY_MAX_DEPTH) {
+        planner_fail(planner, "Query nested deeper than %d levels", QUERY_MAX_DEPTH);
+        return;
+    }
+    planner->path[planner->path_length++] = selection->alias.length ? selection->alias : selection->name;
+    text_append_literal(&out->text, "{");
+    plan_selections(planner, step, service, type->name, selection->children, selection->num_children, out);
+    text_append_literal(&out->text, "}");
+    planner->path_length--;
+}
+
+// A step under parent fetching selections, all of which service has on type_name, for
+// the objects at the current path
+static void plan_entity_step(Planner* planner, int parent, FederatedService* service,
+                             const char* type_name, ASTNode** selections, int count) {
+    int step = plan_add_step(planner, service);
+    StepText out;
+    if (step < 0 || !step_text_begin(planner, &out)) return;
+    
+    text_append_literal(&out.text, "{...on ");
+    text_append_string(&out.text, type_name);
+    text_append_literal(&out.text, "{");
+    plan_selections(planner, step, service, type_name, selections, count, &out);
+    text_append_literal(&out.text, "}}");
+    step_text_finish(planner, step, &out, NULL);
+    
+    ExecutionStep* entity = &planner->plan->steps[step];
+    GraphQLType* type = service_type(service, type_name);
+    entity->type_name = strdup(type_name);
+    entity->any_type = type && type->kind != GQL_OBJECT;
+    entity->parent = parent;
+    entity->path = malloc(sizeof(char*) * (planner->path_length + 1));
+    if (!entity->type_name || !entity->path) {
+        planner_fail(planner, "Out of memory planning query");
+        return;
+    }
+    entity->path_length = planner->path_length;
+    for (int i = 0; i < planner->path_length; i++) {
+        entity->path[i] = strndup(planner->path[i].data, planner->path[i].length);
+    }
+    planner->plan->has_entities = 1;
+    plan_add_dependency(planner, parent, step);
+}
+
+static void plan_selections(Planner* planner, int step, FederatedService* service,
+                            const char* type_name, ASTNode** selections, int count, StepText* out) {
+    if (planner->failed) return;
+    if (++planner->depth > QUERY_MAX_DEPTH) {
+        planner_fail(planner, "Query nested deeper than %d levels", QUERY_MAX_DEPTH);
+        return;
+    }
+    FederationGateway* gateway = planner->gateway;
+    
+    // Fields other services add, by service
+    ASTNode*** foreign = NULL;
+    int* num_foreign = NULL;
+    
+    for (int i = 0; i < count && !planner->failed; i++) {
+        ASTNode* selection = selections[i];
+        if (selection->type == AST_FIELD) {
+            GraphQLField* field = NULL;
+            FederatedService* owner = slice_equals(selection->name, "__typename") ? service
+                                    : field_service(planner, service, type_name, selection->name, &field);
+            if (!owner) {
+                planner_fail(planner, "Cannot query field \"%.*s\" on type \"%s\"",
+                             selection->name.length, selection->name.data, type_name);
+            } else if (owner == service) {
+                if (field) {
+                    plan_field(planner, step, service, field, selection, out);
+                } else {
+                    emit_separator(out);
+                    if (selection->alias.length) {
+                        text_append_slice(&out->text, selection->alias);
+                        text_append_literal(&out->text, ":");
+                    }
+                    text_append_slice(&out->text, selection->name);
+                }
+            } else {
+                int index = 0;
+                while (gateway->services[index] != owner) index++;
+                if (!foreign) {
+                    foreign = calloc(gateway->num_services, sizeof(ASTNode**));
+                    num_foreign = calloc(gateway->num_services, sizeof(int));
+                }
+                ASTNode** grown = foreign && num_foreign
+                                ? realloc(foreign[index], sizeof(ASTNode*) * (num_foreign[index] + 1))
+                                : NULL;
+                if (!grown) {
+                    planner_fail(planner, "Out of memory planning query");
+                    break;
+                }
+                foreign[index] = grown;
+                foreign[index][num_foreign[index]++] = selection;
+            }
+            continue;
+        }
+        
+        // Inline fragment, or a spread written out as one
+        ASTNode* fragment = selection;
+        if (selection->type == AST_FRAGMENT_SPREAD && !(fragment = find_fragment(planner, selection->name))) {
+            planner_fail(planner, "Unknown fragment \"%.*s\"", selection->name.length, selection->name.data);
+            break;
+        }
+        char condition[256];
+        if (fragment->type_condition.length >= (int)sizeof(condition)) {
+            planner_fail(planner, "Type name too long");
+            break;
+        }
+        if (fragment->type_condition.length) {
+            memcpy(condition, fragment->type_condition.data, fragment->type_condition.length);
+            condition[fragment->type_condition.length] = '\0';
+        } else {
+            snprintf(condition, sizeof(condition), "%s", type_name);
+        }
+        emit_separator(out);
+        text_append_literal(&out->text, "...on ");
+        text_append_string(&out->text, condition);
+        emit_directives(planner, out, selection->directives, selection->num_directives);
+        text_append_literal(&out->text, "{");
+        plan_selections(planner, step, service, condition, fragment->children, fragment->num_children, out);
+        text_append_literal(&out->text, "}");
+    }
     
-    // Analyze query to determine which services to query
-    analyze_query(ast, gateway, plan);
+    if (foreign && !planner->failed) {
+        emit_separator(out);
+        text_append_literal(&out->text, ENTITY_TYPENAME_ALIAS ":__typename "
+                                        ENTITY_KEY_ALIAS ":" ENTITY_KEY_FIELD);
+        for (int i = 0; i < gateway->num_services && !planner->failed; i++) {
+            if (num_foreign[i]) {
+                plan_entity_step(planner, step, gateway->services[i], type_name, foreign[i], num_foreign[i]);
+            }
+        }
+    }
+    if (foreign) {
+        for (int i = 0; i < gateway->num_services; i++) free(foreign[i]);
+    }
+    free(foreign);
+    free(num_foreign);
+    planner->depth--;
+}
+
+// Root fields of the operation, with fragments around them opened up
+static int collect_root_fields(Planner* planner, ASTNode** selections, int count,
+                               ASTNode*** fields, int* num_fields) {
+    for (int i = 0; i < count; i++) {
+        ASTNode* selection = selections[i];
+        if (selection->type == AST_FIELD) {
+            ASTNode** grown = realloc(*fields, sizeof(ASTNode*) * (*num_fields + 1));
+            if (!grown) return planner_fail(planner, "Out of memory planning query"), 0;
+            *fields = grown;
+            (*fields)[(*num_fields)++] = selection;
+            continue;
+        }
+        if (selection->num_directives) {
+            return planner_fail(planner, "Directives on root fragments are not supported"), 0;
+        }
+        ASTNode* fragment = selection;
+        if (selection->type == AST_FRAGMENT_SPREAD && !(fragment = find_fragment(planner, selection->name))) {
+            planner_fail(planner, "Unknown fragment \"%.*s\"", selection->name.length, selection->name.data);
+            return 0;
+        }
+        if (++planner->depth > QUERY_MAX_DEPTH) {
+            return planner_fail(planner, "Query nested deeper than %d levels", QUERY_MAX_DEPTH), 0;
+        }
+        if (!collect_root_fields(planner, fragment->children, fragment->num_children, fields, num_fields)) {
+            return 0;
+        }
+        planner->depth--;
+    }
+    return 1;
+}
+
+static void plan_root(Planner* planner) {
+    ASTNode* operation = planner->operation;
+    ASTNode** fields = NULL;
+    int num_fields = 0;
+    if (!collect_root_fields(planner, operation->children, operation->num_children, &fields, &num_fields)) {
+        free(fields);
+        return;
+    }
     
-    // Optimize plan
-    optimize_execution_plan(plan);
+    FederationGateway* gateway = planner->gateway;
+    FederatedService** owners = calloc(num_fields, sizeof(FederatedService*));
+    GraphQLField** resolved = calloc(num_fields, sizeof(GraphQLField*));
+    if (!owners || !resolved) planner_fail(planner, "Out of memory planning query");
+    for (int i = 0; i < num_fields && !planner->failed; i++) {
+        if (slice_equals(fields[i]->name, "__typename")) continue;
+        owners[i] = field_service(planner, NULL, NULL, fields[i]->name, &resolved[i]);
+        if (!owners[i]) {
+            planner_fail(planner, "Cannot query field \"%.*s\" on the %.*s type",
+                         fields[i]->name.length, fields[i]->name.data,
+                         operation->operation.length, operation->operation.data);
+        }
+    }
+    // __typename goes along with a neighbour
+    for (int i = 0; i < num_fields && !planner->failed; i++) {
+        if (!owners[i]) owners[i] = i ? owners[i - 1] : NULL;
+    }
+    for (int i = num_fields - 1; i >= 0 && !planner->failed; i--) {
+        if (!owners[i]) owners[i] = i + 1 < num_fields && owners[i + 1] ? owners[i + 1] : gateway->services[0];
+    }
     
+    // Query fields go to one step per service and run together; mutation fields go in
+    // runs, each step waiting for the one before
+    int mutation = slice_equals(operation->operation, "mutation");
+    int previous = -1;
+    unsigned char* done = calloc(num_fields + 1, 1);
+    if (!done) planner_fail(planner, "Out of memory planning query");
+    for (int i = 0; i < num_fields && !planner->failed; i++) {
+        if (done[i]) continue;
+        FederatedService* service = owners[i];
+        int step = plan_add_step(planner, service);
+        StepText out;
+        if (step < 0 || !step_text_begin(planner, &out)) break;
+        for (int j = i; j < num_fields && !planner->failed; j++) {
+            if (owners[j] != service) {
+                if (mutation) break;
+                continue;
+            }
+            done[j] = 1;
+            if (resolved[j]) {
+                plan_field(planner, step, service, resolved[j], fields[j], &out);
+            } else {
+                emit_separator(&out);
+                if (fields[j]->alias.length) {
+                    text_append_slice(&out.text, fields[j]->alias);
+                    text_append_literal(&out.text, ":");
+                }
+                text_append_slice(&out.text, fields[j]->name);
+            }
+        }
+        step_text_finish(planner, step, &out, &operation->operation);
+        if (mutation && previous >= 0) plan_add_dependency(planner, previous, step);
+        previous = step;
+    }
+    free(done);
+    free(owners);
+    free(resolved);
+    free(fields);
+}
+
+// Plans the document's first operation; NULL with a message in error if it can't be
+ExecutionPlan* create_execution_plan(FederationGateway* gateway, ASTNode* ast, char* error) {
+    ASTNode* operation = NULL;
+    for (int i = 0; i < ast->num_children && !operation; i++) {
+        if (ast->children[i]->type == AST_QUERY) operation = ast->children[i];
+    }
+    if (!operation) {
+        snprintf(error, QUERY_ERROR_SIZE, "Document has no operation");
+        return NULL;
+    }
+    if (gateway->num_services == 0) {
+        snprintf(error, QUERY_ERROR_SIZE, "No services registered");
+        return NULL;
+    }
+    
+    ExecutionPlan* plan = calloc(1, sizeof(ExecutionPlan));
+    if (!plan) {
+        snprintf(error, QUERY_ERROR_SIZE, "Out of memory planning query");
+        return NULL;
+    }
+    Planner planner = {
+        .gateway = gateway,
+        .plan = plan,
+        .document = ast,
+        .operation = operation,
+        .error = error,
+    };
+    
+    // Definitions of the variables, for the steps that use them
+    plan->num_variables = operation->num_arguments;
+    plan->variable_definitions = calloc(plan->num_variables + 1, sizeof(char*));
+    if (!plan->variable_definitions) planner_fail(&planner, "Out of memory planning query");
+    for (int i = 0; i < plan->num_variables && !planner.failed; i++) {
+        ASTArgument* variable = operation->arguments[i];
+        TextBuffer text = {0};
+        text_append_literal(&text, "$");
+        text_append_slice(&text, variable->name);
+        text_append_literal(&text, ":");
+        text_append_slice(&text, variable->type);
+        if (variable->value) {
+            text_append_literal(&text, "=");
+            text_append_slice(&text, variable->value->text);
+        }
+        if (text.failed) planner_fail(&planner, "Out of memory planning query");
+        plan->variable_definitions[i] = text.data;
+    }
+    
+    plan_root(&planner);
+    if (planner.failed) {
+        free_execution_plan(plan);
+        return NULL;
+    }
     return plan;
 }
 
+void free_execution_plan(ExecutionPlan* plan) {
+    for (int i = 0; i < plan->num_steps; i++) {
+        ExecutionStep* step = &plan->steps[i];
+        free(step->type_name);
+        free(step->text);
+        free(step->variables);
+        for (int j = 0; j < step->path_length; j++) free(step->path[j]);
+        free(step->path);
+        free(step->dependents);
+    }
+    for (int i = 0; i < plan->num_variables && plan->variable_definitions; i++) {
+        free(plan->variable_definitions[i]);
+    }
+    free(plan->variable_definitions);
+    free(plan->steps);
+    free(plan);
+}
+
+// Plan execution
+//
+// Every step whose dependencies are done starts at once, as an HTTP request on the
+// gateway's shared keep-alive connections, and all requests in flight are waited on
+// together. Responses are parsed as they arrive and merged into the result as each
+// completes, which frees the steps waiting on it. Entity steps that become ready in the
+// same round and go to the same service are sent as one request with an aliased
+// _entities field per step, and each step sends an entity once however often it appears
+// in the results. A request takes as long as its slowest chain of dependent fetches.
+
+typedef struct {
+    json_object** items;
+    int count;
+    int capacity;
+} ObjectList;
+
+static void object_list_push(ObjectList* list, json_object* object) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 16;
+        json_object** items = realloc(list->items, sizeof(json_object*) * capacity);
+        if (!items) return;
+        list->items = items;
+        list->capacity = capacity;
+    }
+    list->items[list->count++] = object;
+}
+
+// Objects at path below node, looking through lists on the way
+static void collect_objects(json_object* node, char** path, int path_length, int depth, ObjectList* out) {
+    if (json_object_is_type(node, json_type_array)) {
+        size_t length = json_object_array_length(node);
+        for (size_t i = 0; i < length; i++) {
+            collect_objects(json_object_array_get_idx(node, i), path, path_length, depth, out);
+        }
+    } else if (json_object_is_type(node, json_type_object)) {
+        json_object* child;
+        if (depth == path_length) {
+            object_list_push(out, node);
+        } else if (json_object_object_get_ex(node, path[depth], &child)) {
+            collect_objects(child, path, path_length, depth + 1, out);
+        }
+    }
+}
+
+static void merge_objects(json_object* target, json_object* source) {
+    struct json_object_iterator it = json_object_iter_begin(source);
+    struct json_object_iterator end = json_object_iter_end(source);
+    for (; !json_object_iter_equal(&it, &end); json_object_iter_next(&it)) {
+        const char* key = json_object_iter_peek_name(&it);
+        json_object* value = json_object_iter_peek_value(&it);
+        json_object* existing;
+        if (json_object_is_type(value, json_type_object) &&
+            json_object_object_get_ex(target, key, &existing) &&
+            json_object_is_type(existing, json_type_object)) {
+            merge_objects(existing, value);
+        } else {
+            json_object_object_add(target, key, json_object_get(value));
+        }
+    }
+}
+
+// One entity step's part of a request
+typedef struct {
+    int step;
+    json_object* representations;
+    json_object** targets;      // Result objects the entities merge into, held
+    int* target_entity;         // Representation for each target
+    int num_targets;
+} EntityBatch;
+
+typedef struct {
+    CURL* easy;
+    struct curl_slist* headers;
+    json_object* request;       // Owns the body being sent
+    json_tokener* tokener;
+    json_object* response;
+    int malformed;
+    FederatedService* service;
+    int step;                   // Root step, or -1 for entity batches
+    EntityBatch* batches;
+    int num_batches;
+} Fetch;
+
+typedef struct {
+    FederationGateway* gateway;
+    const ExecutionPlan* plan;
+    ExecutionResult* result;
+    json_object* data;
+    json_object* variables;     // NULL if there are none
+    int* waiting;               // Unfinished dependencies of each step
+    unsigned char* skipped;     // Parent failed, so there is nothing to fetch
+    int* ready;
+    int num_ready;
+    CURLM* multi;
+    int in_flight;
+} Execution;
+
+static void execution_result_add_errorf(ExecutionResult* result, const char* format, ...) {
+    char message[512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    execution_result_add_error(result, message);
+}
+
+static void step_finish(Execution* execution, int step, int succeeded) {
+    const ExecutionStep* finished = &execution->plan->steps[step];
+    for (int i = 0; i < finished->num_dependents; i++) {
+        int dependent = finished->dependents[i];
+        if (!succeeded && execution->plan->steps[dependent].parent == step) execution->skipped[dependent] = 1;
+        if (--execution->waiting[dependent] == 0) execution->ready[execution->num_ready++] = dependent;
+    }
+}
+
+static void entity_batch_free(EntityBatch* batch) {
+    for (int i = 0; i < batch->num_targets; i++) json_object_put(batch->targets[i]);
+    if (batch->representations) json_object_put(batch->representations);
+    free(batch->targets);
+    free(batch->target_entity);
+}
+
+// Finds the step's entities in the results so far; returns how many distinct ones
+static int entity_batch_build(Execution* execution, int step, EntityBatch* batch) {
+    const ExecutionStep* entity = &execution->plan->steps[step];
+    *batch = (EntityBatch){ .step = step };
+    ObjectList objects = {0};
+    collect_objects(execution->data, entity->path, entity->path_length, 0, &objects);
+    if (!objects.count) return 0;
+    
+    // Open-addressed on type and key, holding representation indices
+    int slots = 16;
+    while (slots < objects.count * 2) slots *= 2;
+    int* table = malloc(sizeof(int) * slots);
+    const char** typenames = malloc(sizeof(char*) * objects.count);
+    const char** keys = malloc(sizeof(char*) * objects.count);
+    batch->targets = malloc(sizeof(json_object*) * objects.count);
+    batch->target_entity = malloc(sizeof(int) * objects.count);
+    batch->representations = json_object_new_array();
+    int count = 0;
+    if (table && typenames && keys && batch->targets && batch->target_entity && batch->representations) {
+        memset(table, -1, sizeof(int) * slots);
+        for (int i = 0; i < objects.count; i++) {
+            json_object* typename_value;
+            json_object* key_value;
+            if (!json_object_object_get_ex(objects.items[i], ENTITY_TYPENAME_ALIAS, &typename_value) ||
+                !json_object_object_get_ex(objects.items[i], ENTITY_KEY_ALIAS, &key_value) ||
+                !json_object_is_type(typename_value, json_type_string) || !key_value) {
+                continue;
+            }
+            const char* typename = json_object_get_string(typename_value);
+            if (!entity->any_type && strcmp(typename, entity->type_name)) continue;
+            const char* key = json_object_to_json_string_ext(key_value, JSON_C_TO_STRING_PLAIN);
+            
+            uint64_t hash = hash_bytes(hash_bytes(HASH_SEED, typename, strlen(typename) + 1), key, strlen(key));
+            int slot = (int)(hash & (uint64_t)(slots - 1));
+            while (table[slot] >= 0 && (strcmp(typenames[table[slot]], typename) || strcmp(keys[table[slot]], key))) {
+                slot = (slot + 1) & (slots - 1);
+            }
+            if (table[slot] < 0) {
+                json_object* representation = json_object_new_object();
+                json_object_object_add(representation, "__typename", json_object_new_string(typename));
+                json_object_object_add(representation, ENTITY_KEY_FIELD, json_object_get(key_value));
+                json_object_array_add(batch->representations, representation);
+                typenames[count] = typename;
+                keys[count] = key;
+                table[slot] = count++;
+            }
+            batch->targets[batch->num_targets] = json_object_get(objects.items[i]);
+            batch->target_entity[batch->num_targets++] = table[slot];
+        }
+    }
+    free(table);
+    free(typenames);
+    free(keys);
+    free(objects.items);
+    return count;
+}
+
+static size_t fetch_write(char* data, size_t size, size_t count, void* user) {
+    Fetch* fetch = user;
+    size_t length = size * count;
+    if (!fetch->response && !fetch->malformed) {
+        fetch->response = json_tokener_parse_ex(fetch->tokener, data, (int)length);
+        if (!fetch->response && json_tokener_get_error(fetch->tokener) != json_tokener_continue) {
+            fetch->malformed = 1;
+        }
+    }
+    return length;
+}
+
+static void fetch_free(Fetch* fetch) {
+    for (int i = 0; i < fetch->num_batches; i++) entity_batch_free(&fetch->batches[i]);
+    free(fetch->batches);
+    if (fetch->easy) curl_easy_cleanup(fetch->easy);
+    curl_slist_free_all(fetch->headers);
+    if (fetch->request) json_object_put(fetch->request);
+    if (fetch->response) json_object_put(fetch->response);
+    if (fetch->tokener) json_tokener_free(fetch->tokener);
+    free(fetch);
+}
+
+// Ends the steps of a fetch that can't be made
+static void fetch_fail(Execution* execution, Fetch* fetch, const char* reason) {
+    execution_result_add_errorf(execution->result, "Service %s: %s", fetch->service->service_name, reason);
+    if (fetch->step >= 0) step_finish(execution, fetch->step, 0);
+    for (int i = 0; i < fetch->num_batches; i++) step_finish(execution, fetch->batches[i].step, 0);
+    fetch_free(fetch);
+}
+
+// Sends query with variables, added to the user's, to fetch's service
+static void fetch_start(Execution* execution, Fetch* fetch, const char* query, json_object* variables) {
+    fetch->request = json_object_new_object();
+    fetch->tokener = json_tokener_new();
+    fetch->easy = curl_easy_init();
+    if (!fetch->request || !fetch->tokener || !fetch->easy) {
+        if (variables) json_object_put(variables);
+        fetch_fail(execution, fetch, "out of memory");
+        return;
+    }
+    if (execution->variables) {
+        if (!variables) variables = json_object_new_object();
+        struct json_object_iterator it = json_object_iter_begin(execution->variables);
+        struct json_object_iterator end = json_object_iter_end(execution->variables);
+        for (; !json_object_iter_equal(&it, &end); json_object_iter_next(&it)) {
+            json_object_object_add(variables, json_object_iter_peek_name(&it),
+                                   json_object_get(json_object_iter_peek_value(&it)));
+        }
+    }
+    json_object_object_add(fetch->request, "query", json_object_new_string(query));
+    if (variables) json_object_object_add(fetch->request, "variables", variables);
+    
+    fetch->headers = curl_slist_append(NULL, "Content-Type: application/json");
+    fetch->headers = curl_slist_append(fetch->headers, "Accept: application/json");
+    CURL* easy = fetch->easy;
+    curl_easy_setopt(easy, CURLOPT_URL, fetch->service->service_url);
+    curl_easy_setopt(easy, CURLOPT_SHARE, execution->gateway->connections);
+    curl_easy_setopt(easy, CURLOPT_HTTPHEADER, fetch->headers);
+    curl_easy_setopt(easy, CURLOPT_POSTFIELDS,
+                     json_object_to_json_string_ext(fetch->request, JSON_C_TO_STRING_PLAIN));
+    curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, fetch_write);
+    curl_easy_setopt(easy, CURLOPT_WRITEDATA, fetch);
+    curl_easy_setopt(easy, CURLOPT_PRIVATE, fetch);
+    curl_easy_setopt(easy, CURLOPT_TIMEOUT_MS, (long)FETCH_TIMEOUT_MS);
+    curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(easy, CURLOPT_TCP_KEEPALIVE, 1L);
+    if (curl_multi_add_handle(execution->multi, easy) != CURLM_OK) {
+        fetch_fail(execution, fetch, "could not start request");
+        return;
+    }
+    execution->in_flight++;
+}
+
+static void fetch_root(Execution* execution, int step) {
+    Fetch* fetch = calloc(1, sizeof(Fetch));
+    if (!fetch) {
+        execution_result_add_error(execution->result, "Out of memory executing query");
+        step_finish(execution, step, 0);
+        return;
+    }
+    fetch->service = execution->plan->steps[step].service;
+    fetch->step = step;
+    fetch_start(execution, fetch, execution->plan->steps[step].text, NULL);
+}
+
+// One request for all of batches, which go to service; takes the batches
+static void fetch_entities(Execution* execution, FederatedService* service, EntityBatch* batches, int count) {
+    const ExecutionPlan* plan = execution->plan;
+    Fetch* fetch = calloc(1, sizeof(Fetch));
+    if (!fetch) {
+        execution_result_add_error(execution->result, "Out of memory executing query");
+        for (int i = 0; i < count; i++) {
+            step_finish(execution, batches[i].step, 0);
+            entity_batch_free(&batches[i]);
+        }
+        free(batches);
+        return;
+    }
+    fetch->service = service;
+    fetch->step = -1;
+    fetch->batches = batches;
+    fetch->num_batches = count;
+    
+    // query($_0:[_Any!]!,...,$user:T){_0:_entities(representations:$_0){...on T{...}} ...}
+    unsigned char* used = calloc((size_t)plan->num_variables + 1, 1);
+    json_object* variables = json_object_new_object();
+    TextBuffer query = {0};
+    char alias[64];
+    text_append_literal(&query, "query(");
+    for (int i = 0; i < count; i++) {
+        int length = snprintf(alias, sizeof(alias), "%s$_%d:[_Any!]!", i ? "," : "", i);
+        text_append(&query, alias, (size_t)length);
+        snprintf(alias, sizeof(alias), "_%d", i);
+        json_object_object_add(variables, alias, batches[i].representations);
+        batches[i].representations = NULL;
+        const ExecutionStep* entity = &plan->steps[batches[i].step];
+        for (int j = 0; used && j < entity->num_variables; j++) used[entity->variables[j]] = 1;
+    }
+    for (int i = 0; used && i < plan->num_variables; i++) {
+        if (!used[i]) continue;
+        text_append_literal(&query, ",");
+        text_append_string(&query, plan->variable_definitions[i]);
+    }
+    text_append_literal(&query, "){");
+    for (int i = 0; i < count; i++) {
+        int length = snprintf(alias, sizeof(alias), "%s_%d:_entities(representations:$_%d)",
+                              i ? " " : "", i, i);
+        text_append(&query, alias, (size_t)length);
+        text_append_string(&query, plan->steps[batches[i].step].text);
+    }
+    text_append_literal(&query, "}");
+    
+    if (!used || query.failed) {
+        free(used);
+        free(query.data);
+        json_object_put(variables);
+        fetch_fail(execution, fetch, "out of memory");
+        return;
+    }
+    fetch_start(execution, fetch, query.data, variables);
+    free(used);
+    free(query.data);
+}
+
+static void fetch_complete(Execution* execution, Fetch* fetch, CURLcode code) {
+    curl_multi_remove_handle(execution->multi, fetch->easy);
+    execution->in_flight--;
+    
+    long status = 0;
+    curl_easy_getinfo(fetch->easy, CURLINFO_RESPONSE_CODE, &status);
+    json_object* data = NULL;
+    if (code != CURLE_OK) {
+        fetch_fail(execution, fetch, curl_easy_strerror(code));
+        return;
+    }
+    if (!fetch->response || !json_object_is_type(fetch->response, json_type_object)) {
+        char reason[64];
+        snprintf(reason, sizeof(reason), "HTTP %ld without a GraphQL response", status);
+        fetch_fail(execution, fetch, reason);
+        return;
+    }
+    
+    json_object* errors;
+    if (json_object_object_get_ex(fetch->response, "errors", &errors) &&
+        json_object_is_type(errors, json_type_array)) {
+        size_t length = json_object_array_length(errors);
+        for (size_t i = 0; i < length; i++) {
+            json_object* message;
+            if (json_object_object_get_ex(json_object_array_get_idx(errors, i), "message", &message)) {
+                execution_result_add_errorf(execution->result, "Service %s: %s",
+                                            fetch->service->service_name, json_object_get_string(message));
+            }
+        }
+    }
+    if (!json_object_object_get_ex(fetch->response, "data", &data) ||
+        !json_object_is_type(data, json_type_object)) {
+        data = NULL;
+    }
+    
+    if (fetch->step >= 0) {
+        if (data) merge_objects(execution->data, data);
+        step_finish(execution, fetch->step, data != NULL);
+    }
+    for (int i = 0; i < fetch->num_batches; i++) {
+        EntityBatch* batch = &fetch->batches[i];
+        char alias[16];
+        snprintf(alias, sizeof(alias), "_%d", i);
+        json_object* entities = NULL;
+        if (data && json_object_object_get_ex(data, alias, &entities) &&
+            json_object_is_type(entities, json_type_array)) {
+            for (int j = 0; j < batch->num_targets; j++) {
+                json_object* entity = json_object_array_get_idx(entities, (size_t)batch->target_entity[j]);
+                if (json_object_is_type(entity, json_type_object)) merge_objects(batch->targets[j], entity);
+            }
+        } else {
+            entities = NULL;
+        }
+        step_finish(execution, batch->step, entities != NULL);
+    }
+    fetch_free(fetch);
+}
+
+// Starts every ready step, batching entity steps by service
+static void dispatch_ready(Execution* execution) {
+    FederationGateway* gateway = execution->gateway;
+    const ExecutionPlan* plan = execution->plan;
+    while (execution->num_ready > 0) {
+        EntityBatch** batches = calloc(gateway->num_services, sizeof(EntityBatch*));
+        int* num_batches = calloc(gateway->num_services, sizeof(int));
+        int count = execution->num_ready;
+        int* steps = malloc(sizeof(int) * count);
+        if (!batches || !num_batches || !steps) {
+            free(batches);
+            free(num_batches);
+            free(steps);
+            execution_result_add_error(execution->result, "Out of memory executing query");
+            return;
+        }
+        memcpy(steps, execution->ready, sizeof(int) * count);
+        execution->num_ready = 0;
+        
+        for (int i = 0; i < count; i++) {
+            int step = steps[i];
+            const ExecutionStep* ready = &plan->steps[step];
+            if (ready->parent < 0) {
+                fetch_root(execution, step);
+                continue;
+            }
+            EntityBatch batch = { .step = step };
+            if (execution->skipped[step] || entity_batch_build(execution, step, &batch) == 0) {
+                entity_batch_free(&batch);
+                step_finish(execution, step, !execution->skipped[step]);
+                continue;
+            }
+            int index = 0;
+            while (gateway->services[index] != ready->service) index++;
+            EntityBatch* grown = realloc(batches[index], sizeof(EntityBatch) * (num_batches[index] + 1));
+            if (!grown) {
+                entity_batch_free(&batch);
+                step_finish(execution, step, 0);
+                continue;
+            }
+            batches[index] = grown;
+            batches[index][num_batches[index]++] = batch;
+        }
+        for (int i = 0; i < gateway->num_services; i++) {
+            if (num_batches[i]) fetch_entities(execution, gateway->services[i], batches[i], num_batches[i]);
+        }
+        free(batches);
+        free(num_batches);
+        free(steps);
+    }
+}
+
+// Drops the aliases entity keys were fetched under
+static void strip_entity_keys(const ExecutionPlan* plan, json_object* data) {
+    for (int i = 0; i < plan->num_steps; i++) {
+        const ExecutionStep* step = &plan->steps[i];
+        if (step->parent < 0) continue;
+        ObjectList objects = {0};
+        collect_objects(data, step->path, step->path_length, 0, &objects);
+        for (int j = 0; j < objects.count; j++) {
+            json_object_object_del(objects.items[j], ENTITY_TYPENAME_ALIAS);
+            json_object_object_del(objects.items[j], ENTITY_KEY_ALIAS);
+        }
+        free(objects.items);
+    }
+}
+
+// Runs plan, leaving its data and errors in result; variables is a json_object or NULL
+void execute_plan(FederationGateway* gateway, const ExecutionPlan* plan, ExecutionResult* result,
+                  void* variables, void* context) {
+    (void)context;
+    Execution execution = {
+        .gateway = gateway,
+        .plan = plan,
+        .result = result,
+        .data = json_object_new_object(),
+        .variables = variables,
+        .waiting = malloc(sizeof(int) * (plan->num_steps + 1)),
+        .skipped = calloc(plan->num_steps + 1, 1),
+        .ready = malloc(sizeof(int) * (plan->num_steps + 1)),
+        .multi = curl_multi_init(),
+    };
+    if (!execution.data || !execution.waiting || !execution.skipped || !execution.ready || !execution.multi) {
+        execution_result_add_error(result, "Out of memory executing query");
+    } else {
+        for (int i = 0; i < plan->num_steps; i++) {
+            execution.waiting[i] = plan->steps[i].num_dependencies;
+            if (!execution.waiting[i]) execution.ready[execution.num_ready++] = i;
+        }
+        
+        while (1) {
+            dispatch_ready(&execution);
+            if (execution.in_flight == 0) break;
+            int running;
+            curl_multi_perform(execution.multi, &running);
+            CURLMsg* message;
+            int left;
+            while ((message = curl_multi_info_read(execution.multi, &left))) {
+                if (message->msg != CURLMSG_DONE) continue;
+                char* fetch;
+                CURLcode code = message->data.result;
+                curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, &fetch);
+                fetch_complete(&execution, (Fetch*)fetch, code);
+            }
+            if (execution.num_ready == 0 && execution.in_flight > 0) {
+                curl_multi_poll(execution.multi, NULL, 0, FETCH_POLL_MS, NULL);
+            }
+        }
+        if (plan->has_entities) strip_entity_keys(plan, execution.data);
+    }
+    
+    result->data = execution.data;
+    free(execution.waiting);
+    free(execution.skipped);
+    free(execution.ready);
+    if (execution.multi) curl_multi_cleanup(execution.multi);
+}
+
 // Schema stitching
 void merge_schemas(FederationGateway* gateway) {
     // Create merged schema
@@ -330,6 +2313,7 @@ void register_type_resolver(FederationGateway* gateway,
 typedef struct {
     char* subscription_id;
     ASTNode* query;
+    CachedQuery* source;        // Holds query; released with query_cache_release
     void* context;
     void (*callback)(ExecutionResult*);
 } Subscription;
@@ -344,13 +2328,16 @@ char* eghact_create_subscription(FederationGateway* gateway,
                                 const char* subscription_query,
                                 void* context,
                                 void (*callback)(ExecutionResult*)) {
-    // Parse subscription
-    ASTNode* ast = parse_graphql_query(subscription_query);
+    // Parse subscription, or share the cached parse
+    char error[QUERY_ERROR_SIZE];
+    CachedQuery* entry = query_cache_acquire(gateway, subscription_query, error);
+    if (!entry) return NULL;
     
     // Create subscription
     Subscription* sub = malloc(sizeof(Subscription));
     sub->subscription_id = generate_subscription_id();
-    sub->query = ast;
+    sub->query = entry->ast;
+    sub->source = entry;
     sub->context = context;
     sub->callback = callback;
     
@@ -5,43 +5,166 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
 #include <pthread.h>
+#include <poll.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include "eghact-core.h"
+#include "../perf/eghact-perf.h"
+
+#define REGISTRY_READER_STRIPES 16
+#define RING_POINTS_PER_WEIGHT 160    // Virtual nodes per unit of weight
+#define SCHEDULE_MAX 1024             // Longest weighted round-robin schedule
+#define MAX_WEIGHT 256
+#define HASH_SEED 14695981039346656037ull  // FNV-1a offset basis
+#define HEALTH_CHECK_INTERVAL_MS 5000
+#define HEALTH_CHECK_TIMEOUT_MS 1000
+#define HEALTH_MAX_BACKOFF_MS 30000
+#define HEALTH_MAX_IN_FLIGHT 256      // Probes open at once
+#define HEALTH_RETRY_MS 10            // Wait for a free probe slot
+#define HEALTH_DISCOVERY_MS 1000      // Longest a new instance waits for its first check
+#define HEALTH_MAX_EVENTS 64
+#define MESSAGE_DISPATCHERS 4         // Threads; each owns the targets that hash to it
+#define DISPATCH_BATCH 256            // Most messages a dispatcher takes per pass
+#define CONNECTION_POOL_MAX 8         // Idle connections kept per instance
+#define CONNECT_TIMEOUT_MS 1000
+#define SEND_TIMEOUT_MS 1000
+#define FRAME_HEADER_SIZE 7           // u32 length, u8 priority, u16 sender length
+
+EGHACT_PERF_COUNTER(perf_messages_dispatched, "orchestrator.messages.dispatched");
+EGHACT_PERF_COUNTER(perf_messages_unroutable, "orchestrator.messages.unroutable");
+EGHACT_PERF_COUNTER(perf_messages_failed, "orchestrator.messages.failed");
+EGHACT_PERF_COUNTER(perf_connections_opened, "orchestrator.connections.opened");
+EGHACT_PERF_HISTOGRAM(perf_dispatch_batch, "orchestrator.dispatch.batch");
+EGHACT_PERF_HISTOGRAM(perf_lb_candidates, "orchestrator.lb.candidates");
 
 // Service registry
+//
+// Discovery takes no locks. Instances are grouped by service name in a ServiceGroup,
+// which holds everything a pick needs precomputed: the instances, a smooth weighted
+// round-robin schedule and a consistent-hash ring. Groups are found through an
+// open-addressed table in a RegistrySnapshot, which readers load once and never see
+// change. Registering builds a new group for the one name it touches, copies the table
+// around it and publishes the new snapshot; other groups are shared between snapshots.
+//
+// Readers pin an epoch while they look, as the database's readers do. The replaced
+// snapshot and group are stamped with the epoch of the publish that replaced them and
+// freed once the epoch has moved on twice since, so nobody can still reach them.
+// Instances themselves are never freed, so a node returned by discovery stays valid.
+// Health and load change in place, atomically, without a new snapshot.
+
+// Health check state, owned by the prober thread (see "Health checks" below)
+enum { PROBE_IDLE, PROBE_CONNECTING, PROBE_READING };
+
+typedef struct {
+    int fd;                     // -1 between checks
+    int state;                  // PROBE_*
+    uint32_t generation;        // Bumped when the node's timer changes meaning
+    int failures;               // In a row
+} HealthProbe;
+
+// Idle connections to an instance, kept open between batches by the dispatchers
+typedef struct {
+    pthread_mutex_t lock;
+    int fds[CONNECTION_POOL_MAX];
+    int count;
+} ConnectionPool;
+
 typedef struct ServiceNode {
     char* service_id;
     char* service_name;
     char* host;
     int port;
-    int health_status;
-    int load;
+    int weight;                 // 1 to MAX_WEIGHT
+    _Atomic int health_status;
+    _Atomic int load;           // Picks not yet released with eghact_release_service
+    HealthProbe probe;
+    ConnectionPool connections;
     struct ServiceNode* next;
 } ServiceNode;
 
 typedef struct {
-    ServiceNode* services;
-    pthread_mutex_t lock;
+    uint64_t hash;
+    uint32_t instance;
+} RingPoint;
+
+typedef struct {
+    char* name;
+    uint64_t hash;
+    ServiceNode** instances;
+    int num_instances;
+    uint16_t* schedule;         // Instance indexes in smooth weighted order
+    int schedule_len;
+    RingPoint* ring;            // Sorted by hash
+    int ring_len;
+    _Atomic uint32_t cursor;    // Next round-robin or schedule position
+} ServiceGroup;
+
+typedef struct {
+    ServiceGroup** slots;       // Open addressing; capacity is a power of two
+    size_t capacity;
+    size_t num_groups;
+} RegistrySnapshot;
+
+// Pinned readers of one stripe of threads, on its own cache line
+typedef struct {
+    _Alignas(64) _Atomic uint64_t active[2];  // In even and odd epochs
+} ReaderStripe;
+
+// Freed once no reader can still hold it
+typedef struct {
+    void* object;
+    int is_group;
+    uint64_t epoch;
+} Retired;
+
+typedef struct {
+    ServiceNode* _Atomic services;  // Every instance, newest first; pushed under lock
+    pthread_mutex_t lock;       // Serializes writers; readers never take it
     int num_services;
+    
+    RegistrySnapshot* _Atomic snapshot;
+    ReaderStripe readers[REGISTRY_READER_STRIPES];
+    _Atomic uint64_t reader_epoch;
+    Retired* retired;           // Guarded by lock
+    size_t num_retired;
+    size_t retired_capacity;
 } ServiceRegistry;
 
-// Message queue for inter-service communication
+// Message priorities, most urgent first
+enum { MESSAGE_PRIORITY_HIGH, MESSAGE_PRIORITY_NORMAL, MESSAGE_PRIORITY_LOW, MESSAGE_PRIORITIES };
+
+typedef void (*MessageFreeFn)(void* payload, void* opaque);
+
+// One allocation holds the message and its names, and the payload unless it was
+// handed over by eghact_send_message_owned
 typedef struct Message {
+    struct Message* _Atomic next;
     char* from_service;
     char* to_service;
     char* payload;
-    int priority;
-    struct Message* next;
+    size_t payload_len;
+    int priority;               // MESSAGE_PRIORITY_*
+    MessageFreeFn free_payload; // Owned payloads only
+    void* free_opaque;
 } Message;
 
+// Vyukov's intrusive multi-producer single-consumer queue. Producers swap their message
+// in at head and then link it behind the previous one; the dispatcher alone pops from
+// tail. The stub node means the queue is never empty of nodes, so neither end locks.
 typedef struct {
-    Message* head;
-    Message* tail;
-    pthread_mutex_t lock;
-    pthread_cond_t not_empty;
+    _Alignas(64) Message* _Atomic head;
+    _Alignas(64) Message* tail;
+    Message stub;
 } MessageQueue;
 
 // Load balancer
@@ -55,232 +178,1047 @@ typedef enum {
 typedef struct {
     ServiceRegistry* registry;
     LoadBalancingStrategy strategy;
-    int current_index; // For round-robin
 } LoadBalancer;
 
+struct Dispatcher;
+
 // Global orchestrator state
 typedef struct {
     ServiceRegistry* registry;
-    MessageQueue* message_queue;
+    struct Dispatcher* dispatchers;
+    int num_dispatchers;
     LoadBalancer* load_balancer;
     pthread_t health_check_thread;
-    pthread_t message_dispatcher_thread;
 } EghactOrchestrator;
 
+// A dispatcher thread and the queues, one per priority, of the targets it owns
+typedef struct Dispatcher {
+    MessageQueue queues[MESSAGE_PRIORITIES];
+    EghactOrchestrator* orch;
+    pthread_mutex_t lock;       // Only for waiting on wake
+    pthread_cond_t wake;
+    _Atomic int sleeping;       // Producers signal only while set
+    pthread_t thread;
+} Dispatcher;
+
+static _Thread_local uint32_t t_reader_stripe;  // 1-based; 0 until first picked
+static _Atomic uint32_t g_reader_stripes;
+
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t len) {
+    const unsigned char* bytes = data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// FNV-1a spreads similar short keys poorly over the ring, so points get a final mix
+static uint64_t hash_mix(uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    return hash ^ (hash >> 33);
+}
+
+// Pins the current epoch; pass the result to registry_read_end
+static _Atomic uint64_t* registry_read_begin(ServiceRegistry* registry) {
+    if (t_reader_stripe == 0) {
+        t_reader_stripe = atomic_fetch_add_explicit(&g_reader_stripes, 1, memory_order_relaxed) % REGISTRY_READER_STRIPES + 1;
+    }
+    ReaderStripe* stripe = &registry->readers[t_reader_stripe - 1];
+    for (;;) {
+        uint64_t epoch = atomic_load(&registry->reader_epoch);
+        _Atomic uint64_t* active = &stripe->active[epoch & 1];
+        atomic_fetch_add(active, 1);
+        
+        // If the epoch moved on meanwhile, a reclaimer may have checked before the pin landed
+        if (atomic_load(&registry->reader_epoch) == epoch) return active;
+        atomic_fetch_sub(active, 1);
+    }
+}
+
+static inline void registry_read_end(_Atomic uint64_t* active) {
+    atomic_fetch_sub_explicit(active, 1, memory_order_release);
+}
+
+static void group_free(ServiceGroup* group) {
+    if (!group) return;
+    free(group->name);
+    free(group->instances);
+    free(group->schedule);
+    free(group->ring);
+    free(group);
+}
+
+static void snapshot_free(RegistrySnapshot* snapshot) {
+    if (!snapshot) return;
+    free(snapshot->slots);
+    free(snapshot);
+}
+
+static ServiceGroup* snapshot_find(const RegistrySnapshot* snapshot, const char* name, uint64_t hash) {
+    size_t mask = snapshot->capacity - 1;
+    for (size_t i = hash & mask; snapshot->slots[i]; i = (i + 1) & mask) {
+        ServiceGroup* group = snapshot->slots[i];
+        if (group->hash == hash && strcmp(group->name, name) == 0) return group;
+    }
+    return NULL;
+}
+
+// Fills the smooth weighted round-robin order: each step every instance gains its
+// weight, the one with the most is picked and loses the total. Heavy instances are
+// spread through the schedule instead of picked in runs. Weights too large for
+// SCHEDULE_MAX are scaled down first.
+static int group_schedule(ServiceGroup* group) {
+    int n = group->num_instances;
+    int* weights = malloc(sizeof(int) * n);
+    int* current = calloc(n, sizeof(int));
+    if (!weights || !current) {
+        free(weights);
+        free(current);
+        return 0;
+    }
+    
+    int total = 0;
+    for (int i = 0; i < n; i++) total += group->instances[i]->weight;
+    for (int i = 0; i < n; i++) {
+        weights[i] = group->instances[i]->weight;
+        if (total > SCHEDULE_MAX) {
+            weights[i] = (int)((int64_t)weights[i] * SCHEDULE_MAX / total);
+            if (weights[i] < 1) weights[i] = 1;
+        }
+    }
+    total = 0;
+    for (int i = 0; i < n; i++) total += weights[i];
+    
+    group->schedule = malloc(sizeof(uint16_t) * total);
+    if (group->schedule) {
+        for (int step = 0; step < total; step++) {
+            int best = 0;
+            for (int i = 0; i < n; i++) {
+                current[i] += weights[i];
+                if (current[i] > current[best]) best = i;
+            }
+            current[best] -= total;
+            group->schedule[step] = (uint16_t)best;
+        }
+        group->schedule_len = total;
+    }
+    free(weights);
+    free(current);
+    return group->schedule != NULL;
+}
+
+static int ring_point_compare(const void* a, const void* b) {
+    const RingPoint* x = a;
+    const RingPoint* y = b;
+    if (x->hash != y->hash) return x->hash < y->hash ? -1 : 1;
+    return (int)x->instance - (int)y->instance;
+}
+
+// Places RING_POINTS_PER_WEIGHT points per unit of weight for each instance, hashed
+// from its id, so adding or losing an instance only moves the keys next to its points
+static int group_ring(ServiceGroup* group) {
+    int len = 0;
+    for (int i = 0; i < group->num_instances; i++) {
+        len += group->instances[i]->weight * RING_POINTS_PER_WEIGHT;
+    }
+    group->ring = malloc(sizeof(RingPoint) * len);
+    if (!group->ring) return 0;
+    
+    int count = 0;
+    for (int i = 0; i < group->num_instances; i++) {
+        const char* id = group->instances[i]->service_id;
+        uint64_t base = hash_bytes(HASH_SEED, id, strlen(id));
+        for (int point = 0; point < group->instances[i]->weight * RING_POINTS_PER_WEIGHT; point++) {
+            uint64_t hash = hash_mix(hash_bytes(base, &point, sizeof(point)));
+            group->ring[count++] = (RingPoint){ hash, (uint32_t)i };
+        }
+    }
+    qsort(group->ring, count, sizeof(RingPoint), ring_point_compare);
+    group->ring_len = count;
+    return 1;
+}
+
+// Group for name holding the instances of old, if any, and node
+static ServiceGroup* group_build(const ServiceGroup* old, ServiceNode* node, uint64_t hash) {
+    ServiceGroup* group = calloc(1, sizeof(ServiceGroup));
+    if (!group) return NULL;
+    int count = old ? old->num_instances : 0;
+    group->name = strdup(node->service_name);
+    group->hash = hash;
+    group->instances = malloc(sizeof(ServiceNode*) * (count + 1));
+    if (!group->name || !group->instances) {
+        group_free(group);
+        return NULL;
+    }
+    if (count > 0) memcpy(group->instances, old->instances, sizeof(ServiceNode*) * count);
+    group->instances[count] = node;
+    group->num_instances = count + 1;
+    
+    if (!group_schedule(group) || !group_ring(group)) {
+        group_free(group);
+        return NULL;
+    }
+    atomic_init(&group->cursor, old ? atomic_load_explicit(&old->cursor, memory_order_relaxed) : 0);
+    return group;
+}
+
+// Copy of old with group in the slot for its name, resized to stay at most half full
+static RegistrySnapshot* snapshot_with(const RegistrySnapshot* old, ServiceGroup* group, int replaces) {
+    size_t num_groups = (old ? old->num_groups : 0) + (replaces ? 0 : 1);
+    size_t capacity = old ? old->capacity : 16;
+    while (num_groups * 2 > capacity) capacity *= 2;
+    
+    RegistrySnapshot* snapshot = malloc(sizeof(RegistrySnapshot));
+    ServiceGroup** slots = calloc(capacity, sizeof(ServiceGroup*));
+    if (!snapshot || !slots) {
+        free(snapshot);
+        free(slots);
+        return NULL;
+    }
+    snapshot->slots = slots;
+    snapshot->capacity = capacity;
+    snapshot->num_groups = num_groups;
+    
+    size_t mask = capacity - 1;
+    for (size_t i = 0; old && i < old->capacity; i++) {
+        ServiceGroup* existing = old->slots[i];
+        if (!existing || (existing->hash == group->hash && strcmp(existing->name, group->name) == 0)) continue;
+        size_t slot = existing->hash & mask;
+        while (slots[slot]) slot = (slot + 1) & mask;
+        slots[slot] = existing;
+    }
+    size_t slot = group->hash & mask;
+    while (slots[slot]) slot = (slot + 1) & mask;
+    slots[slot] = group;
+    return snapshot;
+}
+
+// Queues object to be freed once readers are done with it. Caller holds the lock. If
+// the list can't grow the object is never freed.
+static void registry_retire(ServiceRegistry* registry, void* object, int is_group) {
+    if (registry->num_retired == registry->retired_capacity) {
+        size_t capacity = registry->retired_capacity ? registry->retired_capacity * 2 : 16;
+        Retired* retired = realloc(registry->retired, sizeof(Retired) * capacity);
+        if (!retired) return;
+        registry->retired = retired;
+        registry->retired_capacity = capacity;
+    }
+    uint64_t epoch = atomic_load(&registry->reader_epoch);
+    registry->retired[registry->num_retired++] = (Retired){ object, is_group, epoch };
+}
+
+// Moves the epoch on while no reader is left in the previous one, then frees what was
+// stamped two epochs back. Caller holds the lock.
+static void registry_reclaim(ServiceRegistry* registry) {
+    uint64_t epoch = atomic_load(&registry->reader_epoch);
+    for (int step = 0; step < 2; step++) {
+        uint64_t lingering = 0;
+        for (int i = 0; i < REGISTRY_READER_STRIPES; i++) {
+            lingering += atomic_load(&registry->readers[i].active[(epoch + 1) & 1]);
+        }
+        if (lingering > 0) break;
+        atomic_store(&registry->reader_epoch, ++epoch);
+    }
+    
+    size_t kept = 0;
+    for (size_t i = 0; i < registry->num_retired; i++) {
+        Retired* retired = &registry->retired[i];
+        if (retired->epoch + 2 <= epoch) {
+            if (retired->is_group) group_free(retired->object);
+            else snapshot_free(retired->object);
+        } else {
+            registry->retired[kept++] = *retired;
+        }
+    }
+    registry->num_retired = kept;
+}
+
+// Adds node to its group and publishes the result; 0 if out of memory. Caller holds the lock.
+static int registry_publish(ServiceRegistry* registry, ServiceNode* node) {
+    RegistrySnapshot* old = atomic_load(&registry->snapshot);
+    uint64_t hash = hash_bytes(HASH_SEED, node->service_name, strlen(node->service_name));
+    ServiceGroup* old_group = old ? snapshot_find(old, node->service_name, hash) : NULL;
+    ServiceGroup* group = group_build(old_group, node, hash);
+    RegistrySnapshot* snapshot = group ? snapshot_with(old, group, old_group != NULL) : NULL;
+    if (!snapshot) {
+        group_free(group);
+        return 0;
+    }
+    
+    // A reader still on the old snapshot loaded it before this store, so it pinned an
+    // epoch no later than the one the retirements are stamped with
+    atomic_store(&registry->snapshot, snapshot);
+    if (old) registry_retire(registry, old, 0);
+    if (old_group) registry_retire(registry, old_group, 1);
+    registry_reclaim(registry);
+    return 1;
+}
+
+// Message queues
+//
+// Each target service belongs to one dispatcher, picked by hashing its name, so its
+// messages are delivered in the order they were sent at each priority. Producers push
+// without locks and only take the dispatcher's mutex to wake it when it is asleep.
+// Both sides use sequentially consistent operations for the handoff: a producer pushes
+// and then reads sleeping, the dispatcher sets sleeping and then reads the queues, so
+// at least one of them sees the other.
+
+static void queue_init(MessageQueue* queue) {
+    atomic_init(&queue->stub.next, NULL);
+    atomic_init(&queue->head, &queue->stub);
+    queue->tail = &queue->stub;
+}
+
+static void queue_push(MessageQueue* queue, Message* msg) {
+    atomic_store_explicit(&msg->next, NULL, memory_order_relaxed);
+    Message* prev = atomic_exchange(&queue->head, msg);
+    atomic_store_explicit(&prev->next, msg, memory_order_release);
+}
+
+// Oldest message, or NULL if there is none or a producer is still linking one in.
+// Dispatcher only.
+static Message* queue_pop(MessageQueue* queue) {
+    Message* tail = queue->tail;
+    Message* next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (tail == &queue->stub) {
+        if (!next) return NULL;
+        queue->tail = tail = next;
+        next = atomic_load_explicit(&next->next, memory_order_acquire);
+    }
+    if (!next) {
+        if (tail != atomic_load(&queue->head)) return NULL;
+        // tail is the last message; the stub goes behind it so it can be taken
+        queue_push(queue, &queue->stub);
+        next = atomic_load_explicit(&tail->next, memory_order_acquire);
+        if (!next) return NULL;
+    }
+    queue->tail = next;
+    return tail;
+}
+
+// False while a push is in progress as well. Dispatcher only.
+static inline int queue_empty(MessageQueue* queue) {
+    return queue->tail == &queue->stub && atomic_load(&queue->head) == &queue->stub;
+}
+
 // Initialize orchestrator
 EghactOrchestrator* eghact_orchestrator_init() {
     EghactOrchestrator* orch = malloc(sizeof(EghactOrchestrator));
     
     // Initialize service registry
-    orch->registry = malloc(sizeof(ServiceRegistry));
+    orch->registry = calloc(1, sizeof(ServiceRegistry));
     orch->registry->services = NULL;
     orch->registry->num_services = 0;
     pthread_mutex_init(&orch->registry->lock, NULL);
     
-    // Initialize message queue
-    orch->message_queue = malloc(sizeof(MessageQueue));
-    orch->message_queue->head = NULL;
-    orch->message_queue->tail = NULL;
-    pthread_mutex_init(&orch->message_queue->lock, NULL);
-    pthread_cond_init(&orch->message_queue->not_empty, NULL);
+    // Initialize dispatchers and their queues
+    orch->num_dispatchers = MESSAGE_DISPATCHERS;
+    orch->dispatchers = aligned_alloc(_Alignof(Dispatcher), sizeof(Dispatcher) * MESSAGE_DISPATCHERS);
+    for (int i = 0; i < orch->num_dispatchers; i++) {
+        Dispatcher* dispatcher = &orch->dispatchers[i];
+        for (int level = 0; level < MESSAGE_PRIORITIES; level++) {
+            queue_init(&dispatcher->queues[level]);
+        }
+        dispatcher->orch = orch;
+        pthread_mutex_init(&dispatcher->lock, NULL);
+        pthread_cond_init(&dispatcher->wake, NULL);
+        atomic_init(&dispatcher->sleeping, 0);
+    }
     
     // Initialize load balancer
     orch->load_balancer = malloc(sizeof(LoadBalancer));
     orch->load_balancer->registry = orch->registry;
     orch->load_balancer->strategy = LB_ROUND_ROBIN;
-    orch->load_balancer->current_index = 0;
     
     // Start background threads
     pthread_create(&orch->health_check_thread, NULL, health_check_worker, orch);
-    pthread_create(&orch->message_dispatcher_thread, NULL, message_dispatcher_worker, orch);
+    for (int i = 0; i < orch->num_dispatchers; i++) {
+        pthread_create(&orch->dispatchers[i].thread, NULL, message_dispatcher_worker,
+                       &orch->dispatchers[i]);
+    }
     
     return orch;
 }
 
-// Register a service
-int eghact_register_service(EghactOrchestrator* orch, const char* name, 
-                           const char* host, int port) {
+// Register a service; weight counts for LB_WEIGHTED and LB_IP_HASH and is clamped to
+// 1..MAX_WEIGHT
+int eghact_register_service_weighted(EghactOrchestrator* orch, const char* name,
+                                    const char* host, int port, int weight) {
     ServiceNode* node = malloc(sizeof(ServiceNode));
+    if (!node) return -1;
     node->service_id = generate_service_id();
     node->service_name = strdup(name);
     node->host = strdup(host);
     node->port = port;
-    node->health_status = 1; // Assume healthy initially
-    node->load = 0;
+    node->weight = weight < 1 ? 1 : weight > MAX_WEIGHT ? MAX_WEIGHT : weight;
+    atomic_init(&node->health_status, 1); // Assume healthy initially
+    atomic_init(&node->load, 0);
+    node->probe = (HealthProbe){ .fd = -1, .state = PROBE_IDLE };
+    pthread_mutex_init(&node->connections.lock, NULL);
+    node->connections.count = 0;
     
     pthread_mutex_lock(&orch->registry->lock);
-    node->next = orch->registry->services;
-    orch->registry->services = node;
-    orch->registry->num_services++;
+    int published = registry_publish(orch->registry, node);
+    if (published) {
+        node->next = atomic_load_explicit(&orch->registry->services, memory_order_relaxed);
+        atomic_store(&orch->registry->services, node);  // The prober walks the list unlocked
+        orch->registry->num_services++;
+    }
     pthread_mutex_unlock(&orch->registry->lock);
     
+    if (!published) {
+        pthread_mutex_destroy(&node->connections.lock);
+        free(node->service_id);
+        free(node->service_name);
+        free(node->host);
+        free(node);
+        return -1;
+    }
     return 0;
 }
 
+int eghact_register_service(EghactOrchestrator* orch, const char* name,
+                           const char* host, int port) {
+    return eghact_register_service_weighted(orch, name, host, port, 1);
+}
+
 // Service discovery
 ServiceNode* eghact_discover_service(EghactOrchestrator* orch, const char* service_name) {
-    return select_service_instance(orch->load_balancer, service_name);
+    return select_service_instance(orch->load_balancer, service_name, NULL);
 }
 
-// Load balancing implementation
-ServiceNode* select_service_instance(LoadBalancer* lb, const char* service_name) {
-    pthread_mutex_lock(&lb->registry->lock);
-    
-    // Collect all instances of the service
-    ServiceNode** instances = NULL;
-    int num_instances = 0;
-    ServiceNode* current = lb->registry->services;
-    
-    while (current) {
-        if (strcmp(current->service_name, service_name) == 0 && 
-            current->health_status == 1) {
-            num_instances++;
-            instances = realloc(instances, sizeof(ServiceNode*) * num_instances);
-            instances[num_instances - 1] = current;
+// Discovery for LB_IP_HASH: the same key keeps reaching the same instance while it is
+// healthy, and only keys next to an instance's ring points move when instances change
+ServiceNode* eghact_discover_service_for_key(EghactOrchestrator* orch, const char* service_name,
+                                           const char* key) {
+    return select_service_instance(orch->load_balancer, service_name, key);
+}
+
+// Ends a pick, for LB_LEAST_CONNECTIONS
+void eghact_release_service(ServiceNode* node) {
+    if (node) atomic_fetch_sub_explicit(&node->load, 1, memory_order_relaxed);
+}
+
+static inline int node_healthy(ServiceNode* node) {
+    return atomic_load_explicit(&node->health_status, memory_order_relaxed) == 1;
+}
+
+static uint32_t lb_random(void) {
+    static _Thread_local uint64_t state;
+    if (state == 0) state = hash_mix((uint64_t)(uintptr_t)&state) | 1;
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return (uint32_t)(state >> 32);
+}
+
+// The first healthy instance at or after position start of order, or NULL
+static ServiceNode* group_next_healthy(const ServiceGroup* group, const uint16_t* order,
+                                       int len, uint32_t start) {
+    for (int i = 0; i < len; i++) {
+        uint32_t position = (start + i) % len;
+        ServiceNode* node = group->instances[order ? order[position] : position];
+        if (node_healthy(node)) return node;
+    }
+    return NULL;
+}
+
+static ServiceNode* group_round_robin(ServiceGroup* group) {
+    uint32_t start = atomic_fetch_add_explicit(&group->cursor, 1, memory_order_relaxed);
+    return group_next_healthy(group, NULL, group->num_instances, start);
+}
+
+static ServiceNode* group_select(ServiceGroup* group, LoadBalancingStrategy strategy, const char* key) {
+    int n = group->num_instances;
+    switch (strategy) {
+        case LB_LEAST_CONNECTIONS: {
+            // The less loaded of two random instances: near least-loaded, without a scan
+            ServiceNode* a = group->instances[lb_random() % n];
+            ServiceNode* b = group->instances[lb_random() % n];
+            if (!node_healthy(a)) a = b;
+            if (!node_healthy(b)) b = a;
+            if (node_healthy(a)) {
+                return atomic_load_explicit(&b->load, memory_order_relaxed) <
+                       atomic_load_explicit(&a->load, memory_order_relaxed) ? b : a;
+            }
+            return group_next_healthy(group, NULL, n, lb_random());
         }
-        current = current->next;
+            
+        case LB_WEIGHTED: {
+            uint32_t start = atomic_fetch_add_explicit(&group->cursor, 1, memory_order_relaxed);
+            return group_next_healthy(group, group->schedule, group->schedule_len, start);
+        }
+            
+        case LB_IP_HASH: {
+            // Without a key there is nothing to hash
+            if (!key) return group_round_robin(group);
+            
+            // First point clockwise from the key; unhealthy instances pass it on
+            uint64_t hash = hash_mix(hash_bytes(HASH_SEED, key, strlen(key)));
+            int low = 0, high = group->ring_len;
+            while (low < high) {
+                int mid = (low + high) / 2;
+                if (group->ring[mid].hash < hash) low = mid + 1;
+                else high = mid;
+            }
+            for (int i = 0; i < group->ring_len; i++) {
+                ServiceNode* node = group->instances[group->ring[(low + i) % group->ring_len].instance];
+                if (node_healthy(node)) return node;
+            }
+            return NULL;
+        }
+            
+        case LB_ROUND_ROBIN:
+        default:
+            return group_round_robin(group);
     }
+}
+
+// Load balancing implementation; key is only used by LB_IP_HASH
+ServiceNode* select_service_instance(LoadBalancer* lb, const char* service_name, const char* key) {
+    ServiceRegistry* registry = lb->registry;
+    _Atomic uint64_t* pin = registry_read_begin(registry);
     
+    RegistrySnapshot* snapshot = atomic_load(&registry->snapshot);
+    uint64_t hash = hash_bytes(HASH_SEED, service_name, strlen(service_name));
+    ServiceGroup* group = snapshot ? snapshot_find(snapshot, service_name, hash) : NULL;
     ServiceNode* selected = NULL;
+    EGHACT_PERF_RECORD(perf_lb_candidates, group ? group->num_instances : 0);
     
-    if (num_instances > 0) {
-        switch (lb->strategy) {
-            case LB_ROUND_ROBIN:
-                selected = instances[lb->current_index % num_instances];
-                lb->current_index++;
-                break;
-                
-            case LB_LEAST_CONNECTIONS:
-                selected = instances[0];
-                for (int i = 1; i < num_instances; i++) {
-                    if (instances[i]->load < selected->load) {
-                        selected = instances[i];
-                    }
-                }
-                break;
-                
-            case LB_WEIGHTED:
-                // Implement weighted selection based on service capacity
-                break;
-                
-            case LB_IP_HASH:
-                // Implement consistent hashing
-                break;
-        }
-        
+    if (group) {
+        selected = group_select(group, lb->strategy, key);
         if (selected) {
-            selected->load++; // Increment connection count
+            atomic_fetch_add_explicit(&selected->load, 1, memory_order_relaxed); // Increment connection count
         }
     }
     
-    free(instances);
-    pthread_mutex_unlock(&lb->registry->lock);
-    
+    registry_read_end(pin);
     return selected;
 }
 
 // Inter-service communication
+//
+// Messages are framed on the wire as a big-endian u32 length of the rest of the frame,
+// a u8 priority, a big-endian u16 sender length, the sender's name and the payload.
+
+static void payload_free(void* payload, void* opaque) {
+    (void)opaque;
+    free(payload);
+}
+
+// Message naming from and to with room for payload_room more bytes after the names,
+// at priority clamped to the known levels; NULL if it can't be framed or allocated
+static Message* message_alloc(const char* from, const char* to, size_t payload_len,
+                              size_t payload_room, int priority) {
+    size_t from_len = strlen(from);
+    size_t to_len = strlen(to);
+    if (from_len > UINT16_MAX || payload_len > UINT32_MAX - 3 - from_len) return NULL;
+    
+    Message* msg = malloc(sizeof(Message) + from_len + to_len + 2 + payload_room);
+    if (!msg) return NULL;
+    msg->from_service = (char*)(msg + 1);
+    msg->to_service = msg->from_service + from_len + 1;
+    memcpy(msg->from_service, from, from_len + 1);
+    memcpy(msg->to_service, to, to_len + 1);
+    msg->payload = payload_room ? msg->to_service + to_len + 1 : NULL;
+    msg->payload_len = payload_len;
+    msg->priority = priority < MESSAGE_PRIORITY_HIGH ? MESSAGE_PRIORITY_HIGH
+                  : priority > MESSAGE_PRIORITY_LOW ? MESSAGE_PRIORITY_LOW : priority;
+    msg->free_payload = NULL;
+    msg->free_opaque = NULL;
+    return msg;
+}
+
+static void message_free(Message* msg) {
+    if (msg->free_payload) msg->free_payload(msg->payload, msg->free_opaque);
+    free(msg);
+}
+
+static void message_enqueue(EghactOrchestrator* orch, Message* msg) {
+    uint64_t hash = hash_bytes(HASH_SEED, msg->to_service, strlen(msg->to_service));
+    Dispatcher* dispatcher = &orch->dispatchers[hash % (uint64_t)orch->num_dispatchers];
+    queue_push(&dispatcher->queues[msg->priority], msg);
+    if (atomic_load(&dispatcher->sleeping)) {
+        pthread_mutex_lock(&dispatcher->lock);
+        pthread_cond_signal(&dispatcher->wake);
+        pthread_mutex_unlock(&dispatcher->lock);
+    }
+}
+
+// Queues a copy of payload at one of the MESSAGE_PRIORITY_* levels
+int eghact_send_message_priority(EghactOrchestrator* orch, const char* from,
+                                const char* to, const char* payload, int priority) {
+    size_t len = strlen(payload);
+    Message* msg = message_alloc(from, to, len, len + 1, priority);
+    if (!msg) return -1;
+    memcpy(msg->payload, payload, len + 1);
+    message_enqueue(orch, msg);
+    return 0;
+}
+
 int eghact_send_message(EghactOrchestrator* orch, const char* from, 
                        const char* to, const char* payload) {
-    Message* msg = malloc(sizeof(Message));
-    msg->from_service = strdup(from);
-    msg->to_service = strdup(to);
-    msg->payload = strdup(payload);
-    msg->priority = 5; // Default priority
-    msg->next = NULL;
-    
-    pthread_mutex_lock(&orch->message_queue->lock);
-    
-    if (orch->message_queue->tail) {
-        orch->message_queue->tail->next = msg;
-        orch->message_queue->tail = msg;
-    } else {
-        orch->message_queue->head = orch->message_queue->tail = msg;
+    return eghact_send_message_priority(orch, from, to, payload, MESSAGE_PRIORITY_NORMAL);
+}
+
+// Queues len bytes at payload without copying them. The message owns payload from the
+// call on, even if it fails, and hands it to free_payload(payload, opaque) once sent or
+// dropped; a NULL free_payload means free().
+int eghact_send_message_owned(EghactOrchestrator* orch, const char* from, const char* to,
+                             void* payload, size_t len, int priority,
+                             MessageFreeFn free_payload, void* opaque) {
+    if (!free_payload) free_payload = payload_free;
+    Message* msg = message_alloc(from, to, len, 0, priority);
+    if (!msg) {
+        free_payload(payload, opaque);
+        return -1;
+    }
+    msg->payload = payload;
+    msg->free_payload = free_payload;
+    msg->free_opaque = opaque;
+    message_enqueue(orch, msg);
+    return 0;
+}
+
+// Health checks
+//
+// One prober thread checks every instance on a schedule of its own, with all the probes
+// in flight at once on non-blocking sockets in an epoll set. A probe connects, sends
+// HEALTH_CHECK and wants a reply starting with OK before its deadline; anything else,
+// the deadline passing included, marks the instance unhealthy. An instance's next check,
+// or the deadline of its probe in flight, sits in one min-heap. Entries carry the probe
+// generation they were made for, so one left stale by a probe that finished early is
+// skipped. Checks come HEALTH_CHECK_INTERVAL_MS apart, give or take a fifth so instances
+// registered together drift apart, and back off while an instance keeps failing. Status
+// is published with an atomic store, which discovery reads without a lock.
+//
+// Instances are only ever added, at the head of the registry's list, so the prober
+// finds new ones by walking from the head to the first one it has seen before.
+
+typedef struct {
+    uint64_t when;              // CLOCK_MONOTONIC ms
+    ServiceNode* node;
+    uint32_t generation;
+} ProbeTimer;
+
+typedef struct {
+    int epoll_fd;
+    ProbeTimer* timers;         // Min-heap by when
+    int num_timers;
+    int timers_capacity;
+    int in_flight;
+    ServiceNode* newest;        // Head of the registry's list when last walked
+} HealthProber;
+
+static uint64_t monotonic_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static void prober_push(HealthProber* prober, ServiceNode* node, uint64_t when) {
+    if (prober->num_timers == prober->timers_capacity) {
+        int capacity = prober->timers_capacity ? prober->timers_capacity * 2 : 64;
+        ProbeTimer* timers = realloc(prober->timers, sizeof(ProbeTimer) * capacity);
+        if (!timers) return;  // The instance goes unchecked rather than the prober down
+        prober->timers = timers;
+        prober->timers_capacity = capacity;
+    }
+    ProbeTimer timer = { when, node, node->probe.generation };
+    int i = prober->num_timers++;
+    while (i > 0 && prober->timers[(i - 1) / 2].when > when) {
+        prober->timers[i] = prober->timers[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    prober->timers[i] = timer;
+}
+
+static ProbeTimer prober_pop(HealthProber* prober) {
+    ProbeTimer top = prober->timers[0];
+    ProbeTimer last = prober->timers[--prober->num_timers];
+    int i = 0;
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= prober->num_timers) break;
+        if (child + 1 < prober->num_timers && prober->timers[child + 1].when < prober->timers[child].when) {
+            child++;
+        }
+        if (prober->timers[child].when >= last.when) break;
+        prober->timers[i] = prober->timers[child];
+        i = child;
+    }
+    if (prober->num_timers > 0) prober->timers[i] = last;
+    return top;
+}
+
+// Next check: the interval doubled per consecutive failure up to the cap, then jittered
+static void probe_schedule(HealthProber* prober, ServiceNode* node, uint64_t now) {
+    uint64_t interval = HEALTH_CHECK_INTERVAL_MS;
+    for (int i = 0; i < node->probe.failures && interval < HEALTH_MAX_BACKOFF_MS; i++) {
+        interval *= 2;
+    }
+    if (interval > HEALTH_MAX_BACKOFF_MS) interval = HEALTH_MAX_BACKOFF_MS;
+    interval = interval * (80 + lb_random() % 41) / 100;
+    node->probe.generation++;
+    prober_push(prober, node, now + interval);
+}
+
+static void probe_finish(HealthProber* prober, ServiceNode* node, int healthy, uint64_t now) {
+    if (node->probe.fd >= 0) {
+        close(node->probe.fd);  // Also leaves the epoll set
+        node->probe.fd = -1;
+        prober->in_flight--;
+    }
+    node->probe.state = PROBE_IDLE;
+    node->probe.failures = healthy ? 0 : node->probe.failures + 1;
+    if (atomic_load_explicit(&node->health_status, memory_order_relaxed) != healthy) {
+        atomic_store(&node->health_status, healthy);
+    }
+    probe_schedule(prober, node, now);
+}
+
+static void probe_start(HealthProber* prober, ServiceNode* node, uint64_t now) {
+    if (prober->in_flight >= HEALTH_MAX_IN_FLIGHT) {
+        // Waits for a slot; stays valid since nothing else is scheduled for the node
+        prober_push(prober, node, now + HEALTH_RETRY_MS);
+        return;
     }
     
-    pthread_cond_signal(&orch->message_queue->not_empty);
-    pthread_mutex_unlock(&orch->message_queue->lock);
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(node->port),
+        .sin_addr.s_addr = inet_addr(node->host),
+    };
+    int fd = addr.sin_addr.s_addr == INADDR_NONE ? -1
+           : socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        probe_finish(prober, node, 0, now);
+        return;
+    }
+    node->probe.fd = fd;
+    prober->in_flight++;
     
-    return 0;
+    // Writable once connected, or once the connect has failed
+    struct epoll_event event = { .events = EPOLLOUT, .data.ptr = node };
+    if ((connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 && errno != EINPROGRESS) ||
+        epoll_ctl(prober->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        probe_finish(prober, node, 0, now);
+        return;
+    }
+    node->probe.state = PROBE_CONNECTING;
+    node->probe.generation++;
+    prober_push(prober, node, now + HEALTH_CHECK_TIMEOUT_MS);
+}
+
+static void probe_ready(HealthProber* prober, ServiceNode* node, uint64_t now) {
+    int fd = node->probe.fd;
+    if (node->probe.state == PROBE_CONNECTING) {
+        int error = 0;
+        socklen_t len = sizeof(error);
+        struct epoll_event event = { .events = EPOLLIN, .data.ptr = node };
+        if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) != 0 || error != 0 ||
+            send(fd, "HEALTH_CHECK", 12, MSG_NOSIGNAL) != 12 ||
+            epoll_ctl(prober->epoll_fd, EPOLL_CTL_MOD, fd, &event) != 0) {
+            probe_finish(prober, node, 0, now);
+            return;
+        }
+        node->probe.state = PROBE_READING;
+        return;
+    }
+    
+    char response[32];
+    ssize_t n = recv(fd, response, sizeof(response), 0);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+    probe_finish(prober, node, n >= 2 && memcmp(response, "OK", 2) == 0, now);
 }
 
 // Health check worker
 void* health_check_worker(void* arg) {
     EghactOrchestrator* orch = (EghactOrchestrator*)arg;
+    HealthProber prober = { .epoll_fd = epoll_create1(EPOLL_CLOEXEC) };
+    if (prober.epoll_fd < 0) return NULL;
+    struct epoll_event events[HEALTH_MAX_EVENTS];
     
     while (1) {
-        pthread_mutex_lock(&orch->registry->lock);
-        ServiceNode* current = orch->registry->services;
+        uint64_t now = monotonic_ms();
         
-        while (current) {
-            // Perform health check
-            int sock = socket(AF_INET, SOCK_STREAM, 0);
-            struct sockaddr_in addr;
-            addr.sin_family = AF_INET;
-            addr.sin_port = htons(current->port);
-            addr.sin_addr.s_addr = inet_addr(current->host);
-            
-            // Set timeout
-            struct timeval timeout;
-            timeout.tv_sec = 1;
-            timeout.tv_usec = 0;
-            setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
-            
-            if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
-                // Send health check request
-                send(sock, "HEALTH_CHECK", 12, 0);
-                char response[32];
-                if (recv(sock, response, sizeof(response), 0) > 0) {
-                    current->health_status = (strcmp(response, "OK") == 0) ? 1 : 0;
-                } else {
-                    current->health_status = 0;
-                }
-            } else {
-                current->health_status = 0;
-            }
-            
-            close(sock);
-            current = current->next;
+        // Instances registered since the last turn are checked right away
+        ServiceNode* head = atomic_load(&orch->registry->services);
+        for (ServiceNode* node = head; node && node != prober.newest; node = node->next) {
+            prober_push(&prober, node, now);
+        }
+        prober.newest = head;
+        
+        // Start the checks that are due and fail the probes past their deadline
+        while (prober.num_timers > 0 && prober.timers[0].when <= now) {
+            ProbeTimer timer = prober_pop(&prober);
+            ServiceNode* node = timer.node;
+            if (timer.generation != node->probe.generation) continue;
+            if (node->probe.state == PROBE_IDLE) probe_start(&prober, node, now);
+            else probe_finish(&prober, node, 0, now);
         }
         
-        pthread_mutex_unlock(&orch->registry->lock);
-        sleep(5); // Check every 5 seconds
+        // Sleeps until the next timer, waking at least this often to find new instances
+        int timeout = HEALTH_DISCOVERY_MS;
+        if (prober.num_timers > 0 && prober.timers[0].when - now < (uint64_t)timeout) {
+            timeout = (int)(prober.timers[0].when - now);
+        }
+        int count = epoll_wait(prober.epoll_fd, events, HEALTH_MAX_EVENTS, timeout);
+        now = monotonic_ms();
+        for (int i = 0; i < count; i++) {
+            probe_ready(&prober, events[i].data.ptr, now);
+        }
     }
     
     return NULL;
 }
 
+// Message dispatchers
+//
+// A dispatcher takes up to DISPATCH_BATCH messages from its most urgent queue that has
+// any, so lower levels wait while higher ones have work, and groups them by target, and
+// by sender too under LB_IP_HASH where the sender picks the instance. Send order holds
+// within a group. Each group costs one discovery and goes out as one writev of all its
+// frames on a connection from the instance's pool. A failed send closes the connection
+// and is retried once on a new one, so the peer may see frames of the group twice or a
+// truncated frame before the connection drops, but never frames out of order.
+
+typedef struct {
+    uint64_t key;               // Hash of what the message is grouped by
+    int index;                  // In the batch, to keep send order
+} BatchEntry;
+
+static int batch_entry_compare(const void* a, const void* b) {
+    const BatchEntry* x = a;
+    const BatchEntry* y = b;
+    if (x->key != y->key) return x->key < y->key ? -1 : 1;
+    return x->index - y->index;
+}
+
+static int connection_open(ServiceNode* node) {
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(node->port),
+        .sin_addr.s_addr = inet_addr(node->host),
+    };
+    if (addr.sin_addr.s_addr == INADDR_NONE) return -1;
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        struct pollfd pending = { .fd = fd, .events = POLLOUT };
+        int error = 0;
+        socklen_t len = sizeof(error);
+        if (errno != EINPROGRESS || poll(&pending, 1, CONNECT_TIMEOUT_MS) != 1 ||
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) != 0 || error != 0) {
+            close(fd);
+            return -1;
+        }
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    EGHACT_PERF_ADD(perf_connections_opened, 1);
+    return fd;
+}
+
+// An idle connection to node, or a new one; -1 if it can't be reached
+static int connection_take(ServiceNode* node) {
+    ConnectionPool* pool = &node->connections;
+    pthread_mutex_lock(&pool->lock);
+    while (pool->count > 0) {
+        int fd = pool->fds[--pool->count];
+        // Peers never write to us, so a readable socket has been closed or reset and
+        // frames written to it would be lost
+        char byte;
+        if (recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) < 0 &&
+            (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            pthread_mutex_unlock(&pool->lock);
+            return fd;
+        }
+        close(fd);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return connection_open(node);
+}
+
+static void connection_put(ServiceNode* node, int fd) {
+    ConnectionPool* pool = &node->connections;
+    pthread_mutex_lock(&pool->lock);
+    if (pool->count < CONNECTION_POOL_MAX) {
+        pool->fds[pool->count++] = fd;
+        fd = -1;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    if (fd >= 0) close(fd);
+}
+
+// Points iov at the frames of msgs, three entries each, with their headers in headers
+static int frames_build(Message** msgs, int count, uint8_t (*headers)[FRAME_HEADER_SIZE],
+                        struct iovec* iov) {
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        Message* msg = msgs[i];
+        size_t from_len = strlen(msg->from_service);
+        uint32_t length = (uint32_t)(3 + from_len + msg->payload_len);
+        uint8_t* header = headers[i];
+        header[0] = (uint8_t)(length >> 24);
+        header[1] = (uint8_t)(length >> 16);
+        header[2] = (uint8_t)(length >> 8);
+        header[3] = (uint8_t)length;
+        header[4] = (uint8_t)msg->priority;
+        header[5] = (uint8_t)(from_len >> 8);
+        header[6] = (uint8_t)from_len;
+        iov[n++] = (struct iovec){ .iov_base = header, .iov_len = FRAME_HEADER_SIZE };
+        iov[n++] = (struct iovec){ .iov_base = msg->from_service, .iov_len = from_len };
+        iov[n++] = (struct iovec){ .iov_base = msg->payload, .iov_len = msg->payload_len };
+    }
+    return n;
+}
+
+// Writes all of iov, advancing it as it goes; waits up to SEND_TIMEOUT_MS for room
+static int frames_send(int fd, struct iovec* iov, int count) {
+    struct msghdr header = {0};
+    while (count > 0) {
+        header.msg_iov = iov;
+        header.msg_iovlen = (size_t)count;
+        ssize_t sent = sendmsg(fd, &header, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            struct pollfd full = { .fd = fd, .events = POLLOUT };
+            if ((errno != EAGAIN && errno != EWOULDBLOCK) ||
+                poll(&full, 1, SEND_TIMEOUT_MS) != 1) {
+                return -1;
+            }
+            continue;
+        }
+        while (count > 0 && (size_t)sent >= iov->iov_len) {
+            sent -= (ssize_t)iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char*)iov->iov_base + sent;
+            iov->iov_len -= (size_t)sent;
+        }
+    }
+    return 0;
+}
+
+// Sends the frames of msgs to node together; 0 on success
+static int deliver_messages(ServiceNode* node, Message** msgs, int count) {
+    uint8_t headers[DISPATCH_BATCH][FRAME_HEADER_SIZE];
+    struct iovec iov[DISPATCH_BATCH * 3];
+    for (int attempt = 0; attempt < 2; attempt++) {
+        int fd = attempt == 0 ? connection_take(node) : connection_open(node);
+        if (fd < 0) continue;
+        int n = frames_build(msgs, count, headers, iov);
+        if (frames_send(fd, iov, n) == 0) {
+            connection_put(node, fd);
+            return 0;
+        }
+        close(fd);
+    }
+    return -1;
+}
+
+// Takes a batch from the most urgent level with messages waiting
+static int dispatcher_take(Dispatcher* dispatcher, Message** batch) {
+    int count = 0;
+    for (int level = 0; level < MESSAGE_PRIORITIES && count == 0; level++) {
+        Message* msg;
+        while (count < DISPATCH_BATCH && (msg = queue_pop(&dispatcher->queues[level]))) {
+            batch[count++] = msg;
+        }
+    }
+    return count;
+}
+
+// Sleeps until a producer signals, unless something was pushed in the meantime
+static void dispatcher_wait(Dispatcher* dispatcher) {
+    pthread_mutex_lock(&dispatcher->lock);
+    atomic_store(&dispatcher->sleeping, 1);
+    int empty = 1;
+    for (int level = 0; level < MESSAGE_PRIORITIES; level++) {
+        if (!queue_empty(&dispatcher->queues[level])) empty = 0;
+    }
+    if (empty) pthread_cond_wait(&dispatcher->wake, &dispatcher->lock);
+    atomic_store(&dispatcher->sleeping, 0);
+    pthread_mutex_unlock(&dispatcher->lock);
+}
+
+// Delivers one group and frees its messages
+static void dispatch_group(EghactOrchestrator* orch, Message** group, int count) {
+    EGHACT_PERF_SPAN_BEGIN(dispatch_span, "orchestrator", "dispatch");
+    ServiceNode* target = eghact_discover_service_for_key(orch, group[0]->to_service,
+                                                          group[0]->from_service);
+    if (target) {
+        if (deliver_messages(target, group, count) == 0) {
+            EGHACT_PERF_ADD(perf_messages_dispatched, count);
+        } else {
+            EGHACT_PERF_ADD(perf_messages_failed, count);
+        }
+        eghact_release_service(target);
+    } else {
+        EGHACT_PERF_ADD(perf_messages_unroutable, count);
+    }
+    EGHACT_PERF_SPAN_END(dispatch_span);
+    
+    for (int i = 0; i < count; i++) {
+        message_free(group[i]);
+    }
+}
+
 // Message dispatcher worker
 void* message_dispatcher_worker(void* arg) {
-    EghactOrchestrator* orch = (EghactOrchestrator*)arg;
+    Dispatcher* dispatcher = (Dispatcher*)arg;
+    EghactOrchestrator* orch = dispatcher->orch;
+#ifdef EGHACT_PERF_ENABLED
+    eghact_perf_set_thread_name("dispatcher");
+#endif
+    Message* batch[DISPATCH_BATCH];
+    Message* group[DISPATCH_BATCH];
+    BatchEntry order[DISPATCH_BATCH];
     
     while (1) {
-        pthread_mutex_lock(&orch->message_queue->lock);
-        
-        while (orch->message_queue->head == NULL) {
-            pthread_cond_wait(&orch->message_queue->not_empty, 
-                            &orch->message_queue->lock);
+        int count = dispatcher_take(dispatcher, batch);
+        if (count == 0) {
+            dispatcher_wait(dispatcher);
+            continue;
         }
+        EGHACT_PERF_RECORD(perf_dispatch_batch, count);
         
-        Message* msg = orch->message_queue->head;
-        orch->message_queue->head = msg->next;
-        if (orch->message_queue->head == NULL) {
-            orch->message_queue->tail = NULL;
+        int by_sender = orch->load_balancer->strategy == LB_IP_HASH;
+        for (int i = 0; i < count; i++) {
+            Message* msg = batch[i];
+            uint64_t key = hash_bytes(HASH_SEED, msg->to_service, strlen(msg->to_service) + 1);
+            if (by_sender) key = hash_bytes(key, msg->from_service, strlen(msg->from_service));
+            order[i] = (BatchEntry){ .key = key, .index = i };
         }
+        qsort(order, (size_t)count, sizeof(BatchEntry), batch_entry_compare);
         
-        pthread_mutex_unlock(&orch->message_queue->lock);
-        
-        // Dispatch message to target service
-        ServiceNode* target = eghact_discover_service(orch, msg->to_service);
-        if (target) {
-            deliver_message(target, msg);
+        // Runs of one key; names are compared too, so a hash collision only splits a
+        // group rather than merging two
+        for (int i = 0; i < count;) {
+            Message* first = batch[order[i].index];
+            int n = 0;
+            group[n++] = first;
+            int j = i + 1;
+            while (j < count && order[j].key == order[i].key) {
+                Message* msg = batch[order[j].index];
+                if (strcmp(msg->to_service, first->to_service) != 0 ||
+                    (by_sender && strcmp(msg->from_service, first->from_service) != 0)) {
+                    break;
+                }
+                group[n++] = msg;
+                j++;
+            }
+            dispatch_group(orch, group, n);
+            i = j;
         }
-        
-        // Clean up
-        free(msg->from_service);
-        free(msg->to_service);
-        free(msg->payload);
-        free(msg);
     }
     
     return NULL;
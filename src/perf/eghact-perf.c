@@ -0,0 +1,390 @@
+// Eghact Performance Instrumentation
+// Per-thread counters, histograms and span rings with Chrome trace export
+//
+// Each thread lazily allocates one PerfThread block and is the only writer of it.
+// Counters are updated with relaxed load+store pairs (no read-modify-write), spans
+// go into a single-producer ring drained by the exporter. The only lock guards the
+// metric name tables and the thread list, and is taken once per call site and once
+// per thread.
+
+#ifndef EGHACT_PERF_ENABLED
+#define EGHACT_PERF_ENABLED
+#endif
+
+#include "eghact-perf.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TRACE_MASK (EGHACT_PERF_TRACE_CAPACITY - 1)
+
+_Static_assert((EGHACT_PERF_TRACE_CAPACITY & TRACE_MASK) == 0, "trace capacity must be a power of two");
+
+typedef struct {
+    const char* category;
+    const char* name;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+} PerfEvent;
+
+typedef struct {
+    _Atomic uint64_t count;
+    _Atomic uint64_t sum;
+    _Atomic uint64_t min;
+    _Atomic uint64_t max;
+    _Atomic uint64_t buckets[EGHACT_PERF_HISTOGRAM_BUCKETS];
+} PerfHistogram;
+
+// Blocks are never freed so spans from exited threads can still be exported
+typedef struct PerfThread {
+    struct PerfThread* next;
+    uint32_t tid;
+    char name[32];
+    _Atomic uint64_t counters[EGHACT_PERF_MAX_COUNTERS];
+    PerfHistogram histograms[EGHACT_PERF_MAX_HISTOGRAMS];
+    _Atomic uint32_t head;  // Written by the owning thread
+    _Atomic uint32_t tail;  // Written by the exporter
+    _Atomic uint64_t dropped;
+    PerfEvent events[EGHACT_PERF_TRACE_CAPACITY];
+} PerfThread;
+
+static struct {
+    pthread_mutex_t lock;
+    const char* counter_names[EGHACT_PERF_MAX_COUNTERS];
+    const char* histogram_names[EGHACT_PERF_MAX_HISTOGRAMS];
+    _Atomic int32_t counter_count;
+    _Atomic int32_t histogram_count;
+    PerfThread* _Atomic threads;
+    uint32_t next_tid;
+    uint64_t epoch_ns;
+} g_perf = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static _Thread_local PerfThread* t_perf;
+
+uint64_t eghact_perf_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static PerfThread* current_thread(void) {
+    if (t_perf) return t_perf;
+
+    PerfThread* thread = (PerfThread*)calloc(1, sizeof(PerfThread));
+    if (!thread) return NULL;
+
+    pthread_mutex_lock(&g_perf.lock);
+    if (g_perf.epoch_ns == 0) g_perf.epoch_ns = eghact_perf_now_ns();
+    thread->tid = ++g_perf.next_tid;
+    snprintf(thread->name, sizeof(thread->name), "thread-%u", thread->tid);
+    thread->next = atomic_load_explicit(&g_perf.threads, memory_order_relaxed);
+    atomic_store_explicit(&g_perf.threads, thread, memory_order_release);
+    pthread_mutex_unlock(&g_perf.lock);
+
+    t_perf = thread;
+    return thread;
+}
+
+// Returns the slot for a call site, registering its name on first use.
+// Call sites sharing a name share a slot.
+static int32_t metric_slot(EghactPerfMetric* metric, const char** names,
+                           _Atomic int32_t* count, int32_t limit) {
+    int32_t id = __atomic_load_n(&metric->id, __ATOMIC_ACQUIRE);
+    if (id > 0) return id - 1;
+    if (id < 0) return -1;
+
+    pthread_mutex_lock(&g_perf.lock);
+    id = metric->id;
+    if (id == 0) {
+        int32_t used = atomic_load_explicit(count, memory_order_relaxed);
+        for (int32_t i = 0; i < used; i++) {
+            if (strcmp(names[i], metric->name) == 0) {
+                id = i + 1;
+                break;
+            }
+        }
+        if (id == 0 && used < limit) {
+            names[used] = metric->name;
+            atomic_store_explicit(count, used + 1, memory_order_release);
+            id = used + 1;
+        }
+        if (id == 0) id = -1;  // Table full, the metric is ignored
+        __atomic_store_n(&metric->id, id, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&g_perf.lock);
+    return id > 0 ? id - 1 : -1;
+}
+
+// Single writer per slot, so a plain load and store is enough
+static inline void bump(_Atomic uint64_t* slot, uint64_t delta) {
+    atomic_store_explicit(slot, atomic_load_explicit(slot, memory_order_relaxed) + delta,
+                          memory_order_relaxed);
+}
+
+void eghact_perf_add(EghactPerfMetric* counter, uint64_t delta) {
+    int32_t slot = metric_slot(counter, g_perf.counter_names, &g_perf.counter_count,
+                               EGHACT_PERF_MAX_COUNTERS);
+    PerfThread* thread = current_thread();
+    if (slot < 0 || !thread) return;
+    bump(&thread->counters[slot], delta);
+}
+
+static inline int bucket_of(uint64_t value) {
+    return value == 0 ? 0 : 64 - __builtin_clzll(value);
+}
+
+void eghact_perf_record(EghactPerfMetric* histogram, uint64_t value) {
+    int32_t slot = metric_slot(histogram, g_perf.histogram_names, &g_perf.histogram_count,
+                               EGHACT_PERF_MAX_HISTOGRAMS);
+    PerfThread* thread = current_thread();
+    if (slot < 0 || !thread) return;
+
+    PerfHistogram* h = &thread->histograms[slot];
+    int bucket = bucket_of(value);
+    if (bucket >= EGHACT_PERF_HISTOGRAM_BUCKETS) bucket = EGHACT_PERF_HISTOGRAM_BUCKETS - 1;
+
+    uint64_t count = atomic_load_explicit(&h->count, memory_order_relaxed);
+    if (count == 0 || value < atomic_load_explicit(&h->min, memory_order_relaxed)) {
+        atomic_store_explicit(&h->min, value, memory_order_relaxed);
+    }
+    if (value > atomic_load_explicit(&h->max, memory_order_relaxed)) {
+        atomic_store_explicit(&h->max, value, memory_order_relaxed);
+    }
+    bump(&h->buckets[bucket], 1);
+    bump(&h->sum, value);
+    atomic_store_explicit(&h->count, count + 1, memory_order_relaxed);
+}
+
+EghactPerfSpan eghact_perf_span_begin(const char* category, const char* name) {
+    EghactPerfSpan span = { category, name, eghact_perf_now_ns() };
+    return span;
+}
+
+void eghact_perf_span_end(EghactPerfSpan* span) {
+    uint64_t end = eghact_perf_now_ns();
+    PerfThread* thread = current_thread();
+    if (!thread) return;
+
+    uint32_t head = atomic_load_explicit(&thread->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&thread->tail, memory_order_acquire);
+    if (head - tail >= EGHACT_PERF_TRACE_CAPACITY) {
+        // Full: keep the older events and count the loss rather than block
+        bump(&thread->dropped, 1);
+        return;
+    }
+
+    PerfEvent* event = &thread->events[head & TRACE_MASK];
+    event->category = span->category;
+    event->name = span->name;
+    event->start_ns = span->start_ns;
+    event->duration_ns = end - span->start_ns;
+    atomic_store_explicit(&thread->head, head + 1, memory_order_release);
+}
+
+void eghact_perf_set_thread_name(const char* name) {
+    PerfThread* thread = current_thread();
+    if (!thread || !name) return;
+    pthread_mutex_lock(&g_perf.lock);
+    snprintf(thread->name, sizeof(thread->name), "%s", name);
+    pthread_mutex_unlock(&g_perf.lock);
+}
+
+// Aggregation
+static PerfThread* first_thread(void) {
+    return atomic_load_explicit(&g_perf.threads, memory_order_acquire);
+}
+
+static int32_t find_name(const char** names, _Atomic int32_t* count, const char* name) {
+    int32_t used = atomic_load_explicit(count, memory_order_acquire);
+    for (int32_t i = 0; i < used; i++) {
+        if (strcmp(names[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+static uint64_t counter_total(int32_t slot) {
+    uint64_t total = 0;
+    for (PerfThread* t = first_thread(); t; t = t->next) {
+        total += atomic_load_explicit(&t->counters[slot], memory_order_relaxed);
+    }
+    return total;
+}
+
+static void histogram_total(int32_t slot, EghactPerfHistogram* out) {
+    memset(out, 0, sizeof(*out));
+    out->name = g_perf.histogram_names[slot];
+
+    for (PerfThread* t = first_thread(); t; t = t->next) {
+        PerfHistogram* h = &t->histograms[slot];
+        uint64_t count = atomic_load_explicit(&h->count, memory_order_relaxed);
+        if (count == 0) continue;
+
+        uint64_t min = atomic_load_explicit(&h->min, memory_order_relaxed);
+        uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+        if (out->count == 0 || min < out->min) out->min = min;
+        if (max > out->max) out->max = max;
+        out->count += count;
+        out->sum += atomic_load_explicit(&h->sum, memory_order_relaxed);
+        for (int i = 0; i < EGHACT_PERF_HISTOGRAM_BUCKETS; i++) {
+            out->buckets[i] += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+        }
+    }
+}
+
+// Upper bound of the bucket holding the given quantile
+static uint64_t histogram_quantile(const EghactPerfHistogram* h, double q) {
+    if (h->count == 0) return 0;
+    uint64_t rank = (uint64_t)(q * (double)(h->count - 1)) + 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < EGHACT_PERF_HISTOGRAM_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            uint64_t bound = i == 0 ? 0 : (i >= 64 ? UINT64_MAX : (1ULL << i) - 1);
+            return bound < h->max ? bound : h->max;
+        }
+    }
+    return h->max;
+}
+
+uint64_t eghact_perf_counter_total(const char* name) {
+    int32_t slot = find_name(g_perf.counter_names, &g_perf.counter_count, name);
+    return slot < 0 ? 0 : counter_total(slot);
+}
+
+int eghact_perf_histogram_total(const char* name, EghactPerfHistogram* out) {
+    int32_t slot = find_name(g_perf.histogram_names, &g_perf.histogram_count, name);
+    if (slot < 0 || !out) return -1;
+    histogram_total(slot, out);
+    return 0;
+}
+
+uint64_t eghact_perf_dropped_spans(void) {
+    uint64_t dropped = 0;
+    for (PerfThread* t = first_thread(); t; t = t->next) {
+        dropped += atomic_load_explicit(&t->dropped, memory_order_relaxed);
+    }
+    return dropped;
+}
+
+// Export
+static void write_json_string(FILE* out, const char* str) {
+    fputc('"', out);
+    for (const unsigned char* p = (const unsigned char*)(str ? str : ""); *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fputc('\\', out);
+            fputc(*p, out);
+        } else if (*p < 0x20) {
+            fprintf(out, "\\u%04x", *p);
+        } else {
+            fputc(*p, out);
+        }
+    }
+    fputc('"', out);
+}
+
+int eghact_perf_write_counters(FILE* out) {
+    if (!out) return -1;
+
+    fputs("{\"counters\":{", out);
+    int32_t counters = atomic_load_explicit(&g_perf.counter_count, memory_order_acquire);
+    for (int32_t i = 0; i < counters; i++) {
+        if (i > 0) fputc(',', out);
+        write_json_string(out, g_perf.counter_names[i]);
+        fprintf(out, ":%llu", (unsigned long long)counter_total(i));
+    }
+
+    fputs("},\"histograms\":{", out);
+    int32_t histograms = atomic_load_explicit(&g_perf.histogram_count, memory_order_acquire);
+    for (int32_t i = 0; i < histograms; i++) {
+        EghactPerfHistogram h;
+        histogram_total(i, &h);
+        if (i > 0) fputc(',', out);
+        write_json_string(out, h.name);
+        fprintf(out, ":{\"count\":%llu,\"sum\":%llu,\"min\":%llu,\"max\":%llu,\"p50\":%llu,\"p99\":%llu}",
+                (unsigned long long)h.count, (unsigned long long)h.sum,
+                (unsigned long long)h.min, (unsigned long long)h.max,
+                (unsigned long long)histogram_quantile(&h, 0.50),
+                (unsigned long long)histogram_quantile(&h, 0.99));
+    }
+
+    fprintf(out, "},\"dropped_spans\":%llu}\n", (unsigned long long)eghact_perf_dropped_spans());
+    return ferror(out) ? -1 : 0;
+}
+
+// Microseconds since the first thread registered, as Chrome trace expects
+static double trace_us(uint64_t ns) {
+    return ns > g_perf.epoch_ns ? (double)(ns - g_perf.epoch_ns) / 1000.0 : 0.0;
+}
+
+int eghact_perf_write_trace_file(FILE* out) {
+    if (!out) return -1;
+
+    int pid = (int)getpid();
+    bool first = true;
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", out);
+
+    // Exporting is not on a hot path; hold the lock so names don't change underneath
+    pthread_mutex_lock(&g_perf.lock);
+    for (PerfThread* t = first_thread(); t; t = t->next) {
+        fprintf(out, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":",
+                first ? "" : ",", pid, t->tid);
+        write_json_string(out, t->name);
+        fputs("}}", out);
+        first = false;
+
+        uint32_t tail = atomic_load_explicit(&t->tail, memory_order_relaxed);
+        uint32_t head = atomic_load_explicit(&t->head, memory_order_acquire);
+        for (uint32_t i = tail; i != head; i++) {
+            const PerfEvent* event = &t->events[i & TRACE_MASK];
+            fputs(",{\"ph\":\"X\",\"name\":", out);
+            write_json_string(out, event->name);
+            fputs(",\"cat\":", out);
+            write_json_string(out, event->category);
+            fprintf(out, ",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u}",
+                    trace_us(event->start_ns), (double)event->duration_ns / 1000.0, pid, t->tid);
+        }
+        atomic_store_explicit(&t->tail, head, memory_order_release);
+    }
+
+    // Counter totals as of the export, shown as tracks in the viewer
+    double now = trace_us(eghact_perf_now_ns());
+    int32_t counters = atomic_load_explicit(&g_perf.counter_count, memory_order_acquire);
+    for (int32_t i = 0; i < counters; i++) {
+        fprintf(out, "%s{\"ph\":\"C\",\"name\":", first ? "" : ",");
+        write_json_string(out, g_perf.counter_names[i]);
+        fprintf(out, ",\"ts\":%.3f,\"pid\":%d,\"args\":{\"value\":%llu}}",
+                now, pid, (unsigned long long)counter_total(i));
+        first = false;
+    }
+    pthread_mutex_unlock(&g_perf.lock);
+
+    fputs("]}\n", out);
+    return ferror(out) ? -1 : 0;
+}
+
+int eghact_perf_write_trace(const char* path) {
+    FILE* out = fopen(path, "w");
+    if (!out) return -1;
+    int result = eghact_perf_write_trace_file(out);
+    if (fclose(out) != 0) result = -1;
+    return result;
+}
+
+// Zeroes all metrics and discards buffered spans. Only call while no other thread
+// is recording, since owners update their slots without read-modify-write.
+void eghact_perf_reset(void) {
+    pthread_mutex_lock(&g_perf.lock);
+    for (PerfThread* t = first_thread(); t; t = t->next) {
+        memset(t->counters, 0, sizeof(t->counters));
+        memset(t->histograms, 0, sizeof(t->histograms));
+        atomic_store_explicit(&t->dropped, 0, memory_order_relaxed);
+        atomic_store_explicit(&t->tail, atomic_load_explicit(&t->head, memory_order_acquire),
+                              memory_order_release);
+    }
+    pthread_mutex_unlock(&g_perf.lock);
+}
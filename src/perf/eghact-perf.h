@@ -0,0 +1,116 @@
+// Eghact Performance Instrumentation
+// Shared counters, histograms and trace spans for the native runtimes
+//
+// Everything here compiles to nothing unless EGHACT_PERF_ENABLED is defined, so
+// instrumented hot paths cost nothing in normal builds. When enabled, each thread
+// records into its own counter slots and trace ring without taking locks; exporters
+// aggregate across threads and write Chrome trace JSON (chrome://tracing, Perfetto).
+//
+//     EGHACT_PERF_COUNTER(db_inserts, "db.insert");
+//     EGHACT_PERF_HISTOGRAM(commit_nodes, "ui.commit.nodes");
+//
+//     void commit(void) {
+//         EGHACT_PERF_SCOPE("ui", "commit");
+//         EGHACT_PERF_ADD(db_inserts, 1);
+//         EGHACT_PERF_RECORD(commit_nodes, flushed);
+//     }
+//
+//     eghact_perf_write_trace("trace.json");
+
+#ifndef EGHACT_PERF_H
+#define EGHACT_PERF_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EGHACT_PERF_MAX_COUNTERS 128
+#define EGHACT_PERF_MAX_HISTOGRAMS 32
+#define EGHACT_PERF_HISTOGRAM_BUCKETS 64   // Bucket i holds values in [2^(i-1), 2^i)
+#define EGHACT_PERF_TRACE_CAPACITY 16384   // Span events buffered per thread
+
+// Static descriptor for one call site's metric; id is assigned on first use
+typedef struct {
+    const char* name;
+    int32_t id;  // 0 = unregistered, otherwise slot + 1
+} EghactPerfMetric;
+
+// Aggregated view of one histogram across threads
+typedef struct {
+    const char* name;
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[EGHACT_PERF_HISTOGRAM_BUCKETS];
+} EghactPerfHistogram;
+
+// Open span, closed by eghact_perf_span_end
+typedef struct {
+    const char* category;
+    const char* name;
+    uint64_t start_ns;
+} EghactPerfSpan;
+
+#ifdef EGHACT_PERF_ENABLED
+
+void eghact_perf_add(EghactPerfMetric* counter, uint64_t delta);
+void eghact_perf_record(EghactPerfMetric* histogram, uint64_t value);
+EghactPerfSpan eghact_perf_span_begin(const char* category, const char* name);
+void eghact_perf_span_end(EghactPerfSpan* span);
+uint64_t eghact_perf_now_ns(void);
+
+// Name this thread in trace output
+void eghact_perf_set_thread_name(const char* name);
+
+// Aggregation and export; safe to call while other threads keep recording
+uint64_t eghact_perf_counter_total(const char* name);
+int eghact_perf_histogram_total(const char* name, EghactPerfHistogram* out);
+int eghact_perf_write_counters(FILE* out);         // Flat JSON object of all metrics
+int eghact_perf_write_trace_file(FILE* out);       // Drains buffered spans
+int eghact_perf_write_trace(const char* path);
+uint64_t eghact_perf_dropped_spans(void);
+void eghact_perf_reset(void);
+
+#define EGHACT_PERF_COUNTER(var, metric_name) \
+    static EghactPerfMetric var = { metric_name, 0 }
+#define EGHACT_PERF_HISTOGRAM(var, metric_name) \
+    static EghactPerfMetric var = { metric_name, 0 }
+#define EGHACT_PERF_ADD(var, delta) eghact_perf_add(&(var), (uint64_t)(delta))
+#define EGHACT_PERF_RECORD(var, value) eghact_perf_record(&(var), (uint64_t)(value))
+
+#define EGHACT_PERF_SPAN_BEGIN(var, category, name) \
+    EghactPerfSpan var = eghact_perf_span_begin(category, name)
+#define EGHACT_PERF_SPAN_END(var) eghact_perf_span_end(&(var))
+
+// Span closed automatically when the enclosing block exits
+#if defined(__GNUC__) || defined(__clang__)
+    #define EGHACT_PERF_CONCAT_(a, b) a##b
+    #define EGHACT_PERF_CONCAT(a, b) EGHACT_PERF_CONCAT_(a, b)
+    #define EGHACT_PERF_SCOPE(category, name) \
+        EghactPerfSpan EGHACT_PERF_CONCAT(eghact_perf_scope_, __LINE__) \
+            __attribute__((cleanup(eghact_perf_span_end))) = eghact_perf_span_begin(category, name)
+#else
+    #define EGHACT_PERF_SCOPE(category, name) ((void)0)
+#endif
+
+#else // !EGHACT_PERF_ENABLED
+
+#define EGHACT_PERF_COUNTER(var, metric_name) typedef int eghact_perf_unused_##var
+#define EGHACT_PERF_HISTOGRAM(var, metric_name) typedef int eghact_perf_unused_##var
+#define EGHACT_PERF_ADD(var, delta) ((void)0)
+#define EGHACT_PERF_RECORD(var, value) ((void)0)
+#define EGHACT_PERF_SPAN_BEGIN(var, category, name) ((void)0)
+#define EGHACT_PERF_SPAN_END(var) ((void)0)
+#define EGHACT_PERF_SCOPE(category, name) ((void)0)
+
+#endif // EGHACT_PERF_ENABLED
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EGHACT_PERF_H
@@ -2,25 +2,80 @@
 // Replacement for Node.js - Pure C implementation with V8/QuickJS embedding
 // No Node.js dependencies whatsoever
 
+#define _GNU_SOURCE             // accept4, memmem
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <dirent.h>
 #include <dlfcn.h>
+#include <pthread.h>
 #include "quickjs.h"
 #include "eghact-core.h"
 
+#define LOOP_MAX_EVENTS 64
+#define BYTECODE_CACHE_MAGIC "EGHB"
+#define BYTECODE_CACHE_VERSION 1        // Bump whenever what a key covers changes
+#define BYTECODE_CACHE_DIR ".eghact-cache"
+#define HASH_SEED 14695981039346656037ull  // FNV-1a offset basis
+#define FS_MMAP_MIN_SIZE (64 * 1024)    // Smaller files are cheaper to read than to map
+#define STREAM_CHUNK_SIZE (64 * 1024)
+#define CHUNK_POOL_MAX 64               // Idle chunks kept for reuse, per pool
+#define HTTP_BUFFER_SIZE (16 * 1024)    // Per reading connection; also caps a request head
+#define HTTP_MAX_BODY (64 * 1024 * 1024)
+#define HTTP_MAX_PIPELINE 64            // Unsent responses before a connection stops reading
+#define HTTP_IOV_BATCH 64
+#define HTTP_MAX_WORKERS 256
+
+struct EventLoop;
+
+// Same-size buffers handed back once done with, ready for another read
+typedef struct {
+    void* chunks[CHUNK_POOL_MAX];
+    int count;
+    size_t chunk_size;
+} ChunkPool;
+
 // Runtime context
 typedef struct {
     JSRuntime* js_runtime;
     JSContext* js_context;
     char* module_path;
     void* native_modules;
-    void* event_loop;
+    struct EventLoop* event_loop;
+    const char* cache_dir;      // Bytecode cache; NULL disables it
+    ChunkPool stream_chunks;
+    ChunkPool http_buffers;
+    const char* script;         // The main script, which HTTP workers run again
+    int worker_id;              // 0 on the main thread
+    int workers_started;
 } EghactRuntime;
 
+// Class ids are process-wide and JS_NewClassID isn't thread-safe, so they are allocated
+// once, before any worker thread creates a runtime of its own
+static JSClassID read_stream_class_id;
+static JSClassID http_server_class_id;
+static JSClassID http_response_class_id;
+static pthread_once_t class_ids_once = PTHREAD_ONCE_INIT;
+
+static void init_class_ids(void) {
+    JS_NewClassID(&read_stream_class_id);
+    JS_NewClassID(&http_server_class_id);
+    JS_NewClassID(&http_response_class_id);
+}
+
 // Module system
 typedef struct Module {
     char* name;
@@ -37,19 +92,388 @@ typedef struct {
 } ModuleSystem;
 
 // Event loop
-typedef struct Event {
-    void (*callback)(void*);
-    void* data;
-    int timeout;
-    struct Event* next;
-} Event;
+//
+// The loop runs on the thread that owns the JSContext, after the main script. Each turn
+// fires the timers that are due, then waits in epoll until the next timer is due or a
+// watched fd is ready, and dispatches what is ready. Timers live in a min-heap ordered by
+// deadline, then by id so equal deadlines fire in the order they were set. Every
+// macrotask, a timer or an I/O callback, is followed by draining the job queue, so
+// promise reactions run before the next one. The loop ends once no timer or watcher
+// is left.
 
 typedef struct {
-    Event* events;
-    int running;
-    pthread_t thread;
+    uint64_t when;              // CLOCK_MONOTONIC ms
+    uint32_t id;
+    JSValue callback;
+    JSValue* args;
+    int num_args;
+} Timer;
+
+typedef struct IoWatcher IoWatcher;
+typedef void (*IoCallback)(struct EventLoop* loop, IoWatcher* watcher, uint32_t events);
+
+// An fd the loop waits on; events are EPOLLIN/EPOLLOUT
+struct IoWatcher {
+    int fd;
+    uint32_t events;
+    IoCallback callback;
+    void* data;
+    int always_ready;           // Regular files, which epoll can't wait on
+    IoWatcher* next_ready;
+};
+
+typedef struct EventLoop {
+    JSContext* ctx;
+    int epoll_fd;
+    Timer* timers;              // Min-heap
+    int num_timers;
+    int timers_capacity;
+    uint32_t next_timer_id;
+    int num_watchers;
+    IoWatcher* ready;           // Always-ready watchers, polled each turn
+    IoWatcher* ready_next;      // Next of them to dispatch this turn
 } EventLoop;
 
+static uint64_t loop_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static EventLoop* create_event_loop(JSContext* ctx) {
+    EventLoop* loop = calloc(1, sizeof(EventLoop));
+    loop->ctx = ctx;
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    loop->next_timer_id = 1;
+    if (loop->epoll_fd < 0) {
+        free(loop);
+        return NULL;
+    }
+    return loop;
+}
+
+static inline int timer_before(const Timer* a, const Timer* b) {
+    return a->when != b->when ? a->when < b->when : a->id < b->id;
+}
+
+static void timer_sift_up(EventLoop* loop, int i) {
+    Timer timer = loop->timers[i];
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!timer_before(&timer, &loop->timers[parent])) break;
+        loop->timers[i] = loop->timers[parent];
+        i = parent;
+    }
+    loop->timers[i] = timer;
+}
+
+static void timer_sift_down(EventLoop* loop, int i) {
+    Timer timer = loop->timers[i];
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= loop->num_timers) break;
+        if (child + 1 < loop->num_timers && timer_before(&loop->timers[child + 1], &loop->timers[child])) {
+            child++;
+        }
+        if (!timer_before(&loop->timers[child], &timer)) break;
+        loop->timers[i] = loop->timers[child];
+        i = child;
+    }
+    loop->timers[i] = timer;
+}
+
+// Takes the timer at i out of the heap
+static Timer timer_remove(EventLoop* loop, int i) {
+    Timer timer = loop->timers[i];
+    loop->timers[i] = loop->timers[--loop->num_timers];
+    if (i < loop->num_timers) {
+        timer_sift_down(loop, i);
+        timer_sift_up(loop, i);
+    }
+    return timer;
+}
+
+static void timer_free(JSContext* ctx, Timer* timer) {
+    JS_FreeValue(ctx, timer->callback);
+    for (int i = 0; i < timer->num_args; i++) {
+        JS_FreeValue(ctx, timer->args[i]);
+    }
+    free(timer->args);
+}
+
+// Returns the timer's id; callback and args are duplicated
+static uint32_t schedule_timeout(EventLoop* loop, JSValueConst callback, int delay,
+                                 int argc, JSValueConst* argv) {
+    if (loop->num_timers == loop->timers_capacity) {
+        loop->timers_capacity = loop->timers_capacity ? loop->timers_capacity * 2 : 64;
+        loop->timers = realloc(loop->timers, sizeof(Timer) * loop->timers_capacity);
+    }
+    
+    Timer* timer = &loop->timers[loop->num_timers];
+    timer->when = loop_now() + (delay > 0 ? delay : 0);
+    timer->id = loop->next_timer_id++;
+    if (loop->next_timer_id == 0) loop->next_timer_id = 1;  // 0 never names a timer
+    timer->callback = JS_DupValue(loop->ctx, callback);
+    timer->args = argc > 0 ? malloc(sizeof(JSValue) * argc) : NULL;
+    timer->num_args = argc;
+    for (int i = 0; i < argc; i++) {
+        timer->args[i] = JS_DupValue(loop->ctx, argv[i]);
+    }
+    
+    uint32_t id = timer->id;
+    timer_sift_up(loop, loop->num_timers++);
+    return id;
+}
+
+static void cancel_timeout(EventLoop* loop, uint32_t id) {
+    for (int i = 0; i < loop->num_timers; i++) {
+        if (loop->timers[i].id == id) {
+            Timer timer = timer_remove(loop, i);
+            timer_free(loop->ctx, &timer);
+            return;
+        }
+    }
+}
+
+// Starts waiting for events on watcher->fd; 0 on failure
+static int loop_watch(EventLoop* loop, IoWatcher* watcher) {
+    struct epoll_event event = { .events = watcher->events, .data.ptr = watcher };
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, watcher->fd, &event) == 0) {
+        watcher->always_ready = 0;
+    } else if (errno == EPERM) {
+        // Regular files never block, so they are ready every turn
+        watcher->always_ready = 1;
+        watcher->next_ready = loop->ready;
+        loop->ready = watcher;
+    } else {
+        return 0;
+    }
+    loop->num_watchers++;
+    return 1;
+}
+
+// Changes which events watcher->fd is waited on for
+static void loop_rewatch(EventLoop* loop, IoWatcher* watcher, uint32_t events) {
+    if (watcher->events == events) return;
+    watcher->events = events;
+    if (watcher->always_ready) return;
+    struct epoll_event event = { .events = events, .data.ptr = watcher };
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, watcher->fd, &event);
+}
+
+static void loop_unwatch(EventLoop* loop, IoWatcher* watcher) {
+    if (watcher->always_ready) {
+        IoWatcher** link = &loop->ready;
+        while (*link && *link != watcher) link = &(*link)->next_ready;
+        if (*link) *link = watcher->next_ready;
+        if (loop->ready_next == watcher) loop->ready_next = watcher->next_ready;
+    } else {
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, watcher->fd, NULL);
+    }
+    loop->num_watchers--;
+}
+
+static void report_exception(JSContext* ctx) {
+    JSValue exception = JS_GetException(ctx);
+    const char* error = JS_ToCString(ctx, exception);
+    fprintf(stderr, "Error: %s\n", error ? error : "(unprintable exception)");
+    JS_FreeCString(ctx, error);
+    JS_FreeValue(ctx, exception);
+}
+
+// Drains the job queue: promise reactions and anything they queue in turn
+static void run_microtasks(EventLoop* loop) {
+    JSRuntime* rt = JS_GetRuntime(loop->ctx);
+    JSContext* job_ctx;
+    int status;
+    while ((status = JS_ExecutePendingJob(rt, &job_ctx)) != 0) {
+        if (status < 0) report_exception(job_ctx);
+    }
+}
+
+static void run_timers(EventLoop* loop) {
+    // Only timers due now; ones their callbacks set with no delay wait for the next turn
+    uint64_t now = loop_now();
+    uint32_t last_id = loop->next_timer_id;
+    while (loop->num_timers > 0 && loop->timers[0].when <= now) {
+        if (loop->timers[0].id >= last_id) break;
+        Timer timer = timer_remove(loop, 0);
+        JSValue result = JS_Call(loop->ctx, timer.callback, JS_UNDEFINED,
+                                 timer.num_args, (JSValueConst*)timer.args);
+        if (JS_IsException(result)) report_exception(loop->ctx);
+        JS_FreeValue(loop->ctx, result);
+        timer_free(loop->ctx, &timer);
+        run_microtasks(loop);
+    }
+}
+
+void run_event_loop(EventLoop* loop) {
+    struct epoll_event events[LOOP_MAX_EVENTS];
+    run_microtasks(loop);
+    
+    while (loop->num_timers > 0 || loop->num_watchers > 0) {
+        run_timers(loop);
+        
+        // Sleep until the next timer is due, or an fd is ready
+        int timeout = -1;
+        if (loop->ready) {
+            timeout = 0;
+        } else if (loop->num_timers > 0) {
+            uint64_t now = loop_now();
+            uint64_t when = loop->timers[0].when;
+            timeout = when > now ? (int)(when - now) : 0;
+        } else if (loop->num_watchers == 0) {
+            break;
+        }
+        
+        int count = epoll_wait(loop->epoll_fd, events, LOOP_MAX_EVENTS, timeout);
+        for (int i = 0; i < count; i++) {
+            IoWatcher* watcher = events[i].data.ptr;
+            watcher->callback(loop, watcher, events[i].events);
+            run_microtasks(loop);
+        }
+        
+        // A callback may unwatch the next one; loop_unwatch moves ready_next past it
+        loop->ready_next = loop->ready;
+        while (loop->ready_next) {
+            IoWatcher* watcher = loop->ready_next;
+            loop->ready_next = watcher->next_ready;
+            watcher->callback(loop, watcher, watcher->events);
+            run_microtasks(loop);
+        }
+    }
+}
+
+static void destroy_event_loop(EventLoop* loop) {
+    if (!loop) return;
+    while (loop->num_timers > 0) {
+        Timer timer = timer_remove(loop, loop->num_timers - 1);
+        timer_free(loop->ctx, &timer);
+    }
+    free(loop->timers);
+    close(loop->epoll_fd);
+    free(loop);
+}
+
+// Bytecode cache
+//
+// Scripts and modules are compiled once to QuickJS bytecode and kept in
+// <cache_dir>/<key>.qjsc. The key hashes the file's real path, the source text and how
+// it was compiled, so an edited file simply misses. Later runs map the entry and read the
+// function straight from it, skipping the parser. An entry QuickJS rejects, say from
+// another QuickJS build, is treated as a miss and replaced. Entries are written to a
+// temporary file and renamed into place. Bytecode is trusted like source: the cache
+// directory must be as protected as the scripts themselves.
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint64_t size;              // Bytecode bytes after the header
+} BytecodeHeader;
+
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t len) {
+    const unsigned char* bytes = data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// The real path, so a file reached relatively or through a link shares one entry
+static uint64_t bytecode_key(const char* filename, const char* source, size_t len, int flags) {
+    char resolved[PATH_MAX];
+    if (realpath(filename, resolved)) filename = resolved;
+    
+    uint32_t version = BYTECODE_CACHE_VERSION;
+    uint64_t hash = hash_bytes(HASH_SEED, &version, sizeof(version));
+    hash = hash_bytes(hash, &flags, sizeof(flags));
+    hash = hash_bytes(hash, filename, strlen(filename) + 1);
+    return hash_bytes(hash, source, len);
+}
+
+static void bytecode_path(const EghactRuntime* runtime, uint64_t key, char* path, size_t size) {
+    snprintf(path, size, "%s/%016llx.qjsc", runtime->cache_dir, (unsigned long long)key);
+}
+
+// Compiled function from the cache entry for key, or JS_UNDEFINED on a miss
+static JSValue bytecode_load(EghactRuntime* runtime, uint64_t key) {
+    char path[PATH_MAX];
+    bytecode_path(runtime, key, path, sizeof(path));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return JS_UNDEFINED;
+    
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size > sizeof(BytecodeHeader)) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) return JS_UNDEFINED;
+    
+    const BytecodeHeader* header = map;
+    JSValue function = JS_UNDEFINED;
+    if (memcmp(header->magic, BYTECODE_CACHE_MAGIC, 4) == 0 &&
+        header->version == BYTECODE_CACHE_VERSION && header->key == key &&
+        header->size == (uint64_t)st.st_size - sizeof(BytecodeHeader)) {
+        // QuickJS copies what it reads, so the mapping can go right after
+        function = JS_ReadObject(runtime->js_context, (const uint8_t*)(header + 1),
+                                 header->size, JS_READ_OBJ_BYTECODE);
+        if (JS_IsException(function)) {
+            JS_FreeValue(runtime->js_context, JS_GetException(runtime->js_context));
+            function = JS_UNDEFINED;
+        }
+    }
+    munmap(map, st.st_size);
+    return function;
+}
+
+// Best effort: a run that can't write its cache still succeeds
+static void bytecode_store(EghactRuntime* runtime, uint64_t key, JSValueConst function) {
+    JSContext* ctx = runtime->js_context;
+    size_t size;
+    uint8_t* bytecode = JS_WriteObject(ctx, &size, function, JS_WRITE_OBJ_BYTECODE);
+    if (!bytecode) {
+        JS_FreeValue(ctx, JS_GetException(ctx));
+        return;
+    }
+    
+    char path[PATH_MAX], temp[PATH_MAX + 32];
+    bytecode_path(runtime, key, path, sizeof(path));
+    snprintf(temp, sizeof(temp), "%s.%ld.%lx", path, (long)getpid(), (unsigned long)pthread_self());
+    mkdir(runtime->cache_dir, 0755);
+    
+    BytecodeHeader header = { .version = BYTECODE_CACHE_VERSION, .key = key, .size = size };
+    memcpy(header.magic, BYTECODE_CACHE_MAGIC, 4);
+    FILE* file = fopen(temp, "wb");
+    int ok = file && fwrite(&header, sizeof(header), 1, file) == 1 &&
+             fwrite(bytecode, 1, size, file) == size;
+    if (file && fclose(file) != 0) ok = 0;
+    if (!ok || rename(temp, path) != 0) unlink(temp);
+    
+    js_free(ctx, bytecode);
+}
+
+// Compiled but not yet run function for source, from the cache when it has one;
+// JS_EXCEPTION on a syntax error. flags are the JS_Eval type flags.
+static JSValue compile_cached(EghactRuntime* runtime, const char* source, size_t len,
+                              const char* filename, int flags) {
+    uint64_t key = 0;
+    if (runtime->cache_dir) {
+        key = bytecode_key(filename, source, len, flags);
+        JSValue function = bytecode_load(runtime, key);
+        if (!JS_IsUndefined(function)) return function;
+    }
+    
+    JSValue function = JS_Eval(runtime->js_context, source, len, filename,
+                               flags | JS_EVAL_FLAG_COMPILE_ONLY);
+    if (runtime->cache_dir && !JS_IsException(function)) {
+        bytecode_store(runtime, key, function);
+    }
+    return function;
+}
+
 // Initialize Eghact runtime
 EghactRuntime* eghact_runtime_create() {
     EghactRuntime* runtime = malloc(sizeof(EghactRuntime));
@@ -57,15 +481,47 @@ EghactRuntime* eghact_runtime_create() {
     // Initialize QuickJS
     runtime->js_runtime = JS_NewRuntime();
     runtime->js_context = JS_NewContext(runtime->js_runtime);
+    JS_SetContextOpaque(runtime->js_context, runtime);
+    JS_SetRuntimeOpaque(runtime->js_runtime, runtime);
+    runtime->stream_chunks = (ChunkPool){ .chunk_size = STREAM_CHUNK_SIZE };
+    runtime->http_buffers = (ChunkPool){ .chunk_size = HTTP_BUFFER_SIZE };
+    runtime->script = NULL;
+    runtime->worker_id = 0;
+    runtime->workers_started = 0;
+    
+    // Stream and server objects, whose finalizers close their fds
+    static const JSClassDef read_stream_class = {
+        "ReadStream",
+        .finalizer = read_stream_finalizer,
+        .gc_mark = read_stream_mark,
+    };
+    static const JSClassDef http_server_class = {
+        "HttpServer",
+        .finalizer = http_server_finalizer,
+        .gc_mark = http_server_mark,
+    };
+    static const JSClassDef http_response_class = {
+        "ServerResponse",
+        .finalizer = http_response_finalizer,
+    };
+    pthread_once(&class_ids_once, init_class_ids);
+    JS_NewClass(runtime->js_runtime, read_stream_class_id, &read_stream_class);
+    JS_NewClass(runtime->js_runtime, http_server_class_id, &http_server_class);
+    JS_NewClass(runtime->js_runtime, http_response_class_id, &http_response_class);
     
     // Set memory limit (256MB)
     JS_SetMemoryLimit(runtime->js_runtime, 256 * 1024 * 1024);
     
+    // Bytecode cache; EGHACT_CACHE_DIR moves it, and set empty turns it off
+    const char* cache_dir = getenv("EGHACT_CACHE_DIR");
+    if (!cache_dir) cache_dir = BYTECODE_CACHE_DIR;
+    runtime->cache_dir = cache_dir[0] ? cache_dir : NULL;
+    
     // Initialize module system
     init_module_system(runtime);
     
     // Initialize event loop
-    runtime->event_loop = create_event_loop();
+    runtime->event_loop = create_event_loop(runtime->js_context);
     
     // Install global objects
     install_global_objects(runtime);
@@ -73,6 +529,93 @@ EghactRuntime* eghact_runtime_create() {
     return runtime;
 }
 
+void eghact_runtime_destroy(EghactRuntime* runtime) {
+    destroy_event_loop(runtime->event_loop);
+    JS_FreeContext(runtime->js_context);
+    JS_FreeRuntime(runtime->js_runtime);
+    
+    // Collecting the last buffers returned them to the pools, so those go after the runtime
+    for (int i = 0; i < runtime->stream_chunks.count; i++) {
+        free(runtime->stream_chunks.chunks[i]);
+    }
+    for (int i = 0; i < runtime->http_buffers.count; i++) {
+        free(runtime->http_buffers.chunks[i]);
+    }
+    free(runtime);
+}
+
+// CommonJS wrapper; the prefix stays on the first line so line numbers match the file
+static const char module_prefix[] =
+    "(function (exports, require, module, __filename, __dirname) {";
+static const char module_suffix[] = "\n})";
+
+// Source wrapped as a CommonJS module function; *len is set to its length
+static char* wrap_module_source(const char* source, size_t* len) {
+    size_t source_len = strlen(source);
+    *len = sizeof(module_prefix) - 1 + source_len + sizeof(module_suffix) - 1;
+    char* wrapped = malloc(*len + 1);
+    if (!wrapped) return NULL;
+    memcpy(wrapped, module_prefix, sizeof(module_prefix) - 1);
+    memcpy(wrapped + sizeof(module_prefix) - 1, source, source_len);
+    memcpy(wrapped + sizeof(module_prefix) - 1 + source_len, module_suffix, sizeof(module_suffix));
+    return wrapped;
+}
+
+// Runs the module at path and returns its exports, or JS_EXCEPTION
+static JSValue load_module(EghactRuntime* runtime, const char* path) {
+    JSContext* ctx = runtime->js_context;
+    char* source = read_file(path);
+    if (!source) {
+        return JS_ThrowReferenceError(ctx, "Cannot read module '%s'", path);
+    }
+    
+    const char* extension = strrchr(path, '.');
+    if (extension && strcmp(extension, ".json") == 0) {
+        JSValue exports = JS_ParseJSON(ctx, source, strlen(source), path);
+        free(source);
+        return exports;
+    }
+    
+    size_t len;
+    char* wrapped = wrap_module_source(source, &len);
+    free(source);
+    if (!wrapped) return JS_ThrowOutOfMemory(ctx);
+    
+    // Evaluating the compiled wrapper yields the module function
+    JSValue compiled = compile_cached(runtime, wrapped, len, path, JS_EVAL_TYPE_GLOBAL);
+    free(wrapped);
+    if (JS_IsException(compiled)) return compiled;
+    JSValue function = JS_EvalFunction(ctx, compiled);
+    if (JS_IsException(function)) return function;
+    
+    JSValue module = JS_NewObject(ctx);
+    JSValue exports = JS_NewObject(ctx);
+    JS_SetPropertyStr(ctx, module, "exports", JS_DupValue(ctx, exports));
+    
+    char dirname[PATH_MAX];
+    get_dirname(path, dirname);
+    JSValue global = JS_GetGlobalObject(ctx);
+    JSValue args[5] = {
+        exports,
+        JS_GetPropertyStr(ctx, global, "require"),
+        module,
+        JS_NewString(ctx, path),
+        JS_NewString(ctx, dirname),
+    };
+    JSValue result = JS_Call(ctx, function, JS_UNDEFINED, 5, args);
+    
+    // module.exports may have been replaced
+    JSValue module_exports = JS_IsException(result)
+        ? JS_EXCEPTION : JS_GetPropertyStr(ctx, module, "exports");
+    JS_FreeValue(ctx, result);
+    for (int i = 0; i < 5; i++) {
+        JS_FreeValue(ctx, args[i]);
+    }
+    JS_FreeValue(ctx, global);
+    JS_FreeValue(ctx, function);
+    return module_exports;
+}
+
 // Custom require() implementation
 JSValue eghact_require(JSContext* ctx, JSValueConst this_val, 
                        int argc, JSValueConst* argv) {
@@ -100,8 +643,10 @@ JSValue eghact_require(JSContext* ctx, JSValueConst this_val,
     // Load module
     JSValue module_exports = load_module(runtime, module_path);
     
-    // Cache module
-    cache_module(runtime, module_name, module_exports);
+    // Cache module; a module that threw is loaded again next time
+    if (!JS_IsException(module_exports)) {
+        cache_module(runtime, module_name, module_exports);
+    }
     
     JS_FreeCString(ctx, module_name);
     free(module_path);
@@ -110,65 +655,1112 @@ JSValue eghact_require(JSContext* ctx, JSValueConst this_val,
 }
 
 // File system API
+//
+// readFile returns an ArrayBuffer over the file's pages: files of FS_MMAP_MIN_SIZE and
+// up are mapped copy-on-write and unmapped when the buffer is collected, so reading
+// one doesn't copy it. Smaller files are read into a buffer of their own. Truncating a
+// file while a buffer maps it makes touching the lost pages fault, as with any mmap.
+// With "utf8" it returns a string decoded straight from the mapping instead.
+//
+// createReadStream reads STREAM_CHUNK_SIZE chunks, one per event loop turn, into
+// buffers from a pool. Each chunk goes to the 'data' listener as an ArrayBuffer and its
+// buffer returns to the pool once that is collected, so a stream holds a few chunks
+// however large the file is.
+
+static void free_mapping(JSRuntime* rt, void* opaque, void* ptr) {
+    munmap(ptr, (size_t)(uintptr_t)opaque);
+}
+
+static void free_buffer(JSRuntime* rt, void* opaque, void* ptr) {
+    free(ptr);
+}
+
+static void release_chunk(JSRuntime* rt, void* opaque, void* ptr) {
+    ChunkPool* pool = opaque;
+    if (pool->count < CHUNK_POOL_MAX) pool->chunks[pool->count++] = ptr;
+    else free(ptr);
+}
+
+static void* take_chunk(ChunkPool* pool) {
+    return pool->count > 0 ? pool->chunks[--pool->count] : malloc(pool->chunk_size);
+}
+
+// Reads until len bytes or end of file; bytes read, or -1
+static ssize_t read_full(int fd, void* data, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = read(fd, (char*)data + done, len - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -1;
+        if (n == 0) break;
+        done += n;
+    }
+    return done;
+}
+
 JSValue eghact_fs_readFile(JSContext* ctx, JSValueConst this_val,
                            int argc, JSValueConst* argv) {
     if (argc < 1) {
         return JS_ThrowTypeError(ctx, "readFile expects filename");
     }
     
-    const char* filename = JS_ToCString(ctx, argv[0]);
+    int text = 0;
+    if (argc > 1 && !JS_IsUndefined(argv[1])) {
+        const char* encoding = JS_ToCString(ctx, argv[1]);
+        if (!encoding) return JS_EXCEPTION;
+        text = strcmp(encoding, "utf8") == 0 || strcmp(encoding, "utf-8") == 0;
+        JS_FreeCString(ctx, encoding);
+        if (!text) return JS_ThrowTypeError(ctx, "readFile only decodes utf8");
+    }
     
-    // Read file
-    FILE* file = fopen(filename, "rb");
-    if (!file) {
-        JS_FreeCString(ctx, filename);
+    const char* filename = JS_ToCString(ctx, argv[0]);
+    if (!filename) return JS_EXCEPTION;
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    JS_FreeCString(ctx, filename);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) close(fd);
         return JS_ThrowInternalError(ctx, "Cannot read file");
     }
     
-    fseek(file, 0, SEEK_END);
-    long size = ftell(file);
-    fseek(file, 0, SEEK_SET);
+    // Map large regular files; read the rest, growing the buffer for pipes and devices
+    size_t size = 0;
+    void* data = NULL;
+    int mapped = 0;
+    if (S_ISREG(st.st_mode) && st.st_size >= FS_MMAP_MIN_SIZE) {
+        size = st.st_size;
+        data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        mapped = data != MAP_FAILED;
+        if (!mapped) data = NULL;
+    }
+    if (!mapped) {
+        size_t capacity = S_ISREG(st.st_mode) ? (size_t)st.st_size + 1 : 4096;
+        ssize_t n = 0;
+        size = 0;
+        do {
+            size += n;
+            if (size == capacity) capacity *= 2;
+            void* grown = realloc(data, capacity);
+            if (!grown) {
+                n = -1;
+                break;
+            }
+            data = grown;
+        } while ((n = read_full(fd, (char*)data + size, capacity - size)) > 0);
+        if (n < 0) {
+            free(data);
+            close(fd);
+            return JS_ThrowInternalError(ctx, "Cannot read file");
+        }
+    }
+    close(fd);
+    
+    if (text) {
+        JSValue result = JS_NewStringLen(ctx, data, size);
+        if (mapped) munmap(data, size);
+        else free(data);
+        return result;
+    }
+    if (mapped) {
+        return JS_NewArrayBuffer(ctx, data, size, free_mapping, (void*)(uintptr_t)size, 0);
+    }
+    return JS_NewArrayBuffer(ctx, data, size, free_buffer, NULL, 0);
+}
+
+typedef struct {
+    IoWatcher watcher;          // First, so the loop's callback finds the stream
+    EghactRuntime* runtime;
+    JSValue self;               // Held while flowing, so the stream outlives its last reference
+    JSValue on_data;
+    JSValue on_end;
+    JSValue on_error;
+    size_t chunk_size;
+    int flowing;
+    int ended;
+} ReadStream;
+
+static void read_stream_stop(ReadStream* stream) {
+    if (!stream->flowing) return;
+    stream->flowing = 0;
+    loop_unwatch(stream->runtime->event_loop, &stream->watcher);
+    
+    // May free the stream, so last
+    JSValue self = stream->self;
+    stream->self = JS_UNDEFINED;
+    JS_FreeValue(stream->runtime->js_context, self);
+}
+
+static void read_stream_start(ReadStream* stream, JSValueConst object) {
+    if (stream->flowing || stream->ended) return;
+    if (!loop_watch(stream->runtime->event_loop, &stream->watcher)) return;
+    stream->flowing = 1;
+    stream->self = JS_DupValue(stream->runtime->js_context, object);
+}
+
+// Caller keeps the stream alive across the call
+static void read_stream_emit(ReadStream* stream, JSValueConst listener, int argc, JSValueConst* argv) {
+    JSContext* ctx = stream->runtime->js_context;
+    if (!JS_IsFunction(ctx, listener)) return;
+    JSValue result = JS_Call(ctx, listener, stream->self, argc, argv);
+    if (JS_IsException(result)) report_exception(ctx);
+    JS_FreeValue(ctx, result);
+}
+
+// End of file or an error: emits once, then lets the stream go
+static void read_stream_finish(ReadStream* stream, const char* error) {
+    JSContext* ctx = stream->runtime->js_context;
+    stream->ended = 1;
+    close(stream->watcher.fd);
+    stream->watcher.fd = -1;
+    
+    // The listener may close the stream and drop the last reference to it
+    JSValue self = JS_DupValue(ctx, stream->self);
+    if (error) {
+        JSValue message = JS_NewString(ctx, error);
+        read_stream_emit(stream, stream->on_error, 1, &message);
+        JS_FreeValue(ctx, message);
+    } else {
+        read_stream_emit(stream, stream->on_end, 0, NULL);
+    }
+    read_stream_stop(stream);
+    JS_FreeValue(ctx, self);
+}
+
+static void read_stream_ready(EventLoop* loop, IoWatcher* watcher, uint32_t events) {
+    ReadStream* stream = (ReadStream*)watcher;
+    ChunkPool* pool = &stream->runtime->stream_chunks;
+    JSContext* ctx = stream->runtime->js_context;
+    
+    void* chunk = take_chunk(pool);
+    if (!chunk) {
+        read_stream_finish(stream, "Out of memory");
+        return;
+    }
+    ssize_t n = read(watcher->fd, chunk, stream->chunk_size);
+    if (n <= 0) {
+        release_chunk(NULL, pool, chunk);
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+        read_stream_finish(stream, n < 0 ? strerror(errno) : NULL);
+        return;
+    }
     
-    char* buffer = malloc(size + 1);
-    fread(buffer, 1, size, file);
-    buffer[size] = '\0';
-    fclose(file);
+    JSValue buffer = JS_NewArrayBuffer(ctx, chunk, n, release_chunk, pool, 0);
+    JSValue self = JS_DupValue(ctx, stream->self);
+    read_stream_emit(stream, stream->on_data, 1, &buffer);
+    JS_FreeValue(ctx, buffer);
+    JS_FreeValue(ctx, self);
+}
+
+static void read_stream_finalizer(JSRuntime* rt, JSValue val) {
+    ReadStream* stream = JS_GetOpaque(val, read_stream_class_id);
+    if (!stream) return;
+    if (stream->watcher.fd >= 0) close(stream->watcher.fd);
+    JS_FreeValueRT(rt, stream->on_data);
+    JS_FreeValueRT(rt, stream->on_end);
+    JS_FreeValueRT(rt, stream->on_error);
+    free(stream);
+}
+
+static void read_stream_mark(JSRuntime* rt, JSValueConst val, JS_MarkFunc* mark_func) {
+    ReadStream* stream = JS_GetOpaque(val, read_stream_class_id);
+    if (!stream) return;
+    JS_MarkValue(rt, stream->on_data, mark_func);
+    JS_MarkValue(rt, stream->on_end, mark_func);
+    JS_MarkValue(rt, stream->on_error, mark_func);
+}
+
+static ReadStream* read_stream_get(JSContext* ctx, JSValueConst this_val) {
+    return JS_GetOpaque2(ctx, this_val, read_stream_class_id);
+}
+
+// stream.on(event, listener): 'data' starts the stream flowing
+JSValue read_stream_on(JSContext* ctx, JSValueConst this_val,
+                       int argc, JSValueConst* argv) {
+    ReadStream* stream = read_stream_get(ctx, this_val);
+    if (!stream) return JS_EXCEPTION;
+    if (argc < 2 || !JS_IsFunction(ctx, argv[1])) {
+        return JS_ThrowTypeError(ctx, "on expects an event name and a listener");
+    }
+    
+    const char* event = JS_ToCString(ctx, argv[0]);
+    if (!event) return JS_EXCEPTION;
+    JSValue* slot = strcmp(event, "data") == 0 ? &stream->on_data
+                  : strcmp(event, "end") == 0 ? &stream->on_end
+                  : strcmp(event, "error") == 0 ? &stream->on_error : NULL;
+    int starts = slot == &stream->on_data;
+    JS_FreeCString(ctx, event);
+    if (slot) {
+        JS_FreeValue(ctx, *slot);
+        *slot = JS_DupValue(ctx, argv[1]);
+    }
+    if (starts) read_stream_start(stream, this_val);
+    
+    return JS_DupValue(ctx, this_val);
+}
+
+JSValue read_stream_pause(JSContext* ctx, JSValueConst this_val,
+                          int argc, JSValueConst* argv) {
+    ReadStream* stream = read_stream_get(ctx, this_val);
+    if (!stream) return JS_EXCEPTION;
+    read_stream_stop(stream);
+    return JS_UNDEFINED;
+}
+
+JSValue read_stream_resume(JSContext* ctx, JSValueConst this_val,
+                           int argc, JSValueConst* argv) {
+    ReadStream* stream = read_stream_get(ctx, this_val);
+    if (!stream) return JS_EXCEPTION;
+    read_stream_start(stream, this_val);
+    return JS_UNDEFINED;
+}
+
+JSValue read_stream_close(JSContext* ctx, JSValueConst this_val,
+                          int argc, JSValueConst* argv) {
+    ReadStream* stream = read_stream_get(ctx, this_val);
+    if (!stream) return JS_EXCEPTION;
+    if (!stream->ended) {
+        stream->ended = 1;
+        close(stream->watcher.fd);
+        stream->watcher.fd = -1;
+        read_stream_stop(stream);
+    }
+    return JS_UNDEFINED;
+}
+
+// fs.createReadStream(path[, { highWaterMark }])
+JSValue eghact_fs_createReadStream(JSContext* ctx, JSValueConst this_val,
+                                   int argc, JSValueConst* argv) {
+    if (argc < 1) {
+        return JS_ThrowTypeError(ctx, "createReadStream expects filename");
+    }
+    EghactRuntime* runtime = JS_GetContextOpaque(ctx);
     
-    JSValue result = JS_NewString(ctx, buffer);
+    // Chunks come from the pool, so they can be smaller than its buffers but not larger
+    int32_t chunk_size = STREAM_CHUNK_SIZE;
+    if (argc > 1 && JS_IsObject(argv[1])) {
+        JSValue mark = JS_GetPropertyStr(ctx, argv[1], "highWaterMark");
+        int failed = !JS_IsUndefined(mark) && JS_ToInt32(ctx, &chunk_size, mark);
+        JS_FreeValue(ctx, mark);
+        if (failed) return JS_EXCEPTION;
+        if (chunk_size < 1 || chunk_size > STREAM_CHUNK_SIZE) chunk_size = STREAM_CHUNK_SIZE;
+    }
     
-    free(buffer);
+    const char* filename = JS_ToCString(ctx, argv[0]);
+    if (!filename) return JS_EXCEPTION;
+    int fd = open(filename, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
     JS_FreeCString(ctx, filename);
+    if (fd < 0) {
+        return JS_ThrowInternalError(ctx, "Cannot read file");
+    }
     
-    return result;
+    JSValue object = JS_NewObjectClass(ctx, read_stream_class_id);
+    ReadStream* stream = calloc(1, sizeof(ReadStream));
+    if (JS_IsException(object) || !stream) {
+        close(fd);
+        free(stream);
+        JS_FreeValue(ctx, object);
+        return JS_ThrowOutOfMemory(ctx);
+    }
+    stream->watcher = (IoWatcher){ .fd = fd, .events = EPOLLIN, .callback = read_stream_ready };
+    stream->runtime = runtime;
+    stream->self = JS_UNDEFINED;
+    stream->on_data = JS_UNDEFINED;
+    stream->on_end = JS_UNDEFINED;
+    stream->on_error = JS_UNDEFINED;
+    stream->chunk_size = chunk_size;
+    JS_SetOpaque(object, stream);
+    
+    JS_SetPropertyStr(ctx, object, "on", JS_NewCFunction(ctx, read_stream_on, "on", 2));
+    JS_SetPropertyStr(ctx, object, "pause", JS_NewCFunction(ctx, read_stream_pause, "pause", 0));
+    JS_SetPropertyStr(ctx, object, "resume", JS_NewCFunction(ctx, read_stream_resume, "resume", 0));
+    JS_SetPropertyStr(ctx, object, "close", JS_NewCFunction(ctx, read_stream_close, "close", 0));
+    return object;
 }
 
-// HTTP Server implementation
+// HTTP server
+//
+// listen() binds its port with SO_REUSEPORT and accepts on the event loop. Given more
+// than one worker, the first listen() also starts that many minus one threads, each
+// with a runtime and context of its own that runs the main script again, so the same
+// createServer().listen() opens a listener per worker and the kernel spreads incoming
+// connections across them. JS values can't cross runtimes, which is why workers get
+// their handler this way; whatever else the script does also happens once per worker,
+// and process.workerId (0 on the main thread) tells them apart.
+//
+// Connections stay open between requests unless the request asks otherwise, and
+// pipelined requests are handed to the handler as they complete. Request bytes are read
+// into buffers from a per-runtime pool and parsed in place; a connection between
+// requests gives its buffer back. Responses are queued in request order, since a
+// handler may end them in any order, and the ended ones at the front of the queue go
+// out together in one sendmsg. Bodies are whole: chunked requests get 501, and write()
+// buffers until end().
+
+typedef struct {
+    char* data;
+    size_t len;
+    size_t capacity;
+} HttpBytes;
+
 typedef struct {
     int socket_fd;
     int port;
     JSValue handler;
     EghactRuntime* runtime;
+    IoWatcher watcher;          // The listening socket
+    JSValue self;               // Held while listening
 } HttpServer;
 
+typedef struct HttpResponse HttpResponse;
+
+typedef struct {
+    IoWatcher watcher;
+    HttpServer* server;
+    char* buffer;               // Unhandled request bytes; pooled unless a body outgrew it
+    size_t capacity;
+    size_t len;
+    size_t scanned;             // Bytes already searched for the end of the head
+    HttpResponse* responses;    // Oldest first, in request order
+    HttpResponse* last_response;
+    int queued;
+    size_t sent;                // Bytes of the oldest response already sent
+    int held;                   // Requests left in the buffer while the queue was full
+    int closing;                // Handles no more requests; closes once the queue is sent
+} HttpConnection;
+
+struct HttpResponse {
+    HttpConnection* connection; // NULL once the connection is gone
+    HttpResponse* next;
+    int refs;                   // The JS object and the connection's queue
+    int keep_alive;
+    int head_only;              // HEAD request: the headers of the response, without its body
+    int ended;
+    HttpBytes headers;          // From setHeader
+    HttpBytes head;             // Status line and headers, built by end()
+    HttpBytes body;
+};
+
+typedef struct {
+    const char* method;
+    size_t method_len;
+    const char* target;
+    size_t target_len;
+    int minor_version;          // HTTP/1.x
+    char* headers;              // First header line
+    char* headers_end;          // The blank line after the last
+    size_t body_len;
+    int keep_alive;
+} HttpRequest;
+
+static int http_bytes_append(HttpBytes* bytes, const void* data, size_t len) {
+    if (len == 0) return 1;
+    if (bytes->len + len > bytes->capacity) {
+        size_t capacity = bytes->capacity ? bytes->capacity : 256;
+        while (capacity < bytes->len + len) capacity *= 2;
+        char* grown = realloc(bytes->data, capacity);
+        if (!grown) return 0;
+        bytes->data = grown;
+        bytes->capacity = capacity;
+    }
+    memcpy(bytes->data + bytes->len, data, len);
+    bytes->len += len;
+    return 1;
+}
+
+#define http_bytes_append_literal(bytes, literal) \
+    http_bytes_append(bytes, literal, sizeof(literal) - 1)
+
+static const char* http_reason(int status) {
+    switch (status) {
+    case 200: return "OK";
+    case 201: return "Created";
+    case 204: return "No Content";
+    case 301: return "Moved Permanently";
+    case 302: return "Found";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 413: return "Payload Too Large";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 503: return "Service Unavailable";
+    default: return "Unknown";
+    }
+}
+
+static void http_buffer_free(HttpConnection* connection, char* buffer, size_t capacity) {
+    if (capacity == HTTP_BUFFER_SIZE) {
+        release_chunk(NULL, &connection->server->runtime->http_buffers, buffer);
+    } else {
+        free(buffer);
+    }
+}
+
+static void http_response_release(HttpResponse* response) {
+    if (--response->refs > 0) return;
+    free(response->headers.data);
+    free(response->head.data);
+    free(response->body.data);
+    free(response);
+}
+
+// A response at the back of the connection's queue, which holds the one reference
+static HttpResponse* http_response_create(HttpConnection* connection, int keep_alive, int head_only) {
+    HttpResponse* response = calloc(1, sizeof(HttpResponse));
+    if (!response) return NULL;
+    response->connection = connection;
+    response->refs = 1;
+    response->keep_alive = keep_alive;
+    response->head_only = head_only;
+    if (connection->last_response) connection->last_response->next = response;
+    else connection->responses = response;
+    connection->last_response = response;
+    connection->queued++;
+    return response;
+}
+
+// Builds the head and marks the response ready to send. Out of memory, the response
+// is sent empty and the connection closed after it.
+static void http_response_finish(HttpResponse* response, int status) {
+    char line[128];
+    int n = snprintf(line, sizeof(line), "HTTP/1.1 %d %s\r\n", status, http_reason(status));
+    int ok = http_bytes_append(&response->head, line, n) &&
+             http_bytes_append(&response->head, response->headers.data, response->headers.len);
+    
+    // 1xx, 204 and 304 responses have no body, so no length either
+    int bodyless = status < 200 || status == 204 || status == 304;
+    if (!bodyless) {
+        n = snprintf(line, sizeof(line), "Content-Length: %zu\r\n", response->body.len);
+        ok = ok && http_bytes_append(&response->head, line, n);
+    }
+    if (!response->keep_alive) {
+        ok = ok && http_bytes_append_literal(&response->head, "Connection: close\r\n");
+    }
+    ok = ok && http_bytes_append_literal(&response->head, "\r\n");
+    
+    if (bodyless || response->head_only) response->body.len = 0;
+    if (!ok) {
+        response->head.len = 0;
+        response->body.len = 0;
+        response->keep_alive = 0;
+    }
+    response->ended = 1;
+}
+
+// Answers a request the handler never sees, and stops reading
+static void http_reject(HttpConnection* connection, int status) {
+    connection->closing = 1;
+    HttpResponse* response = http_response_create(connection, 0, 0);
+    if (response) http_response_finish(response, status);
+}
+
+// Sends the ended responses at the front of the queue, as many as the socket takes,
+// and updates what the connection waits for. -1 once the connection has failed; the
+// caller closes it, or, outside its own callback, leaves that to the next event.
+static int http_flush(HttpConnection* connection) {
+    EventLoop* loop = connection->server->runtime->event_loop;
+    while (connection->responses && connection->responses->ended) {
+        struct iovec iov[HTTP_IOV_BATCH];
+        int count = 0;
+        size_t requested = 0;
+        size_t skip = connection->sent;
+        for (HttpResponse* response = connection->responses;
+             response && response->ended && count + 2 <= HTTP_IOV_BATCH;
+             response = response->next) {
+            HttpBytes* parts[2] = { &response->head, &response->body };
+            for (int i = 0; i < 2; i++) {
+                if (skip >= parts[i]->len) {
+                    skip -= parts[i]->len;
+                    continue;
+                }
+                iov[count++] = (struct iovec){ parts[i]->data + skip, parts[i]->len - skip };
+                requested += parts[i]->len - skip;
+                skip = 0;
+            }
+        }
+        
+        ssize_t n = 0;
+        if (count > 0) {
+            struct msghdr message = { .msg_iov = iov, .msg_iovlen = count };
+            n = sendmsg(connection->watcher.fd, &message, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                connection->closing = 1;
+                loop_rewatch(loop, &connection->watcher, EPOLLOUT);
+                return -1;
+            }
+            if (n < 0) break;
+        }
+        
+        // Retire the responses sent in full
+        size_t sent = connection->sent + n;
+        while (connection->responses && connection->responses->ended) {
+            HttpResponse* response = connection->responses;
+            size_t size = response->head.len + response->body.len;
+            if (sent < size) break;
+            sent -= size;
+            connection->responses = response->next;
+            if (!connection->responses) connection->last_response = NULL;
+            connection->queued--;
+            if (!response->keep_alive) connection->closing = 1;
+            response->connection = NULL;
+            http_response_release(response);
+        }
+        connection->sent = sent;
+        if ((size_t)n < requested) break;
+    }
+    
+    // Writable wakes the connection to send, to close, or to resume held back requests
+    int resumable = connection->held && connection->queued < HTTP_MAX_PIPELINE;
+    uint32_t events = connection->closing || connection->held ? 0 : EPOLLIN;
+    if (connection->responses ? connection->responses->ended : connection->closing) events |= EPOLLOUT;
+    if (resumable && !connection->closing) events |= EPOLLOUT;
+    loop_rewatch(loop, &connection->watcher, events);
+    return 0;
+}
+
+static void http_connection_close(HttpConnection* connection) {
+    loop_unwatch(connection->server->runtime->event_loop, &connection->watcher);
+    close(connection->watcher.fd);
+    
+    // Responses still held by JS outlive the connection; ending them does nothing
+    HttpResponse* response = connection->responses;
+    while (response) {
+        HttpResponse* next = response->next;
+        response->connection = NULL;
+        http_response_release(response);
+        response = next;
+    }
+    if (connection->buffer) http_buffer_free(connection, connection->buffer, connection->capacity);
+    free(connection);
+}
+
+static int http_has_token(const char* value, size_t len, const char* token) {
+    size_t token_len = strlen(token);
+    for (size_t i = 0; i + token_len <= len; i++) {
+        if (strncasecmp(value + i, token, token_len) == 0) return 1;
+    }
+    return 0;
+}
+
+// Steps *cursor over one header line; 0 at the end of the head
+static int http_next_header(char** cursor, char* end, char** name, size_t* name_len,
+                            char** value, size_t* value_len) {
+    if (*cursor >= end) return 0;
+    char* line = *cursor;
+    char* line_end = memchr(line, '\r', end - line);
+    if (!line_end) line_end = end;
+    *cursor = line_end + 2;
+    
+    char* colon = memchr(line, ':', line_end - line);
+    if (!colon) colon = line;  // Makes the name empty, which the caller rejects
+    *name = line;
+    *name_len = colon - line;
+    char* start = colon < line_end ? colon + 1 : line_end;
+    while (start < line_end && (*start == ' ' || *start == '\t')) start++;
+    while (line_end > start && (line_end[-1] == ' ' || line_end[-1] == '\t')) line_end--;
+    *value = start;
+    *value_len = line_end - start;
+    return 1;
+}
+
+// Parses the request line and the headers that matter here; 0, or the status to reject with
+static int http_parse_head(char* head, size_t len, HttpRequest* request) {
+    char* end = head + len - 4;  // The blank line
+    char* line_end = memchr(head, '\r', end + 2 - head);
+    char* space = memchr(head, ' ', line_end - head);
+    char* target_end = space ? memchr(space + 1, ' ', line_end - space - 1) : NULL;
+    if (!space || space == head || !target_end || target_end == space + 1) return 400;
+    
+    char* version = target_end + 1;
+    if (line_end - version != 8 || memcmp(version, "HTTP/1.", 7) != 0 ||
+        version[7] < '0' || version[7] > '9') {
+        return 400;
+    }
+    request->method = head;
+    request->method_len = space - head;
+    request->target = space + 1;
+    request->target_len = target_end - space - 1;
+    request->minor_version = version[7] - '0';
+    request->keep_alive = request->minor_version >= 1;
+    request->body_len = 0;
+    request->headers = line_end + 2;
+    request->headers_end = end + 2;
+    
+    int has_length = 0;
+    char* cursor = request->headers;
+    char *name, *value;
+    size_t name_len, value_len;
+    while (http_next_header(&cursor, request->headers_end, &name, &name_len, &value, &value_len)) {
+        if (name_len == 0) return 400;
+        if (name_len == 14 && strncasecmp(name, "content-length", 14) == 0) {
+            if (value_len == 0 || value_len > 19) return value_len ? 413 : 400;
+            size_t body_len = 0;
+            for (size_t i = 0; i < value_len; i++) {
+                if (value[i] < '0' || value[i] > '9') return 400;
+                body_len = body_len * 10 + (value[i] - '0');
+            }
+            if (body_len > HTTP_MAX_BODY) return 413;
+            // Lengths that disagree leave the request's end ambiguous
+            if (has_length && body_len != request->body_len) return 400;
+            has_length = 1;
+            request->body_len = body_len;
+        } else if (name_len == 17 && strncasecmp(name, "transfer-encoding", 17) == 0) {
+            return 501;
+        } else if (name_len == 10 && strncasecmp(name, "connection", 10) == 0) {
+            if (http_has_token(value, value_len, "close")) request->keep_alive = 0;
+            else if (http_has_token(value, value_len, "keep-alive")) request->keep_alive = 1;
+        }
+    }
+    return 0;
+}
+
+// { method, url, httpVersion, headers, body }, with header names lowercased
+static JSValue http_request_object(JSContext* ctx, const HttpRequest* request, const char* body) {
+    JSValue object = JS_NewObject(ctx);
+    JS_SetPropertyStr(ctx, object, "method", JS_NewStringLen(ctx, request->method, request->method_len));
+    JS_SetPropertyStr(ctx, object, "url", JS_NewStringLen(ctx, request->target, request->target_len));
+    JS_SetPropertyStr(ctx, object, "httpVersion",
+                      JS_NewString(ctx, request->minor_version ? "1.1" : "1.0"));
+    
+    JSValue headers = JS_NewObject(ctx);
+    char* cursor = request->headers;
+    char *name, *value;
+    size_t name_len, value_len;
+    while (http_next_header(&cursor, request->headers_end, &name, &name_len, &value, &value_len)) {
+        for (size_t i = 0; i < name_len; i++) {
+            name[i] = tolower((unsigned char)name[i]);
+        }
+        JSAtom atom = JS_NewAtomLen(ctx, name, name_len);
+        JS_SetProperty(ctx, headers, atom, JS_NewStringLen(ctx, value, value_len));
+        JS_FreeAtom(ctx, atom);
+    }
+    JS_SetPropertyStr(ctx, object, "headers", headers);
+    JS_SetPropertyStr(ctx, object, "body", JS_NewStringLen(ctx, body, request->body_len));
+    return object;
+}
+
+// Calls the handler with a request and the response that answers it
+static void http_dispatch(HttpConnection* connection, const HttpRequest* request, const char* body) {
+    JSContext* ctx = connection->server->runtime->js_context;
+    int head_only = request->method_len == 4 && memcmp(request->method, "HEAD", 4) == 0;
+    HttpResponse* response = http_response_create(connection, request->keep_alive, head_only);
+    if (!response) {
+        connection->closing = 1;
+        return;
+    }
+    if (!request->keep_alive) connection->closing = 1;
+    
+    JSValue res = JS_NewObjectClass(ctx, http_response_class_id);
+    if (JS_IsException(res)) {
+        JS_FreeValue(ctx, JS_GetException(ctx));
+        response->keep_alive = 0;
+        http_response_finish(response, 500);
+        return;
+    }
+    JS_SetOpaque(res, response);
+    response->refs++;
+    
+    JSValue args[2] = { http_request_object(ctx, request, body), res };
+    JSValue result = JS_Call(ctx, connection->server->handler, JS_UNDEFINED, 2, args);
+    if (JS_IsException(result)) {
+        report_exception(ctx);
+        if (!response->ended) {
+            response->body.len = 0;
+            response->keep_alive = 0;
+            http_response_finish(response, 500);
+        }
+    }
+    JS_FreeValue(ctx, result);
+    JS_FreeValue(ctx, args[0]);
+    JS_FreeValue(ctx, args[1]);
+}
+
+// Hands every complete request in the buffer to the handler, then keeps what is left of
+// the next one at the front, in a buffer large enough for its body
+static void http_parse(HttpConnection* connection) {
+    size_t offset = 0, needed = 0;
+    connection->held = 0;
+    while (!connection->closing && offset < connection->len) {
+        if (connection->queued >= HTTP_MAX_PIPELINE) {
+            connection->held = 1;
+            break;
+        }
+        char* head = connection->buffer + offset;
+        size_t available = connection->len - offset;
+        size_t from = connection->scanned > 3 ? connection->scanned - 3 : 0;
+        char* end = memmem(head + from, available - from, "\r\n\r\n", 4);
+        if (!end) {
+            connection->scanned = available;
+            if (available >= HTTP_BUFFER_SIZE) http_reject(connection, 431);
+            break;
+        }
+        
+        size_t head_len = end + 4 - head;
+        HttpRequest request;
+        int status = http_parse_head(head, head_len, &request);
+        if (status) {
+            http_reject(connection, status);
+            break;
+        }
+        if (available < head_len + request.body_len) {
+            connection->scanned = head_len - 1;  // Finds this head again straight away
+            needed = head_len + request.body_len;
+            break;
+        }
+        
+        http_dispatch(connection, &request, head + head_len);
+        offset += head_len + request.body_len;
+        connection->scanned = 0;
+    }
+    
+    if (connection->closing) {
+        connection->len = 0;
+    } else if (offset > 0) {
+        memmove(connection->buffer, connection->buffer + offset, connection->len - offset);
+        connection->len -= offset;
+    }
+    if (needed > connection->capacity) {
+        char* grown = malloc(needed);
+        if (!grown) {
+            http_reject(connection, 413);
+            connection->len = 0;
+        } else {
+            memcpy(grown, connection->buffer, connection->len);
+            http_buffer_free(connection, connection->buffer, connection->capacity);
+            connection->buffer = grown;
+            connection->capacity = needed;
+        }
+    }
+    if (connection->len == 0) {
+        http_buffer_free(connection, connection->buffer, connection->capacity);
+        connection->buffer = NULL;
+        connection->capacity = 0;
+        connection->scanned = 0;
+    }
+}
+
+// -1 once the connection has failed
+static int http_read(HttpConnection* connection) {
+    if (!connection->buffer) {
+        connection->buffer = take_chunk(&connection->server->runtime->http_buffers);
+        if (!connection->buffer) return -1;
+        connection->capacity = HTTP_BUFFER_SIZE;
+    }
+    ssize_t n = recv(connection->watcher.fd, connection->buffer + connection->len,
+                     connection->capacity - connection->len, 0);
+    if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+    if (n == 0) {
+        // The client is done sending; answer what it asked, then close
+        connection->closing = 1;
+        connection->len = 0;
+    } else {
+        connection->len += n;
+    }
+    http_parse(connection);
+    return 0;
+}
+
+static void http_connection_ready(EventLoop* loop, IoWatcher* watcher, uint32_t events) {
+    HttpConnection* connection = watcher->data;
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        http_connection_close(connection);
+        return;
+    }
+    if (connection->held && connection->queued < HTTP_MAX_PIPELINE) http_parse(connection);
+    if ((events & EPOLLIN) && !connection->closing && !connection->held &&
+        http_read(connection) < 0) {
+        http_connection_close(connection);
+        return;
+    }
+    if (http_flush(connection) < 0 || (connection->closing && !connection->responses)) {
+        http_connection_close(connection);
+    }
+}
+
+static void http_accept_ready(EventLoop* loop, IoWatcher* watcher, uint32_t events) {
+    HttpServer* server = watcher->data;
+    for (;;) {
+        int fd = accept4(watcher->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0 && (errno == EINTR || errno == ECONNABORTED)) continue;
+        if (fd < 0) return;  // Accepted them all, or out of fds until one closes
+        
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        HttpConnection* connection = calloc(1, sizeof(HttpConnection));
+        if (connection) {
+            connection->watcher = (IoWatcher){
+                .fd = fd, .events = EPOLLIN, .callback = http_connection_ready, .data = connection,
+            };
+            connection->server = server;
+        }
+        if (!connection || !loop_watch(loop, &connection->watcher)) {
+            close(fd);
+            free(connection);
+        }
+    }
+}
+
+// Non-blocking listener sharing port with the other workers'; -1 with errno set on failure
+static int http_listen_socket(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) != 0 ||
+        bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(fd, SOMAXCONN) != 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+int eghact_run_script(EghactRuntime* runtime, const char* filename);
+
+typedef struct {
+    char* script;
+    int worker_id;
+} HttpWorker;
+
+static void* http_worker_main(void* arg) {
+    HttpWorker* worker = arg;
+    EghactRuntime* runtime = eghact_runtime_create();
+    runtime->worker_id = worker->worker_id;
+    eghact_run_script(runtime, worker->script);
+    eghact_runtime_destroy(runtime);
+    free(worker->script);
+    free(worker);
+    return NULL;
+}
+
+// Starts workers - 1 threads running the main script; the calling thread is worker 0
+static void http_start_workers(EghactRuntime* runtime, int workers) {
+    if (runtime->workers_started || !runtime->script) return;
+    runtime->workers_started = 1;
+    
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    for (int i = 1; i < workers; i++) {
+        HttpWorker* worker = malloc(sizeof(HttpWorker));
+        char* script = strdup(runtime->script);
+        pthread_t thread;
+        if (worker && script) {
+            *worker = (HttpWorker){ script, i };
+            if (pthread_create(&thread, &attr, http_worker_main, worker) == 0) continue;
+        }
+        free(worker);
+        free(script);
+        fprintf(stderr, "Started %d of %d HTTP workers\n", i, workers);
+        break;
+    }
+    pthread_attr_destroy(&attr);
+}
+
+static void http_server_finalizer(JSRuntime* rt, JSValue val) {
+    HttpServer* server = JS_GetOpaque(val, http_server_class_id);
+    if (!server) return;
+    if (server->socket_fd >= 0) close(server->socket_fd);
+    JS_FreeValueRT(rt, server->handler);
+    free(server);
+}
+
+static void http_server_mark(JSRuntime* rt, JSValueConst val, JS_MarkFunc* mark_func) {
+    HttpServer* server = JS_GetOpaque(val, http_server_class_id);
+    if (server) JS_MarkValue(rt, server->handler, mark_func);
+}
+
+static void http_response_finalizer(JSRuntime* rt, JSValue val) {
+    HttpResponse* response = JS_GetOpaque(val, http_response_class_id);
+    if (response) http_response_release(response);
+}
+
+// Appends a string or an ArrayBuffer to the body; -1 with an exception pending
+static int http_response_append(JSContext* ctx, HttpResponse* response, JSValueConst data) {
+    size_t len;
+    if (!JS_IsString(data)) {
+        uint8_t* bytes = JS_GetArrayBuffer(ctx, &len, data);
+        if (bytes) {
+            if (http_bytes_append(&response->body, bytes, len)) return 0;
+            JS_ThrowOutOfMemory(ctx);
+            return -1;
+        }
+        JS_FreeValue(ctx, JS_GetException(ctx));  // Not a buffer; sent as its string
+    }
+    const char* text = JS_ToCStringLen(ctx, &len, data);
+    if (!text) return -1;
+    int ok = http_bytes_append(&response->body, text, len);
+    JS_FreeCString(ctx, text);
+    if (!ok) {
+        JS_ThrowOutOfMemory(ctx);
+        return -1;
+    }
+    return 0;
+}
+
+// res.setHeader(name, value); the server sets Content-Length and Connection itself
+JSValue http_response_setHeader(JSContext* ctx, JSValueConst this_val,
+                                int argc, JSValueConst* argv) {
+    HttpResponse* response = JS_GetOpaque2(ctx, this_val, http_response_class_id);
+    if (!response) return JS_EXCEPTION;
+    if (argc < 2) {
+        return JS_ThrowTypeError(ctx, "setHeader expects a name and a value");
+    }
+    if (response->ended) {
+        return JS_ThrowTypeError(ctx, "Cannot set headers after the response has ended");
+    }
+    
+    size_t name_len, value_len;
+    const char* name = JS_ToCStringLen(ctx, &name_len, argv[0]);
+    const char* value = name ? JS_ToCStringLen(ctx, &value_len, argv[1]) : NULL;
+    if (!value) {
+        JS_FreeCString(ctx, name);
+        return JS_EXCEPTION;
+    }
+    
+    JSValue result = JS_UNDEFINED;
+    if (name_len == 0 || strpbrk(name, ":\r\n") || strpbrk(value, "\r\n")) {
+        result = JS_ThrowTypeError(ctx, "Invalid header '%s'", name);
+    } else if (strcasecmp(name, "content-length") != 0 && strcasecmp(name, "connection") != 0) {
+        int ok = http_bytes_append(&response->headers, name, name_len) &&
+                 http_bytes_append_literal(&response->headers, ": ") &&
+                 http_bytes_append(&response->headers, value, value_len) &&
+                 http_bytes_append_literal(&response->headers, "\r\n");
+        if (!ok) result = JS_ThrowOutOfMemory(ctx);
+    }
+    JS_FreeCString(ctx, name);
+    JS_FreeCString(ctx, value);
+    return result;
+}
+
+// res.write(data): buffered, and sent with the rest at end()
+JSValue http_response_write(JSContext* ctx, JSValueConst this_val,
+                            int argc, JSValueConst* argv) {
+    HttpResponse* response = JS_GetOpaque2(ctx, this_val, http_response_class_id);
+    if (!response) return JS_EXCEPTION;
+    if (response->ended) {
+        return JS_ThrowTypeError(ctx, "write after end");
+    }
+    if (argc > 0 && http_response_append(ctx, response, argv[0]) < 0) return JS_EXCEPTION;
+    return JS_TRUE;
+}
+
+// res.end([data]): sends the response with res.statusCode, once those before it are sent
+JSValue http_response_end(JSContext* ctx, JSValueConst this_val,
+                          int argc, JSValueConst* argv) {
+    HttpResponse* response = JS_GetOpaque2(ctx, this_val, http_response_class_id);
+    if (!response) return JS_EXCEPTION;
+    if (response->ended) return JS_UNDEFINED;
+    
+    int32_t status;
+    JSValue code = JS_GetPropertyStr(ctx, this_val, "statusCode");
+    int failed = JS_ToInt32(ctx, &status, code);
+    JS_FreeValue(ctx, code);
+    if (failed) return JS_EXCEPTION;
+    if (status < 100 || status > 999) {
+        return JS_ThrowRangeError(ctx, "Invalid status code %d", status);
+    }
+    if (argc > 0 && !JS_IsUndefined(argv[0]) &&
+        http_response_append(ctx, response, argv[0]) < 0) {
+        return JS_EXCEPTION;
+    }
+    
+    http_response_finish(response, status);
+    if (response->connection) http_flush(response->connection);
+    return JS_UNDEFINED;
+}
+
+// server.listen(port[, { workers }][, callback]): workers 0 means one per core
+JSValue http_server_listen(JSContext* ctx, JSValueConst this_val,
+                           int argc, JSValueConst* argv) {
+    HttpServer* server = JS_GetOpaque2(ctx, this_val, http_server_class_id);
+    if (!server) return JS_EXCEPTION;
+    if (argc < 1) {
+        return JS_ThrowTypeError(ctx, "listen expects a port");
+    }
+    if (server->socket_fd >= 0) {
+        return JS_ThrowTypeError(ctx, "Server is already listening");
+    }
+    
+    int32_t port, workers = 1;
+    if (JS_ToInt32(ctx, &port, argv[0])) return JS_EXCEPTION;
+    JSValueConst callback = JS_UNDEFINED;
+    for (int i = 1; i < argc && i < 3; i++) {
+        if (JS_IsFunction(ctx, argv[i])) {
+            callback = argv[i];
+        } else if (JS_IsObject(argv[i])) {
+            JSValue count = JS_GetPropertyStr(ctx, argv[i], "workers");
+            int failed = !JS_IsUndefined(count) && JS_ToInt32(ctx, &workers, count);
+            JS_FreeValue(ctx, count);
+            if (failed) return JS_EXCEPTION;
+        }
+    }
+    if (port < 0 || port > 65535) {
+        return JS_ThrowRangeError(ctx, "Invalid port %d", port);
+    }
+    if (workers <= 0) workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers < 1) workers = 1;
+    if (workers > HTTP_MAX_WORKERS) workers = HTTP_MAX_WORKERS;
+    if (workers > 1 && port == 0) {
+        return JS_ThrowRangeError(ctx, "Workers need a fixed port to share");
+    }
+    
+    int fd = http_listen_socket(port);
+    if (fd < 0) {
+        return JS_ThrowInternalError(ctx, "Cannot listen on port %d: %s", port, strerror(errno));
+    }
+    EghactRuntime* runtime = server->runtime;
+    server->socket_fd = fd;
+    server->port = port;
+    server->watcher = (IoWatcher){
+        .fd = fd, .events = EPOLLIN, .callback = http_accept_ready, .data = server,
+    };
+    if (!loop_watch(runtime->event_loop, &server->watcher)) {
+        close(fd);
+        server->socket_fd = -1;
+        return JS_ThrowInternalError(ctx, "Cannot listen on port %d", port);
+    }
+    server->self = JS_DupValue(ctx, this_val);
+    
+    if (runtime->worker_id == 0 && workers > 1) http_start_workers(runtime, workers);
+    if (JS_IsFunction(ctx, callback)) {
+        schedule_timeout(runtime->event_loop, callback, 0, 0, NULL);
+    }
+    return JS_DupValue(ctx, this_val);
+}
+
 JSValue eghact_http_createServer(JSContext* ctx, JSValueConst this_val,
                                 int argc, JSValueConst* argv) {
     if (argc < 1 || !JS_IsFunction(ctx, argv[0])) {
         return JS_ThrowTypeError(ctx, "createServer expects handler function");
     }
     
-    HttpServer* server = malloc(sizeof(HttpServer));
+    JSValue server_obj = JS_NewObjectClass(ctx, http_server_class_id);
+    HttpServer* server = calloc(1, sizeof(HttpServer));
+    if (JS_IsException(server_obj) || !server) {
+        free(server);
+        JS_FreeValue(ctx, server_obj);
+        return JS_ThrowOutOfMemory(ctx);
+    }
     server->runtime = JS_GetContextOpaque(ctx);
     server->handler = JS_DupValue(ctx, argv[0]);
-    
-    // Create socket
-    server->socket_fd = socket(AF_INET, SOCK_STREAM, 0);
-    
-    // Return server object
-    JSValue server_obj = JS_NewObject(ctx);
+    server->socket_fd = -1;
+    server->self = JS_UNDEFINED;
     JS_SetOpaque(server_obj, server);
     
     // Add listen method
-    JSValue listen_func = JS_NewCFunction(ctx, http_server_listen, "listen", 1);
+    JSValue listen_func = JS_NewCFunction(ctx, http_server_listen, "listen", 3);
     JS_SetPropertyStr(ctx, server_obj, "listen", listen_func);
     
     return server_obj;
@@ -192,16 +1784,34 @@ JSValue eghact_setTimeout(JSContext* ctx, JSValueConst this_val,
         return JS_ThrowTypeError(ctx, "setTimeout expects callback and delay");
     }
     
-    JSValue callback = argv[0];
+    if (!JS_IsFunction(ctx, argv[0])) {
+        return JS_ThrowTypeError(ctx, "setTimeout expects a function");
+    }
+    
     int delay;
-    JS_ToInt32(ctx, &delay, argv[1]);
+    if (JS_ToInt32(ctx, &delay, argv[1])) {
+        return JS_EXCEPTION;
+    }
     
     EghactRuntime* runtime = JS_GetContextOpaque(ctx);
     
-    // Schedule in event loop
-    schedule_timeout(runtime->event_loop, callback, delay);
+    // Schedule in event loop; arguments after the delay go to the callback
+    uint32_t id = schedule_timeout(runtime->event_loop, argv[0], delay, argc - 2, argv + 2);
     
-    return JS_NewInt32(ctx, generate_timer_id());
+    return JS_NewUint32(ctx, id);
+}
+
+JSValue eghact_clearTimeout(JSContext* ctx, JSValueConst this_val,
+                           int argc, JSValueConst* argv) {
+    uint32_t id;
+    if (argc < 1 || JS_ToUint32(ctx, &id, argv[0])) {
+        return JS_UNDEFINED;
+    }
+    
+    EghactRuntime* runtime = JS_GetContextOpaque(ctx);
+    cancel_timeout(runtime->event_loop, id);
+    
+    return JS_UNDEFINED;
 }
 
 // Console implementation
@@ -260,6 +1870,8 @@ void install_global_objects(EghactRuntime* runtime) {
     JSValue fs = JS_NewObject(ctx);
     JS_SetPropertyStr(ctx, fs, "readFile",
                      JS_NewCFunction(ctx, eghact_fs_readFile, "readFile", 2));
+    JS_SetPropertyStr(ctx, fs, "createReadStream",
+                     JS_NewCFunction(ctx, eghact_fs_createReadStream, "createReadStream", 2));
     register_builtin_module(runtime, "fs", fs);
     
     // http module
@@ -268,9 +1880,22 @@ void install_global_objects(EghactRuntime* runtime) {
                      JS_NewCFunction(ctx, eghact_http_createServer, "createServer", 1));
     register_builtin_module(runtime, "http", http);
     
+    // Responses share one prototype, so a request doesn't build their methods each time
+    JSValue response_proto = JS_NewObject(ctx);
+    JS_SetPropertyStr(ctx, response_proto, "statusCode", JS_NewInt32(ctx, 200));
+    JS_SetPropertyStr(ctx, response_proto, "setHeader",
+                     JS_NewCFunction(ctx, http_response_setHeader, "setHeader", 2));
+    JS_SetPropertyStr(ctx, response_proto, "write",
+                     JS_NewCFunction(ctx, http_response_write, "write", 1));
+    JS_SetPropertyStr(ctx, response_proto, "end",
+                     JS_NewCFunction(ctx, http_response_end, "end", 1));
+    JS_SetClassProto(ctx, http_response_class_id, response_proto);
+    
     // Timers
     JS_SetPropertyStr(ctx, global, "setTimeout",
                      JS_NewCFunction(ctx, eghact_setTimeout, "setTimeout", 2));
+    JS_SetPropertyStr(ctx, global, "clearTimeout",
+                     JS_NewCFunction(ctx, eghact_clearTimeout, "clearTimeout", 1));
     
     JS_FreeValue(ctx, global);
 }
@@ -291,23 +1916,6 @@ char* resolve_module_path(EghactRuntime* runtime, const char* name) {
     return search_node_modules(runtime, name);
 }
 
-// Event loop implementation
-void* event_loop_thread(void* arg) {
-    EventLoop* loop = (EventLoop*)arg;
-    
-    while (loop->running) {
-        Event* event = get_next_event(loop);
-        if (event) {
-            event->callback(event->data);
-            free(event);
-        } else {
-            usleep(1000); // 1ms sleep
-        }
-    }
-    
-    return NULL;
-}
-
 // Main execution
 int eghact_run_script(EghactRuntime* runtime, const char* filename) {
     // Read script
@@ -325,23 +1933,25 @@ int eghact_run_script(EghactRuntime* runtime, const char* filename) {
     char dirname[PATH_MAX];
     get_dirname(filename, dirname);
     JS_SetPropertyStr(ctx, global, "__dirname", JS_NewString(ctx, dirname));
+    runtime->script = filename;
     
-    // Execute script
-    JSValue result = JS_Eval(ctx, script, strlen(script), filename, 
-                            JS_EVAL_TYPE_GLOBAL);
+    JSValue process = JS_GetPropertyStr(ctx, global, "process");
+    JS_SetPropertyStr(ctx, process, "workerId", JS_NewInt32(ctx, runtime->worker_id));
+    JS_FreeValue(ctx, process);
+    
+    // Execute script, compiled from the bytecode cache when it can be
+    JSValue compiled = compile_cached(runtime, script, strlen(script), filename,
+                                      JS_EVAL_TYPE_GLOBAL);
+    free(script);
+    JS_FreeValue(ctx, global);
+    JSValue result = JS_IsException(compiled) ? compiled : JS_EvalFunction(ctx, compiled);
     
     if (JS_IsException(result)) {
-        JSValue exception = JS_GetException(ctx);
-        const char* error = JS_ToCString(ctx, exception);
-        fprintf(stderr, "Error: %s\n", error);
-        JS_FreeCString(ctx, error);
-        JS_FreeValue(ctx, exception);
+        report_exception(ctx);
         return 1;
     }
     
     JS_FreeValue(ctx, result);
-    JS_FreeValue(ctx, global);
-    free(script);
     
     // Run event loop
     run_event_loop(runtime->event_loop);
@@ -349,21 +1959,93 @@ int eghact_run_script(EghactRuntime* runtime, const char* filename) {
     return 0;
 }
 
+// Compiles path, or every .js file under it, into the bytecode cache both ways it can
+// be loaded: as a script and as a module. Returns how many files failed.
+static int compile_cache_path(EghactRuntime* runtime, const char* path, int* compiled) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        fprintf(stderr, "Cannot read %s\n", path);
+        return 1;
+    }
+    
+    if (S_ISDIR(st.st_mode)) {
+        DIR* dir = opendir(path);
+        if (!dir) return 1;
+        int failures = 0;
+        struct dirent* entry;
+        while ((entry = readdir(dir))) {
+            // Skips ., .. and hidden directories such as the cache itself
+            if (entry->d_name[0] == '.') continue;
+            size_t len = strlen(entry->d_name);
+            char child[PATH_MAX];
+            snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+            struct stat child_st;
+            if (stat(child, &child_st) != 0) continue;
+            if (S_ISDIR(child_st.st_mode) ||
+                (len > 3 && strcmp(entry->d_name + len - 3, ".js") == 0)) {
+                failures += compile_cache_path(runtime, child, compiled);
+            }
+        }
+        closedir(dir);
+        return failures;
+    }
+    
+    char* source = read_file(path);
+    if (!source) {
+        fprintf(stderr, "Cannot read %s\n", path);
+        return 1;
+    }
+    size_t len;
+    char* wrapped = wrap_module_source(source, &len);
+    JSValue script = compile_cached(runtime, source, strlen(source), path, JS_EVAL_TYPE_GLOBAL);
+    JSValue module = wrapped ? compile_cached(runtime, wrapped, len, path, JS_EVAL_TYPE_GLOBAL)
+                             : JS_EXCEPTION;
+    free(source);
+    free(wrapped);
+    
+    int failed = JS_IsException(script) || JS_IsException(module);
+    if (failed) {
+        fprintf(stderr, "%s: ", path);
+        report_exception(runtime->js_context);
+    } else {
+        (*compiled)++;
+    }
+    JS_FreeValue(runtime->js_context, script);
+    JS_FreeValue(runtime->js_context, module);
+    return failed;
+}
+
+// eghact compile-cache <file|dir>...: prewarms the bytecode cache
+static int compile_cache_command(EghactRuntime* runtime, int argc, char* argv[]) {
+    if (!runtime->cache_dir) {
+        fprintf(stderr, "The bytecode cache is disabled (EGHACT_CACHE_DIR is empty)\n");
+        return 1;
+    }
+    
+    int compiled = 0, failures = 0;
+    for (int i = 0; i < argc; i++) {
+        failures += compile_cache_path(runtime, argv[i], &compiled);
+    }
+    printf("Cached %d file(s) in %s\n", compiled, runtime->cache_dir);
+    return failures > 0;
+}
+
 // CLI entry point
 int main(int argc, char* argv[]) {
     if (argc < 2) {
         printf("Eghact Runtime v1.0.0\n");
         printf("Usage: eghact <script.js>\n");
+        printf("       eghact compile-cache <file|dir>...\n");
         return 1;
     }
     
     EghactRuntime* runtime = eghact_runtime_create();
-    int result = eghact_run_script(runtime, argv[1]);
+    int result = strcmp(argv[1], "compile-cache") == 0
+        ? compile_cache_command(runtime, argc - 2, argv + 2)
+        : eghact_run_script(runtime, argv[1]);
     
     // Cleanup
-    JS_FreeContext(runtime->js_context);
-    JS_FreeRuntime(runtime->js_runtime);
-    free(runtime);
+    eghact_runtime_destroy(runtime);
     
     return result;
 }
\ No newline at end of file